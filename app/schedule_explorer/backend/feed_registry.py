@@ -0,0 +1,171 @@
+"""
+GTFS feeds kept resident across provider switches.
+
+The backend used to hold a single feed, so alternating requests for two
+providers reloaded each of them every time. The registry keeps every loaded
+feed, with its memory-mapped cache and native timetable, until the estimated
+memory of all resident feeds exceeds a budget. Switching to a resident feed
+is a dictionary lookup.
+
+When over budget, feeds are evicted by how long they have been idle relative
+to what they cost to load again: a feed that loads in a second goes before
+one that took a minute to build, unless it has been idle far longer. The
+feed being switched to is never evicted.
+
+Memory per feed is an estimate: the growth of the process while it was
+loaded (or, for lazily loaded feeds, while each section was decoded) plus
+the size of the files it maps.
+"""
+
+import logging
+import os
+import threading
+import time
+from collections import OrderedDict
+from dataclasses import dataclass
+from typing import Any, Callable, Dict, List, Optional, Tuple
+
+import psutil
+
+from .gtfs_loader import FlixbusFeed, LazyFlixbusFeed, bytes_to_mb
+
+logger = logging.getLogger("schedule_explorer.feed_registry")
+
+# Fraction of physical memory resident feeds may use by default
+DEFAULT_BUDGET_FRACTION = 0.25
+DEFAULT_MAX_FEEDS = 8
+# Loads faster than this are treated as taking this long when scoring
+MIN_LOAD_SECONDS = 0.1
+
+
+@dataclass
+class ResidentFeed:
+    key: str
+    feed: FlixbusFeed
+    load_seconds: float
+    heap_bytes: int
+    last_access: float
+    hits: int = 0
+
+    def memory_bytes(self) -> int:
+        if isinstance(self.feed, LazyFlixbusFeed):
+            memory = self.feed.resident_bytes()
+        else:
+            memory = self.heap_bytes
+        native = self.feed.native
+        if native is not None:
+            try:
+                memory += native.path.stat().st_size
+            except OSError:
+                pass
+        return memory
+
+    def eviction_score(self, now: float) -> float:
+        """Higher is evicted first: idle time per second of reload cost."""
+        return (now - self.last_access) / max(self.load_seconds, MIN_LOAD_SECONDS)
+
+
+def load_measured(load_fn: Callable[..., FlixbusFeed], *args, **kwargs) -> Tuple[FlixbusFeed, float, int]:
+    """Run load_fn, returning the feed, its load time and the process growth."""
+    process = psutil.Process()
+    rss0 = process.memory_info().rss
+    t0 = time.time()
+    feed = load_fn(*args, **kwargs)
+    return feed, time.time() - t0, max(0, process.memory_info().rss - rss0)
+
+
+class FeedRegistry:
+    def __init__(self, budget_bytes: int, max_feeds: int = DEFAULT_MAX_FEEDS):
+        self.budget_bytes = budget_bytes
+        self.max_feeds = max(1, max_feeds)
+        self._feeds: "OrderedDict[str, ResidentFeed]" = OrderedDict()
+        self._lock = threading.Lock()
+
+    @classmethod
+    def from_env(cls) -> "FeedRegistry":
+        """Budget from FEED_MEMORY_BUDGET_MB and FEED_MAX_RESIDENT, defaulting
+        to a quarter of physical memory and DEFAULT_MAX_FEEDS feeds."""
+        budget_mb = os.environ.get("FEED_MEMORY_BUDGET_MB")
+        if budget_mb:
+            budget = int(float(budget_mb) * 1024 * 1024)
+        else:
+            budget = int(psutil.virtual_memory().total * DEFAULT_BUDGET_FRACTION)
+        max_feeds = int(os.environ.get("FEED_MAX_RESIDENT", DEFAULT_MAX_FEEDS))
+        logger.info(
+            f"Feed registry: up to {max_feeds} feeds within {bytes_to_mb(budget)} MB"
+        )
+        return cls(budget, max_feeds)
+
+    def __contains__(self, key: str) -> bool:
+        with self._lock:
+            return key in self._feeds
+
+    def __len__(self) -> int:
+        with self._lock:
+            return len(self._feeds)
+
+    def get(self, key: str) -> Optional[FlixbusFeed]:
+        """The resident feed for key, marking it as most recently used."""
+        with self._lock:
+            entry = self._feeds.get(key)
+            if entry is None:
+                return None
+            entry.last_access = time.time()
+            entry.hits += 1
+            self._feeds.move_to_end(key)
+            # Lazily loaded feeds grow as they are used
+            self._evict(keep=key)
+            return entry.feed
+
+    def put(self, key: str, feed: FlixbusFeed, load_seconds: float, heap_bytes: int) -> None:
+        """Make feed resident under key, evicting others to stay in budget."""
+        with self._lock:
+            self._feeds[key] = ResidentFeed(
+                key=key,
+                feed=feed,
+                load_seconds=load_seconds,
+                heap_bytes=heap_bytes,
+                last_access=time.time(),
+            )
+            self._feeds.move_to_end(key)
+            self._evict(keep=key)
+
+    def remove(self, key: str) -> None:
+        with self._lock:
+            self._feeds.pop(key, None)
+
+    def _evict(self, keep: str) -> None:
+        now = time.time()
+        sizes = {key: entry.memory_bytes() for key, entry in self._feeds.items()}
+        total = sum(sizes.values())
+        while len(self._feeds) > 1 and (
+            total > self.budget_bytes or len(self._feeds) > self.max_feeds
+        ):
+            victim = max(
+                (entry for key, entry in self._feeds.items() if key != keep),
+                key=lambda entry: entry.eviction_score(now),
+            )
+            del self._feeds[victim.key]
+            total -= sizes[victim.key]
+            # The feed, its mapping and its native timetable are released
+            # once the last request using them is done
+            logger.info(
+                f"Evicted feed {victim.key} ({bytes_to_mb(sizes[victim.key])} MB, "
+                f"idle {now - victim.last_access:.0f}s, loads in {victim.load_seconds:.1f}s); "
+                f"{len(self._feeds)} feeds resident, {bytes_to_mb(total)} MB"
+            )
+
+    def status(self) -> List[Dict[str, Any]]:
+        """Resident feeds, most recently used first."""
+        now = time.time()
+        with self._lock:
+            return [
+                {
+                    "key": entry.key,
+                    "memory_mb": bytes_to_mb(entry.memory_bytes()),
+                    "load_seconds": round(entry.load_seconds, 2),
+                    "idle_seconds": round(now - entry.last_access, 1),
+                    "hits": entry.hits,
+                }
+                for entry in reversed(self._feeds.values())
+            ]
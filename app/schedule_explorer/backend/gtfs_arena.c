@@ -0,0 +1,218 @@
+#include "gtfs_arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_MIN_BLOCK (64 * 1024)
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    size_t size;
+    size_t used;
+    // Followed by the block data, 8-byte aligned
+};
+
+static char* block_data(ArenaBlock* block) {
+    return (char*)block + ((sizeof(ArenaBlock) + 7) & ~(size_t)7);
+}
+
+void arena_init(Arena* arena, size_t block_size) {
+    memset(arena, 0, sizeof(*arena));
+    arena->block_size = block_size < ARENA_MIN_BLOCK ? ARENA_MIN_BLOCK : block_size;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    if (size == 0) size = 8;
+
+    // Blocks are kept in allocation order; after a reset the old ones are
+    // reused before new ones are requested
+    ArenaBlock* block = arena->current;
+    while (block && block->size - block->used < size) {
+        block = block->next;
+    }
+    if (!block) {
+        size_t data_size = size > arena->block_size ? size : arena->block_size;
+        block = malloc(((sizeof(ArenaBlock) + 7) & ~(size_t)7) + data_size);
+        if (!block) {
+            fprintf(stderr, "Error: Out of memory allocating %zu bytes from arena\n", size);
+            fflush(stderr);
+            return NULL;
+        }
+        block->next = NULL;
+        block->size = data_size;
+        block->used = 0;
+        if (!arena->blocks) {
+            arena->blocks = block;
+        } else {
+            ArenaBlock* last = arena->current ? arena->current : arena->blocks;
+            while (last->next) last = last->next;
+            last->next = block;
+        }
+        arena->reserved += data_size;
+    }
+    arena->current = block;
+
+    void* p = block_data(block) + block->used;
+    block->used += size;
+    arena->used += size;
+    if (arena->used > arena->peak) arena->peak = arena->used;
+    return p;
+}
+
+void* arena_calloc(Arena* arena, size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    void* p = arena_alloc(arena, count * size);
+    if (p) memset(p, 0, count * size);
+    return p;
+}
+
+void arena_reset(Arena* arena) {
+    for (ArenaBlock* block = arena->blocks; block; block = block->next) {
+        block->used = 0;
+    }
+    arena->current = arena->blocks;
+    arena->used = 0;
+}
+
+void arena_free(Arena* arena) {
+    ArenaBlock* block = arena->blocks;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    size_t block_size = arena->block_size;
+    memset(arena, 0, sizeof(*arena));
+    arena->block_size = block_size;
+}
+
+// ---------------------------------------------------------------------------
+// String interner
+// ---------------------------------------------------------------------------
+
+uint32_t gtfs_hash(const char* s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int64_t interner_slot(const StringInterner* interner, const char* s, uint32_t hash) {
+    uint32_t i = hash & interner->mask;
+    while (interner->slots[i]) {
+        if (interner->hashes[i] == hash && strcmp(interner->data + interner->slots[i], s) == 0) {
+            return i;
+        }
+        i = (i + 1) & interner->mask;
+    }
+    return -(int64_t)i - 1;
+}
+
+// Double the hash table, moving entries by their stored hashes
+static int interner_grow(StringInterner* interner) {
+    size_t cap = interner->slots ? ((size_t)interner->mask + 1) * 2 : 1024;
+    uint32_t* slots = calloc(cap, sizeof(uint32_t));
+    uint32_t* hashes = malloc(sizeof(uint32_t) * cap);
+    if (!slots || !hashes) {
+        free(slots);
+        free(hashes);
+        return -1;
+    }
+    uint32_t mask = (uint32_t)(cap - 1);
+    if (interner->slots) {
+        for (size_t k = 0; k <= interner->mask; k++) {
+            if (!interner->slots[k]) continue;
+            uint32_t i = interner->hashes[k] & mask;
+            while (slots[i]) i = (i + 1) & mask;
+            slots[i] = interner->slots[k];
+            hashes[i] = interner->hashes[k];
+        }
+    }
+    free(interner->slots);
+    free(interner->hashes);
+    interner->slots = slots;
+    interner->hashes = hashes;
+    interner->mask = mask;
+    return 0;
+}
+
+int64_t interner_add(StringInterner* interner, const char* s, uint32_t hash) {
+    if (!interner->data) {
+        interner->cap = 4096;
+        interner->data = malloc(interner->cap);
+        if (!interner->data) goto oom;
+        interner->data[0] = '\0';
+        interner->len = 1;
+    }
+    if (!s || !*s) {
+        return 0;
+    }
+    if (!interner->slots || ((size_t)interner->count + 1) * 2 > (size_t)interner->mask + 1) {
+        if (interner_grow(interner) != 0) goto oom;
+    }
+
+    size_t n = strlen(s) + 1;
+    interner->added++;
+    interner->added_bytes += n;
+    int64_t slot = interner_slot(interner, s, hash);
+    if (slot >= 0) {
+        return (int64_t)interner->slots[slot];
+    }
+
+    if (interner->len + n > UINT32_MAX) {
+        fprintf(stderr, "Error: String pool exceeds 4 GB\n");
+        fflush(stderr);
+        return -1;
+    }
+    if (interner->len + n > interner->cap) {
+        size_t cap = interner->cap * 2;
+        while (cap < interner->len + n) cap *= 2;
+        char* data = realloc(interner->data, cap);
+        if (!data) goto oom;
+        interner->data = data;
+        interner->cap = cap;
+    }
+    uint32_t offset = (uint32_t)interner->len;
+    memcpy(interner->data + offset, s, n);
+    interner->len += n;
+
+    uint32_t i = (uint32_t)(-slot - 1);
+    interner->slots[i] = offset;
+    interner->hashes[i] = hash;
+    interner->count++;
+    return offset;
+
+oom:
+    fprintf(stderr, "Error: Out of memory interning strings\n");
+    fflush(stderr);
+    return -1;
+}
+
+int64_t interner_find(const StringInterner* interner, const char* s, uint32_t hash) {
+    if (!s || !*s) {
+        return 0;
+    }
+    if (!interner->slots) {
+        return -1;
+    }
+    int64_t slot = interner_slot(interner, s, hash);
+    return slot >= 0 ? (int64_t)interner->slots[slot] : -1;
+}
+
+size_t interner_bytes(const StringInterner* interner) {
+    size_t table = interner->slots ? ((size_t)interner->mask + 1) * 2 * sizeof(uint32_t) : 0;
+    return interner->cap + table;
+}
+
+void interner_free(StringInterner* interner) {
+    free(interner->data);
+    free(interner->slots);
+    free(interner->hashes);
+    memset(interner, 0, sizeof(*interner));
+}
@@ -0,0 +1,65 @@
+#ifndef GTFS_ARENA_H
+#define GTFS_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Memory building blocks for the native GTFS tables.
+//
+// Arena: a bump allocator. Memory is carved out of large blocks and given
+// back all at once, so short-lived arrays cost one pointer bump each and no
+// individual free. Resetting keeps the blocks for the next user.
+//
+// StringInterner: stores every distinct string once in a single contiguous
+// pool and hands out its offset, so tables keep 4-byte string references
+// instead of fixed-width character arrays. Callers hash a field once with
+// gtfs_hash() and pass the hash along; the table keeps the hash of every
+// slot so it never rehashes strings when it grows.
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock* blocks;     // Newest first
+    ArenaBlock* current;    // Block allocations are served from
+    size_t block_size;
+    size_t used;            // Bytes handed out since the last reset
+    size_t peak;            // Largest `used` seen
+    size_t reserved;        // Bytes held in blocks
+} Arena;
+
+void arena_init(Arena* arena, size_t block_size);
+
+// 8-byte aligned, uninitialised memory. NULL when out of memory.
+void* arena_alloc(Arena* arena, size_t size);
+void* arena_calloc(Arena* arena, size_t count, size_t size);
+
+// Forget every allocation but keep the blocks
+void arena_reset(Arena* arena);
+void arena_free(Arena* arena);
+
+typedef struct {
+    char* data;             // "\0" followed by every distinct string
+    size_t len;
+    size_t cap;
+    uint32_t* slots;        // String offsets, 0 for empty slots
+    uint32_t* hashes;       // Hash of the string in each slot
+    uint32_t mask;
+    uint32_t count;         // Distinct strings
+    uint64_t added;         // Non-empty strings passed to interner_add
+    uint64_t added_bytes;   // Their total size, repeats included
+} StringInterner;
+
+uint32_t gtfs_hash(const char* s);
+
+// Offset of s in the pool, adding it if needed. "" is always offset 0.
+// hash must be gtfs_hash(s). Returns -1 when out of memory.
+int64_t interner_add(StringInterner* interner, const char* s, uint32_t hash);
+
+// Offset of s, or -1 when it was never added
+int64_t interner_find(const StringInterner* interner, const char* s, uint32_t hash);
+
+// Bytes held by the pool and the hash table
+size_t interner_bytes(const StringInterner* interner);
+void interner_free(StringInterner* interner);
+
+#endif // GTFS_ARENA_H
@@ -0,0 +1,615 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "gtfs_precache_version.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#endif
+
+// Benchmarks for the native GTFS engine.
+//
+//   gtfs_bench generate <dir> <rows> [--seed N] [--columns spec|shuffled]
+//     Write a deterministic synthetic GTFS feed with about <rows>
+//     stop_times rows: ids of realistic lengths, quoted fields (names with
+//     commas, escaped quotes) and optionally shuffled column orders with
+//     extra optional columns.
+//
+//   gtfs_bench run <results.json> [--rows 10000,100000,...] [--precache PATH]
+//                  [--work-dir DIR] [--repeat N] [--columns spec|shuffled]
+//                  [--baseline old.json] [--tolerance PCT]
+//     Generate a feed per size (kept in the work directory for later runs),
+//     run every parser mode of gtfs_precache on it and record rows/s, MB/s,
+//     peak RSS and output size. With --baseline, modes whose rows/s dropped
+//     by more than the tolerance are reported and the exit status is 2.
+
+#define DEFAULT_ROWS "10000,100000,1000000"
+#define DEFAULT_REPEAT 3
+#define DEFAULT_TOLERANCE 10.0
+#define MAX_SIZES 16
+#define MAX_RESULTS 64
+#define BOUNDED_MEMORY_MB "64"
+
+// ---------------------------------------------------------------------------
+// Deterministic random numbers (splitmix64)
+// ---------------------------------------------------------------------------
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    uint64_t z = (rng_state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [0, n)
+static uint32_t rng_below(uint32_t n) {
+    return n ? (uint32_t)(rng_next() % n) : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Feed generator
+// ---------------------------------------------------------------------------
+
+static const char* STREETS[] = {
+    "Gare du Nord", "De Brouckère", "Bourse", "Porte de Namur", "Louise",
+    "Montgomery", "Schuman", "Arts-Loi", "Rogier", "Simonis", "Heysel",
+    "Merode", "Delta", "Herrmann-Debroux", "Stockel", "Erasme", "Clemenceau",
+    "Albert", "Vanderkindere", "Flagey", "Place Jourdan", "Trône",
+};
+static const char* SERVICES[] = {"Semaine", "Samedi", "Dimanche"};
+
+// A file being written: its columns in output order. Each column is
+// written by index into the row's values, so column order can be shuffled.
+typedef struct {
+    FILE* fp;
+    const char** names;
+    int count;
+    int order[16];
+} CsvOut;
+
+static int csv_open(CsvOut* out, const char* dir, const char* file, const char** names,
+                    int count, int shuffled) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    out->fp = fopen(path, "w");
+    if (!out->fp) {
+        fprintf(stderr, "Error: Could not create %s\n", path);
+        fflush(stderr);
+        return -1;
+    }
+    out->names = names;
+    out->count = count;
+    for (int i = 0; i < count; i++) out->order[i] = i;
+    if (shuffled) {
+        for (int i = count - 1; i > 0; i--) {
+            int j = (int)rng_below((uint32_t)i + 1);
+            int t = out->order[i];
+            out->order[i] = out->order[j];
+            out->order[j] = t;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        fprintf(out->fp, "%s%s", i ? "," : "", names[out->order[i]]);
+    }
+    fputc('\n', out->fp);
+    return 0;
+}
+
+// Write one field, quoting it when it needs it (or, for a realistic mix,
+// sometimes when it does not)
+static void csv_field(FILE* fp, const char* value, int quote) {
+    if (!quote && !strpbrk(value, ",\"\n")) {
+        fputs(value, fp);
+        return;
+    }
+    fputc('"', fp);
+    for (const char* c = value; *c; c++) {
+        if (*c == '"') fputc('"', fp);
+        fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
+
+static void csv_row(CsvOut* out, const char** values, int quote) {
+    for (int i = 0; i < out->count; i++) {
+        if (i) fputc(',', out->fp);
+        csv_field(out->fp, values[out->order[i]], quote);
+    }
+    fputc('\n', out->fp);
+}
+
+static int csv_close(CsvOut* out) {
+    int failed = ferror(out->fp);
+    if (fclose(out->fp) != 0 || failed) {
+        fprintf(stderr, "Error: Could not write feed file\n");
+        fflush(stderr);
+        return -1;
+    }
+    return 0;
+}
+
+static void format_gtfs_time(char* buf, size_t size, uint32_t seconds) {
+    snprintf(buf, size, "%02u:%02u:%02u", seconds / 3600, seconds / 60 % 60, seconds % 60);
+}
+
+// Stop ids in the styles seen in real feeds: short numbers, prefixed
+// numbers and long structured ids
+static void stop_id(char* buf, size_t size, uint32_t stop, int style) {
+    switch (style) {
+    case 0: snprintf(buf, size, "%04u", stop + 1000); break;
+    case 1: snprintf(buf, size, "8%06u", stop * 7 + 100000); break;
+    default: snprintf(buf, size, "StopPoint:OCE%u-%08u", stop % 3, stop * 13 + 87000000); break;
+    }
+}
+
+int generate_feed(const char* dir, uint64_t rows, uint64_t seed, int shuffled) {
+    rng_state = seed;
+    mkdir(dir, 0755);
+
+    // Sizes scale with the number of rows; trips have 10-50 stops
+    uint32_t avg_len = 30;
+    uint64_t n_trips = rows / avg_len ? rows / avg_len : 1;
+    uint32_t n_stops = (uint32_t)(rows / 100);
+    if (n_stops < 50) n_stops = 50;
+    if (n_stops > 200000) n_stops = 200000;
+    uint32_t n_routes = (uint32_t)(n_trips / 200);
+    if (n_routes < 5) n_routes = 5;
+    if (n_routes > 5000) n_routes = 5000;
+    int id_style = (int)rng_below(3);
+    char id[64], id2[64], a[32], b[32], c[32], d[32], e[64];
+
+    CsvOut out;
+    static const char* agency_cols[] = {"agency_id", "agency_name", "agency_url", "agency_timezone", "agency_lang"};
+    if (csv_open(&out, dir, "agency.txt", agency_cols, 5, shuffled) != 0) return -1;
+    const char* agency[] = {"BENCH", "Bench Transit, Synthetic Lines", "https://example.org", "Europe/Brussels", "fr"};
+    csv_row(&out, agency, 0);
+    if (csv_close(&out) != 0) return -1;
+
+    static const char* calendar_cols[] = {"service_id", "monday", "tuesday", "wednesday", "thursday",
+                                          "friday", "saturday", "sunday", "start_date", "end_date"};
+    if (csv_open(&out, dir, "calendar.txt", calendar_cols, 10, shuffled) != 0) return -1;
+    for (int s = 0; s < 3; s++) {
+        const char* weekday = s == 0 ? "1" : "0";
+        const char* row[] = {SERVICES[s], weekday, weekday, weekday, weekday, weekday,
+                             s == 1 ? "1" : "0", s == 2 ? "1" : "0", "20260101", "20261231"};
+        csv_row(&out, row, 0);
+    }
+    if (csv_close(&out) != 0) return -1;
+
+    static const char* dates_cols[] = {"service_id", "date", "exception_type"};
+    if (csv_open(&out, dir, "calendar_dates.txt", dates_cols, 3, shuffled) != 0) return -1;
+    const char* holiday[] = {"Semaine", "20260721", "2"};
+    const char* holiday_sunday[] = {"Dimanche", "20260721", "1"};
+    csv_row(&out, holiday, 0);
+    csv_row(&out, holiday_sunday, 0);
+    if (csv_close(&out) != 0) return -1;
+
+    static const char* stop_cols[] = {"stop_id", "stop_code", "stop_name", "stop_lat", "stop_lon",
+                                      "location_type", "parent_station"};
+    if (csv_open(&out, dir, "stops.txt", stop_cols, 7, shuffled) != 0) return -1;
+    for (uint32_t s = 0; s < n_stops; s++) {
+        stop_id(id, sizeof(id), s, id_style);
+        snprintf(a, sizeof(a), "%u", s + 1);
+        // Some names contain commas or quotes and must be quoted
+        const char* street = STREETS[s % (sizeof(STREETS) / sizeof(STREETS[0]))];
+        switch (rng_below(4)) {
+        case 0: snprintf(e, sizeof(e), "%s, Quai %u", street, s % 4 + 1); break;
+        case 1: snprintf(e, sizeof(e), "%s \"%u\"", street, s); break;
+        default: snprintf(e, sizeof(e), "%s %u", street, s); break;
+        }
+        snprintf(b, sizeof(b), "%.6f", 50.75 + rng_below(200000) / 1000000.0);
+        snprintf(c, sizeof(c), "%.6f", 4.25 + rng_below(300000) / 1000000.0);
+        const char* row[] = {id, a, e, b, c, "0", ""};
+        csv_row(&out, row, rng_below(8) == 0);
+    }
+    if (csv_close(&out) != 0) return -1;
+
+    static const char* route_cols[] = {"route_id", "agency_id", "route_short_name", "route_long_name",
+                                       "route_type", "route_color", "route_text_color"};
+    if (csv_open(&out, dir, "routes.txt", route_cols, 7, shuffled) != 0) return -1;
+    for (uint32_t r = 0; r < n_routes; r++) {
+        snprintf(id, sizeof(id), "%u", r + 1);
+        snprintf(a, sizeof(a), "%u", r % 100 + 1);
+        snprintf(e, sizeof(e), "%s - %s",
+                 STREETS[r % (sizeof(STREETS) / sizeof(STREETS[0]))],
+                 STREETS[(r * 7 + 3) % (sizeof(STREETS) / sizeof(STREETS[0]))]);
+        snprintf(b, sizeof(b), "%06X", (unsigned)(rng_next() & 0xFFFFFF));
+        const char* row[] = {id, "BENCH", a, e, r % 3 == 0 ? "1" : "3", b, "FFFFFF"};
+        csv_row(&out, row, r % 5 == 0);
+    }
+    if (csv_close(&out) != 0) return -1;
+
+    // Each route has one stop pattern per direction
+    uint32_t max_len = avg_len * 2;
+    uint32_t* patterns = malloc(sizeof(uint32_t) * n_routes * max_len);
+    uint32_t* lengths = malloc(sizeof(uint32_t) * n_routes);
+    if (!patterns || !lengths) {
+        fprintf(stderr, "Error: Out of memory generating patterns\n");
+        fflush(stderr);
+        free(patterns);
+        free(lengths);
+        return -1;
+    }
+    for (uint32_t r = 0; r < n_routes; r++) {
+        lengths[r] = 10 + rng_below(max_len - 10);
+        for (uint32_t k = 0; k < lengths[r]; k++) {
+            patterns[r * max_len + k] = rng_below(n_stops);
+        }
+    }
+
+    static const char* trip_cols[] = {"route_id", "service_id", "trip_id", "trip_headsign",
+                                      "direction_id", "block_id", "shape_id"};
+    static const char* stop_time_cols[] = {"trip_id", "arrival_time", "departure_time", "stop_id",
+                                           "stop_sequence", "pickup_type", "drop_off_type",
+                                           "shape_dist_traveled", "timepoint"};
+    CsvOut trips, stop_times;
+    if (csv_open(&trips, dir, "trips.txt", trip_cols, 7, shuffled) != 0) {
+        free(patterns);
+        free(lengths);
+        return -1;
+    }
+    // The shuffled layout keeps the extra optional columns; the spec layout
+    // is the five required ones in the usual order
+    if (csv_open(&stop_times, dir, "stop_times.txt", stop_time_cols, shuffled ? 9 : 5, shuffled) != 0) {
+        fclose(trips.fp);
+        free(patterns);
+        free(lengths);
+        return -1;
+    }
+
+    uint64_t written = 0;
+    for (uint64_t t = 0; written < rows; t++) {
+        uint32_t r = (uint32_t)(t % n_routes);
+        uint32_t direction = (uint32_t)(t / n_routes % 2);
+        const char* service = SERVICES[t % 3];
+        // Trip ids like 115283612-ZEB_R6_00-Semaine-05
+        snprintf(id, sizeof(id), "%llu-%s%u_%02u-%s-%02u",
+                 (unsigned long long)(115000000 + t * 17), r % 2 ? "ZEB_R" : "T", r,
+                 (unsigned)(t % 97), service, (unsigned)(t % 24));
+        snprintf(a, sizeof(a), "%u", r + 1);
+        snprintf(b, sizeof(b), "%u", direction);
+        snprintf(c, sizeof(c), "%llu", (unsigned long long)(t / 4));
+        snprintf(d, sizeof(d), "%u%u", r + 1, direction);
+        const char* headsign = STREETS[(r + direction * 5) % (sizeof(STREETS) / sizeof(STREETS[0]))];
+        const char* trip_row[] = {a, service, id, headsign, b, c, d};
+        csv_row(&trips, trip_row, t % 11 == 0);
+
+        // Departures spread over 05:00-25:00 (past midnight for late trips)
+        uint32_t time = 5 * 3600 + rng_below(20 * 3600);
+        uint32_t len = lengths[r];
+        if (len > rows - written) len = (uint32_t)(rows - written);
+        double dist = 0;
+        for (uint32_t k = 0; k < len; k++) {
+            uint32_t stop = patterns[r * max_len + (direction ? lengths[r] - 1 - k : k)];
+            stop_id(id2, sizeof(id2), stop, id_style);
+            format_gtfs_time(a, sizeof(a), time);
+            uint32_t dwell = rng_below(3) == 0 ? 30 : 0;
+            format_gtfs_time(b, sizeof(b), time + dwell);
+            snprintf(c, sizeof(c), "%u", k + 1);
+            snprintf(e, sizeof(e), "%.1f", dist);
+            const char* row[] = {id, a, b, id2, c, k == 0 ? "0" : "", k + 1 == len ? "1" : "0",
+                                 e, dwell ? "1" : "0"};
+            csv_row(&stop_times, row, (t + k) % 17 == 0);
+            time += dwell + 60 + rng_below(120);
+            dist += 300 + rng_below(500);
+        }
+        written += len;
+    }
+    free(patterns);
+    free(lengths);
+    if (csv_close(&trips) != 0 || csv_close(&stop_times) != 0) return -1;
+
+    // Marks a complete feed so runs can reuse it
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/.bench_feed", dir);
+    FILE* marker = fopen(path, "w");
+    if (marker) {
+        fprintf(marker, "%llu %llu %d\n", (unsigned long long)rows, (unsigned long long)seed, shuffled);
+        fclose(marker);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Harness
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    char mode[32];
+    uint64_t rows;
+    uint64_t input_bytes;
+    uint64_t output_bytes;
+    long peak_rss;
+    double seconds;
+    double rows_per_s;
+    double mb_per_s;
+    int status;
+} BenchResult;
+
+static uint64_t file_size(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+static uint64_t feed_size(const char* dir) {
+    static const char* files[] = {"agency.txt", "calendar.txt", "calendar_dates.txt", "stops.txt",
+                                  "routes.txt", "trips.txt", "stop_times.txt"};
+    char path[4096];
+    uint64_t total = 0;
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        total += file_size(path);
+    }
+    return total;
+}
+
+// Reuse a feed generated earlier with the same parameters
+static int feed_matches(const char* dir, uint64_t rows, uint64_t seed, int shuffled) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/.bench_feed", dir);
+    FILE* fp = fopen(path, "r");
+    if (!fp) return 0;
+    unsigned long long r = 0, s = 0;
+    int sh = -1;
+    int ok = fscanf(fp, "%llu %llu %d", &r, &s, &sh) == 3 && r == rows && s == seed && sh == shuffled;
+    fclose(fp);
+    return ok;
+}
+
+#ifndef _WIN32
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run a command with its output in log_path; returns the exit status and
+// the wall time and peak RSS of the child
+static int run_command(char* const* argv, const char* log_path, double* seconds, long* peak_rss) {
+    double start = bench_now();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) return -1;
+    *seconds = bench_now() - start;
+#ifdef __APPLE__
+    *peak_rss = usage.ru_maxrss;          // Bytes on macOS
+#else
+    *peak_rss = usage.ru_maxrss * 1024L;  // Kilobytes elsewhere
+#endif
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+#endif
+
+// Run one mode `repeat` times and keep the fastest run
+static int bench_mode(BenchResult* result, const char* mode, char* const* argv, const char* output,
+                      const char* log_path, uint64_t rows, uint64_t input_bytes, int repeat) {
+#ifdef _WIN32
+    (void)argv; (void)output; (void)log_path; (void)repeat;
+    fprintf(stderr, "Error: gtfs_bench run is not supported on Windows\n");
+    fflush(stderr);
+    return -1;
+#else
+    memset(result, 0, sizeof(*result));
+    snprintf(result->mode, sizeof(result->mode), "%s", mode);
+    result->rows = rows;
+    result->input_bytes = input_bytes;
+    result->seconds = -1;
+    for (int i = 0; i < repeat; i++) {
+        double seconds;
+        long peak_rss;
+        remove(output);
+        int status = run_command(argv, log_path, &seconds, &peak_rss);
+        if (status != 0) {
+            fprintf(stderr, "Error: %s failed with status %d, see %s\n", mode, status, log_path);
+            fflush(stderr);
+            result->status = status;
+            return -1;
+        }
+        if (result->seconds < 0 || seconds < result->seconds) {
+            result->seconds = seconds;
+        }
+        if (peak_rss > result->peak_rss) result->peak_rss = peak_rss;
+        result->output_bytes = file_size(output);
+    }
+    remove(output);
+    result->rows_per_s = result->seconds > 0 ? rows / result->seconds : 0;
+    result->mb_per_s = result->seconds > 0 ? input_bytes / (1024.0 * 1024.0) / result->seconds : 0;
+    printf("%-18s %10llu rows  %8.2fs  %12.0f rows/s  %8.1f MB/s  peak %7.1f MB  output %8.1f MB\n",
+           mode, (unsigned long long)rows, result->seconds, result->rows_per_s, result->mb_per_s,
+           result->peak_rss / (1024.0 * 1024.0), result->output_bytes / (1024.0 * 1024.0));
+    fflush(stdout);
+    return 0;
+#endif
+}
+
+static void write_result(FILE* fp, const BenchResult* r, int last) {
+    // One result per line keeps the file easy to diff and to read back
+    fprintf(fp, "    {\"mode\": \"%s\", \"rows\": %llu, \"input_bytes\": %llu, \"seconds\": %.4f, "
+                "\"rows_per_s\": %.0f, \"mb_per_s\": %.2f, \"peak_rss_bytes\": %ld, "
+                "\"output_bytes\": %llu}%s\n",
+            r->mode, (unsigned long long)r->rows, (unsigned long long)r->input_bytes, r->seconds,
+            r->rows_per_s, r->mb_per_s, r->peak_rss, (unsigned long long)r->output_bytes,
+            last ? "" : ",");
+}
+
+// Compare with a results file written by an earlier run. Returns the
+// number of regressions.
+static int compare_baseline(const char* path, const BenchResult* results, int count, double tolerance) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Warning: Could not open baseline %s\n", path);
+        fflush(stderr);
+        return 0;
+    }
+    int regressions = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), fp)) {
+        char mode[32];
+        unsigned long long rows;
+        const char* m = strstr(line, "\"mode\": \"");
+        const char* r = strstr(line, "\"rows\": ");
+        const char* s = strstr(line, "\"rows_per_s\": ");
+        double old_rate;
+        if (!m || !r || !s || sscanf(m + 9, "%31[^\"]", mode) != 1 ||
+            sscanf(r + 8, "%llu", &rows) != 1 || sscanf(s + 14, "%lf", &old_rate) != 1) {
+            continue;
+        }
+        for (int i = 0; i < count; i++) {
+            if (strcmp(results[i].mode, mode) != 0 || results[i].rows != rows || old_rate <= 0) continue;
+            double change = (results[i].rows_per_s - old_rate) / old_rate * 100.0;
+            int regressed = change < -tolerance;
+            printf("%-18s %10llu rows  %+6.1f%% rows/s vs baseline%s\n", mode, rows, change,
+                   regressed ? "  REGRESSION" : "");
+            regressions += regressed;
+        }
+    }
+    fclose(fp);
+    fflush(stdout);
+    return regressions;
+}
+
+static int run_benchmarks(int argc, char* argv[]) {
+    const char* results_path = argv[2];
+    const char* rows_arg = DEFAULT_ROWS;
+    const char* precache = "./gtfs_precache";
+    const char* work_dir = "bench_feeds";
+    const char* baseline = NULL;
+    int repeat = DEFAULT_REPEAT;
+    int shuffled = 0;
+    double tolerance = DEFAULT_TOLERANCE;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--rows") == 0) rows_arg = argv[i + 1];
+        else if (strcmp(argv[i], "--precache") == 0) precache = argv[i + 1];
+        else if (strcmp(argv[i], "--work-dir") == 0) work_dir = argv[i + 1];
+        else if (strcmp(argv[i], "--baseline") == 0) baseline = argv[i + 1];
+        else if (strcmp(argv[i], "--repeat") == 0) repeat = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--tolerance") == 0) tolerance = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--columns") == 0) shuffled = strcmp(argv[i + 1], "shuffled") == 0;
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (repeat < 1) repeat = 1;
+
+    uint64_t sizes[MAX_SIZES];
+    int n_sizes = 0;
+    for (const char* p = rows_arg; *p && n_sizes < MAX_SIZES;) {
+        char* end;
+        unsigned long long rows = strtoull(p, &end, 10);
+        if (end == p) break;
+        if (rows > 0) sizes[n_sizes++] = rows;
+        p = *end == ',' ? end + 1 : end;
+    }
+    if (n_sizes == 0) {
+        fprintf(stderr, "Error: No row counts in %s\n", rows_arg);
+        return 1;
+    }
+
+    mkdir(work_dir, 0755);
+    BenchResult results[MAX_RESULTS];
+    int n_results = 0;
+    int failed = 0;
+    char dir[3072], stop_times[4200], output[4200], log_path[4200];
+    for (int s = 0; s < n_sizes && n_results + 3 <= MAX_RESULTS; s++) {
+        uint64_t rows = sizes[s];
+        snprintf(dir, sizeof(dir), "%s/feed_%llu%s", work_dir, (unsigned long long)rows,
+                 shuffled ? "_shuffled" : "");
+        if (!feed_matches(dir, rows, rows, shuffled)) {
+            printf("Generating %llu rows in %s...\n", (unsigned long long)rows, dir);
+            fflush(stdout);
+            if (generate_feed(dir, rows, rows, shuffled) != 0) return 1;
+        }
+        snprintf(stop_times, sizeof(stop_times), "%s/stop_times.txt", dir);
+        snprintf(output, sizeof(output), "%s/bench.out", dir);
+        snprintf(log_path, sizeof(log_path), "%s/bench.log", dir);
+        uint64_t stop_times_bytes = file_size(stop_times);
+
+        // Parser modes of gtfs_precache
+        char* in_memory[] = {(char*)precache, stop_times, output, NULL};
+        char* bounded[] = {(char*)precache, stop_times, output, "--max-memory", BOUNDED_MEMORY_MB, NULL};
+        char* timetable[] = {(char*)precache, "--timetable", dir, output, NULL};
+        failed |= bench_mode(&results[n_results], "precache", in_memory, output, log_path,
+                             rows, stop_times_bytes, repeat) != 0;
+        n_results += results[n_results].seconds >= 0;
+        failed |= bench_mode(&results[n_results], "precache_bounded", bounded, output, log_path,
+                             rows, stop_times_bytes, repeat) != 0;
+        n_results += results[n_results].seconds >= 0;
+        failed |= bench_mode(&results[n_results], "timetable", timetable, output, log_path,
+                             rows, feed_size(dir), repeat) != 0;
+        n_results += results[n_results].seconds >= 0;
+    }
+
+    FILE* fp = fopen(results_path, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not write %s\n", results_path);
+        return 1;
+    }
+    time_t now = time(NULL);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    fprintf(fp, "{\n  \"version\": \"%s\",\n  \"timestamp\": \"%s\",\n  \"columns\": \"%s\",\n"
+                "  \"repeat\": %d,\n  \"results\": [\n",
+            GTFS_PRECACHE_VERSION_STRING, stamp, shuffled ? "shuffled" : "spec", repeat);
+    for (int i = 0; i < n_results; i++) {
+        write_result(fp, &results[i], i + 1 == n_results);
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    printf("Results written to %s\n", results_path);
+    fflush(stdout);
+
+    if (baseline && compare_baseline(baseline, results, n_results, tolerance) > 0) {
+        return 2;
+    }
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 4 && strcmp(argv[1], "generate") == 0) {
+        uint64_t seed = 1;
+        int shuffled = 0;
+        for (int i = 4; i + 1 < argc; i += 2) {
+            if (strcmp(argv[i], "--seed") == 0) seed = strtoull(argv[i + 1], NULL, 10);
+            else if (strcmp(argv[i], "--columns") == 0) shuffled = strcmp(argv[i + 1], "shuffled") == 0;
+        }
+        uint64_t rows = strtoull(argv[3], NULL, 10);
+        if (rows == 0) {
+            fprintf(stderr, "Error: rows must be positive\n");
+            return 1;
+        }
+        return generate_feed(argv[2], rows, seed, shuffled) == 0 ? 0 : 1;
+    }
+    if (argc >= 3 && strcmp(argv[1], "run") == 0) {
+        return run_benchmarks(argc, argv);
+    }
+    fprintf(stderr, "Usage: %s generate <dir> <rows> [--seed N] [--columns spec|shuffled]\n", argv[0]);
+    fprintf(stderr, "       %s run <results.json> [--rows N,N,...] [--precache PATH] [--work-dir DIR]\n"
+                    "           [--repeat N] [--columns spec|shuffled] [--baseline FILE] [--tolerance PCT]\n",
+            argv[0]);
+    return 1;
+}
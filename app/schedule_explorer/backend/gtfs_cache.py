@@ -0,0 +1,315 @@
+"""
+Block-compressed container for the .gtfs_cache file.
+
+The cache is a set of named sections (stops, routes, trips, ...). Each
+section is msgpack-encoded as a stream of items (key/value pairs for maps,
+elements for lists) and cut into blocks of about BLOCK_SIZE bytes at item
+boundaries, so every block decodes on its own. Blocks are compressed
+independently, in parallel, with a fast codec: zstd or LZ4 through pyarrow
+when it is installed, zlib at its fastest level otherwise. An index at the
+front of the file records where every block of every section lives, so a
+reader can decompress one section, or one block of it, without touching the
+rest.
+
+File layout (integers little-endian):
+
+    magic       8 bytes, CACHE_MAGIC
+    index_size  4 bytes
+    index       msgpack map:
+                  {"codec": str,
+                   "sections": [{"name": str, "kind": "map" | "list" | "value",
+                                 "count": items, "size": raw bytes,
+                                 "blocks": [[offset, length, size, count], ...]}]}
+    blocks      compressed data; offsets count from the end of the index
+
+Files without the magic are read as a single plain msgpack document, the
+format written before blocks were introduced.
+"""
+
+import logging
+import mmap
+import os
+import struct
+import zlib
+from concurrent.futures import ThreadPoolExecutor
+from pathlib import Path
+from typing import Any, Callable, Dict, Iterator, List, Optional, Tuple
+
+import msgpack
+
+logger = logging.getLogger("schedule_explorer.gtfs_cache")
+
+CACHE_MAGIC = b"GTFSCCH\x01"
+BLOCK_SIZE = 1 << 20
+MAX_WORKERS = 4
+
+# Preferred codecs first. LZMA is deliberately absent: it compresses a little
+# better but decompresses an order of magnitude slower than any of these.
+CODEC_PREFERENCE = ["zstd", "lz4", "zlib"]
+
+Codec = Tuple[Callable[[bytes], bytes], Callable[[bytes, int], bytes]]
+
+
+def _pyarrow_codec(name: str) -> Optional[Codec]:
+    try:
+        import pyarrow
+    except ImportError:
+        return None
+    if not pyarrow.Codec.is_available(name):
+        return None
+    codec = pyarrow.Codec(name)
+    return (
+        lambda data: codec.compress(data, asbytes=True),
+        lambda data, size: codec.decompress(data, decompressed_size=size, asbytes=True),
+    )
+
+
+def get_codec(name: str) -> Optional[Codec]:
+    """(compress, decompress) functions for a codec, None when unavailable."""
+    if name in ("zstd", "lz4"):
+        return _pyarrow_codec(name)
+    if name == "zlib":
+        return (lambda data: zlib.compress(data, 1), lambda data, size: zlib.decompress(data))
+    if name == "none":
+        return (bytes, lambda data, size: bytes(data))
+    return None
+
+
+def default_codec() -> str:
+    """The codec new caches are written with: GTFS_CACHE_CODEC when set and
+    available, otherwise the first available codec in CODEC_PREFERENCE."""
+    requested = os.environ.get("GTFS_CACHE_CODEC")
+    if requested:
+        if get_codec(requested):
+            return requested
+        logger.warning(f"Cache codec {requested} is not available, using the default")
+    for name in CODEC_PREFERENCE:
+        if get_codec(name):
+            return name
+    return "none"
+
+
+def _default_workers() -> int:
+    return max(1, min(MAX_WORKERS, os.cpu_count() or 1))
+
+
+def _section_blocks(value: Any, block_size: int) -> Tuple[str, Iterator[Tuple[bytes, int]]]:
+    """Split a section into independently decodable msgpack blocks.
+
+    Returns the section kind and an iterator of (raw block, item count).
+    """
+    packer = msgpack.Packer(use_bin_type=True)
+
+    if isinstance(value, dict):
+        kind = "map"
+        items = (packer.pack(k) + packer.pack(v) for k, v in value.items())
+    elif isinstance(value, list):
+        kind = "list"
+        items = (packer.pack(item) for item in value)
+    else:
+        return "value", iter([(packer.pack(value), 1)])
+
+    def blocks() -> Iterator[Tuple[bytes, int]]:
+        buf = bytearray()
+        count = 0
+        for item in items:
+            buf += item
+            count += 1
+            if len(buf) >= block_size:
+                yield bytes(buf), count
+                buf.clear()
+                count = 0
+        if count:
+            yield bytes(buf), count
+
+    return kind, blocks()
+
+
+def pack_cache(
+    sections: Dict[str, Any],
+    codec: Optional[str] = None,
+    block_size: int = BLOCK_SIZE,
+    workers: Optional[int] = None,
+) -> bytes:
+    """Encode sections into the block-compressed cache format.
+
+    Blocks are packed on the calling thread and compressed by a pool of
+    workers while packing continues; the codecs release the GIL.
+    """
+    codec = codec or default_codec()
+    compress = get_codec(codec)[0]
+    workers = workers or _default_workers()
+
+    index = {"codec": codec, "sections": []}
+    pending = []  # (section entry, raw size, count, future)
+    with ThreadPoolExecutor(max_workers=workers) as pool:
+        for name, value in sections.items():
+            kind, blocks = _section_blocks(value, block_size)
+            entry = {"name": name, "kind": kind, "count": 0, "size": 0, "blocks": []}
+            index["sections"].append(entry)
+            for raw, count in blocks:
+                entry["count"] += count
+                entry["size"] += len(raw)
+                pending.append((entry, len(raw), count, pool.submit(compress, raw)))
+
+        chunks = []
+        offset = 0
+        for entry, size, count, future in pending:
+            data = future.result()
+            entry["blocks"].append([offset, len(data), size, count])
+            chunks.append(data)
+            offset += len(data)
+
+    header = msgpack.packb(index, use_bin_type=True)
+    raw_size = sum(entry["size"] for entry in index["sections"])
+    logger.info(
+        f"Packed {len(index['sections'])} cache sections, {len(pending)} blocks: "
+        f"{raw_size / (1024 * 1024):.2f} MB -> {offset / (1024 * 1024):.2f} MB ({codec})"
+    )
+    return b"".join([CACHE_MAGIC, struct.pack("<I", len(header)), header] + chunks)
+
+
+class CacheReader:
+    """Lazy reader for a cache file.
+
+    The file is memory-mapped; only the index is decoded on open. Sections
+    and blocks are decompressed when asked for.
+    """
+
+    def __init__(self, path: Path, workers: Optional[int] = None):
+        self.path = Path(path)
+        self.workers = workers or _default_workers()
+        self._file = open(self.path, "rb")
+        try:
+            self._map = mmap.mmap(self._file.fileno(), 0, access=mmap.ACCESS_READ)
+        except ValueError:
+            # Empty file
+            self._map = None
+        self.size = len(self._map) if self._map is not None else 0
+        self.legacy = self._map is None or self._map[: len(CACHE_MAGIC)] != CACHE_MAGIC
+        self._sections: Dict[str, dict] = {}
+        self._legacy_data: Optional[dict] = None
+        self.codec = None
+
+        if self.legacy:
+            return
+        (index_size,) = struct.unpack_from("<I", self._map, len(CACHE_MAGIC))
+        start = len(CACHE_MAGIC) + 4
+        index = msgpack.unpackb(self._map[start : start + index_size], raw=False)
+        self._base = start + index_size
+        self.codec = index["codec"]
+        codec = get_codec(self.codec)
+        if codec is None:
+            self.close()
+            raise ValueError(f"Cache codec {self.codec} is not available")
+        self._decompress = codec[1]
+        self._sections = {entry["name"]: entry for entry in index["sections"]}
+
+    @property
+    def closed(self) -> bool:
+        return self._file.closed
+
+    def close(self) -> None:
+        if self._map is not None:
+            self._map.close()
+            self._map = None
+        self._file.close()
+
+    def __enter__(self) -> "CacheReader":
+        return self
+
+    def __exit__(self, *exc) -> None:
+        self.close()
+
+    def _legacy(self) -> dict:
+        if self._legacy_data is None:
+            data = self._map[:] if self._map is not None else b""
+            self._legacy_data = msgpack.unpackb(data, raw=False)
+        return self._legacy_data
+
+    def sections(self) -> List[str]:
+        if self.legacy:
+            return list(self._legacy().keys())
+        return list(self._sections.keys())
+
+    def __contains__(self, name: str) -> bool:
+        if self.legacy:
+            return name in self._legacy()
+        return name in self._sections
+
+    def block_count(self, name: str) -> int:
+        if self.legacy:
+            return 1
+        return len(self._sections[name]["blocks"])
+
+    def _raw_block(self, entry: dict, i: int) -> bytes:
+        offset, length, size, _ = entry["blocks"][i]
+        start = self._base + offset
+        return self._decompress(self._map[start : start + length], size)
+
+    def _decode(self, entry: dict, raw: bytes) -> Any:
+        unpacker = msgpack.Unpacker(raw=False, max_buffer_size=len(raw) or 1)
+        unpacker.feed(raw)
+        if entry["kind"] == "map":
+            return {key: next(unpacker) for key in unpacker}
+        if entry["kind"] == "list":
+            return list(unpacker)
+        return next(unpacker)
+
+    def block(self, name: str, i: int) -> Any:
+        """Decode one block of a section: a dict holding part of a map
+        section, or a slice of a list section."""
+        if self.legacy:
+            return self._legacy()[name]
+        entry = self._sections[name]
+        return self._decode(entry, self._raw_block(entry, i))
+
+    def section(self, name: str) -> Any:
+        """Decode a whole section. Its blocks are decompressed in parallel."""
+        if self.legacy:
+            return self._legacy()[name]
+        entry = self._sections[name]
+        n = len(entry["blocks"])
+        if n > 1 and self.workers > 1:
+            with ThreadPoolExecutor(max_workers=min(self.workers, n)) as pool:
+                raw_blocks = list(pool.map(lambda i: self._raw_block(entry, i), range(n)))
+        else:
+            raw_blocks = [self._raw_block(entry, i) for i in range(n)]
+
+        if entry["kind"] == "map":
+            result = {}
+            for raw in raw_blocks:
+                result.update(self._decode(entry, raw))
+            return result
+        if entry["kind"] == "list":
+            result = []
+            for raw in raw_blocks:
+                result.extend(self._decode(entry, raw))
+            return result
+        return self._decode(entry, raw_blocks[0])
+
+    def read_all(self) -> Dict[str, Any]:
+        return {name: self.section(name) for name in self.sections()}
+
+
+def read_cache(path: Path) -> Dict[str, Any]:
+    """Decode every section of a cache file."""
+    with CacheReader(path) as reader:
+        return reader.read_all()
+
+
+def write_cache_data(path: Path, data: bytes) -> None:
+    """Write packed cache data to path through a temporary file, so readers
+    that still map the previous file are not affected."""
+    path = Path(path)
+    tmp = path.with_name(path.name + ".tmp")
+    with open(tmp, "wb") as f:
+        f.write(data)
+    os.replace(tmp, path)
+
+
+def write_cache(path: Path, sections: Dict[str, Any], **kwargs) -> int:
+    """Write sections to path atomically. Returns the file size."""
+    data = pack_cache(sections, **kwargs)
+    write_cache_data(path, data)
+    return len(data)
@@ -0,0 +1,226 @@
+#include "gtfs_timetable_internal.h"
+#include "gtfs_taskgraph.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Service calendars of routes: the days each route runs on, its
+// calendar_dates.txt additions and removals and its runs of consecutive
+// days, computed for every route at once from the compiled service bitsets.
+// Routes are spread over threads twice: once to count the days of every
+// route, then, with the output laid out, to write them.
+
+#define CALENDAR_MAX_THREADS 64
+
+typedef struct {
+    const GttTimetable* tt;
+    const GttCalendarQuery* query;
+    GttRouteCalendars* out;
+    int write;                  // 0 while counting days, 1 while writing them
+    size_t first;               // This worker handles routes first, first + step, ...
+    size_t step;
+    uint64_t* active;           // Union of the active service bitsets of a route
+} CalendarWorker;
+
+static int compare_days(const void* a, const void* b) {
+    int32_t x = *(const int32_t*)a;
+    int32_t y = *(const int32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int day_active(const uint64_t* bits, int64_t d) {
+    return (bits[d / 64] >> (d % 64)) & 1;
+}
+
+static void route_calendar(CalendarWorker* w, size_t r) {
+    const GttTimetable* tt = w->tt;
+    const GttCalendarQuery* q = w->query;
+    GttRouteCalendar* rc = &w->out->routes[r];
+    int32_t* out = w->write ? w->out->days + rc->first_day : NULL;
+    uint32_t words = tt->header.service_words;
+    int32_t calendar_start = tt->header.calendar_start;
+    int64_t calendar_days = tt->header.calendar_days;
+
+    // Window of the calendar.txt entries, and the exceptions
+    uint8_t calendar_weekdays = 0;
+    int32_t window_start = INT32_MAX;
+    int32_t window_end = INT32_MIN;
+    uint32_t n_additions = 0;
+    uint32_t n_removals = 0;
+    uint8_t addition_weekdays = 0;
+    for (uint32_t i = q->services_start[r]; i < q->services_start[r + 1]; i++) {
+        uint32_t s = q->services[i];
+        if (tt->service_start[s] <= tt->service_end[s]) {
+            calendar_weekdays |= tt->service_calendar_days[s];
+            if (tt->service_start[s] < window_start) window_start = tt->service_start[s];
+            if (tt->service_end[s] > window_end) window_end = tt->service_end[s];
+        }
+        for (uint32_t e = tt->exceptions_start[s]; e < tt->exceptions_start[s + 1]; e++) {
+            if (tt->exception_types[e] == 1) {
+                addition_weekdays |= (uint8_t)(1u << weekday_of(tt->exception_days[e]));
+                n_additions++;
+            } else {
+                n_removals++;
+            }
+        }
+    }
+
+    uint32_t n_valid = 0;
+    uint32_t n_ranges = 0;
+    uint8_t valid_weekdays = 0;
+    int32_t* valid = out;
+    int32_t* additions = out ? out + rc->n_valid : NULL;
+    int32_t* removals = out ? additions + n_additions : NULL;
+    int32_t* ranges = out ? removals + n_removals : NULL;
+
+    if (out) {
+        uint32_t a = 0;
+        uint32_t m = 0;
+        for (uint32_t i = q->services_start[r]; i < q->services_start[r + 1]; i++) {
+            uint32_t s = q->services[i];
+            for (uint32_t e = tt->exceptions_start[s]; e < tt->exceptions_start[s + 1]; e++) {
+                if (tt->exception_types[e] == 1) {
+                    additions[a++] = tt->exception_days[e];
+                } else {
+                    removals[m++] = tt->exception_days[e];
+                }
+            }
+        }
+        qsort(additions, n_additions, sizeof(int32_t), compare_days);
+        qsort(removals, n_removals, sizeof(int32_t), compare_days);
+    }
+
+    if (calendar_weekdays) {
+        // Days of the window on which any active service runs
+        memset(w->active, 0, sizeof(uint64_t) * words);
+        for (uint32_t i = q->active_start[r]; i < q->active_start[r + 1]; i++) {
+            const uint64_t* row = tt->service_bits + (size_t)q->active[i] * words;
+            for (uint32_t k = 0; k < words; k++) w->active[k] |= row[k];
+        }
+        int64_t from = (int64_t)window_start - calendar_start;
+        int64_t to = (int64_t)window_end - calendar_start;
+        if (from < 0) from = 0;
+        if (to >= calendar_days) to = calendar_days - 1;
+        int64_t previous = INT64_MIN;
+        for (int64_t d = from; d <= to; d++) {
+            if (!day_active(w->active, d)) continue;
+            int32_t day = (int32_t)(calendar_start + d);
+            if (out) valid[n_valid] = day;
+            n_valid++;
+            valid_weekdays |= (uint8_t)(1u << weekday_of(day));
+            if (d != previous + 1) {
+                if (out) ranges[2 * n_ranges] = day;
+                n_ranges++;
+            }
+            if (out) ranges[2 * n_ranges - 1] = day;
+            previous = d;
+        }
+    } else {
+        // Without a weekly calendar a route runs on its added days
+        n_valid = n_additions;
+        valid_weekdays = addition_weekdays;
+        if (out) {
+            memcpy(valid, additions, sizeof(int32_t) * n_additions);
+            for (uint32_t i = 0; i < n_additions; i++) {
+                if (i > 0 && additions[i] <= additions[i - 1] + 1) {
+                    ranges[2 * n_ranges - 1] = additions[i];
+                    continue;
+                }
+                ranges[2 * n_ranges] = ranges[2 * n_ranges + 1] = additions[i];
+                n_ranges++;
+            }
+        } else {
+            // Duplicate and consecutive days only merge once sorted: room
+            // for the worst case, the layout ends with the ranges
+            n_ranges = n_additions;
+        }
+    }
+
+    rc->n_ranges = n_ranges;
+    if (!w->write) {
+        rc->n_valid = n_valid;
+        rc->n_additions = n_additions;
+        rc->n_removals = n_removals;
+        rc->calendar_weekdays = calendar_weekdays;
+        rc->valid_weekdays = valid_weekdays;
+        rc->addition_weekdays = addition_weekdays;
+    }
+}
+
+static int run_worker(void* workers, int index) {
+    CalendarWorker* w = (CalendarWorker*)workers + index;
+    for (size_t r = w->first; r < w->query->n_routes; r += w->step) {
+        route_calendar(w, r);
+    }
+    return 0;
+}
+
+// Run one pass over every route on the workers
+static void run_pass(CalendarWorker* workers, uint32_t n_threads, int write) {
+    for (uint32_t t = 0; t < n_threads; t++) {
+        workers[t].write = write;
+    }
+    parallel_for((int)n_threads, run_worker, workers);
+}
+
+GttRouteCalendars* gtt_route_calendars(const GttTimetable* tt, const GttCalendarQuery* query) {
+    size_t n_routes = query->n_routes;
+    uint32_t n_threads = query->n_threads ? query->n_threads : 1;
+    if (n_threads > CALENDAR_MAX_THREADS) n_threads = CALENDAR_MAX_THREADS;
+    if (n_threads > n_routes) n_threads = n_routes > 0 ? (uint32_t)n_routes : 1;
+
+    GttRouteCalendars* result = calloc(1, sizeof(GttRouteCalendars));
+    CalendarWorker* workers = calloc(n_threads, sizeof(CalendarWorker));
+    if (!result || !workers) {
+        free(result);
+        free(workers);
+        return NULL;
+    }
+    result->n_routes = n_routes;
+    result->routes = calloc(n_routes + 1, sizeof(GttRouteCalendar));
+    int failed = result->routes == NULL;
+    for (uint32_t t = 0; t < n_threads && !failed; t++) {
+        workers[t].tt = tt;
+        workers[t].query = query;
+        workers[t].out = result;
+        workers[t].first = t;
+        workers[t].step = n_threads;
+        workers[t].active = malloc(sizeof(uint64_t) * (tt->header.service_words + 1));
+        failed = workers[t].active == NULL;
+    }
+
+    if (!failed) {
+        run_pass(workers, n_threads, 0);
+        size_t n_days = 0;
+        for (size_t r = 0; r < n_routes; r++) {
+            GttRouteCalendar* rc = &result->routes[r];
+            rc->first_day = (uint32_t)n_days;
+            n_days += (size_t)rc->n_valid + rc->n_additions + rc->n_removals + 2 * (size_t)rc->n_ranges;
+        }
+        result->n_days = n_days;
+        result->days = malloc(sizeof(int32_t) * (n_days + 1));
+        failed = result->days == NULL;
+    }
+    if (!failed) {
+        run_pass(workers, n_threads, 1);
+    }
+
+    for (uint32_t t = 0; t < n_threads; t++) {
+        free(workers[t].active);
+    }
+    free(workers);
+    if (failed) {
+        gtt_free_route_calendars(result);
+        return NULL;
+    }
+    return result;
+}
+
+void gtt_free_route_calendars(GttRouteCalendars* calendars) {
+    if (!calendars) {
+        return;
+    }
+    free(calendars->routes);
+    free(calendars->days);
+    free(calendars);
+}
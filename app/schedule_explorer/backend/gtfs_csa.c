@@ -0,0 +1,396 @@
+#include "gtfs_timetable_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+// Connection scan (CSA) queries over the departure-sorted connection array
+// of a compiled timetable. Each query is a single linear pass over a slice
+// of that array, touching only flat per-stop and per-trip arrays, which
+// makes one-to-all questions ("where can I be by 10:00?") and full-day
+// profiles cheap compared with repeated journey planning.
+//
+// Trips of the previous service day that run past midnight are scanned as a
+// second stream (their connections departing at 24:00 or later, shifted back
+// by a day) merged with the connections of the query day.
+
+#define INF INT32_MAX
+#define DAY_SECONDS 86400
+
+typedef struct {
+    const GttConnection* connections;
+    size_t n_connections;
+    uint32_t n_trips;
+    uint8_t* active;        // Per trip: bit 0 runs on the day, bit 1 the day before
+} Scan;
+
+static int scan_init(Scan* scan, const GttTimetable* tt, int32_t day) {
+    scan->connections = tt->connections;
+    scan->n_connections = (size_t)tt->counts[GTT_SEC_CONNECTIONS];
+    scan->n_trips = tt->header.n_trips;
+    scan->active = malloc(scan->n_trips + 1);
+    uint8_t* services = malloc(tt->header.n_services + 1);
+    if (!scan->active || !services) {
+        free(scan->active);
+        free(services);
+        return -1;
+    }
+    for (uint32_t s = 0; s < tt->header.n_services; s++) {
+        services[s] = (uint8_t)(gtt_service_active(tt, s, day) |
+                                (gtt_service_active(tt, s, day - 1) << 1));
+    }
+    for (uint32_t t = 0; t < scan->n_trips; t++) {
+        scan->active[t] = services[tt->trip_service[t]];
+    }
+    free(services);
+    return 0;
+}
+
+// Index of the first connection departing at or after time
+static size_t first_departure(const Scan* scan, int32_t time) {
+    size_t lo = 0, hi = scan->n_connections;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (scan->connections[mid].departure < time) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// ---------------------------------------------------------------------------
+// Earliest arrival
+// ---------------------------------------------------------------------------
+
+int64_t gtt_earliest_arrivals(const GttTimetable* tt,
+                              const uint32_t* from_stops, size_t n_from,
+                              int32_t day, int32_t departure, int32_t max_duration,
+                              int32_t* arrivals) {
+    uint32_t n_stops = tt->header.n_stops;
+    Scan scan;
+    if (scan_init(&scan, tt, day) != 0) {
+        fprintf(stderr, "Error: Out of memory scanning connections\n");
+        fflush(stderr);
+        return -1;
+    }
+    // ride: arrival by a trip, the only arrivals footpaths continue from
+    int32_t* ride = malloc(sizeof(int32_t) * (n_stops + 1));
+    uint8_t* boarded = calloc((size_t)scan.n_trips * 2 + 1, 1);
+    if (!ride || !boarded) {
+        fprintf(stderr, "Error: Out of memory scanning connections\n");
+        fflush(stderr);
+        free(scan.active);
+        free(ride);
+        free(boarded);
+        return -1;
+    }
+    for (uint32_t s = 0; s < n_stops; s++) {
+        arrivals[s] = INF;
+        ride[s] = INF;
+    }
+    for (size_t i = 0; i < n_from; i++) {
+        uint32_t s = from_stops[i];
+        if (s >= n_stops) continue;
+        arrivals[s] = departure;
+        for (uint32_t k = tt->transfers_start[s]; k < tt->transfers_start[s + 1]; k++) {
+            int32_t walk = departure + tt->transfer_times[k];
+            if (walk < arrivals[tt->transfer_stops[k]]) arrivals[tt->transfer_stops[k]] = walk;
+        }
+    }
+
+    const GttConnection* conns = scan.connections;
+    size_t n = scan.n_connections;
+    size_t i = first_departure(&scan, departure);
+    size_t j = first_departure(&scan, departure + DAY_SECONDS);
+    int64_t limit = max_duration > 0 ? (int64_t)departure + max_duration : INT64_MAX;
+
+    for (;;) {
+        const GttConnection* c;
+        int32_t offset;
+        uint32_t previous_day;
+        if (i < n && (j >= n || conns[i].departure <= conns[j].departure - DAY_SECONDS)) {
+            c = &conns[i++];
+            offset = 0;
+            previous_day = 0;
+        } else if (j < n) {
+            c = &conns[j++];
+            offset = -DAY_SECONDS;
+            previous_day = 1;
+        } else {
+            break;
+        }
+        int32_t dep = c->departure + offset;
+        if (dep > limit) break;
+        if (!(scan.active[c->trip] & (1u << previous_day))) continue;
+
+        uint8_t* on = &boarded[previous_day * scan.n_trips + c->trip];
+        if (!*on && arrivals[c->from_stop] > dep) continue;
+        *on = 1;
+
+        int32_t arr = c->arrival + offset;
+        uint32_t to = c->to_stop;
+        if (arr >= ride[to]) continue;
+        ride[to] = arr;
+        if (arr < arrivals[to]) arrivals[to] = arr;
+        for (uint32_t k = tt->transfers_start[to]; k < tt->transfers_start[to + 1]; k++) {
+            int32_t walk = arr + tt->transfer_times[k];
+            if (walk < arrivals[tt->transfer_stops[k]]) arrivals[tt->transfer_stops[k]] = walk;
+        }
+    }
+
+    int64_t reached = 0;
+    for (uint32_t s = 0; s < n_stops; s++) {
+        reached += arrivals[s] != INF;
+    }
+    free(scan.active);
+    free(ride);
+    free(boarded);
+    return reached;
+}
+
+// ---------------------------------------------------------------------------
+// Profile
+// ---------------------------------------------------------------------------
+
+// Profile entries of a stop form a list from the earliest departure to the
+// latest. The scan runs from late to early, so new entries go to the front.
+typedef struct {
+    int32_t departure;
+    int32_t arrival;
+    uint32_t next;
+} ProfileNode;
+
+typedef struct {
+    ProfileNode* nodes;
+    size_t n_nodes;
+    size_t cap;
+    uint32_t* head;         // Per stop, GTT_NONE when empty
+} ProfileLists;
+
+// Earliest arrival at the targets when at stop at time, without walking
+static int32_t profile_eval(const ProfileLists* lists, uint32_t stop, int32_t time) {
+    uint32_t k = lists->head[stop];
+    while (k != GTT_NONE && lists->nodes[k].departure < time) {
+        k = lists->nodes[k].next;
+    }
+    return k == GTT_NONE ? INF : lists->nodes[k].arrival;
+}
+
+static int profile_push(ProfileLists* lists, uint32_t stop, int32_t departure, int32_t arrival) {
+    if (lists->n_nodes == lists->cap) {
+        size_t cap = lists->cap ? lists->cap * 2 : 1024;
+        ProfileNode* nodes = realloc(lists->nodes, sizeof(ProfileNode) * cap);
+        if (!nodes) return -1;
+        lists->nodes = nodes;
+        lists->cap = cap;
+    }
+    ProfileNode* node = &lists->nodes[lists->n_nodes];
+    node->departure = departure;
+    node->arrival = arrival;
+    node->next = lists->head[stop];
+    lists->head[stop] = (uint32_t)lists->n_nodes++;
+    return 0;
+}
+
+static int compare_entries_latest_first(const void* a, const void* b) {
+    const GttProfileEntry* x = a;
+    const GttProfileEntry* y = b;
+    if (x->departure != y->departure) return x->departure > y->departure ? -1 : 1;
+    return x->arrival < y->arrival ? -1 : x->arrival > y->arrival;
+}
+
+typedef struct {
+    GttProfileEntry* data;
+    size_t len;
+    size_t cap;
+} EntryBuffer;
+
+static int entry_push(EntryBuffer* buf, int32_t departure, int32_t arrival) {
+    if (buf->len == buf->cap) {
+        size_t cap = buf->cap ? buf->cap * 2 : 256;
+        GttProfileEntry* data = realloc(buf->data, sizeof(GttProfileEntry) * cap);
+        if (!data) return -1;
+        buf->data = data;
+        buf->cap = cap;
+    }
+    buf->data[buf->len].departure = departure;
+    buf->data[buf->len].arrival = arrival;
+    buf->len++;
+    return 0;
+}
+
+// Gather the entries of every stop within the window, including boarding at
+// a stop one footpath away, and keep only the Pareto-optimal ones
+static GttProfile* collect_profile(const GttTimetable* tt, const ProfileLists* lists,
+                                   const uint8_t* is_target,
+                                   int32_t departure_min, int32_t departure_max) {
+    uint32_t n_stops = tt->header.n_stops;
+    GttProfile* profile = calloc(1, sizeof(GttProfile));
+    EntryBuffer out = {0};
+    EntryBuffer tmp = {0};
+    if (!profile || !(profile->stop_start = calloc(n_stops + 1, sizeof(uint32_t)))) {
+        goto fail;
+    }
+
+    for (uint32_t s = 0; s < n_stops; s++) {
+        tmp.len = 0;
+        if (!is_target[s]) {
+            for (uint32_t k = lists->head[s]; k != GTT_NONE; k = lists->nodes[k].next) {
+                const ProfileNode* node = &lists->nodes[k];
+                if (node->departure > departure_max) break;
+                if (entry_push(&tmp, node->departure, node->arrival) != 0) goto fail;
+            }
+            for (uint32_t f = tt->transfers_start[s]; f < tt->transfers_start[s + 1]; f++) {
+                int32_t walk = tt->transfer_times[f];
+                for (uint32_t k = lists->head[tt->transfer_stops[f]]; k != GTT_NONE; k = lists->nodes[k].next) {
+                    const ProfileNode* node = &lists->nodes[k];
+                    int32_t departure = node->departure - walk;
+                    if (departure > departure_max) break;
+                    if (departure < departure_min) continue;
+                    if (entry_push(&tmp, departure, node->arrival) != 0) goto fail;
+                }
+            }
+        }
+
+        qsort(tmp.data, tmp.len, sizeof(GttProfileEntry), compare_entries_latest_first);
+        size_t first = out.len;
+        int32_t best = INF;
+        for (size_t k = 0; k < tmp.len; k++) {
+            if (tmp.data[k].arrival < best) {
+                best = tmp.data[k].arrival;
+                if (entry_push(&out, tmp.data[k].departure, best) != 0) goto fail;
+            }
+        }
+        // Latest first -> earliest first
+        for (size_t a = first, b = out.len; a + 1 < b; a++, b--) {
+            GttProfileEntry e = out.data[a];
+            out.data[a] = out.data[b - 1];
+            out.data[b - 1] = e;
+        }
+        profile->stop_start[s + 1] = (uint32_t)out.len;
+    }
+
+    free(tmp.data);
+    profile->entries = out.data;
+    profile->n_entries = out.len;
+    return profile;
+
+fail:
+    free(tmp.data);
+    free(out.data);
+    if (profile) free(profile->stop_start);
+    free(profile);
+    return NULL;
+}
+
+GttProfile* gtt_profile(const GttTimetable* tt,
+                        const uint32_t* to_stops, size_t n_to,
+                        int32_t day, int32_t departure_min, int32_t departure_max) {
+    uint32_t n_stops = tt->header.n_stops;
+    GttProfile* profile = NULL;
+    ProfileLists lists = {0};
+    Scan scan;
+    if (scan_init(&scan, tt, day) != 0) {
+        fprintf(stderr, "Error: Out of memory computing profile\n");
+        fflush(stderr);
+        return NULL;
+    }
+    uint8_t* is_target = calloc(n_stops + 1, 1);
+    int32_t* target_walk = malloc(sizeof(int32_t) * (n_stops + 1));
+    int32_t* trip_best = malloc(sizeof(int32_t) * ((size_t)scan.n_trips * 2 + 1));
+    lists.head = malloc(sizeof(uint32_t) * (n_stops + 1));
+    if (!is_target || !target_walk || !trip_best || !lists.head) {
+        goto done;
+    }
+
+    // Walking time from every stop to the nearest target
+    for (size_t i = 0; i < n_to; i++) {
+        if (to_stops[i] < n_stops) is_target[to_stops[i]] = 1;
+    }
+    for (uint32_t s = 0; s < n_stops; s++) {
+        target_walk[s] = is_target[s] ? 0 : INF;
+        lists.head[s] = GTT_NONE;
+        for (uint32_t k = tt->transfers_start[s]; k < tt->transfers_start[s + 1]; k++) {
+            if (is_target[tt->transfer_stops[k]] && tt->transfer_times[k] < target_walk[s]) {
+                target_walk[s] = tt->transfer_times[k];
+            }
+        }
+    }
+    for (size_t t = 0; t < (size_t)scan.n_trips * 2; t++) {
+        trip_best[t] = INF;
+    }
+
+    const GttConnection* conns = scan.connections;
+    size_t i = scan.n_connections;
+    size_t j = scan.n_connections;
+    size_t i_end = first_departure(&scan, departure_min);
+    size_t j_end = first_departure(&scan, departure_min + DAY_SECONDS);
+
+    for (;;) {
+        const GttConnection* c;
+        int32_t offset;
+        uint32_t previous_day;
+        if (j > j_end && (i <= i_end || conns[j - 1].departure - DAY_SECONDS >= conns[i - 1].departure)) {
+            c = &conns[--j];
+            offset = -DAY_SECONDS;
+            previous_day = 1;
+        } else if (i > i_end) {
+            c = &conns[--i];
+            offset = 0;
+            previous_day = 0;
+        } else {
+            break;
+        }
+        if (!(scan.active[c->trip] & (1u << previous_day))) continue;
+
+        int32_t arr = c->arrival + offset;
+        uint32_t to = c->to_stop;
+        int32_t* trip_time = &trip_best[previous_day * scan.n_trips + c->trip];
+
+        // Stay seated, get off at the target or change at (or near) to
+        int32_t best = *trip_time;
+        if (target_walk[to] != INF && arr + target_walk[to] < best) best = arr + target_walk[to];
+        int32_t t = profile_eval(&lists, to, arr);
+        if (t < best) best = t;
+        for (uint32_t k = tt->transfers_start[to]; k < tt->transfers_start[to + 1]; k++) {
+            t = profile_eval(&lists, tt->transfer_stops[k], arr + tt->transfer_times[k]);
+            if (t < best) best = t;
+        }
+        if (best == INF) continue;
+        *trip_time = best;
+
+        uint32_t from = c->from_stop;
+        if (is_target[from]) continue;
+        uint32_t head = lists.head[from];
+        if (head == GTT_NONE || best < lists.nodes[head].arrival) {
+            if (profile_push(&lists, from, c->departure + offset, best) != 0) goto done;
+        }
+    }
+
+    profile = collect_profile(tt, &lists, is_target, departure_min, departure_max);
+
+done:
+    if (!profile) {
+        fprintf(stderr, "Error: Out of memory computing profile\n");
+        fflush(stderr);
+    }
+    free(scan.active);
+    free(is_target);
+    free(target_walk);
+    free(trip_best);
+    free(lists.head);
+    free(lists.nodes);
+    return profile;
+}
+
+void gtt_free_profile(GttProfile* profile) {
+    if (!profile) {
+        return;
+    }
+    free(profile->stop_start);
+    free(profile->entries);
+    free(profile);
+}
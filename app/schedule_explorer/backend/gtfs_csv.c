@@ -0,0 +1,324 @@
+#include "gtfs_csv.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define CSV_BUFFER_SIZE (256 * 1024)
+#define CSV_INITIAL_FIELDS 32
+
+// Refill the raw read buffer. Returns the number of bytes available.
+static size_t csv_fill(CsvReader* reader) {
+    if (reader->buffer_pos < reader->buffer_len) {
+        return reader->buffer_len - reader->buffer_pos;
+    }
+    if (reader->eof) {
+        return 0;
+    }
+    reader->buffer_len = fread(reader->buffer, 1, reader->buffer_size, reader->fp);
+    reader->buffer_pos = 0;
+    if (reader->buffer_len < reader->buffer_size) {
+        reader->eof = 1;
+        if (reader->zip && zip_stream_wait(reader->zip) != 0) {
+            reader->error = 1;
+        }
+    }
+    return reader->buffer_len;
+}
+
+// Append bytes to the current record, growing it as needed
+static int csv_append(CsvReader* reader, size_t* len, const char* data, size_t n) {
+    if (*len + n + 1 > reader->line_cap) {
+        size_t cap = reader->line_cap ? reader->line_cap : 1024;
+        while (*len + n + 1 > cap) cap *= 2;
+        char* line = realloc(reader->line, cap);
+        if (!line) {
+            fprintf(stderr, "Error: Out of memory reading CSV record\n");
+            fflush(stderr);
+            return -1;
+        }
+        reader->line = line;
+        reader->line_cap = cap;
+    }
+    memcpy(reader->line + *len, data, n);
+    *len += n;
+    reader->line[*len] = '\0';
+    return 0;
+}
+
+// Read one raw record (which may span several lines when quoted).
+// Returns 1 on success, 0 at end of file, -1 on error.
+static int csv_read_record(CsvReader* reader, size_t* out_len) {
+    size_t len = 0;
+    int in_quotes = 0;
+    int got_data = 0;
+
+    while (csv_fill(reader) > 0) {
+        const char* start = reader->buffer + reader->buffer_pos;
+        const char* end = reader->buffer + reader->buffer_len;
+        const char* p = start;
+
+        while (p < end) {
+            if (*p == '"') {
+                in_quotes = !in_quotes;
+            } else if (*p == '\n' && !in_quotes) {
+                break;
+            }
+            p++;
+        }
+
+        got_data = 1;
+        if (csv_append(reader, &len, start, (size_t)(p - start)) != 0) {
+            return -1;
+        }
+        if (p < end) {
+            // Consume the newline and finish the record
+            reader->buffer_pos += (size_t)(p - start) + 1;
+            reader->line_number++;
+            *out_len = len;
+            return 1;
+        }
+        reader->buffer_pos = reader->buffer_len;
+    }
+
+    if (reader->error) {
+        return -1;
+    }
+    if (!got_data) {
+        return 0;
+    }
+    reader->line_number++;
+    *out_len = len;
+    return 1;
+}
+
+// Split the current record into fields in place
+static int csv_split(CsvReader* reader, size_t len) {
+    char* p = reader->line;
+    char* end = reader->line + len;
+
+    // Strip trailing CR
+    while (end > p && (end[-1] == '\r')) {
+        *--end = '\0';
+    }
+
+    reader->n_fields = 0;
+    for (;;) {
+        if (reader->n_fields == reader->max_fields) {
+            int max_fields = reader->max_fields ? reader->max_fields * 2 : CSV_INITIAL_FIELDS;
+            char** fields = realloc(reader->fields, sizeof(char*) * max_fields);
+            if (!fields) {
+                fprintf(stderr, "Error: Out of memory splitting CSV record\n");
+                fflush(stderr);
+                return -1;
+            }
+            reader->fields = fields;
+            reader->max_fields = max_fields;
+        }
+
+        // Skip leading whitespace
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+
+        if (p < end && *p == '"') {
+            // Quoted field: unescape doubled quotes in place
+            char* out = ++p;
+            reader->fields[reader->n_fields++] = out;
+            while (p < end) {
+                if (*p == '"') {
+                    if (p + 1 < end && p[1] == '"') {
+                        *out++ = '"';
+                        p += 2;
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                *out++ = *p++;
+            }
+            // Skip anything between the closing quote and the delimiter
+            while (p < end && *p != ',') p++;
+            *out = '\0';
+        } else {
+            char* start = p;
+            while (p < end && *p != ',') p++;
+            char* field_end = p;
+            while (field_end > start && (field_end[-1] == ' ' || field_end[-1] == '\t')) field_end--;
+            reader->fields[reader->n_fields++] = start;
+            *field_end = '\0';
+        }
+
+        if (p >= end) break;
+        p++;  // Skip delimiter
+    }
+    return 0;
+}
+
+int csv_open(CsvReader* reader, const char* path) {
+    memset(reader, 0, sizeof(*reader));
+    char archive[4096];
+    const char* member;
+    if (zip_split_path(path, NULL, archive, sizeof(archive), &member) == 0) {
+        reader->zip = zip_stream_open(archive, member);
+        reader->fp = reader->zip ? zip_stream_file(reader->zip) : NULL;
+    } else {
+        reader->fp = fopen(path, "rb");
+    }
+    if (!reader->fp) {
+        return -1;
+    }
+    reader->buffer_size = CSV_BUFFER_SIZE;
+    reader->buffer = malloc(reader->buffer_size);
+    if (!reader->buffer) {
+        fprintf(stderr, "Error: Out of memory opening %s\n", path);
+        fflush(stderr);
+        csv_close(reader);
+        return -1;
+    }
+
+    size_t len = 0;
+    if (csv_read_record(reader, &len) != 1) {
+        fprintf(stderr, "Error: Could not read header line of %s\n", path);
+        fflush(stderr);
+        csv_close(reader);
+        return -1;
+    }
+
+    // Skip a UTF-8 BOM
+    if (len >= 3 && (unsigned char)reader->line[0] == 0xEF &&
+        (unsigned char)reader->line[1] == 0xBB && (unsigned char)reader->line[2] == 0xBF) {
+        memmove(reader->line, reader->line + 3, len - 2);
+        len -= 3;
+    }
+
+    if (csv_split(reader, len) != 0) {
+        csv_close(reader);
+        return -1;
+    }
+
+    reader->header = calloc(reader->n_fields, sizeof(char*));
+    if (!reader->header) {
+        csv_close(reader);
+        return -1;
+    }
+    reader->n_columns = reader->n_fields;
+    for (int i = 0; i < reader->n_fields; i++) {
+        reader->header[i] = strdup(reader->fields[i]);
+        if (!reader->header[i]) {
+            csv_close(reader);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int csv_next(CsvReader* reader) {
+    for (;;) {
+        size_t len = 0;
+        int status = csv_read_record(reader, &len);
+        if (status != 1) {
+            return status;
+        }
+        // Skip blank lines
+        size_t i = 0;
+        while (i < len && (reader->line[i] == '\r' || reader->line[i] == ' ')) i++;
+        if (i == len) {
+            continue;
+        }
+        if (csv_split(reader, len) != 0) {
+            return -1;
+        }
+        return 1;
+    }
+}
+
+int csv_column(const CsvReader* reader, const char* name) {
+    for (int i = 0; i < reader->n_columns; i++) {
+        if (strcmp(reader->header[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char* csv_field(const CsvReader* reader, int column) {
+    if (column < 0 || column >= reader->n_fields) {
+        return "";
+    }
+    return reader->fields[column];
+}
+
+void csv_close(CsvReader* reader) {
+    if (reader->zip) {
+        zip_stream_close(reader->zip);
+    } else if (reader->fp) {
+        fclose(reader->fp);
+    }
+    if (reader->header) {
+        for (int i = 0; i < reader->n_columns; i++) {
+            free(reader->header[i]);
+        }
+        free(reader->header);
+    }
+    free(reader->buffer);
+    free(reader->line);
+    free(reader->fields);
+    memset(reader, 0, sizeof(*reader));
+}
+
+int csv_parse_time(const char* value) {
+    int parts[3] = {0, 0, 0};
+    int part = 0;
+    int digits = 0;
+
+    while (*value == ' ') value++;
+    for (const char* p = value; *p; p++) {
+        if (*p >= '0' && *p <= '9') {
+            parts[part] = parts[part] * 10 + (*p - '0');
+            digits++;
+        } else if (*p == ':' && part < 2 && digits > 0) {
+            part++;
+            digits = 0;
+        } else if (*p == ' ') {
+            break;
+        } else {
+            return -1;
+        }
+    }
+    if (part != 2 || digits == 0 || parts[1] > 59 || parts[2] > 59) {
+        return -1;
+    }
+    return parts[0] * 3600 + parts[1] * 60 + parts[2];
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date
+static int days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+int csv_parse_date(const char* value) {
+    int digits[8];
+    int n = 0;
+
+    while (*value == ' ') value++;
+    for (const char* p = value; *p && *p != ' '; p++) {
+        if (*p < '0' || *p > '9' || n == 8) {
+            return INT32_MIN;
+        }
+        digits[n++] = *p - '0';
+    }
+    if (n != 8) {
+        return INT32_MIN;
+    }
+    int year = digits[0] * 1000 + digits[1] * 100 + digits[2] * 10 + digits[3];
+    int month = digits[4] * 10 + digits[5];
+    int day = digits[6] * 10 + digits[7];
+    if (month < 1 || month > 12 || day < 1 || day > 31) {
+        return INT32_MIN;
+    }
+    return days_from_civil(year, month, day);
+}
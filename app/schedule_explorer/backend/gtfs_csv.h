@@ -0,0 +1,55 @@
+#ifndef GTFS_CSV_H
+#define GTFS_CSV_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "gtfs_zip.h"
+
+// Streaming reader for GTFS CSV files.
+// Handles a UTF-8 BOM, CRLF line endings, quoted fields (including
+// doubled quotes and embedded newlines) and columns in any order.
+// Files inside a zip archive ("feed.zip/stops.txt") are read directly.
+typedef struct {
+    FILE* fp;
+    ZipStream* zip;      // Set when reading a member of a zip archive
+    int error;           // The zip member turned out corrupt or truncated
+    char* buffer;        // Raw read buffer
+    size_t buffer_size;
+    size_t buffer_pos;
+    size_t buffer_len;
+    int eof;
+    char* line;          // Current record, fields point into it
+    size_t line_cap;
+    char** fields;
+    int n_fields;
+    int max_fields;
+    char** header;       // Column names (owned copies)
+    int n_columns;
+    long line_number;
+} CsvReader;
+
+// Open a CSV file and read its header. Returns 0 on success, -1 on error
+// or when the file does not exist.
+int csv_open(CsvReader* reader, const char* path);
+
+// Read the next record. Returns 1 if a record was read, 0 at end of file
+// and -1 on error. Blank lines are skipped.
+int csv_next(CsvReader* reader);
+
+// Index of a header column, or -1 if the file has no such column
+int csv_column(const CsvReader* reader, const char* name);
+
+// Field value of the current record, "" when the column is missing
+const char* csv_field(const CsvReader* reader, int column);
+
+void csv_close(CsvReader* reader);
+
+// Parse "H:MM:SS" / "HH:MM:SS" (hours may exceed 24) into seconds.
+// Returns -1 for empty or malformed values.
+int csv_parse_time(const char* value);
+
+// Parse "YYYYMMDD" into days since 1970-01-01. Returns INT32_MIN on error.
+int csv_parse_date(const char* value);
+
+#endif // GTFS_CSV_H
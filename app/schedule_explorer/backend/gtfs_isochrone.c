@@ -0,0 +1,205 @@
+#include "gtfs_timetable_internal.h"
+#include "gtfs_spatial.h"
+#include "gtfs_taskgraph.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+// Isochrones: travel times from an origin to every stop for several
+// departure times, evaluated in parallel with one connection scan per
+// departure, and an optional rasterization onto square or hexagonal cells
+// for display on a map.
+
+#define INF INT32_MAX
+#define METERS_PER_DEGREE 111320.0
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+typedef struct {
+    const GttTimetable* tt;
+    const GttIsochroneQuery* query;
+    int32_t* arrivals;      // n_departures * n_stops
+    uint32_t first;         // This worker evaluates departures first, first + step, ...
+    uint32_t step;
+} IsochroneWorker;
+
+static int run_worker(void* workers, int index) {
+    IsochroneWorker* w = (IsochroneWorker*)workers + index;
+    uint32_t n_stops = w->tt->header.n_stops;
+    for (size_t d = w->first; d < w->query->n_departures; d += w->step) {
+        if (gtt_earliest_arrivals(w->tt, w->query->from_stops, w->query->n_from,
+                                  w->query->day, w->query->departures[d],
+                                  w->query->max_duration, w->arrivals + d * n_stops) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Evaluate every departure, spreading them over up to n_threads threads
+static int run_departures(const GttTimetable* tt, const GttIsochroneQuery* q, int32_t* arrivals) {
+    uint32_t n_threads = q->n_threads ? q->n_threads : 1;
+    if (n_threads > q->n_departures) n_threads = (uint32_t)q->n_departures;
+    if (n_threads == 0) return 0;
+
+    IsochroneWorker* workers = calloc(n_threads, sizeof(IsochroneWorker));
+    if (!workers) {
+        return -1;
+    }
+    for (uint32_t t = 0; t < n_threads; t++) {
+        workers[t].tt = tt;
+        workers[t].query = q;
+        workers[t].arrivals = arrivals;
+        workers[t].first = t;
+        workers[t].step = n_threads;
+    }
+    int result = parallel_for((int)n_threads, run_worker, workers);
+    free(workers);
+    return result;
+}
+
+int gtt_isochrone(const GttTimetable* tt, const GttIsochroneQuery* query, GttStopReach* reach) {
+    uint32_t n_stops = tt->header.n_stops;
+    size_t n_dep = query->n_departures;
+    int32_t* arrivals = malloc(sizeof(int32_t) * (n_dep * n_stops + 1));
+    int32_t* travel = malloc(sizeof(int32_t) * (n_dep + 1));
+    if (!arrivals || !travel || run_departures(tt, query, arrivals) != 0) {
+        fprintf(stderr, "Error: Out of memory computing isochrone\n");
+        fflush(stderr);
+        free(arrivals);
+        free(travel);
+        return -1;
+    }
+
+    int32_t limit = query->max_duration > 0 ? query->max_duration : INF;
+    for (uint32_t s = 0; s < n_stops; s++) {
+        // Travel times of the stop for each departure, sorted (n_dep is small)
+        size_t n_reached = 0;
+        for (size_t d = 0; d < n_dep; d++) {
+            int32_t arrival = arrivals[d * n_stops + s];
+            int32_t t = arrival == INF ? INF : arrival - query->departures[d];
+            if (t > limit) t = INF;
+            if (t != INF) n_reached++;
+            size_t k = d;
+            while (k > 0 && travel[k - 1] > t) {
+                travel[k] = travel[k - 1];
+                k--;
+            }
+            travel[k] = t;
+        }
+        int32_t first = n_dep ? arrivals[s] : INF;
+        if (first != INF && first - query->departures[0] > limit) first = INF;
+        reach[s].first_arrival = first;
+        reach[s].min_travel = n_reached ? travel[0] : INF;
+        // Unreached departures sort last: the median is over the reached ones
+        reach[s].median_travel = n_reached ? travel[n_reached / 2] : INF;
+    }
+    free(arrivals);
+    free(travel);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Rasterization
+// ---------------------------------------------------------------------------
+
+size_t gtt_rasterize(const GttTimetable* tt, const GttStopReach* reach,
+                     int32_t max_time, double cell_m, double walk_radius_m,
+                     int hexagonal, GttCell* out, size_t capacity) {
+    uint32_t n_stops = tt->header.n_stops;
+    if (cell_m <= 0) return 0;
+
+    // Reached stops with a position
+    double* lat = malloc(sizeof(double) * (n_stops + 1));
+    double* lon = malloc(sizeof(double) * (n_stops + 1));
+    int32_t* time = malloc(sizeof(int32_t) * (n_stops + 1));
+    uint32_t* near = NULL;
+    size_t near_cap = 256;
+    size_t total = 0;
+    SpatialGrid grid;
+    memset(&grid, 0, sizeof(grid));
+    if (!lat || !lon || !time) goto done;
+
+    size_t n = 0;
+    double min_lat = 90.0, max_lat = -90.0, min_lon = 180.0, max_lon = -180.0;
+    for (uint32_t s = 0; s < n_stops; s++) {
+        double a = tt->stop_lat[s], o = tt->stop_lon[s];
+        if (reach[s].median_travel > max_time || isnan(a) || isnan(o) || (a == 0.0 && o == 0.0)) {
+            continue;
+        }
+        lat[n] = a;
+        lon[n] = o;
+        time[n] = reach[s].median_travel;
+        if (a < min_lat) min_lat = a;
+        if (a > max_lat) max_lat = a;
+        if (o < min_lon) min_lon = o;
+        if (o > max_lon) max_lon = o;
+        n++;
+    }
+    if (n == 0) goto done;
+    if (spatial_grid_build(&grid, lat, lon, n, walk_radius_m > cell_m ? walk_radius_m : cell_m) != 0) {
+        goto done;
+    }
+    near = malloc(sizeof(uint32_t) * near_cap);
+    if (!near) goto done;
+
+    // Cell sizes in degrees at the middle latitude, covering the walk around
+    // the outermost stops
+    double lon_scale = cos((min_lat + max_lat) / 2.0 * M_PI / 180.0);
+    if (lon_scale < 0.01) lon_scale = 0.01;
+    double pad_lat = walk_radius_m / METERS_PER_DEGREE;
+    double pad_lon = walk_radius_m / (METERS_PER_DEGREE * lon_scale);
+    min_lat -= pad_lat;
+    max_lat += pad_lat;
+    min_lon -= pad_lon;
+    max_lon += pad_lon;
+    double step_lon = cell_m / (METERS_PER_DEGREE * lon_scale);
+    double step_lat = cell_m / METERS_PER_DEGREE;
+    if (hexagonal) step_lat *= sqrt(3.0) / 2.0;
+
+    uint32_t rows = (uint32_t)((max_lat - min_lat) / step_lat) + 1;
+    uint32_t cols = (uint32_t)((max_lon - min_lon) / step_lon) + 1;
+    for (uint32_t r = 0; r < rows; r++) {
+        double clat = min_lat + (r + 0.5) * step_lat;
+        double shift = hexagonal && (r & 1) ? 0.5 : 0.0;
+        for (uint32_t c = 0; c < cols; c++) {
+            double clon = min_lon + (c + 0.5 + shift) * step_lon;
+            size_t found = spatial_grid_within(&grid, lat, lon, clat, clon, walk_radius_m, near, near_cap);
+            if (found > near_cap) {
+                uint32_t* bigger = realloc(near, sizeof(uint32_t) * found);
+                if (!bigger) goto done;
+                near = bigger;
+                near_cap = found;
+                found = spatial_grid_within(&grid, lat, lon, clat, clon, walk_radius_m, near, near_cap);
+            }
+            int32_t best = INF;
+            for (size_t k = 0; k < found; k++) {
+                uint32_t i = near[k];
+                double walk = geo_distance_m(clat, clon, lat[i], lon[i]) / WALKING_SPEED_MPS;
+                int32_t t = time[i] + (int32_t)walk;
+                if (t < best) best = t;
+            }
+            if (best > max_time) continue;
+            if (total < capacity) {
+                out[total].lat = clat;
+                out[total].lon = clon;
+                out[total].travel_time = best;
+                out[total].reserved = 0;
+            }
+            total++;
+        }
+    }
+
+done:
+    spatial_grid_free(&grid);
+    free(near);
+    free(lat);
+    free(lon);
+    free(time);
+    return total;
+}
@@ -1,6 +1,6 @@
 from dataclasses import dataclass, field, asdict
 from datetime import datetime, timedelta
-from typing import List, Optional, Dict, Set, Callable
+from typing import List, Optional, Dict, Set, Callable, Tuple
 import pandas as pd
 from pathlib import Path
 import os
@@ -10,9 +10,11 @@ import msgpack
 import psutil
 import time
 from .memory_util import check_memory_for_file
+from .gtfs_cache import CacheReader, pack_cache, write_cache_data
+from .native_timetable import NativeTimetable, load_native_timetable
+import json
 import subprocess
-from threading import Thread
-from queue import Queue, Empty
+from threading import RLock, Thread
 
 
 def bytes_to_mb(bytes: int, precision: int = 2) -> int:
@@ -467,17 +469,7 @@ class Route:
             # Add the last range
             date_ranges.append([current_range[0], current_range[-1]])
 
-            # Format date ranges
-            formatted_ranges = []
-            for start_date, end_date in date_ranges:
-                if start_date == end_date:
-                    formatted_ranges.append(start_date.strftime("%Y-%m-%d"))
-                else:
-                    formatted_ranges.append(
-                        f"{start_date.strftime('%Y-%m-%d')} to {end_date.strftime('%Y-%m-%d')}"
-                    )
-
-            self.service_calendar = "; ".join(formatted_ranges)
+            self.service_calendar = format_service_calendar(date_ranges)
             # logger.info(
             #     f"Route {self.route_id}: Service calendar: {self.service_calendar}"
             # )
@@ -664,6 +656,8 @@ class FlixbusFeed:
     )  # trip_id -> list of stop times
     agencies: Dict[str, Agency] = field(default_factory=dict)  # agency_id -> Agency
     _feed: Optional["FlixbusFeed"] = field(default=None, repr=False)
+    # Compiled timetable used for fast queries, None when the native library is unavailable
+    native: Optional[NativeTimetable] = field(default=None, repr=False, compare=False)
 
     def __post_init__(self):
         """Set feed reference on all routes"""
@@ -761,6 +755,83 @@ class FlixbusFeed:
             return stop.translations[language]
         return stop.name
 
+    def find_trips_between(
+        self,
+        from_ids: List[str],
+        to_ids: List[str],
+        date: Optional[datetime] = None,
+    ) -> List[Route]:
+        """Find all trips calling at any of from_ids and later at any of to_ids.
+
+        Returns one Route per trip, with stops from the boarding to the alighting
+        stop. When date is given, only trips whose service runs on that weekday
+        are returned. Uses the native timetable when available.
+        """
+        if self.native is None:
+            # Like the native search: board at the first from-stop of a trip
+            # and alight at the next to-stop, so each trip is returned once
+            by_trip = {}
+            for from_id in from_ids:
+                for to_id in to_ids:
+                    for route in self.find_trips_between_stations(from_id, to_id):
+                        key = (
+                            route.stops[0].stop_sequence,
+                            route.stops[-1].stop_sequence,
+                        )
+                        best = by_trip.get(route.trip_id)
+                        if best is None or key < best[0]:
+                            by_trip[route.trip_id] = (key, route)
+            routes = [route for _, route in by_trip.values()]
+            if date:
+                day_name = date.strftime("%A").lower()
+                routes = [r for r in routes if day_name in r.service_days]
+            return routes
+
+        base_routes = {}
+        for route in self.routes:
+            base_routes.setdefault(route.route_id, route)
+
+        routes = []
+        for match in self.native.trips_between(from_ids, to_ids, date):
+            base_route = base_routes.get(match.route_id)
+            if not base_route:
+                continue
+            route_stops = [
+                RouteStop(
+                    stop=self.stops[stop_id],
+                    arrival_time=arrival_time,
+                    departure_time=departure_time,
+                    stop_sequence=sequence,
+                )
+                for (stop_id, arrival_time, departure_time), sequence in zip(
+                    match.stop_times, match.stop_sequences
+                )
+                if stop_id in self.stops
+            ]
+            trip = self.trips.get(match.trip_id)
+            routes.append(
+                Route(
+                    route_id=base_route.route_id,
+                    route_name=base_route.route_name,
+                    trip_id=match.trip_id,
+                    service_days=sorted(match.service_days),
+                    stops=route_stops,
+                    shape=base_route.shape,
+                    short_name=base_route.short_name,
+                    long_name=base_route.long_name,
+                    route_type=base_route.route_type,
+                    color=base_route.color,
+                    text_color=base_route.text_color,
+                    agency_id=base_route.agency_id,
+                    headsigns=base_route.headsigns,
+                    service_ids=[match.service_id],
+                    direction_id=match.direction_id,
+                    trips=[trip] if trip else [],
+                    _feed=self,
+                )
+            )
+        return routes
+
     def find_trips_between_stations(self, start_id: str, end_id: str) -> List[Route]:
         """Find all trips/services between two stations, including duplicates for different times."""
         routes = []
@@ -812,14 +883,11 @@ class FlixbusFeed:
                 if start_pos is None or end_pos is None:
                     continue
 
-                # Check if stops appear in sequence (either direction)
-                if start_pos < end_pos:  # Forward direction
-                    relevant_stops = stop_times[start_pos : end_pos + 1]
-                elif start_pos > end_pos:  # Reverse direction
-                    relevant_stops = stop_times[end_pos : start_pos + 1]
-                    relevant_stops.reverse()  # Reverse to maintain from -> to order
-                else:
-                    continue  # Same stop
+                # Only trips calling at the start before the end, as in the
+                # native search: a reversed trip runs backwards in time
+                if start_pos >= end_pos:
+                    continue
+                relevant_stops = stop_times[start_pos : end_pos + 1]
 
                 # Create RouteStop objects
                 route_stops = [
@@ -1005,13 +1073,74 @@ def process_trip_batch(args):
     return routes
 
 
+def format_service_calendar(ranges: List[Tuple[datetime, datetime]]) -> Optional[str]:
+    """Human-readable list of date ranges, None when there are none."""
+    if not ranges:
+        return None
+    formatted_ranges = []
+    for start_date, end_date in ranges:
+        if start_date == end_date:
+            formatted_ranges.append(start_date.strftime("%Y-%m-%d"))
+        else:
+            formatted_ranges.append(
+                f"{start_date.strftime('%Y-%m-%d')} to {end_date.strftime('%Y-%m-%d')}"
+            )
+    return "; ".join(formatted_ranges)
+
+
+def calculate_service_info_native(routes: List[Route], native) -> None:
+    """Route.calculate_service_info() for every route at once, from the
+    service calendars compiled into the native timetable.
+
+    calendar_dates.txt additions and removals come out sorted by date rather
+    than in file order.
+    """
+    routes = [route for route in routes if route.trips]
+    calendars = native.route_calendars(
+        [({trip.service_id for trip in route.trips}, route.service_ids) for route in routes]
+    )
+    epoch = datetime(1970, 1, 1)
+    dates: Dict[int, datetime] = {}
+
+    def to_dates(days: List[int]) -> List[datetime]:
+        result = []
+        for day in days:
+            value = dates.get(day)
+            if value is None:
+                value = dates[day] = epoch + timedelta(days=day)
+            result.append(value)
+        return result
+
+    for route, calendar in zip(routes, calendars):
+        route.service_days_explicit = sorted(
+            day.capitalize() for day in calendar.calendar_weekdays
+        )
+        route.calendar_dates_additions = to_dates(calendar.additions)
+        route.calendar_dates_removals = to_dates(calendar.removals)
+        route.valid_calendar_days = to_dates(calendar.valid_days)
+        route.service_calendar = format_service_calendar(
+            [(dates[first], dates[last]) for first, last in calendar.ranges]
+        )
+        if route.valid_calendar_days:
+            route.service_days = sorted(calendar.valid_weekdays)
+        else:
+            logger.error(
+                f"Route {route.route_id}: No service_days (no valid calendar days)"
+            )
+        if not route.service_days and route.calendar_dates_additions:
+            route.service_days = sorted(calendar.addition_weekdays)
+
+
 def load_translations(gtfs_dir: str) -> dict[str, dict[str, str]]:
     """Load translations from translations.txt file.
 
-    Handles both translation formats:
-    1. Simple format: trans_id,translation,lang
+    Handles both translation formats, row by row as the native timetable does:
+    1. Simple format: trans_id,translation,lang, where trans_id is the stop name
     2. Table-based format: table_name,field_name,language,translation,record_id[,record_sub_id,field_value]
 
+    Translations of a name apply to every stop with that name; a record_id
+    translates that stop only and overrides them.
+
     Returns a dictionary mapping stop_id to a dictionary of language codes to translations.
     """
     translations_file = os.path.join(gtfs_dir, "translations.txt")
@@ -1019,167 +1148,160 @@ def load_translations(gtfs_dir: str) -> dict[str, dict[str, str]]:
         logger.warning(f"No translations file found at {translations_file}")
         return {}
 
-    # First, determine which format we're dealing with by reading the header
-    with open(translations_file, "r", encoding="utf-8") as f:
-        header = f.readline().strip().split(",")
-
-    # Create a mapping of stop IDs to translations
-    translations = {}
-
-    if "table_name" in header:  # Table-based format
-        logger.info("Using table-based format for translations")
+    # Read as text, so IDs and names compare as written in the files
+    df = pd.read_csv(translations_file, dtype=str, keep_default_na=False)
+    stops_df = pd.read_csv(
+        os.path.join(gtfs_dir, "stops.txt"),
+        usecols=["stop_id", "stop_name"],
+        dtype=str,
+        keep_default_na=False,
+    )
 
-        # Read translations file
-        df = pd.read_csv(translations_file)
+    # (record_id, name, language, translation) of every stop name translation
+    rows = []
+    for row in df.to_dict("records"):
+        if row.get("table_name", ""):
+            if row["table_name"] != "stops" or row.get("field_name", "") != "stop_name":
+                continue
+            record = row.get("record_id", "")
+            name = row.get("field_value", "")
+            language = row.get("language", "")
+        else:
+            record = ""
+            name = row.get("trans_id", "")
+            language = row.get("lang", "")
+        if (not record and not name) or not language:
+            continue
+        rows.append((record, name, language, row.get("translation", "")))
 
-        # Filter for stop name translations only
-        stop_translations = df[
-            (df["table_name"] == "stops") & (df["field_name"] == "stop_name")
-        ]
+    # Some stops might share the same name
+    name_to_ids = {}
+    for stop_id, stop_name in zip(stops_df["stop_id"], stops_df["stop_name"]):
+        name_to_ids.setdefault(stop_name, []).append(stop_id)
+    stop_ids = set(stops_df["stop_id"])
 
-        # Load stops.txt to get the mapping between stop_id and stop_name
-        stops_df = pd.read_csv(os.path.join(gtfs_dir, "stops.txt"))
-
-        # Create a mapping of stop_name to stop_id
-        # Some stops might share the same name, so we need to handle that
-        name_to_ids = {}
-        for _, stop in stops_df.iterrows():
-            stop_name = stop["stop_name"]
-            stop_id = str(stop["stop_id"])
-            if stop_name not in name_to_ids:
-                name_to_ids[stop_name] = []
-            name_to_ids[stop_name].append(stop_id)
-
-        # Process each translation
-        for _, row in stop_translations.iterrows():
-            # Get the original stop name either from record_id or field_value
-            original_name = row.get("field_value", row.get("record_id"))
-            if pd.isna(original_name):
-                continue
+    translations = {}
+    for record, name, language, translation in rows:
+        if not record:
+            for stop_id in name_to_ids.get(name, []):
+                translations.setdefault(stop_id, {})[language] = translation
+    for record, name, language, translation in rows:
+        if record and record in stop_ids:
+            translations.setdefault(record, {})[language] = translation
 
-            # Find all stop IDs that match this name
-            stop_ids = name_to_ids.get(original_name, [])
-            if not stop_ids:
-                continue
+    logger.info(f"Created translations map with {len(translations)} entries")
+    return translations
 
-            # Add translation for each matching stop ID
-            for stop_id in stop_ids:
-                if stop_id not in translations:
-                    translations[stop_id] = {}
-                translations[stop_id][row["language"]] = row["translation"]
 
-    else:  # Simple format (trans_id,translation,lang)
-        logger.info("Using simple format for translations")
+CACHE_VERSION = "4.3.0.0"
 
-        # Read translations file
-        df = pd.read_csv(translations_file)
 
-        # Load stops.txt to get the mapping between stop_id and stop_name
-        stops_df = pd.read_csv(os.path.join(gtfs_dir, "stops.txt"))
+def cache_sections(feed: "FlixbusFeed") -> Dict[str, object]:
+    """Plain-data sections of a feed, as stored in the cache.
 
-        # Create a mapping of stop names to translations
-        name_translations = {}
-        for _, row in df.iterrows():
-            trans_id = row["trans_id"]
-            if trans_id not in name_translations:
-                name_translations[trans_id] = {}
-            name_translations[trans_id][row["lang"]] = row["translation"]
+    Routes refer to stops, trips and shapes by ID so that each section can be
+    loaded on its own (see LazyFlixbusFeed).
+    """
+    # Create a custom dictionary without _feed references
+    data = {
+        "stops": {},
+        "translations": {"names": [], "columns": {}},
+        "agencies": {
+            agency_id: asdict(agency) for agency_id, agency in feed.agencies.items()
+        },
+        "calendars": {cal_id: asdict(cal) for cal_id, cal in feed.calendars.items()},
+        "calendar_dates": [asdict(cal_date) for cal_date in feed.calendar_dates],
+        "shapes": {},
+        "routes": [],
+        "trips": {trip_id: asdict(trip) for trip_id, trip in feed.trips.items()},
+        "stop_times_dict": feed.stop_times_dict,
+    }
 
-        # Map translations to stop IDs
-        for _, stop in stops_df.iterrows():
-            stop_id = str(stop["stop_id"])
-            stop_name = stop["stop_name"]
-            if stop_name in name_translations:
-                translations[stop_id] = name_translations[stop_name]
+    # Translations are stored once per language as a column of indices into
+    # a list of distinct names, aligned with the stops section (-1: none)
+    names = data["translations"]["names"]
+    columns = data["translations"]["columns"]
+    name_index: Dict[str, int] = {}
+    for i, (stop_id, stop) in enumerate(feed.stops.items()):
+        stop_data = asdict(stop)
+        stop_data.pop("translations")
+        data["stops"][stop_id] = stop_data
+        for language, name in (stop.translations or {}).items():
+            if name not in name_index:
+                name_index[name] = len(names)
+                names.append(name)
+            column = columns.setdefault(language, [-1] * len(feed.stops))
+            column[i] = name_index[name]
+
+    # Handle routes separately to avoid _feed recursion
+    for route in feed.routes:
+        if route.shape:
+            data["shapes"][route.shape.shape_id] = route.shape.points
+        route_dict = {
+            "route_id": route.route_id,
+            "route_name": route.route_name,
+            "trip_id": route.trip_id,
+            "service_days": route.service_days,
+            "stops": [
+                {
+                    "stop_id": rs.stop.id,
+                    "arrival_time": rs.arrival_time,
+                    "departure_time": rs.departure_time,
+                    "stop_sequence": rs.stop_sequence,
+                }
+                for rs in route.stops
+            ],
+            "shape_id": route.shape.shape_id if route.shape else None,
+            "short_name": route.short_name,
+            "long_name": route.long_name,
+            "route_type": route.route_type,
+            "color": route.color,
+            "text_color": route.text_color,
+            "agency_id": route.agency_id,
+            "headsigns": route.headsigns,
+            "service_ids": route.service_ids,
+            "direction_id": route.direction_id,
+            "route_desc": route.route_desc,
+            "route_url": route.route_url,
+            "route_sort_order": route.route_sort_order,
+            "continuous_pickup": route.continuous_pickup,
+            "continuous_drop_off": route.continuous_drop_off,
+            "trip_ids": [trip.id for trip in route.trips],  # Store only trip IDs
+            # Add service calendar fields
+            "service_days_explicit": route.service_days_explicit,
+            "calendar_dates_additions": [
+                d.isoformat() for d in route.calendar_dates_additions
+            ],
+            "calendar_dates_removals": [
+                d.isoformat() for d in route.calendar_dates_removals
+            ],
+            "valid_calendar_days": [d.isoformat() for d in route.valid_calendar_days],
+            "service_calendar": route.service_calendar,
+        }
+        data["routes"].append(route_dict)
 
-    logger.info(f"Created translations map with {len(translations)} entries")
-    return translations
+    # Convert datetime objects to ISO format strings
+    for calendar in data["calendars"].values():
+        calendar["start_date"] = calendar["start_date"].isoformat()
+        calendar["end_date"] = calendar["end_date"].isoformat()
 
+    for cal_date in data["calendar_dates"]:
+        cal_date["date"] = cal_date["date"].isoformat()
 
-CACHE_VERSION = "4.0.0.1"
+    return data
 
 
 def serialize_gtfs_data(feed: "FlixbusFeed") -> bytes:
-    """Serialize GTFS feed data using msgpack."""
+    """Serialize GTFS feed data into the block-compressed cache format."""
     try:
         logger.info("Starting GTFS feed serialization")
         t00 = time.time()
-        # Create a custom dictionary without _feed references
-        data = {
-            "stops": {stop_id: asdict(stop) for stop_id, stop in feed.stops.items()},
-            "routes": [],
-            "calendars": {
-                cal_id: asdict(cal) for cal_id, cal in feed.calendars.items()
-            },
-            "calendar_dates": [asdict(cal_date) for cal_date in feed.calendar_dates],
-            "trips": {trip_id: asdict(trip) for trip_id, trip in feed.trips.items()},
-            "stop_times_dict": feed.stop_times_dict,
-            "agencies": {
-                agency_id: asdict(agency) for agency_id, agency in feed.agencies.items()
-            },
-        }
-
-        # Handle routes separately to avoid _feed recursion
-        for route in feed.routes:
-            route_dict = {
-                "route_id": route.route_id,
-                "route_name": route.route_name,
-                "trip_id": route.trip_id,
-                "service_days": route.service_days,
-                "stops": [
-                    {
-                        "stop": asdict(rs.stop),
-                        "arrival_time": rs.arrival_time,
-                        "departure_time": rs.departure_time,
-                        "stop_sequence": rs.stop_sequence,
-                    }
-                    for rs in route.stops
-                ],
-                "shape": asdict(route.shape) if route.shape else None,
-                "short_name": route.short_name,
-                "long_name": route.long_name,
-                "route_type": route.route_type,
-                "color": route.color,
-                "text_color": route.text_color,
-                "agency_id": route.agency_id,
-                "headsigns": route.headsigns,
-                "service_ids": route.service_ids,
-                "direction_id": route.direction_id,
-                "route_desc": route.route_desc,
-                "route_url": route.route_url,
-                "route_sort_order": route.route_sort_order,
-                "continuous_pickup": route.continuous_pickup,
-                "continuous_drop_off": route.continuous_drop_off,
-                "trip_ids": [trip.id for trip in route.trips],  # Store only trip IDs
-                # Add service calendar fields
-                "service_days_explicit": route.service_days_explicit,
-                "calendar_dates_additions": [
-                    d.isoformat() for d in route.calendar_dates_additions
-                ],
-                "calendar_dates_removals": [
-                    d.isoformat() for d in route.calendar_dates_removals
-                ],
-                "valid_calendar_days": [
-                    d.isoformat() for d in route.valid_calendar_days
-                ],
-                "service_calendar": route.service_calendar,
-            }
-            data["routes"].append(route_dict)
-
-        # Convert datetime objects to ISO format strings
-        if "calendars" in data:
-            for calendar in data["calendars"].values():
-                calendar["start_date"] = calendar["start_date"].isoformat()
-                calendar["end_date"] = calendar["end_date"].isoformat()
+        data = cache_sections(feed)
 
-        if "calendar_dates" in data:
-            for cal_date in data["calendar_dates"]:
-                cal_date["date"] = cal_date["date"].isoformat()
-
-        # Pack with msgpack
+        # Pack each section with msgpack and compress its blocks
         logger.info("Packing data with msgpack")
         t0 = time.time()
-        packed_data = msgpack.packb(data, use_bin_type=True)
+        packed_data = pack_cache(data)
         logger.info(
             f"Packed data size: {bytes_to_mb(len(packed_data))} MB in {time.time() - t0:.2f}s"
         )
@@ -1194,120 +1316,207 @@ def serialize_gtfs_data(feed: "FlixbusFeed") -> bytes:
         raise
 
 
-def deserialize_gtfs_data(data: bytes) -> "FlixbusFeed":
-    """Deserialize GTFS feed data from msgpack."""
-    try:
-        start_time = time.time()
-        logger.info("Starting GTFS feed deserialization")
+def _load_stops(feed: "LazyFlixbusFeed") -> Dict[str, Stop]:
+    stops = {
+        stop_id: Stop(**stop_data)
+        for stop_id, stop_data in feed._cache.section("stops").items()
+    }
+    if "translations" not in feed._cache:
+        return stops
+    translations = feed._cache.section("translations")
+    names = translations["names"]
+    languages = list(translations["columns"].keys())
+    columns = list(translations["columns"].values())
+    # Stops with the same translations share one dictionary
+    shared: Dict[Tuple[int, ...], Dict[str, str]] = {}
+    for i, stop in enumerate(stops.values()):
+        indices = tuple(column[i] for column in columns)
+        if not any(index >= 0 for index in indices):
+            continue
+        stop_translations = shared.get(indices)
+        if stop_translations is None:
+            stop_translations = {
+                language: names[index]
+                for language, index in zip(languages, indices)
+                if index >= 0
+            }
+            shared[indices] = stop_translations
+        stop.translations = stop_translations
+    return stops
 
-        # Unpack with msgpack
-        logger.info("Unpacking data with msgpack")
-        t0 = time.time()
-        raw_data = msgpack.unpackb(data, raw=False)
-        logger.info(f"Msgpack unpacking took {time.time() - t0:.2f} seconds")
 
-        # Convert back to objects
-        logger.info("Converting back to objects")
-        t0 = time.time()
+def _load_agencies(feed: "LazyFlixbusFeed") -> Dict[str, Agency]:
+    if "agencies" not in feed._cache:
+        return {}
+    return {
+        agency_id: Agency(**agency_data)
+        for agency_id, agency_data in feed._cache.section("agencies").items()
+    }
 
-        # Convert stops
-        stops = {}
-        for stop_id, stop_data in raw_data["stops"].items():
-            stops[stop_id] = Stop(**stop_data)
 
-        # Convert calendars
-        calendars = {}
-        if "calendars" in raw_data:
-            for cal_id, cal_data in raw_data["calendars"].items():
-                cal_data["start_date"] = datetime.fromisoformat(cal_data["start_date"])
-                cal_data["end_date"] = datetime.fromisoformat(cal_data["end_date"])
-                calendars[cal_id] = Calendar(**cal_data)
+def _load_calendars(feed: "LazyFlixbusFeed") -> Dict[str, Calendar]:
+    calendars = {}
+    if "calendars" in feed._cache:
+        for cal_id, cal_data in feed._cache.section("calendars").items():
+            cal_data["start_date"] = datetime.fromisoformat(cal_data["start_date"])
+            cal_data["end_date"] = datetime.fromisoformat(cal_data["end_date"])
+            calendars[cal_id] = Calendar(**cal_data)
+    return calendars
 
-        # Convert calendar dates
-        calendar_dates = []
-        if "calendar_dates" in raw_data:
-            for cal_date in raw_data["calendar_dates"]:
-                cal_date["date"] = datetime.fromisoformat(cal_date["date"])
-                calendar_dates.append(CalendarDate(**cal_date))
-
-        # Convert trips
-        trips = {}
-        if "trips" in raw_data:
-            for trip_id, trip_data in raw_data["trips"].items():
-                # Convert stop times
-                stop_times = []
-                for stop_time_data in trip_data.get("stop_times", []):
-                    stop_time_data["trip_id"] = trip_id  # Add trip_id to the data
-                    stop_times.append(StopTime(**stop_time_data))
-                trip_data["stop_times"] = stop_times
-                trips[trip_id] = Trip(**trip_data)
-
-        # Convert agencies
-        agencies = {}
-        if "agencies" in raw_data:
-            for agency_id, agency_data in raw_data["agencies"].items():
-                agencies[agency_id] = Agency(**agency_data)
-
-        # Convert routes
-        routes = []
-        for route_data in raw_data["routes"]:
-            # Convert route stops
-            route_stops = [
-                RouteStop(
-                    stop=stops[stop_data["stop"]["id"]],
-                    arrival_time=stop_data["arrival_time"],
-                    departure_time=stop_data["departure_time"],
-                    stop_sequence=stop_data["stop_sequence"],
+
+def _load_calendar_dates(feed: "LazyFlixbusFeed") -> List[CalendarDate]:
+    calendar_dates = []
+    if "calendar_dates" in feed._cache:
+        for cal_date in feed._cache.section("calendar_dates"):
+            cal_date["date"] = datetime.fromisoformat(cal_date["date"])
+            calendar_dates.append(CalendarDate(**cal_date))
+    return calendar_dates
+
+
+def _load_trips(feed: "LazyFlixbusFeed") -> Dict[str, Trip]:
+    trips = {}
+    if "trips" in feed._cache:
+        for trip_id, trip_data in feed._cache.section("trips").items():
+            # Convert stop times
+            stop_times = []
+            for stop_time_data in trip_data.get("stop_times", []):
+                stop_time_data["trip_id"] = trip_id  # Add trip_id to the data
+                stop_times.append(StopTime(**stop_time_data))
+            trip_data["stop_times"] = stop_times
+            trips[trip_id] = Trip(**trip_data)
+    return trips
+
+
+def _load_stop_times_dict(feed: "LazyFlixbusFeed") -> Dict[str, List[Dict]]:
+    if "stop_times_dict" not in feed._cache:
+        return {}
+    return feed._cache.section("stop_times_dict")
+
+
+def _load_routes(feed: "LazyFlixbusFeed") -> List["Route"]:
+    # Routes point into the stops, trips and shapes sections, which are
+    # loaded first
+    stops = feed.stops
+    trips = feed.trips
+    shapes = feed._cache.section("shapes") if "shapes" in feed._cache else {}
+
+    routes = []
+    for route_data in feed._cache.section("routes"):
+        # Convert route stops
+        route_data["stops"] = [
+            RouteStop(
+                stop=stops[stop_data["stop_id"]],
+                arrival_time=stop_data["arrival_time"],
+                departure_time=stop_data["departure_time"],
+                stop_sequence=stop_data["stop_sequence"],
+            )
+            for stop_data in route_data["stops"]
+        ]
+
+        # Convert shape if present
+        shape_id = route_data.pop("shape_id", None)
+        if shape_id is not None and shape_id in shapes:
+            route_data["shape"] = Shape(shape_id=shape_id, points=shapes[shape_id])
+
+        # Add trips to route
+        route_data["trips"] = [
+            trips[trip_id] for trip_id in route_data.pop("trip_ids", []) if trip_id in trips
+        ]
+
+        # Convert datetime fields back from ISO format
+        for key in (
+            "calendar_dates_additions",
+            "calendar_dates_removals",
+            "valid_calendar_days",
+        ):
+            if key in route_data:
+                route_data[key] = [datetime.fromisoformat(d) for d in route_data[key]]
+
+        route = Route(**route_data)
+        route._feed = feed
+        routes.append(route)
+    return routes
+
+
+class LazyFlixbusFeed(FlixbusFeed):
+    """A feed backed by a cache file, whose sections are decoded on first access.
+
+    Only the section directory is read when the feed is created. Each field
+    (stops, routes, trips, ...) is loaded the first time it is used and then
+    stored as a plain attribute, so later accesses cost nothing. Switching to
+    a provider therefore only pays for the sections its requests touch: the
+    stop map and station search need the stops section alone.
+    """
+
+    # Field -> function building it from the cache
+    SECTIONS = {
+        "stops": _load_stops,
+        "agencies": _load_agencies,
+        "calendars": _load_calendars,
+        "calendar_dates": _load_calendar_dates,
+        "trips": _load_trips,
+        "stop_times_dict": _load_stop_times_dict,
+        "routes": _load_routes,
+    }
+
+    def __init__(self, cache: CacheReader):
+        # The dataclass __init__ is skipped on purpose: fields stay unset
+        # until __getattr__ loads them
+        self._cache = cache
+        self._lock = RLock()
+        # Growth of the process while each section was decoded
+        self.section_bytes: Dict[str, int] = {}
+        self._feed = None
+        self.native = None
+
+    def __getattr__(self, name: str):
+        loader = LazyFlixbusFeed.SECTIONS.get(name)
+        if loader is None:
+            raise AttributeError(
+                f"'{type(self).__name__}' object has no attribute '{name}'"
+            )
+        with self._lock:
+            if name not in self.__dict__:
+                t0 = time.time()
+                process = psutil.Process()
+                rss0 = process.memory_info().rss
+                self.__dict__[name] = loader(self)
+                self.section_bytes[name] = max(0, process.memory_info().rss - rss0)
+                logger.info(
+                    f"Loaded cache section {name} in {time.time() - t0:.2f} seconds "
+                    f"(+{bytes_to_mb(self.section_bytes[name])} MB)"
                 )
-                for stop_data in route_data["stops"]
-            ]
-            route_data["stops"] = route_stops
-
-            # Convert shape if present
-            if route_data.get("shape"):
-                route_data["shape"] = Shape(**route_data["shape"])
-
-            # Add trips to route
-            route_trips = []
-            for trip_id in route_data.get("trip_ids", []):
-                if trip_id in trips:
-                    route_trips.append(trips[trip_id])
-            route_data["trips"] = route_trips
-
-            # Remove trip_ids as it's not a field in the Route class
-            route_data.pop("trip_ids", None)
-
-            # Convert datetime fields back from ISO format
-            if "calendar_dates_additions" in route_data:
-                route_data["calendar_dates_additions"] = [
-                    datetime.fromisoformat(d)
-                    for d in route_data["calendar_dates_additions"]
-                ]
-            if "calendar_dates_removals" in route_data:
-                route_data["calendar_dates_removals"] = [
-                    datetime.fromisoformat(d)
-                    for d in route_data["calendar_dates_removals"]
-                ]
-            if "valid_calendar_days" in route_data:
-                route_data["valid_calendar_days"] = [
-                    datetime.fromisoformat(d) for d in route_data["valid_calendar_days"]
-                ]
+                if all(section in self.__dict__ for section in LazyFlixbusFeed.SECTIONS):
+                    # Everything is decoded: release the mapping
+                    self._cache.close()
+        return self.__dict__[name]
+
+    def loaded_sections(self) -> List[str]:
+        return [name for name in LazyFlixbusFeed.SECTIONS if name in self.__dict__]
+
+    def resident_bytes(self) -> int:
+        """Estimated memory held: decoded sections plus the mapped cache file."""
+        mapped = 0 if self._cache.closed else self._cache.size
+        return sum(self.section_bytes.values()) + mapped
+
+    def load_all(self) -> None:
+        for name in LazyFlixbusFeed.SECTIONS:
+            getattr(self, name)
 
-            routes.append(Route(**route_data))
-
-        # Create feed instance
-        feed = FlixbusFeed(
-            stops=stops,
-            routes=routes,
-            calendars=calendars,
-            calendar_dates=calendar_dates,
-            trips=trips,
-            stop_times_dict=raw_data["stop_times_dict"],
-            agencies=agencies,
-        )
 
+def deserialize_gtfs_data(cache_file: Path) -> "FlixbusFeed":
+    """Open a cache file as a feed whose sections load on demand.
+
+    The stops section is decoded right away; everything else is decoded on
+    first access.
+    """
+    try:
+        start_time = time.time()
+        logger.info("Starting GTFS feed deserialization")
+        feed = LazyFlixbusFeed(CacheReader(cache_file))
+        feed.stops
         logger.info(
-            f"Deserialization completed in {time.time() - start_time:.2f} seconds"
+            f"Deserialization of the stops section completed in {time.time() - start_time:.2f} seconds"
         )
         return feed
     except Exception as e:
@@ -1315,11 +1524,72 @@ def deserialize_gtfs_data(data: bytes) -> "FlixbusFeed":
         raise
 
 
-def load_stop_times(data_path: Path, cpu_check_fn=None) -> Dict[str, List[Dict]]:
+def handle_precache_output(line: str, progress_fn: Optional[Callable[[Dict], None]] = None) -> None:
+    """Handle one stdout line of gtfs_precache --progress=json.
+
+    Lines starting with "{" are JSON events: "phase" when a phase starts,
+    "progress" once a second, "pipeline" with the utilization of each stage
+    of a threaded conversion, "stats" with --stats and "done" at exit, each carrying phase, rows,
+    total_rows, bytes, total_bytes, rows_per_s, rss_bytes, cpu_percent,
+    elapsed_s and eta_s (null when unknown). Events go to progress_fn; any
+    other line is a human-readable message and is logged.
+    """
+    line = line.strip()
+    if not line:
+        return
+    if line.startswith("{"):
+        try:
+            event = json.loads(line)
+        except ValueError:
+            logger.info(f"gtfs_precache output: {line}")
+            return
+        if event.get("event") == "phase":
+            logger.info(f"gtfs_precache phase: {event.get('phase')}")
+        elif event.get("event") == "pipeline":
+            logger.info(f"gtfs_precache pipeline bottleneck: {event.get('bottleneck')}")
+        else:
+            logger.debug(f"gtfs_precache {event.get('event')}: {event}")
+        if progress_fn:
+            progress_fn(event)
+        return
+    logger.info(f"gtfs_precache output: {line}")
+
+
+# Output of gtfs_precache kept next to the GTFS files. It is grouped by trip
+# and indexed (.stop_times.msgpack.index), so the next conversion only
+# repacks the trips that changed.
+STOP_TIMES_CACHE = ".stop_times.msgpack"
+
+
+def find_previous_stop_times(data_path: Path) -> Optional[Path]:
+    """Converted stop times to reuse unchanged trips from.
+
+    That is the output kept in data_path itself, or else the newest one of a
+    sibling directory (an earlier dataset of the same provider).
+    """
+    own = data_path / STOP_TIMES_CACHE
+    if own.exists() and own.with_name(STOP_TIMES_CACHE + ".index").exists():
+        return own
+    candidates = []
+    for sibling in data_path.parent.glob(f"*/{STOP_TIMES_CACHE}"):
+        if sibling.parent == data_path or not sibling.with_name(STOP_TIMES_CACHE + ".index").exists():
+            continue
+        candidates.append((sibling.stat().st_mtime, sibling))
+    return max(candidates)[1] if candidates else None
+
+
+def load_stop_times(
+    data_path: Path,
+    cpu_check_fn=None,
+    cpu_limit: Optional[int] = None,
+    progress_fn: Optional[Callable[[Dict], None]] = None,
+) -> Dict[str, List[Dict]]:
     """
     Load stop times from stop_times.txt using the C implementation.
     Falls back to Python implementation if C implementation fails.
     Returns a dictionary mapping trip_id to a list of stop times.
+    cpu_limit caps the C implementation's CPU use, in percent of one core.
+    progress_fn receives its progress events (see handle_precache_output).
     """
     txt_path = data_path / "stop_times.txt"
     if not txt_path.exists():
@@ -1338,23 +1608,22 @@ def load_stop_times(data_path: Path, cpu_check_fn=None) -> Dict[str, List[Dict]]
     # Try C implementation first if available
     if gtfs_precache.exists():
         try:
-            # Create a temporary file for the msgpack output
-            temp_msgpack_path = txt_path.with_suffix('.msgpack.tmp')
-            logger.debug(f"Temporary msgpack path: {temp_msgpack_path}")
+            # The output is kept for the next conversion (see STOP_TIMES_CACHE)
+            msgpack_path = data_path / STOP_TIMES_CACHE
+            previous = find_previous_stop_times(data_path)
+            logger.debug(f"msgpack path: {msgpack_path}, previous: {previous}")
             
             try:
-                # Clean up any existing tmp file
-                if temp_msgpack_path.exists():
-                    try:
-                        temp_msgpack_path.unlink()
-                        logger.debug("Cleaned up existing temporary file")
-                    except Exception as e:
-                        logger.warning(f"Failed to clean up existing temporary file: {e}")
-                
                 # Run the C program to convert to msgpack
                 logger.info("Running C program to convert stop_times.txt...")
                 import subprocess
-                cmd = [str(gtfs_precache), str(txt_path), str(temp_msgpack_path)]
+                cmd = [str(gtfs_precache), str(txt_path), str(msgpack_path), "--progress=json"]
+                if previous is not None:
+                    cmd.append(f"--incremental={previous}")
+                else:
+                    cmd.append("--incremental")
+                if cpu_limit is not None:
+                    cmd.append(str(max(1, min(100, int(cpu_limit)))))
                 logger.debug(f"Running command: {' '.join(cmd)}")
                 
                 # First check the version
@@ -1372,87 +1641,48 @@ def load_stop_times(data_path: Path, cpu_check_fn=None) -> Dict[str, List[Dict]]
                 except Exception as e:
                     logger.error(f"Version check failed: {e}")
                 
-                # Now run the actual conversion
-                # Use Popen with threads to handle output
-                def enqueue_output(out, queue):
-                    for line in iter(out.readline, ''):
-                        queue.put(line)
-                    out.close()
-                
+                # Now run the actual conversion. Progress arrives on stdout as
+                # JSON events (one per line, see handle_precache_output);
+                # stderr is drained by a thread so neither pipe can fill up.
                 process = subprocess.Popen(
                     cmd,
                     stdout=subprocess.PIPE,
                     stderr=subprocess.PIPE,
                     text=True,
                     bufsize=1,  # Line buffered
-                    universal_newlines=True
                 )
-                
-                # Create queues and threads for stdout and stderr
-                stdout_q = Queue()
-                stderr_q = Queue()
-                stdout_t = Thread(target=enqueue_output, args=(process.stdout, stdout_q))
-                stderr_t = Thread(target=enqueue_output, args=(process.stderr, stderr_q))
-                stdout_t.daemon = True
-                stderr_t.daemon = True
-                stdout_t.start()
+
+                def log_stderr(stream):
+                    for line in iter(stream.readline, ''):
+                        logger.warning(f"gtfs_precache stderr: {line.strip()}")
+                    stream.close()
+
+                stderr_t = Thread(target=log_stderr, args=(process.stderr,), daemon=True)
                 stderr_t.start()
-                
-                # Read output from both streams
-                while process.poll() is None:
-                    # Check stdout
-                    try:
-                        while True:  # Read all available stdout lines
-                            line = stdout_q.get_nowait()
-                            logger.info(f"gtfs_precache output: {line.strip()}")
-                    except Empty:
-                        pass
-                        
-                    # Check stderr
-                    try:
-                        while True:  # Read all available stderr lines
-                            line = stderr_q.get_nowait()
-                            logger.warning(f"gtfs_precache stderr: {line.strip()}")
-                    except Empty:
-                        pass
-                        
-                    time.sleep(0.1)  # Short sleep to prevent busy waiting
-                
-                # Get the return code
+                for line in iter(process.stdout.readline, ''):
+                    handle_precache_output(line, progress_fn)
+                process.stdout.close()
+
                 return_code = process.wait()
-                
-                # Read any remaining output
-                try:
-                    while True:
-                        line = stdout_q.get_nowait()
-                        logger.info(f"gtfs_precache output: {line.strip()}")
-                except Empty:
-                    pass
-                    
-                try:
-                    while True:
-                        line = stderr_q.get_nowait()
-                        logger.warning(f"gtfs_precache stderr: {line.strip()}")
-                except Empty:
-                    pass
-                
+                stderr_t.join(timeout=5)
+
                 if return_code != 0:
                     logger.error(f"C program failed with return code {return_code}")
                     raise RuntimeError("Failed to convert stop_times.txt")
                 
                 # Load the msgpack data
                 logger.info("Loading msgpack data...")
-                if not temp_msgpack_path.exists():
-                    logger.error("Temporary msgpack file was not created")
-                    raise RuntimeError("Temporary msgpack file was not created")
+                if not msgpack_path.exists():
+                    logger.error("msgpack file was not created")
+                    raise RuntimeError("msgpack file was not created")
                     
-                file_size = temp_msgpack_path.stat().st_size
-                logger.debug(f"Temporary msgpack file size: {file_size} bytes")
+                file_size = msgpack_path.stat().st_size
+                logger.debug(f"msgpack file size: {file_size} bytes")
                 if file_size == 0:
-                    logger.error("Temporary msgpack file is empty")
-                    raise RuntimeError("Temporary msgpack file is empty")
+                    logger.error("msgpack file is empty")
+                    raise RuntimeError("msgpack file is empty")
                     
-                with open(temp_msgpack_path, 'rb') as f:
+                with open(msgpack_path, 'rb') as f:
                     data = msgpack.unpackb(f.read(), raw=False)
                 
                 # Verify data structure
@@ -1491,15 +1721,14 @@ def load_stop_times(data_path: Path, cpu_check_fn=None) -> Dict[str, List[Dict]]
                 logger.info(f"Successfully loaded {len(stop_times)} stop times for {len(result)} trips using C implementation")
                 return result
             
-            finally:
-                # Clean up temporary file
-                if temp_msgpack_path.exists():
+            except Exception:
+                # Do not reuse trips from an output that could not be read
+                for path in (msgpack_path, msgpack_path.with_name(STOP_TIMES_CACHE + ".index")):
                     try:
-                        temp_msgpack_path.unlink()
-                        logger.debug("Cleaned up temporary file")
+                        path.unlink(missing_ok=True)
                     except Exception as e:
-                        logger.error(f"Failed to clean up temporary file: {e}")
-                        pass
+                        logger.error(f"Failed to remove {path}: {e}")
+                raise
         except Exception as e:
             logger.warning(f"C implementation failed, falling back to Python: {e}")
             # Fall through to Python implementation
@@ -1562,7 +1791,9 @@ def load_stop_times(data_path: Path, cpu_check_fn=None) -> Dict[str, List[Dict]]
 def load_feed(
     data_dir: str | Path = None, 
     target_stops: Set[str] = None,
-    cpu_check_fn: Optional[Callable] = None
+    cpu_check_fn: Optional[Callable] = None,
+    cpu_limit: Optional[int] = None,
+    progress_fn: Optional[Callable[[Dict], None]] = None
 ) -> FlixbusFeed:
     """
     Load GTFS feed from the specified directory.
@@ -1572,6 +1803,8 @@ def load_feed(
         data_dir: Path to the GTFS data directory. Can be either a string or Path object.
         target_stops: Optional set of stop IDs to filter routes by.
         cpu_check_fn: Optional function to check CPU usage and throttle if needed
+        cpu_limit: Optional CPU limit for the C stop_times converter, in percent of one core
+        progress_fn: Optional callback receiving the C converter's progress events
         
     Returns:
         GTFSFeed object containing the loaded GTFS data.
@@ -1601,8 +1834,9 @@ def load_feed(
         if stored_hash == current_hash:
             logger.info(f"Loading from cache... {current_hash}")
             try:
-                with open(cache_file, "rb") as f:
-                    return deserialize_gtfs_data(f.read())
+                feed = deserialize_gtfs_data(cache_file)
+                feed.native = load_native_timetable(data_path, current_hash)
+                return feed
             except Exception as e:
                 logger.warning(f"Failed to load cache: {e}")
                 # Delete corrupted cache files
@@ -1612,6 +1846,18 @@ def load_feed(
                 except:
                     pass
 
+    # The native library reads the GTFS files on its own threads and
+    # releases the GIL meanwhile: compile the timetable while the tables
+    # below are read
+    native_result = {}
+    native_thread = Thread(
+        target=lambda: native_result.update(
+            timetable=load_native_timetable(data_path, current_hash)
+        ),
+        daemon=True,
+    )
+    native_thread.start()
+
     # Load agencies first
     t0 = time.time()
     logger.info("Loading agencies...")
@@ -1674,11 +1920,6 @@ def load_feed(
     )
     logger.info(f"Using chunk size of {optimal_chunk_size} based on available memory")
 
-    # Load translations first
-    t0 = time.time()
-    translations = load_translations(data_path)
-    logger.info(f"Loaded translations in {time.time() - t0:.2f} seconds")
-
     # Load stops
     t0 = time.time()
     logger.info("Loading stops...")
@@ -1694,7 +1935,6 @@ def load_feed(
                 name=row["stop_name"],
                 lat=row["stop_lat"],
                 lon=row["stop_lon"],
-                translations=translations.get(str(row["stop_id"]), {}),
             )
             stops[stop.id] = stop
             # if stop.translations:
@@ -1818,7 +2058,7 @@ def load_feed(
     )
 
     # Load stop times
-    stop_times_dict = load_stop_times(data_path, cpu_check_fn)
+    stop_times_dict = load_stop_times(data_path, cpu_check_fn, cpu_limit, progress_fn)
 
     # Try to load calendar.txt first, fall back to calendar_dates.txt
     t0 = time.time()
@@ -2088,22 +2328,46 @@ def load_feed(
     )
     logger.info(f"Created feed object in {time.time() - t0:.2f} seconds")
 
+    t0 = time.time()
+    native_thread.join()
+    feed.native = native_result.get("timetable")
+    logger.info(f"Waited {time.time() - t0:.2f} seconds for the native timetable")
+
     # Calculate service info for all routes
     t0 = time.time()
     logger.info("Calculating service info for all routes...")
-    for route in feed.routes:
-        route.calculate_service_info()
+    if feed.native is not None:
+        calculate_service_info_native(feed.routes, feed.native)
+    else:
+        for route in feed.routes:
+            route.calculate_service_info()
     logger.info(
         f"Calculated service info for {len(feed.routes)} routes in {time.time() - t0:.2f} seconds"
     )
 
+    # Stop name translations come with the native timetable; stops with the
+    # same translations share one dictionary
+    t0 = time.time()
+    if feed.native is not None:
+        translations = feed.native.stop_translations()
+    else:
+        translations = load_translations(data_path)
+    for stop_id, stop_translations in translations.items():
+        stop = stops.get(stop_id)
+        if stop is not None:
+            stop.translations = stop_translations
+    logger.info(
+        f"Applied translations to {len(translations)} stops in {time.time() - t0:.2f} seconds"
+    )
+
     # Save to cache
     t0 = time.time()
     logger.info(f"Saving to cache... with hash {current_hash}")
     try:
         serialized_data = serialize_gtfs_data(feed)
-        with open(cache_file, "wb") as f:
-            f.write(serialized_data)
+        # Replace rather than overwrite: a running server may have the
+        # previous cache mapped
+        write_cache_data(cache_file, serialized_data)
         hash_file.write_text(current_hash)
     except Exception as e:
         logger.warning(f"Failed to save cache: {e}")
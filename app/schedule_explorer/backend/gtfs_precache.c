@@ -5,6 +5,9 @@
 #include <msgpack.h>
 #include <sys/stat.h>
 #include "gtfs_precache_version.h"
+#include "gtfs_timetable.h"
+#include "gtfs_arena.h"
+#include "gtfs_zip.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -15,38 +18,152 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <limits.h>
+#include <pthread.h>
+#include <sched.h>
 #ifdef __linux__
 #include <sys/sysinfo.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <errno.h>
 #endif
 #endif
 
+// Progress counters are written by the worker and sampled by the reporter
+// thread; relaxed atomic stores compile to plain stores
+#ifdef _MSC_VER
+typedef volatile size_t ProgressCounter;
+#define PROGRESS_STORE(counter, value) ((counter) = (value))
+#define PROGRESS_LOAD(counter) (counter)
+#else
+#include <stdatomic.h>
+typedef _Atomic size_t ProgressCounter;
+#define PROGRESS_STORE(counter, value) atomic_store_explicit(&(counter), (value), memory_order_relaxed)
+#define PROGRESS_LOAD(counter) atomic_load_explicit(&(counter), memory_order_relaxed)
+#endif
+
+// Keep an event printed in several calls on one line when batch jobs report
+// at the same time
+#ifdef _WIN32
+#define STDOUT_LOCK() _lock_file(stdout)
+#define STDOUT_UNLOCK() _unlock_file(stdout)
+#else
+#define STDOUT_LOCK() flockfile(stdout)
+#define STDOUT_UNLOCK() funlockfile(stdout)
+#endif
+
 #define MAX_LINE_LENGTH 1024
+#define MAX_FIELDS 32  // Columns read from a stop_times line
 #define BATCH_SIZE 10000  // Process 10k rows at a time
-#define PROGRESS_INTERVAL 1000  // Show progress every 1k rows
-#define DEFAULT_CPU_LIMIT 50  // Default CPU limit in percentage
+#define PROGRESS_INTERVAL_MS 1000  // Report progress every second
+#define DEFAULT_CPU_LIMIT 100  // Default CPU limit in percentage of one core (no throttling)
+#define CPU_BURST 0.2  // CPU seconds a throttled run may use ahead of its budget
+
+// Token-bucket CPU throttle. CPU time is credited at `limit` percent of the
+// wall clock, up to CPU_BURST seconds ahead, and each check pays for the CPU
+// the process used since the previous one; a caller in debt sleeps until the
+// bucket is back at zero. The state lives in the struct and is locked, so
+// several threads can share one throttle (CPU time is measured per process).
+typedef struct {
+    int limit;              // Percent of one core
+    int unlimited;          // Never sleeps: a limit of 100 or more, or of every core in batch mode
+    double tokens;          // CPU seconds that may still be used
+    double start_wall;
+    double start_cpu;
+    double last_wall;
+    double last_cpu;
+    double slept;           // Wall seconds spent sleeping
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+} CpuThrottle;
 
-// Structure to hold a stop time entry
+typedef enum {
+    PHASE_COUNT,            // Counting input lines
+    PHASE_PARSE,            // Parsing rows into the msgpack buffer
+    PHASE_WRITE,            // Writing the buffer out
+    PHASE_SORT,             // Bounded-memory mode: parsing into sorted runs
+    PHASE_MERGE_PASS,       // Bounded-memory mode: intermediate merges
+    PHASE_MERGE,            // Bounded-memory mode: final merge into the output
+    PHASE_HASH,             // Incremental mode: hashing the rows of each trip
+} ProgressPhase;
+
+static const char* PHASE_NAMES[] = {"count", "parse", "write", "sort", "merge_pass", "merge", "hash"};
+
+// Progress of a run. Workers only store counters, with no clock or rusage
+// calls per row; a reporter thread samples them every PROGRESS_INTERVAL_MS
+// and prints a progress line, or with --progress=json one JSON event per
+// line (NDJSON).
 typedef struct {
-    char trip_id[64];
-    char stop_id[64];
-    char arrival_time[16];
-    char departure_time[16];
-    int stop_sequence;
-} StopTime;
-
-// Structure to hold progress statistics
+    int json;
+    ProgressCounter phase;
+    ProgressCounter rows;
+    ProgressCounter total_rows;     // 0 when unknown
+    ProgressCounter bytes;          // Input bytes consumed
+    ProgressCounter total_bytes;
+    ProgressCounter stop;
+    const CpuThrottle* throttle;
+    char job[80];           // Batch mode: "\"job\":\"<id>\"," added to JSON events, else ""
+    double start;
+    int started;
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+} ProgressReporter;
+
+typedef enum {
+    STAT_READ,              // Reading lines (the counting pass included)
+    STAT_TOKENIZE,          // Splitting lines into fields
+    STAT_CONVERT,           // Validating stop_sequence; sort records in bounded mode
+    STAT_PACK,              // msgpack encoding
+    STAT_WRITE,             // Writing the output, and sorted runs in bounded mode
+    STAT_SORT,              // Bounded-memory mode: sorting runs
+    STAT_MERGE,             // Bounded-memory mode: merging runs (packing and writing included)
+    STAT_HASH,              // Incremental mode: grouping and hashing rows by trip
+    STAT_PHASES
+} StatPhase;
+
+static const char* STAT_NAMES[] = {"read", "tokenize", "convert", "pack", "write", "sort", "merge", "hash"};
+
+#define STAT_COUNTERS 4
+static const char* COUNTER_NAMES[] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+// Time spent per phase for --stats. Rows go through the stages a batch at a
+// time, so the timers and the hardware counters (perf_event_open on Linux:
+// cycles, instructions, cache misses and branch misses of the calling
+// thread) are read a few times per BATCH_SIZE rows rather than per row.
+// Threads of the pipeline keep their own and are merged at the end.
 typedef struct {
-    long total_rows;
-    long processed_rows;
-    double start_time;
-    double last_progress;
-    double rows_per_second;
-    long memory_usage;
-} Progress;
+    int enabled;
+    int current;                    // Phase being timed, -1 between phases
+    double started;
+    double start;                   // When the run started
+    size_t rows;
+    size_t bytes;
+    double seconds[STAT_PHASES];
+    double counts[STAT_PHASES][STAT_COUNTERS];
+    int threads;                    // Threads whose phases were added in, 1 when run on one
+    int n_counters;                 // Hardware counters open, 0 when unavailable
+    int counter_kinds[STAT_COUNTERS];   // Index in COUNTER_NAMES of each open counter
+#ifdef __linux__
+    int fds[STAT_COUNTERS];
+    uint64_t start_values[STAT_COUNTERS];
+    uint64_t start_enabled;
+    uint64_t start_running;
+#endif
+    char unavailable[128];          // Why there are no hardware counters
+} PhaseStats;
 
 // Function declarations
-int process_line(char* line, msgpack_packer* pk);
-int process_stop_times(const char* input_file, const char* output_file);
+int process_line(char* line, const int* columns, msgpack_packer* pk);
+int process_stop_times(const char* input_file, const char* output_file, int threads,
+                       CpuThrottle* throttle, ProgressReporter* progress, PhaseStats* stats);
+int process_stop_times_external(const char* input_file, const char* output_file, long long max_memory,
+                                CpuThrottle* throttle, ProgressReporter* progress, PhaseStats* stats);
 int check_rebuild(const char* executable_path);
 
 // Parse a CSV line into fields
@@ -113,27 +230,55 @@ int parse_csv_line(char* line, char** fields, int max_fields) {
     return field;
 }
 
-// Process a single line of the CSV file
-int process_line(char* line, msgpack_packer* pk) {
-    char* fields[10];  // More than enough for our needs
-    int num_fields = parse_csv_line(line, fields, 10);
+// Split a stop_times line into its fields. columns are the indices found
+// by get_column_indices. values receives trip_id, arrival_time,
+// departure_time, stop_id and stop_sequence, pointing into line.
+int tokenize_stop_time(char* line, const int* columns, char** values) {
+    char* fields[MAX_FIELDS];
+    int num_fields = parse_csv_line(line, fields, MAX_FIELDS);
     
-    if (num_fields < 5) {  // We need at least 5 fields
+    // columns: trip_id, stop_id, arrival_time, departure_time, stop_sequence
+    int needed = 0;
+    for (int i = 0; i < 5; i++) {
+        if (columns[i] >= needed) needed = columns[i] + 1;
+    }
+    if (num_fields < needed) {
         fprintf(stderr, "Error: Not enough fields in line: %s\n", line);
         fflush(stderr);
         return -1;
     }
-    
-    // Convert stop_sequence to integer first to validate it
+    values[0] = fields[columns[0]];
+    values[1] = fields[columns[2]];
+    values[2] = fields[columns[3]];
+    values[3] = fields[columns[1]];
+    values[4] = fields[columns[4]];
+    return 0;
+}
+
+// Convert stop_sequence to an integer, validating it
+int convert_stop_sequence(const char* text, long* seq) {
     char* endptr;
-    long seq = strtol(fields[4], &endptr, 10);
-    if (*endptr != '\0' || seq < 0 || seq > INT_MAX) {
-        fprintf(stderr, "Invalid stop_sequence: %s\n", fields[4]);
+    *seq = strtol(text, &endptr, 10);
+    if (*endptr != '\0' || *seq < 0 || *seq > INT_MAX) {
+        fprintf(stderr, "Invalid stop_sequence: %s\n", text);
         fflush(stderr);
         return -1;
     }
-    
-    // Pack stop time as a dictionary
+    return 0;
+}
+
+// Split a stop_times line and validate stop_sequence. values is as for
+// tokenize_stop_time.
+int parse_stop_time(char* line, const int* columns, char** values, long* seq) {
+    if (tokenize_stop_time(line, columns, values) != 0) {
+        return -1;
+    }
+    return convert_stop_sequence(values[4], seq);
+}
+
+// Pack one stop time as a dictionary
+int pack_stop_time(msgpack_packer* pk, const char* trip_id, const char* arrival_time,
+                   const char* departure_time, const char* stop_id, int32_t stop_sequence) {
     if (msgpack_pack_map(pk, 5) != 0) {
         fprintf(stderr, "Error: Could not pack map header\n");
         fflush(stderr);
@@ -143,8 +288,8 @@ int process_line(char* line, msgpack_packer* pk) {
     // Pack trip_id
     if (msgpack_pack_str(pk, 7) != 0 ||
         msgpack_pack_str_body(pk, "trip_id", 7) != 0 ||
-        msgpack_pack_str(pk, strlen(fields[0])) != 0 ||
-        msgpack_pack_str_body(pk, fields[0], strlen(fields[0])) != 0) {
+        msgpack_pack_str(pk, strlen(trip_id)) != 0 ||
+        msgpack_pack_str_body(pk, trip_id, strlen(trip_id)) != 0) {
         fprintf(stderr, "Error: Could not pack trip_id\n");
         fflush(stderr);
         return -1;
@@ -153,8 +298,8 @@ int process_line(char* line, msgpack_packer* pk) {
     // Pack arrival_time
     if (msgpack_pack_str(pk, 12) != 0 ||
         msgpack_pack_str_body(pk, "arrival_time", 12) != 0 ||
-        msgpack_pack_str(pk, strlen(fields[1])) != 0 ||
-        msgpack_pack_str_body(pk, fields[1], strlen(fields[1])) != 0) {
+        msgpack_pack_str(pk, strlen(arrival_time)) != 0 ||
+        msgpack_pack_str_body(pk, arrival_time, strlen(arrival_time)) != 0) {
         fprintf(stderr, "Error: Could not pack arrival_time\n");
         fflush(stderr);
         return -1;
@@ -163,8 +308,8 @@ int process_line(char* line, msgpack_packer* pk) {
     // Pack departure_time
     if (msgpack_pack_str(pk, 14) != 0 ||
         msgpack_pack_str_body(pk, "departure_time", 14) != 0 ||
-        msgpack_pack_str(pk, strlen(fields[2])) != 0 ||
-        msgpack_pack_str_body(pk, fields[2], strlen(fields[2])) != 0) {
+        msgpack_pack_str(pk, strlen(departure_time)) != 0 ||
+        msgpack_pack_str_body(pk, departure_time, strlen(departure_time)) != 0) {
         fprintf(stderr, "Error: Could not pack departure_time\n");
         fflush(stderr);
         return -1;
@@ -173,8 +318,8 @@ int process_line(char* line, msgpack_packer* pk) {
     // Pack stop_id
     if (msgpack_pack_str(pk, 7) != 0 ||
         msgpack_pack_str_body(pk, "stop_id", 7) != 0 ||
-        msgpack_pack_str(pk, strlen(fields[3])) != 0 ||
-        msgpack_pack_str_body(pk, fields[3], strlen(fields[3])) != 0) {
+        msgpack_pack_str(pk, strlen(stop_id)) != 0 ||
+        msgpack_pack_str_body(pk, stop_id, strlen(stop_id)) != 0) {
         fprintf(stderr, "Error: Could not pack stop_id\n");
         fflush(stderr);
         return -1;
@@ -183,7 +328,7 @@ int process_line(char* line, msgpack_packer* pk) {
     // Pack stop_sequence
     if (msgpack_pack_str(pk, 13) != 0 ||
         msgpack_pack_str_body(pk, "stop_sequence", 13) != 0 ||
-        msgpack_pack_int32(pk, (int32_t)seq) != 0) {
+        msgpack_pack_int32(pk, stop_sequence) != 0) {
         fprintf(stderr, "Error: Could not pack stop_sequence\n");
         fflush(stderr);
         return -1;
@@ -192,6 +337,16 @@ int process_line(char* line, msgpack_packer* pk) {
     return 0;
 }
 
+// Process a single line of the CSV file
+int process_line(char* line, const int* columns, msgpack_packer* pk) {
+    char* values[5];
+    long seq;
+    if (parse_stop_time(line, columns, values, &seq) != 0) {
+        return -1;
+    }
+    return pack_stop_time(pk, values[0], values[1], values[2], values[3], (int32_t)seq);
+}
+
 // Cross-platform function to get current timestamp in seconds
 double get_timestamp() {
 #ifdef _WIN32
@@ -222,6 +377,71 @@ long get_memory_usage() {
 #endif
 }
 
+// Cross-platform function to get the current resident memory in bytes.
+// Falls back to the peak where the current value is not available.
+long get_resident_memory() {
+#ifdef __linux__
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        long pages, resident;
+        int read = fscanf(fp, "%ld %ld", &pages, &resident);
+        fclose(fp);
+        if (read == 2) {
+            return resident * sysconf(_SC_PAGESIZE);
+        }
+    }
+#endif
+    return get_memory_usage();
+}
+
+// Cross-platform function to get the number of online CPUs
+int get_cpu_count() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+// Cross-platform function to get the memory available to new allocations
+// in bytes, or -1 when it cannot be determined
+long long get_available_memory() {
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status)) {
+        return (long long)status.ullAvailPhys;
+    }
+    return -1;
+#elif defined(__linux__)
+    // MemAvailable counts reclaimable page cache, unlike sysinfo's freeram
+    FILE* fp = fopen("/proc/meminfo", "r");
+    if (fp) {
+        char line[256];
+        long long kb = -1;
+        while (fgets(line, sizeof(line), fp)) {
+            if (sscanf(line, "MemAvailable: %lld kB", &kb) == 1) {
+                break;
+            }
+        }
+        fclose(fp);
+        if (kb >= 0) {
+            return kb * 1024;
+        }
+    }
+    struct sysinfo info;
+    if (sysinfo(&info) == 0) {
+        return ((long long)info.freeram + info.bufferram) * info.mem_unit;
+    }
+    return -1;
+#else
+    return -1;
+#endif
+}
+
 // Cross-platform function to sleep for microseconds
 void platform_sleep(long microseconds) {
 #ifdef _WIN32
@@ -235,21 +455,24 @@ void platform_sleep(long microseconds) {
 #endif
 }
 
-// Cross-platform function to get CPU time
+// Cross-platform function to get the user and system CPU time of all threads
 double get_cpu_time() {
 #ifdef _WIN32
     FILETIME create_time, exit_time, kernel_time, user_time;
     if (GetProcessTimes(GetCurrentProcess(), &create_time, &exit_time, &kernel_time, &user_time)) {
-        ULARGE_INTEGER ui;
-        ui.LowPart = user_time.dwLowDateTime;
-        ui.HighPart = user_time.dwHighDateTime;
-        return (double)ui.QuadPart / 10000000.0;  // Convert to seconds
+        ULARGE_INTEGER user, kernel;
+        user.LowPart = user_time.dwLowDateTime;
+        user.HighPart = user_time.dwHighDateTime;
+        kernel.LowPart = kernel_time.dwLowDateTime;
+        kernel.HighPart = kernel_time.dwHighDateTime;
+        return (double)(user.QuadPart + kernel.QuadPart) / 10000000.0;  // Convert to seconds
     }
     return 0;
 #else
     struct rusage usage;
     getrusage(RUSAGE_SELF, &usage);
-    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
 #endif
 }
 
@@ -279,185 +502,418 @@ void format_time(int seconds, char* buffer) {
     }
 }
 
-// Function to update and display progress
-void update_progress(Progress* progress) {
+void cpu_throttle_init(CpuThrottle* throttle, int limit) {
+    memset(throttle, 0, sizeof(*throttle));
+    throttle->limit = limit;
+    throttle->unlimited = limit >= 100;
+    throttle->start_wall = throttle->last_wall = get_timestamp();
+    throttle->start_cpu = throttle->last_cpu = get_cpu_time();
+#ifdef _WIN32
+    InitializeCriticalSection(&throttle->lock);
+#else
+    pthread_mutex_init(&throttle->lock, NULL);
+#endif
+}
+
+void cpu_throttle_free(CpuThrottle* throttle) {
+#ifdef _WIN32
+    DeleteCriticalSection(&throttle->lock);
+#else
+    pthread_mutex_destroy(&throttle->lock);
+#endif
+}
+
+// Settle the CPU used since the last check and sleep off any debt. Meant to
+// be called between batches of work.
+void cpu_throttle(CpuThrottle* throttle) {
+    if (throttle->unlimited) return;
+
+#ifdef _WIN32
+    EnterCriticalSection(&throttle->lock);
+#else
+    pthread_mutex_lock(&throttle->lock);
+#endif
     double now = get_timestamp();
-    if (now - progress->last_progress >= 1.0) {  // Update every second
-        // Calculate statistics
-        double elapsed = now - progress->start_time;
-        progress->rows_per_second = progress->processed_rows / elapsed;
-        int eta = (progress->total_rows - progress->processed_rows) / progress->rows_per_second;
-        progress->memory_usage = get_memory_usage();
-        
-        // Format memory usage
-        char memory_str[32];
-        format_size(progress->memory_usage, memory_str);
-        
-        // Format ETA
-        char eta_str[32];
-        format_time(eta, eta_str);
-        
-        // Print progress
+    double cpu = get_cpu_time();
+    double rate = throttle->limit / 100.0;
+    throttle->tokens += (now - throttle->last_wall) * rate - (cpu - throttle->last_cpu);
+    if (throttle->tokens > CPU_BURST) throttle->tokens = CPU_BURST;
+    throttle->last_wall = now;
+    throttle->last_cpu = cpu;
+    double sleep = throttle->tokens < 0 ? -throttle->tokens / rate : 0;
+    if (sleep > 0) throttle->slept += sleep;
 #ifdef _WIN32
-        // On Windows, we need to print a newline because \r doesn't work well
-        printf("Progress: %.1f%% (%ld/%ld) | Speed: %.0f rows/s | Memory: %s | ETA: %s\n",
+    LeaveCriticalSection(&throttle->lock);
 #else
-        // On Unix-like systems, use \r to overwrite the line
-        printf("\rProgress: %.1f%% (%ld/%ld) | Speed: %.0f rows/s | Memory: %s | ETA: %s",
+    pthread_mutex_unlock(&throttle->lock);
 #endif
-               (float)progress->processed_rows / progress->total_rows * 100,
-               progress->processed_rows, progress->total_rows,
-               progress->rows_per_second,
-               memory_str,
-               eta_str);
-        
-        // Always flush stdout to ensure progress is displayed
-        fflush(stdout);
-        
-        // Update last progress time
-        progress->last_progress = now;
+
+    // Sleep outside the lock; the wall time passing refills the bucket
+    if (sleep > 0) {
+        platform_sleep((long)(sleep * 1000000));
     }
 }
 
-// Function to limit CPU usage
-void limit_cpu(int cpu_limit) {
-    static double last_check = 0;
-    static double last_cpu_time = 0;
-    static int debug_counter = 0;
-    
-    double now = get_timestamp();
-    if (now - last_check < 0.1) return;  // Check every 100ms
-    
-    double cpu_time = get_cpu_time();
-    
-    if (last_cpu_time > 0) {
-        // Calculate CPU usage percentage
-        double time_diff = cpu_time - last_cpu_time;
-        double real_diff = now - last_check;
-        double cpu_usage = (time_diff / real_diff) * 100;
-        
-        // Print debug info every 10 seconds
-        debug_counter++;
-        if (debug_counter >= 100) {  // 100 * 100ms = 10s
-            printf("\nCPU usage: %.1f%% (limit: %d%%)\n", cpu_usage, cpu_limit);
-            fflush(stdout);
-            debug_counter = 0;
-        }
-        
-        // If CPU usage is too high, sleep
-        if (cpu_usage > cpu_limit) {
-            // Calculate sleep time in microseconds
-            // Use a more aggressive sleep time when CPU usage is much higher than the limit
-            double overage_factor = cpu_usage / cpu_limit;
-            long sleep_time = (long)((time_diff * 100 / cpu_limit - real_diff) * 1000000 * overage_factor);
-            if (sleep_time > 0) {
-                platform_sleep(sleep_time);
+// Measured CPU usage since the throttle started, in percent of one core
+double cpu_throttle_usage(const CpuThrottle* throttle) {
+    double wall = get_timestamp() - throttle->start_wall;
+    return wall > 0 ? (get_cpu_time() - throttle->start_cpu) / wall * 100.0 : 0;
+}
+
+void cpu_throttle_report(const CpuThrottle* throttle) {
+    double wall = get_timestamp() - throttle->start_wall;
+    double cpu = get_cpu_time() - throttle->start_cpu;
+    printf("CPU: %.1fs over %.1fs (%.0f%% of one core, limit %d%%, throttled %.1fs)\n",
+           cpu, wall, wall > 0 ? cpu / wall * 100.0 : 0, throttle->limit, throttle->slept);
+    fflush(stdout);
+}
+
+#ifdef __linux__
+static int perf_open(uint64_t config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // This thread only: the progress reporter is not counted
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+// Read the counter group: values of the open counters, and how long the
+// group was enabled and actually running (the kernel multiplexes counters
+// when there are not enough of them)
+static int perf_read(const PhaseStats* stats, uint64_t* values, uint64_t* enabled, uint64_t* running) {
+    uint64_t buffer[3 + STAT_COUNTERS];
+    ssize_t size = (ssize_t)(sizeof(uint64_t) * (3 + stats->n_counters));
+    if (read(stats->fds[0], buffer, size) != size) {
+        return -1;
+    }
+    *enabled = buffer[1];
+    *running = buffer[2];
+    memcpy(values, buffer + 3, sizeof(uint64_t) * stats->n_counters);
+    return 0;
+}
+#endif
+
+void stats_init(PhaseStats* stats, int enabled) {
+    memset(stats, 0, sizeof(*stats));
+    stats->enabled = enabled;
+    stats->current = -1;
+    stats->threads = 1;
+    stats->start = get_timestamp();
+    snprintf(stats->unavailable, sizeof(stats->unavailable), "not supported on this platform");
+    if (!enabled) {
+        return;
+    }
+#ifdef __linux__
+    static const uint64_t configs[STAT_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    for (int i = 0; i < STAT_COUNTERS; i++) {
+        int fd = perf_open(configs[i], stats->n_counters ? stats->fds[0] : -1);
+        if (fd < 0) {
+            if (i == 0) {
+                snprintf(stats->unavailable, sizeof(stats->unavailable), "perf_event_open: %s%s",
+                         strerror(errno), errno == EACCES || errno == EPERM
+                             ? " (see /proc/sys/kernel/perf_event_paranoid)" : "");
+                return;
             }
+            continue;   // Leave out counters the CPU does not have
         }
+        stats->fds[stats->n_counters] = fd;
+        stats->counter_kinds[stats->n_counters++] = i;
     }
-    
-    last_check = now;
-    last_cpu_time = cpu_time;
+    ioctl(stats->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(stats->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
 }
 
-// Function to parse a CSV line into a StopTime struct
-int parse_line(char* line, StopTime* stop_time, int* column_indices) {
-    char* token;
-    char* rest = line;
-    int column = 0;
-    int found_columns = 0;
-    static int debug_counter = 0;
-    
-    // Initialize stop_time with empty strings
-    stop_time->trip_id[0] = '\0';
-    stop_time->stop_id[0] = '\0';
-    stop_time->arrival_time[0] = '\0';
-    stop_time->departure_time[0] = '\0';
-    stop_time->stop_sequence = -1;
-    
-    while ((token = strtok_r(rest, ",", &rest))) {
-        // Remove quotes and whitespace
-        while (*token == ' ' || *token == '"') token++;
-        char* end = token + strlen(token) - 1;
-        while (end > token && (*end == ' ' || *end == '"' || *end == '\n' || *end == '\r')) end--;
-        *(end + 1) = '\0';
-        
-        if (column == column_indices[0]) {  // trip_id
-            if (strlen(token) >= sizeof(stop_time->trip_id)) {
-                fprintf(stderr, "trip_id too long: %s\n", token);
-                fflush(stderr);
-                return -1;
-            }
-            strncpy(stop_time->trip_id, token, sizeof(stop_time->trip_id) - 1);
-            stop_time->trip_id[sizeof(stop_time->trip_id) - 1] = '\0';
-            found_columns++;
-        } else if (column == column_indices[1]) {  // stop_id
-            if (strlen(token) >= sizeof(stop_time->stop_id)) {
-                fprintf(stderr, "stop_id too long: %s\n", token);
-                fflush(stderr);
-                return -1;
-            }
-            strncpy(stop_time->stop_id, token, sizeof(stop_time->stop_id) - 1);
-            stop_time->stop_id[sizeof(stop_time->stop_id) - 1] = '\0';
-            found_columns++;
-        } else if (column == column_indices[2]) {  // arrival_time
-            if (strlen(token) >= sizeof(stop_time->arrival_time)) {
-                fprintf(stderr, "arrival_time too long: %s\n", token);
-                fflush(stderr);
-                return -1;
+void stats_free(PhaseStats* stats) {
+#ifdef __linux__
+    for (int i = 0; i < stats->n_counters; i++) {
+        close(stats->fds[i]);
+    }
+#endif
+    stats->n_counters = 0;
+}
+
+// Stop timing the current phase
+void stats_end(PhaseStats* stats) {
+    if (!stats->enabled || stats->current < 0) {
+        return;
+    }
+    stats->seconds[stats->current] += get_timestamp() - stats->started;
+#ifdef __linux__
+    uint64_t values[STAT_COUNTERS], enabled, running;
+    if (stats->n_counters > 0 && perf_read(stats, values, &enabled, &running) == 0) {
+        // Scale up the share of the phase the counters were not scheduled
+        uint64_t ran = running - stats->start_running;
+        double scale = ran > 0 ? (double)(enabled - stats->start_enabled) / ran : 0;
+        for (int i = 0; i < stats->n_counters; i++) {
+            stats->counts[stats->current][i] += (values[i] - stats->start_values[i]) * scale;
+        }
+    }
+#endif
+    stats->current = -1;
+}
+
+// Start timing phase, ending the current one
+void stats_begin(PhaseStats* stats, StatPhase phase) {
+    if (!stats->enabled) {
+        return;
+    }
+    stats_end(stats);
+#ifdef __linux__
+    if (stats->n_counters > 0 &&
+        perf_read(stats, stats->start_values, &stats->start_enabled, &stats->start_running) != 0) {
+        memset(stats->start_values, 0, sizeof(stats->start_values));
+    }
+#endif
+    stats->current = phase;
+    stats->started = get_timestamp();
+}
+
+// Add the phase times of a thread that worked alongside, and its counters
+// when it measured the same ones
+void stats_merge(PhaseStats* stats, const PhaseStats* other) {
+    if (!stats->enabled || !other->enabled) {
+        return;
+    }
+    int same = other->n_counters == stats->n_counters &&
+               memcmp(other->counter_kinds, stats->counter_kinds, sizeof(int) * stats->n_counters) == 0;
+    for (int p = 0; p < STAT_PHASES; p++) {
+        stats->seconds[p] += other->seconds[p];
+        for (int i = 0; same && i < stats->n_counters; i++) {
+            stats->counts[p][i] += other->counts[p][i];
+        }
+    }
+    stats->threads++;
+}
+
+// Print the time and counters of each phase. The counters are given per
+// row so that feeds of different sizes compare.
+void stats_report(const PhaseStats* stats, int json) {
+    if (!stats->enabled) {
+        return;
+    }
+    double total = get_timestamp() - stats->start;
+    double rows = stats->rows > 0 ? (double)stats->rows : 1;
+    double timed = 0;
+    for (int p = 0; p < STAT_PHASES; p++) {
+        timed += stats->seconds[p];
+    }
+
+    if (json) {
+        STDOUT_LOCK();
+        printf("{\"event\":\"stats\",\"rows\":%zu,\"bytes\":%zu,\"elapsed_s\":%.4f,\"other_s\":%.4f,"
+               "\"threads\":%d,\"counters\":%s,\"phases\":[",
+               stats->rows, stats->bytes, total, total > timed ? total - timed : 0, stats->threads,
+               stats->n_counters ? "true" : "false");
+        int first = 1;
+        for (int p = 0; p < STAT_PHASES; p++) {
+            if (stats->seconds[p] <= 0) continue;
+            printf("%s{\"phase\":\"%s\",\"seconds\":%.4f,\"share\":%.4f,\"ns_per_row\":%.1f",
+                   first ? "" : ",", STAT_NAMES[p], stats->seconds[p],
+                   total > 0 ? stats->seconds[p] / total : 0, stats->seconds[p] * 1e9 / rows);
+            for (int i = 0; i < stats->n_counters; i++) {
+                printf(",\"%s\":%.0f", COUNTER_NAMES[stats->counter_kinds[i]], stats->counts[p][i]);
             }
-            strncpy(stop_time->arrival_time, token, sizeof(stop_time->arrival_time) - 1);
-            stop_time->arrival_time[sizeof(stop_time->arrival_time) - 1] = '\0';
-            found_columns++;
-        } else if (column == column_indices[3]) {  // departure_time
-            if (strlen(token) >= sizeof(stop_time->departure_time)) {
-                fprintf(stderr, "departure_time too long: %s\n", token);
-                fflush(stderr);
-                return -1;
+            printf("}");
+            first = 0;
+        }
+        printf("]}\n");
+        fflush(stdout);
+        STDOUT_UNLOCK();
+        return;
+    }
+
+    char size_str[32];
+    format_size((long)stats->bytes, size_str);
+    printf("Phase stats: %zu rows, %s in %.3fs\n", stats->rows, size_str, total);
+    printf("  %-9s %9s %7s %8s", "phase", "seconds", "share", "ns/row");
+    if (stats->n_counters > 0) {
+        printf(" %11s %11s %6s %14s %15s", "cycles/row", "instr/row", "IPC", "cache-miss/row", "branch-miss/row");
+    }
+    printf("\n");
+    for (int p = 0; p < STAT_PHASES; p++) {
+        if (stats->seconds[p] <= 0) continue;
+        printf("  %-9s %9.3f %6.1f%% %8.1f", STAT_NAMES[p], stats->seconds[p],
+               total > 0 ? stats->seconds[p] / total * 100.0 : 0, stats->seconds[p] * 1e9 / rows);
+        if (stats->n_counters > 0) {
+            double values[STAT_COUNTERS] = {-1, -1, -1, -1};
+            for (int i = 0; i < stats->n_counters; i++) {
+                values[stats->counter_kinds[i]] = stats->counts[p][i];
             }
-            strncpy(stop_time->departure_time, token, sizeof(stop_time->departure_time) - 1);
-            stop_time->departure_time[sizeof(stop_time->departure_time) - 1] = '\0';
-            found_columns++;
-        } else if (column == column_indices[4]) {  // stop_sequence
-            char* endptr;
-            long seq = strtol(token, &endptr, 10);
-            if (*endptr != '\0' || seq < 0 || seq > INT_MAX) {
-                fprintf(stderr, "Invalid stop_sequence: %s\n", token);
-                fflush(stderr);
-                return -1;
+            char cells[STAT_COUNTERS][32];
+            for (int k = 0; k < STAT_COUNTERS; k++) {
+                if (values[k] < 0) snprintf(cells[k], sizeof(cells[k]), "n/a");
+                else snprintf(cells[k], sizeof(cells[k]), "%.1f", values[k] / rows);
             }
-            stop_time->stop_sequence = (int)seq;
-            found_columns++;
+            char ipc[32] = "n/a";
+            if (values[0] > 0 && values[1] >= 0) snprintf(ipc, sizeof(ipc), "%.2f", values[1] / values[0]);
+            printf(" %11s %11s %6s %14s %15s", cells[0], cells[1], ipc, cells[2], cells[3]);
         }
-        column++;
+        printf("\n");
     }
-    
-    // Print debug info every 10000 rows
-    debug_counter++;
-    if (debug_counter >= 10000) {
-        printf("\nParsed row: trip_id=%s, stop_id=%s, arrival=%s, departure=%s, seq=%d\n",
-               stop_time->trip_id, stop_time->stop_id,
-               stop_time->arrival_time, stop_time->departure_time,
-               stop_time->stop_sequence);
-        fflush(stdout);
-        debug_counter = 0;
+    if (stats->threads > 1) {
+        printf("  Phases ran on %d threads at once: seconds are summed over threads, shares are of the wall time\n",
+               stats->threads);
+    } else {
+        printf("  %-9s %9.3f %6.1f%%\n", "other", total - timed,
+               total > 0 ? (total - timed) / total * 100.0 : 0);
     }
-    
-    // Verify all required columns were found
-    if (found_columns != 5) {
-        fprintf(stderr, "Missing columns in line: found %d/5\n", found_columns);
-        fflush(stderr);
-        return -1;
+    if (stats->n_counters == 0) {
+        printf("  Hardware counters unavailable: %s\n", stats->unavailable);
     }
-    
+    fflush(stdout);
+}
+
+// Print one progress sample. rate is in rows per second, negative when
+// unknown.
+static void progress_print(ProgressReporter* progress, const char* event, double rate) {
+    size_t phase = PROGRESS_LOAD(progress->phase);
+    size_t rows = PROGRESS_LOAD(progress->rows);
+    size_t total_rows = PROGRESS_LOAD(progress->total_rows);
+    size_t bytes = PROGRESS_LOAD(progress->bytes);
+    size_t total_bytes = PROGRESS_LOAD(progress->total_bytes);
+    double elapsed = get_timestamp() - progress->start;
+    double cpu = progress->throttle ? cpu_throttle_usage(progress->throttle) : 0;
+    long rss = get_resident_memory();
+    double eta = rate > 0 && total_rows > rows ? (total_rows - rows) / rate : -1;
+
+    if (progress->json) {
+        char rate_str[32] = "null", eta_str[32] = "null";
+        if (rate >= 0) snprintf(rate_str, sizeof(rate_str), "%.0f", rate);
+        if (eta >= 0) snprintf(eta_str, sizeof(eta_str), "%.1f", eta);
+        printf("{\"event\":\"%s\",%s\"phase\":\"%s\",\"rows\":%zu,\"total_rows\":%zu,"
+               "\"bytes\":%zu,\"total_bytes\":%zu,\"rows_per_s\":%s,\"rss_bytes\":%ld,"
+               "\"cpu_percent\":%.1f,\"elapsed_s\":%.2f,\"eta_s\":%s}\n",
+               event, progress->job, PHASE_NAMES[phase], rows, total_rows, bytes, total_bytes,
+               rate_str, rss, cpu, elapsed, eta_str);
+    } else {
+        char memory_str[32], eta_str[32] = "-";
+        format_size(rss, memory_str);
+        if (eta >= 0) format_time((int)eta, eta_str);
+        if (total_rows > 0) {
+            printf("Progress [%s]: %.1f%% (%zu/%zu) | Speed: %.0f rows/s | Memory: %s | CPU: %.0f%% | ETA: %s\n",
+                   PHASE_NAMES[phase], (double)rows / total_rows * 100.0, rows, total_rows,
+                   rate > 0 ? rate : 0, memory_str, cpu, eta_str);
+        } else {
+            printf("Progress [%s]: %zu rows | Speed: %.0f rows/s | Memory: %s | CPU: %.0f%%\n",
+                   PHASE_NAMES[phase], rows, rate > 0 ? rate : 0, memory_str, cpu);
+        }
+    }
+    fflush(stdout);
+}
+
+static void progress_run(ProgressReporter* progress) {
+    size_t last_phase = PROGRESS_LOAD(progress->phase);
+    size_t last_rows = 0;
+    double last_time = get_timestamp();
+    while (!PROGRESS_LOAD(progress->stop)) {
+        // Sleep in short slices so stopping is prompt
+        for (int slept = 0; slept < PROGRESS_INTERVAL_MS && !PROGRESS_LOAD(progress->stop); slept += 50) {
+            platform_sleep(50 * 1000);
+        }
+        if (PROGRESS_LOAD(progress->stop)) break;
+
+        // Rate over the last interval, restarting with each phase
+        size_t phase = PROGRESS_LOAD(progress->phase);
+        size_t rows = PROGRESS_LOAD(progress->rows);
+        double now = get_timestamp();
+        if (phase != last_phase || rows < last_rows) {
+            last_phase = phase;
+            last_rows = 0;
+        }
+        double rate = now > last_time ? (rows - last_rows) / (now - last_time) : -1;
+        progress_print(progress, "progress", rate);
+        last_rows = rows;
+        last_time = now;
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI progress_thread(LPVOID arg) {
+    progress_run(arg);
     return 0;
 }
+#else
+static void* progress_thread(void* arg) {
+    progress_run(arg);
+    return NULL;
+}
+#endif
+
+// Start the reporter thread. Without it the run continues silently. job
+// names the run in JSON events in batch mode, NULL otherwise.
+void progress_start(ProgressReporter* progress, int json, const CpuThrottle* throttle, const char* job) {
+    memset(progress, 0, sizeof(*progress));
+    progress->json = json;
+    progress->throttle = throttle;
+    if (job) {
+        snprintf(progress->job, sizeof(progress->job), "\"job\":\"%s\",", job);
+    }
+    progress->start = get_timestamp();
+#ifdef _WIN32
+    progress->thread = CreateThread(NULL, 0, progress_thread, progress, 0, NULL);
+    progress->started = progress->thread != NULL;
+#else
+    progress->started = pthread_create(&progress->thread, NULL, progress_thread, progress) == 0;
+#endif
+}
+
+// Enter a phase; rows and bytes restart from zero. total_rows is 0 when
+// unknown.
+void progress_phase(ProgressReporter* progress, ProgressPhase phase, size_t total_rows) {
+    PROGRESS_STORE(progress->rows, 0);
+    PROGRESS_STORE(progress->bytes, 0);
+    PROGRESS_STORE(progress->total_rows, total_rows);
+    PROGRESS_STORE(progress->phase, phase);
+    if (progress->json) {
+        progress_print(progress, "phase", -1);
+    }
+}
+
+// Stop the reporter thread and print the --stats report; in JSON mode a
+// final "done" event carries the exit status
+void progress_stop(ProgressReporter* progress, int status, const PhaseStats* stats) {
+    PROGRESS_STORE(progress->stop, 1);
+    if (progress->started) {
+#ifdef _WIN32
+        WaitForSingleObject(progress->thread, INFINITE);
+        CloseHandle(progress->thread);
+#else
+        pthread_join(progress->thread, NULL);
+#endif
+        progress->started = 0;
+    }
+    if (status == 0) {
+        stats_report(stats, progress->json);
+    }
+    if (progress->json) {
+        double elapsed = get_timestamp() - progress->start;
+        printf("{\"event\":\"done\",%s\"status\":%d,\"rows\":%zu,\"elapsed_s\":%.2f,"
+               "\"rss_bytes\":%ld,\"peak_rss_bytes\":%ld,\"cpu_percent\":%.1f}\n",
+               progress->job, status, PROGRESS_LOAD(progress->rows), elapsed, get_resident_memory(),
+               get_memory_usage(), progress->throttle ? cpu_throttle_usage(progress->throttle) : 0);
+        fflush(stdout);
+    }
+}
 
 // Function to get column indices from header
 int get_column_indices(char* header, int* indices) {
     char* token;
     char* rest = header;
     int column = 0;
+
+    // Skip a UTF-8 byte order mark
+    if (strncmp(rest, "\xEF\xBB\xBF", 3) == 0) rest += 3;
     
     // Initialize indices to -1
     for (int i = 0; i < 5; i++) {
@@ -613,43 +1069,768 @@ int check_rebuild(const char* executable_path) {
     return 0;  // No rebuild needed
 }
 
-int process_stop_times(const char* input_file, const char* output_file) {
-    FILE* fp = fopen(input_file, "r");
-    if (!fp) {
-        fprintf(stderr, "Error: Could not open input file %s\n", input_file);
+// The input is a stop_times.txt file or a member of a GTFS zip archive,
+// named "feed.zip" (for its stop_times.txt) or "feed.zip/stop_times.txt".
+// A member is inflated on its own thread while the rows are parsed, without
+// being extracted; passes that read the input twice inflate it twice.
+typedef struct {
+    const char* path;
+    FILE* fp;
+    ZipStream* zip;
+} InputFile;
+
+static int input_open(InputFile* input, const char* path) {
+    char archive[PATH_MAX];
+    const char* member;
+    input->path = path;
+    input->zip = NULL;
+    if (zip_split_path(path, "stop_times.txt", archive, sizeof(archive), &member) == 0) {
+        input->zip = zip_stream_open(archive, member);
+        input->fp = input->zip ? zip_stream_file(input->zip) : NULL;
+    } else {
+        input->fp = fopen(path, "r");
+    }
+    if (!input->fp) {
+        fprintf(stderr, "Error: Could not open input file %s\n", path);
         fflush(stderr);
-        return 1;
+        return -1;
     }
+    return 0;
+}
 
-    // First count total lines
-    printf("Counting total lines...\n");
-    fflush(stdout);
-    size_t total_lines = 0;
-    char line[1024];
-    while (fgets(line, sizeof(line), fp)) {
-        total_lines++;
+// Close the input. Once it has been read to the end, returns -1 when a zip
+// member turned out corrupt or truncated.
+static int input_close(InputFile* input) {
+    int result = 0;
+    if (input->zip) {
+        result = zip_stream_close(input->zip);
+    } else if (input->fp) {
+        fclose(input->fp);
     }
-    total_lines--; // Subtract header line
-    printf("Total lines to process: %zu\n", total_lines);
-    fflush(stdout);
+    input->fp = NULL;
+    input->zip = NULL;
+    return result;
+}
 
-    // Reset file pointer
-    rewind(fp);
+// Read the input again from the start, after reading it to the end
+static int input_rewind(InputFile* input) {
+    if (!input->zip) {
+        rewind(input->fp);
+        return 0;
+    }
+    if (input_close(input) != 0) {
+        return -1;
+    }
+    return input_open(input, input->path);
+}
 
-    // Skip header line
-    if (!fgets(line, sizeof(line), fp)) {
-        fprintf(stderr, "Error: Could not read header line\n");
-        fflush(stderr);
-        fclose(fp);
-        return 1;
+// Size of the input in bytes, uncompressed for zip members
+static int input_size(const char* path, uint64_t* size) {
+    char archive[PATH_MAX];
+    const char* member;
+    if (zip_split_path(path, "stop_times.txt", archive, sizeof(archive), &member) == 0) {
+        return zip_member_size(archive, member, size);
+    }
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return -1;
     }
+    *size = (uint64_t)st.st_size;
+    return 0;
+}
 
-    // Initialize msgpack buffer
-    msgpack_sbuffer* buffer = msgpack_sbuffer_new();
+// Lines read ahead of parsing, so that each stage of the conversion runs
+// over a whole batch of rows
+typedef struct {
+    char* text;                     // The lines, each NUL-terminated
+    size_t cap;
+    size_t count;
+    size_t offsets[BATCH_SIZE];
+    char* fields[BATCH_SIZE][5];    // As filled by tokenize_stop_time
+    int32_t seqs[BATCH_SIZE];
+} LineBatch;
+
+// Read up to BATCH_SIZE lines, adding their size to bytes. Returns the
+// number of lines read, or -1 when out of memory.
+static long read_batch(FILE* fp, LineBatch* batch, size_t* bytes) {
+    size_t used = 0;
+    batch->count = 0;
+    while (batch->count < BATCH_SIZE) {
+        if (batch->cap - used < MAX_LINE_LENGTH) {
+            size_t cap = batch->cap ? batch->cap * 2 : (size_t)BATCH_SIZE * 128;
+            char* text = realloc(batch->text, cap);
+            if (!text) {
+                fprintf(stderr, "Error: Out of memory reading stop_times\n");
+                fflush(stderr);
+                return -1;
+            }
+            batch->text = text;
+            batch->cap = cap;
+        }
+        char* line = batch->text + used;
+        if (!fgets(line, MAX_LINE_LENGTH, fp)) break;
+        size_t len = strlen(line);
+        batch->offsets[batch->count++] = used;
+        used += len + 1;
+        *bytes += len;
+    }
+    return (long)batch->count;
+}
+
+// Tokenize and convert the lines of a batch. first_row numbers the first
+// line in error messages.
+static int parse_batch(LineBatch* batch, const int* columns, size_t first_row, PhaseStats* stats) {
+    stats_begin(stats, STAT_TOKENIZE);
+    for (size_t i = 0; i < batch->count; i++) {
+        if (tokenize_stop_time(batch->text + batch->offsets[i], columns, batch->fields[i]) != 0) {
+            fprintf(stderr, "Error: Could not process stop_times row %zu\n", first_row + i);
+            fflush(stderr);
+            return -1;
+        }
+    }
+    stats_begin(stats, STAT_CONVERT);
+    for (size_t i = 0; i < batch->count; i++) {
+        long seq;
+        if (convert_stop_sequence(batch->fields[i][4], &seq) != 0) {
+            fprintf(stderr, "Error: Could not process stop_times row %zu\n", first_row + i);
+            fflush(stderr);
+            return -1;
+        }
+        batch->seqs[i] = (int32_t)seq;
+    }
+    return 0;
+}
+
+static void free_batch(LineBatch* batch) {
+    if (batch) free(batch->text);
+    free(batch);
+}
+
+// ---------------------------------------------------------------------------
+// Pipelined conversion
+// ---------------------------------------------------------------------------
+
+/*
+ * The in-memory conversion runs as a pipeline of stages on their own
+ * threads, so reading, parsing, packing and writing overlap:
+ *
+ *   reader -> parser 1..N -> packer -> writer (the calling thread)
+ *
+ * Stages pass blocks of BATCH_SIZE lines through single-producer,
+ * single-consumer rings. The reader deals blocks to the parsers in turn and
+ * the packer collects them in the same order, which keeps the rows in input
+ * order without any reordering; the N rings into the packer act as one
+ * multi-producer queue. The writer hands written blocks back to the reader,
+ * so the blocks in flight, and the memory, are bounded by PIPELINE_BLOCKS
+ * per parser. Every ring can hold all blocks, so pushing never waits and a
+ * stage only waits for its input (the reader for a free block), asleep on
+ * a condition variable rather than polling.
+ */
+
+#define PIPELINE_BLOCKS 4           // Blocks in flight per parser
+#define PIPELINE_MAX_PARSERS 16
+
+// Ring indices are only written by one side each: the producer publishes
+// a slot with a release store of tail, the consumer frees it with one of head
+#ifdef _MSC_VER
+typedef volatile size_t RingIndex;
+static size_t ring_load(RingIndex* index) {
+    size_t value = *index;
+    MemoryBarrier();
+    return value;
+}
+static void ring_store(RingIndex* index, size_t value) {
+    MemoryBarrier();
+    *index = value;
+}
+#else
+typedef _Atomic size_t RingIndex;
+static size_t ring_load(RingIndex* index) {
+    return atomic_load_explicit(index, memory_order_acquire);
+}
+static void ring_store(RingIndex* index, size_t value) {
+    atomic_store_explicit(index, value, memory_order_release);
+}
+#endif
+
+typedef struct {
+    void** slots;
+    size_t mask;
+    RingIndex head;                 // Next slot to read, written by the consumer
+    char pad[64];                   // Keep the two indices on separate cache lines
+    RingIndex tail;                 // Next slot to write, written by the producer
+} Ring;
+
+static int ring_init(Ring* ring, size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) size *= 2;
+    ring->slots = malloc(sizeof(void*) * size);
+    ring->mask = size - 1;
+    ring_store(&ring->head, 0);
+    ring_store(&ring->tail, 0);
+    return ring->slots ? 0 : -1;
+}
+
+static int ring_push(Ring* ring, void* item) {
+    size_t tail = ring_load(&ring->tail);
+    if (tail - ring_load(&ring->head) > ring->mask) {
+        return 0;
+    }
+    ring->slots[tail & ring->mask] = item;
+    ring_store(&ring->tail, tail + 1);
+    return 1;
+}
+
+static int ring_pop(Ring* ring, void** item) {
+    size_t head = ring_load(&ring->head);
+    if (head == ring_load(&ring->tail)) {
+        return 0;
+    }
+    *item = ring->slots[head & ring->mask];
+    ring_store(&ring->head, head + 1);
+    return 1;
+}
+
+typedef struct {
+    LineBatch lines;
+    size_t first_row;               // Number of the first line, for messages
+    size_t bytes;                   // Input bytes read up to the end of the block
+    msgpack_sbuffer packed;
+} PipelineBlock;
+
+typedef enum {
+    STAGE_READ,
+    STAGE_PARSE,
+    STAGE_PACK,
+    STAGE_WRITE,
+    STAGE_KINDS
+} StageKind;
+
+static const char* STAGE_NAMES[] = {"read", "parse", "pack", "write"};
+
+typedef struct Pipeline Pipeline;
+
+typedef struct {
+    Pipeline* pipeline;
+    StageKind kind;
+    int index;                      // Parser number
+    double busy;                    // Seconds spent working
+    double waiting;                 // Seconds spent waiting for input
+    PhaseStats stats;               // --stats timings of this thread
+    int started;
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+} Stage;
+
+struct Pipeline {
+    InputFile* input;
+    const int* columns;
+    CpuThrottle* throttle;
+    ProgressReporter* progress;
+    int stats_enabled;
+    int n_parsers;
+    PipelineBlock* blocks;
+    size_t n_blocks;
+    size_t header_bytes;
+    Ring free_blocks;               // writer -> reader
+    Ring* parse_in;                 // reader -> each parser
+    Ring* parse_out;                // each parser -> packer
+    Ring packed;                    // packer -> writer
+    Stage* stages;                  // reader, parsers, packer, writer
+    int n_stages;
+    ProgressCounter failed;         // Set by the first stage that fails
+    size_t rows;                    // Rows packed
+    size_t bytes;                   // Input bytes read
+    // Idle stages sleep on `pushed` instead of polling their ring; it is
+    // signalled after every push and when a stage fails
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE pushed;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t pushed;
+#endif
+};
+
+static void pipeline_lock(Pipeline* p) {
+#ifdef _WIN32
+    EnterCriticalSection(&p->lock);
+#else
+    pthread_mutex_lock(&p->lock);
+#endif
+}
+
+static void pipeline_unlock(Pipeline* p) {
+#ifdef _WIN32
+    LeaveCriticalSection(&p->lock);
+#else
+    pthread_mutex_unlock(&p->lock);
+#endif
+}
+
+static void pipeline_wake(Pipeline* p) {
+    pipeline_lock(p);
+#ifdef _WIN32
+    WakeAllConditionVariable(&p->pushed);
+#else
+    pthread_cond_broadcast(&p->pushed);
+#endif
+    pipeline_unlock(p);
+}
+
+static void pipeline_fail(Pipeline* p) {
+    PROGRESS_STORE(p->failed, 1);
+    pipeline_wake(p);
+}
+
+// Hand a block (or NULL, the end of the stream) to the next stage
+static void stage_push(Stage* stage, Ring* ring, PipelineBlock* block) {
+    ring_push(ring, block);
+    pipeline_wake(stage->pipeline);
+}
+
+// Wait for the next block of a ring; NULL marks the end of the stream.
+// Returns -1 when another stage failed.
+static int stage_pop(Stage* stage, Ring* ring, PipelineBlock** block) {
+    Pipeline* p = stage->pipeline;
+    void* item;
+    if (ring_pop(ring, &item)) {
+        *block = item;
+        return 0;
+    }
+    // Check again under the lock: a producer signals while holding it, so
+    // a push cannot slip in between the check and the wait
+    double start = get_timestamp();
+    int popped;
+    pipeline_lock(p);
+    while (!(popped = ring_pop(ring, &item)) && !PROGRESS_LOAD(p->failed)) {
+#ifdef _WIN32
+        SleepConditionVariableCS(&p->pushed, &p->lock, INFINITE);
+#else
+        pthread_cond_wait(&p->pushed, &p->lock);
+#endif
+    }
+    pipeline_unlock(p);
+    stage->waiting += get_timestamp() - start;
+    if (!popped) return -1;
+    *block = item;
+    return 0;
+}
+
+static void run_reader(Stage* stage) {
+    Pipeline* p = stage->pipeline;
+    size_t bytes = p->header_bytes;
+    size_t row = 1;
+    size_t used = 0;
+    for (size_t k = 0; !PROGRESS_LOAD(p->failed); k++) {
+        PipelineBlock* block;
+        if (used < p->n_blocks) {
+            block = &p->blocks[used++];
+        } else if (stage_pop(stage, &p->free_blocks, &block) != 0) {
+            break;
+        }
+        double start = get_timestamp();
+        stats_begin(&stage->stats, STAT_READ);
+        long n = read_batch(p->input->fp, &block->lines, &bytes);
+        stats_end(&stage->stats);
+        stage->busy += get_timestamp() - start;
+        if (n < 0) {
+            pipeline_fail(p);
+            break;
+        }
+        if (n == 0) break;
+        block->first_row = row;
+        block->bytes = bytes;
+        row += (size_t)n;
+        stage_push(stage, &p->parse_in[k % p->n_parsers], block);
+    }
+    p->bytes = bytes;
+    for (int i = 0; i < p->n_parsers; i++) {
+        stage_push(stage, &p->parse_in[i], NULL);
+    }
+}
+
+static void run_parser(Stage* stage) {
+    Pipeline* p = stage->pipeline;
+    PipelineBlock* block;
+    while (stage_pop(stage, &p->parse_in[stage->index], &block) == 0 && block) {
+        double start = get_timestamp();
+        int parsed = parse_batch(&block->lines, p->columns, block->first_row, &stage->stats);
+        stats_end(&stage->stats);
+        stage->busy += get_timestamp() - start;
+        if (parsed != 0) {
+            pipeline_fail(p);
+            break;
+        }
+        stage_push(stage, &p->parse_out[stage->index], block);
+    }
+    stage_push(stage, &p->parse_out[stage->index], NULL);
+}
+
+static void run_packer(Stage* stage) {
+    Pipeline* p = stage->pipeline;
+    PipelineBlock* block;
+    msgpack_packer pk;
+    for (size_t k = 0; stage_pop(stage, &p->parse_out[k % p->n_parsers], &block) == 0 && block; k++) {
+        double start = get_timestamp();
+        stats_begin(&stage->stats, STAT_PACK);
+        msgpack_sbuffer_clear(&block->packed);
+        msgpack_packer_init(&pk, &block->packed, msgpack_sbuffer_write);
+        LineBatch* lines = &block->lines;
+        int ok = 1;
+        for (size_t i = 0; i < lines->count && ok; i++) {
+            char** values = lines->fields[i];
+            if (pack_stop_time(&pk, values[0], values[1], values[2], values[3], lines->seqs[i]) != 0) {
+                fprintf(stderr, "Error: Could not process stop_times row %zu\n", block->first_row + i);
+                fflush(stderr);
+                ok = 0;
+            }
+        }
+        stats_end(&stage->stats);
+        stage->busy += get_timestamp() - start;
+        if (!ok) {
+            pipeline_fail(p);
+            break;
+        }
+        p->rows += lines->count;
+        PROGRESS_STORE(p->progress->rows, p->rows);
+        PROGRESS_STORE(p->progress->bytes, block->bytes);
+        stage_push(stage, &p->packed, block);
+        cpu_throttle(p->throttle);
+    }
+    stage_push(stage, &p->packed, NULL);
+}
+
+static void run_stage(Stage* stage) {
+    stats_init(&stage->stats, stage->pipeline->stats_enabled);
+    switch (stage->kind) {
+        case STAGE_READ: run_reader(stage); break;
+        case STAGE_PARSE: run_parser(stage); break;
+        case STAGE_PACK: run_packer(stage); break;
+        default: break;
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI stage_thread(LPVOID arg) {
+    run_stage(arg);
+    return 0;
+}
+#else
+static void* stage_thread(void* arg) {
+    run_stage(arg);
+    return NULL;
+}
+#endif
+
+// Write the packed blocks on the calling thread, timed by its stats
+static int run_writer(Stage* stage, FILE* out, PhaseStats* stats) {
+    Pipeline* p = stage->pipeline;
+    PipelineBlock* block;
+    while (stage_pop(stage, &p->packed, &block) == 0 && block) {
+        double start = get_timestamp();
+        stats_begin(stats, STAT_WRITE);
+        size_t written = fwrite(block->packed.data, 1, block->packed.size, out);
+        stats_end(stats);
+        stage->busy += get_timestamp() - start;
+        if (written != block->packed.size) {
+            pipeline_fail(p);
+            return -1;
+        }
+        stage_push(stage, &p->free_blocks, block);
+    }
+    return PROGRESS_LOAD(p->failed) ? -1 : 0;
+}
+
+// Print how busy each stage was; the busiest one limits the throughput
+static void pipeline_report(const Pipeline* p, double elapsed, const ProgressReporter* progress) {
+    double busy[STAGE_KINDS] = {0}, waiting[STAGE_KINDS] = {0};
+    int threads[STAGE_KINDS] = {0};
+    for (int i = 0; i < p->n_stages; i++) {
+        busy[p->stages[i].kind] += p->stages[i].busy;
+        waiting[p->stages[i].kind] += p->stages[i].waiting;
+        threads[p->stages[i].kind]++;
+    }
+    int bottleneck = 0;
+    double share[STAGE_KINDS], idle[STAGE_KINDS];
+    for (int k = 0; k < STAGE_KINDS; k++) {
+        double capacity = elapsed > 0 ? elapsed * threads[k] : 1;
+        share[k] = busy[k] / capacity;
+        idle[k] = waiting[k] / capacity;
+        if (share[k] > share[bottleneck]) bottleneck = k;
+    }
+
+    STDOUT_LOCK();
+    if (progress->json) {
+        printf("{\"event\":\"pipeline\",%s\"parsers\":%d,\"blocks\":%zu,\"elapsed_s\":%.4f,"
+               "\"bottleneck\":\"%s\",\"stages\":[",
+               progress->job, p->n_parsers, p->n_blocks, elapsed, STAGE_NAMES[bottleneck]);
+        for (int k = 0; k < STAGE_KINDS; k++) {
+            printf("%s{\"stage\":\"%s\",\"threads\":%d,\"busy\":%.4f,\"waiting\":%.4f}",
+                   k ? "," : "", STAGE_NAMES[k], threads[k], share[k], idle[k]);
+        }
+        printf("]}\n");
+    } else {
+        printf("Pipeline: %d parser%s, %zu blocks in flight, %.3fs\n",
+               p->n_parsers, p->n_parsers == 1 ? "" : "s", p->n_blocks, elapsed);
+        printf("  %-6s %7s %6s %8s\n", "stage", "threads", "busy", "waiting");
+        for (int k = 0; k < STAGE_KINDS; k++) {
+            printf("  %-6s %7d %5.1f%% %7.1f%%\n", STAGE_NAMES[k], threads[k],
+                   share[k] * 100.0, idle[k] * 100.0);
+        }
+        printf("  Bottleneck: %s\n", STAGE_NAMES[bottleneck]);
+    }
+    fflush(stdout);
+    STDOUT_UNLOCK();
+}
+
+// Convert the rest of the input, after its header line, with n_parsers
+// parser threads. The output is written to a temporary file and renamed into
+// place once the input was read without error. Closes the input.
+static int run_pipeline(InputFile* input, const int* columns, size_t header_bytes, size_t total_lines,
+                        const char* output_file, int n_parsers, CpuThrottle* throttle,
+                        ProgressReporter* progress, PhaseStats* stats) {
+    Pipeline p;
+    memset(&p, 0, sizeof(p));
+    p.input = input;
+    p.columns = columns;
+    p.throttle = throttle;
+    p.progress = progress;
+    p.stats_enabled = stats->enabled;
+    p.n_parsers = n_parsers;
+    p.header_bytes = header_bytes;
+    p.n_blocks = (size_t)n_parsers * PIPELINE_BLOCKS;
+    p.n_stages = n_parsers + 3;
+    p.blocks = calloc(p.n_blocks, sizeof(PipelineBlock));
+    p.parse_in = calloc(n_parsers, sizeof(Ring));
+    p.parse_out = calloc(n_parsers, sizeof(Ring));
+    p.stages = calloc(p.n_stages, sizeof(Stage));
+    PROGRESS_STORE(p.failed, 0);
+#ifdef _WIN32
+    InitializeCriticalSection(&p.lock);
+    InitializeConditionVariable(&p.pushed);
+#else
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.pushed, NULL);
+#endif
+
+    int result = 1;
+    FILE* out = NULL;
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", output_file);
+
+    int ready = p.blocks && p.parse_in && p.parse_out && p.stages &&
+                ring_init(&p.free_blocks, p.n_blocks + 1) == 0 &&
+                ring_init(&p.packed, p.n_blocks + 1) == 0;
+    for (int i = 0; ready && i < n_parsers; i++) {
+        ready = ring_init(&p.parse_in[i], p.n_blocks + 1) == 0 &&
+                ring_init(&p.parse_out[i], p.n_blocks + 1) == 0;
+    }
+    for (size_t i = 0; ready && i < p.n_blocks; i++) {
+        msgpack_sbuffer_init(&p.blocks[i].packed);
+    }
+    if (!ready) {
+        fprintf(stderr, "Error: Out of memory starting the pipeline\n");
+        fflush(stderr);
+        goto cleanup;
+    }
+
+    // Header: {"stop_times": [<total_lines> rows]}
+    msgpack_sbuffer header;
+    msgpack_sbuffer_init(&header);
+    msgpack_packer pk;
+    msgpack_packer_init(&pk, &header, msgpack_sbuffer_write);
+    out = fopen(tmp_path, "wb");
+    int header_ok = msgpack_pack_map(&pk, 1) == 0 &&
+                    msgpack_pack_str(&pk, 10) == 0 &&
+                    msgpack_pack_str_body(&pk, "stop_times", 10) == 0 &&
+                    msgpack_pack_array(&pk, total_lines) == 0 &&
+                    out && fwrite(header.data, 1, header.size, out) == header.size;
+    msgpack_sbuffer_destroy(&header);
+    if (!header_ok) {
+        fprintf(stderr, "Error: Could not write output file %s\n", tmp_path);
+        fflush(stderr);
+        goto cleanup;
+    }
+
+    printf("Converting with %d parser thread%s\n", n_parsers, n_parsers == 1 ? "" : "s");
+    fflush(stdout);
+    progress_phase(progress, PHASE_PARSE, total_lines);
+    double start = get_timestamp();
+    for (int i = 0; i < p.n_stages; i++) {
+        Stage* stage = &p.stages[i];
+        stage->pipeline = &p;
+        stage->kind = i == 0 ? STAGE_READ : i <= n_parsers ? STAGE_PARSE
+                    : i == n_parsers + 1 ? STAGE_PACK : STAGE_WRITE;
+        stage->index = i - 1;
+        if (stage->kind == STAGE_WRITE) break;
+#ifdef _WIN32
+        stage->thread = CreateThread(NULL, 0, stage_thread, stage, 0, NULL);
+        stage->started = stage->thread != NULL;
+#else
+        stage->started = pthread_create(&stage->thread, NULL, stage_thread, stage) == 0;
+#endif
+        if (!stage->started) {
+            fprintf(stderr, "Error: Could not start a pipeline thread\n");
+            fflush(stderr);
+            pipeline_fail(&p);
+            break;
+        }
+    }
+
+    Stage* writer = &p.stages[p.n_stages - 1];
+    int written = PROGRESS_LOAD(p.failed) ? -1 : run_writer(writer, out, stats);
+    if (written != 0) {
+        pipeline_fail(&p);
+    }
+    for (int i = 0; i < p.n_stages - 1; i++) {
+        Stage* stage = &p.stages[i];
+        if (stage->started) {
+#ifdef _WIN32
+            WaitForSingleObject(stage->thread, INFINITE);
+            CloseHandle(stage->thread);
+#else
+            pthread_join(stage->thread, NULL);
+#endif
+        }
+        stats_merge(stats, &stage->stats);
+        stats_free(&stage->stats);
+    }
+    double elapsed = get_timestamp() - start;
+    stats->rows = p.rows;
+    stats->bytes = p.bytes;
+
+    if (input_close(input) != 0 || PROGRESS_LOAD(p.failed)) goto cleanup;
+    if (p.rows != total_lines) {
+        fprintf(stderr, "Error: %s changed while it was being read\n", input->path);
+        fflush(stderr);
+        goto cleanup;
+    }
+    int closed = fclose(out);
+    out = NULL;
+    if (closed != 0) {
+        fprintf(stderr, "Error: Could not write output file %s\n", tmp_path);
+        fflush(stderr);
+        goto cleanup;
+    }
+#ifdef _WIN32
+    remove(output_file);
+#endif
+    if (rename(tmp_path, output_file) != 0) {
+        fprintf(stderr, "Error: Could not replace %s\n", output_file);
+        fflush(stderr);
+        goto cleanup;
+    }
+    pipeline_report(&p, elapsed, progress);
+    PROGRESS_STORE(progress->rows, p.rows);
+    printf("Processing complete. Processed %zu rows.\n", p.rows);
+    fflush(stdout);
+    cpu_throttle_report(throttle);
+    result = 0;
+
+cleanup:
+    input_close(input);
+    if (out) fclose(out);
+    if (result != 0) remove(tmp_path);
+    for (size_t i = 0; p.blocks && i < p.n_blocks; i++) {
+        free(p.blocks[i].lines.text);
+        msgpack_sbuffer_destroy(&p.blocks[i].packed);
+    }
+    for (int i = 0; i < n_parsers; i++) {
+        if (p.parse_in) free(p.parse_in[i].slots);
+        if (p.parse_out) free(p.parse_out[i].slots);
+    }
+    free(p.free_blocks.slots);
+    free(p.packed.slots);
+    free(p.blocks);
+    free(p.parse_in);
+    free(p.parse_out);
+    free(p.stages);
+#ifdef _WIN32
+    DeleteCriticalSection(&p.lock);
+#else
+    pthread_cond_destroy(&p.pushed);
+    pthread_mutex_destroy(&p.lock);
+#endif
+    return result;
+}
+
+int process_stop_times(const char* input_file, const char* output_file, int threads,
+                       CpuThrottle* throttle, ProgressReporter* progress, PhaseStats* stats) {
+    LineBatch* batch = calloc(1, sizeof(LineBatch));
+    if (!batch) {
+        fprintf(stderr, "Error: Out of memory\n");
+        fflush(stderr);
+        return 1;
+    }
+    InputFile input;
+    if (input_open(&input, input_file) != 0) {
+        free_batch(batch);
+        return 1;
+    }
+
+    // First count total lines
+    printf("Counting total lines...\n");
+    fflush(stdout);
+    size_t total_lines = 0;
+    size_t bytes = 0;
+    char line[1024];
+    progress_phase(progress, PHASE_COUNT, 0);
+    stats_begin(stats, STAT_READ);
+    while (fgets(line, sizeof(line), input.fp)) {
+        total_lines++;
+        bytes += strlen(line);
+        PROGRESS_STORE(progress->rows, total_lines);
+        PROGRESS_STORE(progress->bytes, bytes);
+        if (total_lines % BATCH_SIZE == 0) {
+            stats_end(stats);
+            cpu_throttle(throttle);
+            stats_begin(stats, STAT_READ);
+        }
+    }
+    stats_end(stats);
+    total_lines--; // Subtract header line
+    printf("Total lines to process: %zu\n", total_lines);
+    fflush(stdout);
+
+    // Reset file pointer
+    if (input_rewind(&input) != 0) {
+        free_batch(batch);
+        return 1;
+    }
+
+    // Find the columns in the header line
+    int columns[5];
+    if (!fgets(line, sizeof(line), input.fp)) {
+        fprintf(stderr, "Error: Could not read header line\n");
+        fflush(stderr);
+        input_close(&input);
+        free_batch(batch);
+        return 1;
+    }
+    size_t header_bytes = strlen(line);
+    if (get_column_indices(line, columns) != 0) {
+        input_close(&input);
+        free_batch(batch);
+        return 1;
+    }
+
+    if (threads > 0) {
+        free_batch(batch);
+        return run_pipeline(&input, columns, header_bytes, total_lines, output_file, threads,
+                            throttle, progress, stats);
+    }
+
+    // Initialize msgpack buffer
+    msgpack_sbuffer* buffer = msgpack_sbuffer_new();
     if (!buffer) {
         fprintf(stderr, "Error: Could not create msgpack buffer\n");
         fflush(stderr);
-        fclose(fp);
+        input_close(&input);
+        free_batch(batch);
         return 1;
     }
     printf("Created msgpack buffer\n");
@@ -660,7 +1841,8 @@ int process_stop_times(const char* input_file, const char* output_file) {
         fprintf(stderr, "Error: Could not create msgpack packer\n");
         fflush(stderr);
         msgpack_sbuffer_free(buffer);
-        fclose(fp);
+        input_close(&input);
+        free_batch(batch);
         return 1;
     }
     printf("Created msgpack packer\n");
@@ -696,41 +1878,42 @@ int process_stop_times(const char* input_file, const char* output_file) {
 
     size_t processed = 0;
     size_t successful = 0;
-    time_t start_time = time(NULL);
-    time_t last_progress = start_time;
-
-    // Process each line
-    while (fgets(line, sizeof(line), fp)) {
-        // Process the line
-        if (process_line(line, pk) == 0) {
-            successful++;
-        } else {
-            fprintf(stderr, "Error: Could not process stop_times row %zu\n", processed + 1);
-            fflush(stderr);
-            goto cleanup;
-        }
-        processed++;
+    bytes = header_bytes;
+    progress_phase(progress, PHASE_PARSE, total_lines);
 
-        // Update progress
-        time_t current_time = time(NULL);
-        if (current_time - last_progress >= 1) {
-            double progress = (double)processed / total_lines * 100.0;
-            double elapsed = difftime(current_time, start_time);
-            double speed = processed / (elapsed > 0 ? elapsed : 1);
-            double eta = (total_lines - processed) / (speed > 0 ? speed : 1);
-            
-            // Get current memory usage
-            double memory_mb = get_memory_usage() / (1024.0 * 1024.0);
+    // Process the lines a batch at a time, one stage after the other
+    for (;;) {
+        stats_begin(stats, STAT_READ);
+        long n = read_batch(input.fp, batch, &bytes);
+        if (n < 0) goto cleanup;
+        if (n == 0) break;
+        if (parse_batch(batch, columns, processed + 1, stats) != 0) goto cleanup;
 
-            printf("Progress: %.1f%% (%zu/%zu) | Success: %zu | Speed: %.0f rows/s | Memory: %.1f MB | ETA: %.0fs | Buffer size: %zu bytes\n",
-                   progress, processed, total_lines, successful, speed, memory_mb, eta, buffer->size);
-            fflush(stdout);
-            last_progress = current_time;
+        stats_begin(stats, STAT_PACK);
+        for (size_t i = 0; i < batch->count; i++) {
+            char** values = batch->fields[i];
+            if (pack_stop_time(pk, values[0], values[1], values[2], values[3], batch->seqs[i]) != 0) {
+                fprintf(stderr, "Error: Could not process stop_times row %zu\n", processed + i + 1);
+                fflush(stderr);
+                goto cleanup;
+            }
         }
+        stats_end(stats);
+        processed += batch->count;
+        successful += batch->count;
+        PROGRESS_STORE(progress->rows, processed);
+        PROGRESS_STORE(progress->bytes, bytes);
+        cpu_throttle(throttle);
     }
+    stats_end(stats);
+    if (input_close(&input) != 0) goto cleanup;
+    stats->rows = processed;
+    stats->bytes = bytes;
 
     printf("Processing complete. Final buffer size: %zu bytes\n", buffer->size);
     fflush(stdout);
+    progress_phase(progress, PHASE_WRITE, processed);
+    stats_begin(stats, STAT_WRITE);
 
     // Write to output file
     FILE* out = fopen(output_file, "wb");
@@ -753,59 +1936,1571 @@ int process_stop_times(const char* input_file, const char* output_file) {
     // Ensure all data is written and close the file
     fflush(out);
     fclose(out);
+    stats_end(stats);
+    PROGRESS_STORE(progress->rows, processed);
+    PROGRESS_STORE(progress->bytes, written);
 
     // Cleanup msgpack resources
     msgpack_packer_free(pk);
     msgpack_sbuffer_free(buffer);
-    fclose(fp);
+    free_batch(batch);
 
     printf("Successfully wrote %zu bytes to output file\n", written);
     printf("Processing complete. Processed %zu rows, %zu successful.\n", processed, successful);
     fflush(stdout);
+    cpu_throttle_report(throttle);
     return 0;
 
 cleanup:
+    stats_end(stats);
     if (pk) msgpack_packer_free(pk);
     if (buffer) msgpack_sbuffer_free(buffer);
-    if (fp) fclose(fp);
+    input_close(&input);
+    free_batch(batch);
     return 1;
 }
 
-// Function declarations
-int process_line(char* line, msgpack_packer* pk);
-int process_stop_times(const char* input_file, const char* output_file);
-int check_rebuild(const char* executable_path);
+// ---------------------------------------------------------------------------
+// Bounded-memory mode
+//
+// For feeds larger than the available memory: rows are parsed into runs of
+// at most max_memory bytes, each run is sorted by trip_id and stop_sequence
+// and spilled to a temporary file next to the output, and the runs are then
+// k-way merged (at most MAX_MERGE_FAN_IN at a time) straight into the output
+// file. The output is grouped by trip and never held in memory.
+// ---------------------------------------------------------------------------
 
-int main(int argc, char* argv[]) {
-    // Get version
-    const char* version = get_version();
-    
-    // Check for version flag
-    if (argc == 2 && strcmp(argv[1], "--version") == 0) {
-        printf("GTFS Precache Tool v%s\n", version);
-        return 0;  // Success exit code for version
-    }
-    
-    // Print version and check arguments
-    printf("GTFS Precache Tool v%s\n", version);
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <input_file> <output_file> [cpu_limit]\n", argv[0]);
-        return 1;
+#define MAX_MERGE_FAN_IN 64
+#define MIN_SORT_MEMORY (4LL * 1024 * 1024)
+
+// A parsed row. text holds trip_id, arrival_time, departure_time and
+// stop_id back to back, each NUL terminated, so it compares by trip_id.
+// Run files store rows as uint32 size, int32 stop_sequence, then the text.
+typedef struct {
+    char* text;
+    uint32_t size;
+    int32_t stop_sequence;
+} SortRow;
+
+// Reads the rows of a run file one at a time
+typedef struct {
+    FILE* fp;
+    SortRow row;
+    uint32_t cap;
+} RunReader;
+
+typedef int (*RowSink)(const SortRow* row, void* ctx);
+
+static int compare_sort_rows(const void* a, const void* b) {
+    const SortRow* x = a;
+    const SortRow* y = b;
+    int c = strcmp(x->text, y->text);
+    if (c != 0) return c;
+    return (x->stop_sequence > y->stop_sequence) - (x->stop_sequence < y->stop_sequence);
+}
+
+static void run_path(char* path, size_t size, const char* output_file, size_t run) {
+    snprintf(path, size, "%s.run%zu", output_file, run);
+}
+
+static int write_sort_row(FILE* fp, const SortRow* row) {
+    if (fwrite(&row->size, sizeof(row->size), 1, fp) != 1 ||
+        fwrite(&row->stop_sequence, sizeof(row->stop_sequence), 1, fp) != 1 ||
+        fwrite(row->text, 1, row->size, fp) != row->size) {
+        fprintf(stderr, "Error: Could not write sorted run\n");
+        fflush(stderr);
+        return -1;
     }
-    
-    const char* input_file = argv[1];
-    const char* output_file = argv[2];
-    int cpu_limit = DEFAULT_CPU_LIMIT;
-    
-    if (argc > 3) {
-        cpu_limit = atoi(argv[3]);
-        if (cpu_limit < 1 || cpu_limit > 100) {
+    return 0;
+}
+
+static int run_file_sink(const SortRow* row, void* ctx) {
+    return write_sort_row((FILE*)ctx, row);
+}
+
+// msgpack write callback streaming into a FILE*. Unlike msgpack_fbuffer_write
+// it accepts the empty writes made for empty strings.
+static int file_write(void* data, const char* buf, size_t len) {
+    return len == 0 || fwrite(buf, 1, len, (FILE*)data) == len ? 0 : -1;
+}
+
+static int output_sink(const SortRow* row, void* ctx) {
+    const char* trip_id = row->text;
+    const char* arrival_time = trip_id + strlen(trip_id) + 1;
+    const char* departure_time = arrival_time + strlen(arrival_time) + 1;
+    const char* stop_id = departure_time + strlen(departure_time) + 1;
+    return pack_stop_time((msgpack_packer*)ctx, trip_id, arrival_time, departure_time, stop_id,
+                          row->stop_sequence);
+}
+
+// Sort the rows and write them to a new run file
+static int spill_run(const char* path, SortRow* rows, size_t count, PhaseStats* stats) {
+    stats_begin(stats, STAT_SORT);
+    qsort(rows, count, sizeof(SortRow), compare_sort_rows);
+    stats_begin(stats, STAT_WRITE);
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not create run file %s\n", path);
+        fflush(stderr);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (write_sort_row(fp, &rows[i]) != 0) {
+            fclose(fp);
+            return -1;
+        }
+    }
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Error: Could not write run file %s\n", path);
+        fflush(stderr);
+        return -1;
+    }
+    return 0;
+}
+
+// Read the next row of a run: 1 when a row was read, 0 at the end of the
+// run, -1 on error
+static int run_reader_next(RunReader* reader) {
+    uint32_t size;
+    if (fread(&size, sizeof(size), 1, reader->fp) != 1) {
+        return feof(reader->fp) ? 0 : -1;
+    }
+    if (size > reader->cap) {
+        char* text = realloc(reader->row.text, size);
+        if (!text) return -1;
+        reader->row.text = text;
+        reader->cap = size;
+    }
+    if (fread(&reader->row.stop_sequence, sizeof(int32_t), 1, reader->fp) != 1 ||
+        fread(reader->row.text, 1, size, reader->fp) != size) {
+        return -1;
+    }
+    reader->row.size = size;
+    return 1;
+}
+
+static int run_less(const RunReader* readers, size_t a, size_t b) {
+    int c = compare_sort_rows(&readers[a].row, &readers[b].row);
+    return c < 0 || (c == 0 && a < b);
+}
+
+static void heap_sift_down(size_t* heap, size_t n, size_t i, const RunReader* readers) {
+    for (;;) {
+        size_t child = 2 * i + 1;
+        size_t best = i;
+        if (child < n && run_less(readers, heap[child], heap[best])) best = child;
+        if (child + 1 < n && run_less(readers, heap[child + 1], heap[best])) best = child + 1;
+        if (best == i) return;
+        size_t tmp = heap[i];
+        heap[i] = heap[best];
+        heap[best] = tmp;
+        i = best;
+    }
+}
+
+// Merge runs first .. first + count - 1 into one sorted stream of rows
+// passed to sink. The run files are removed afterwards.
+static int merge_runs(const char* output_file, size_t first, size_t count, RowSink sink, void* ctx,
+                      CpuThrottle* throttle, ProgressReporter* progress) {
+    RunReader* readers = calloc(count, sizeof(RunReader));
+    size_t* heap = malloc(sizeof(size_t) * (count + 1));
+    char path[PATH_MAX];
+    size_t n = 0;
+    int result = -1;
+    if (!readers || !heap) {
+        fprintf(stderr, "Error: Out of memory merging runs\n");
+        fflush(stderr);
+        goto done;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        run_path(path, sizeof(path), output_file, first + i);
+        readers[i].fp = fopen(path, "rb");
+        if (!readers[i].fp) {
+            fprintf(stderr, "Error: Could not open run file %s\n", path);
+            fflush(stderr);
+            goto done;
+        }
+        int r = run_reader_next(&readers[i]);
+        if (r < 0) goto read_error;
+        if (r > 0) heap[n++] = i;
+    }
+    for (size_t i = n / 2; i-- > 0;) {
+        heap_sift_down(heap, n, i, readers);
+    }
+
+    size_t merged = 0;
+    while (n > 0) {
+        RunReader* top = &readers[heap[0]];
+        if (sink(&top->row, ctx) != 0) goto done;
+        PROGRESS_STORE(progress->rows, ++merged);
+        if (merged % BATCH_SIZE == 0) {
+            cpu_throttle(throttle);
+        }
+        int r = run_reader_next(top);
+        if (r < 0) goto read_error;
+        if (r == 0) heap[0] = heap[--n];
+        heap_sift_down(heap, n, 0, readers);
+    }
+    result = 0;
+    goto done;
+
+read_error:
+    fprintf(stderr, "Error: Could not read sorted run\n");
+    fflush(stderr);
+done:
+    for (size_t i = 0; readers && i < count; i++) {
+        if (readers[i].fp) fclose(readers[i].fp);
+        free(readers[i].row.text);
+        run_path(path, sizeof(path), output_file, first + i);
+        remove(path);
+    }
+    free(readers);
+    free(heap);
+    return result;
+}
+
+int process_stop_times_external(const char* input_file, const char* output_file, long long max_memory,
+                                CpuThrottle* throttle, ProgressReporter* progress, PhaseStats* stats) {
+    if (max_memory < MIN_SORT_MEMORY) max_memory = MIN_SORT_MEMORY;
+
+    // A quarter of the budget indexes the rows, the rest holds their text
+    size_t row_cap = (size_t)max_memory / 4 / sizeof(SortRow);
+    size_t text_cap = (size_t)max_memory - row_cap * sizeof(SortRow);
+    SortRow* rows = malloc(sizeof(SortRow) * row_cap);
+    char* text = malloc(text_cap);
+    LineBatch* batch = calloc(1, sizeof(LineBatch));
+    InputFile input = {input_file, NULL, NULL};
+    FILE* out = NULL;
+    size_t n_runs = 0;
+    int result = 1;
+    char path[PATH_MAX];
+    char line[MAX_LINE_LENGTH];
+    char memory_str[32];
+
+    if (!rows || !text || !batch) {
+        fprintf(stderr, "Error: Could not allocate %lld bytes for sorting\n", max_memory);
+        fflush(stderr);
+        goto cleanup;
+    }
+    if (input_open(&input, input_file) != 0) goto cleanup;
+    int columns[5];
+    if (!fgets(line, sizeof(line), input.fp)) {
+        fprintf(stderr, "Error: Could not read header line\n");
+        fflush(stderr);
+        goto cleanup;
+    }
+    size_t bytes = strlen(line);
+    if (get_column_indices(line, columns) != 0) goto cleanup;
+
+    format_size((long)max_memory, memory_str);
+    printf("Sorting stop times in runs of up to %s\n", memory_str);
+    fflush(stdout);
+
+    // Parse into runs, spilling each one when the budget is full
+    size_t n_rows = 0;
+    size_t text_used = 0;
+    size_t total = 0;
+    progress_phase(progress, PHASE_SORT, 0);
+    for (;;) {
+        stats_begin(stats, STAT_READ);
+        long n = read_batch(input.fp, batch, &bytes);
+        if (n < 0) goto cleanup;
+        if (n == 0) break;
+        if (parse_batch(batch, columns, total + 1, stats) != 0) goto cleanup;
+
+        for (size_t i = 0; i < batch->count; i++) {
+            char** values = batch->fields[i];
+            size_t size = 0;
+            for (int f = 0; f < 4; f++) {
+                size += strlen(values[f]) + 1;
+            }
+            if (n_rows == row_cap || text_used + size > text_cap) {
+                run_path(path, sizeof(path), output_file, n_runs);
+                if (spill_run(path, rows, n_rows, stats) != 0) goto cleanup;
+                stats_begin(stats, STAT_CONVERT);
+                n_runs++;
+                n_rows = 0;
+                text_used = 0;
+            }
+
+            SortRow* row = &rows[n_rows++];
+            row->text = text + text_used;
+            row->size = (uint32_t)size;
+            row->stop_sequence = batch->seqs[i];
+            for (int f = 0; f < 4; f++) {
+                size_t len = strlen(values[f]) + 1;
+                memcpy(text + text_used, values[f], len);
+                text_used += len;
+            }
+        }
+        stats_end(stats);
+        total += batch->count;
+        PROGRESS_STORE(progress->rows, total);
+        PROGRESS_STORE(progress->bytes, bytes);
+        cpu_throttle(throttle);
+    }
+    run_path(path, sizeof(path), output_file, n_runs);
+    if (spill_run(path, rows, n_rows, stats) != 0) goto cleanup;
+    stats_end(stats);
+    n_runs++;
+    if (input_close(&input) != 0) goto cleanup;
+    stats->rows = total;
+    stats->bytes = bytes;
+
+    // The merge only needs one row per run
+    free(rows);
+    free(text);
+    free_batch(batch);
+    rows = NULL;
+    text = NULL;
+    batch = NULL;
+    printf("Sorted %zu rows into %zu runs\n", total, n_runs);
+    fflush(stdout);
+
+    // Merge in passes until few enough runs are left for the final merge
+    size_t first = 0;
+    if (n_runs > MAX_MERGE_FAN_IN) {
+        progress_phase(progress, PHASE_MERGE_PASS, 0);
+    }
+    while (n_runs - first > MAX_MERGE_FAN_IN) {
+        run_path(path, sizeof(path), output_file, n_runs);
+        FILE* run = fopen(path, "wb");
+        if (!run) {
+            fprintf(stderr, "Error: Could not create run file %s\n", path);
+            fflush(stderr);
+            goto cleanup;
+        }
+        n_runs++;
+        stats_begin(stats, STAT_MERGE);
+        int merged = merge_runs(output_file, first, MAX_MERGE_FAN_IN, run_file_sink, run, throttle, progress);
+        stats_end(stats);
+        if (fclose(run) != 0 || merged != 0) {
+            fprintf(stderr, "Error: Could not merge runs into %s\n", path);
+            fflush(stderr);
+            goto cleanup;
+        }
+        first += MAX_MERGE_FAN_IN;
+    }
+
+    out = fopen(output_file, "wb");
+    if (!out) {
+        fprintf(stderr, "Error: Could not open output file %s\n", output_file);
+        fflush(stderr);
+        goto cleanup;
+    }
+    msgpack_packer pk;
+    msgpack_packer_init(&pk, out, file_write);
+    if (msgpack_pack_map(&pk, 1) != 0 ||
+        msgpack_pack_str(&pk, 10) != 0 ||
+        msgpack_pack_str_body(&pk, "stop_times", 10) != 0 ||
+        msgpack_pack_array(&pk, total) != 0) {
+        fprintf(stderr, "Error: Could not pack stop_times header\n");
+        fflush(stderr);
+        goto cleanup;
+    }
+    progress_phase(progress, PHASE_MERGE, total);
+    stats_begin(stats, STAT_MERGE);
+    if (merge_runs(output_file, first, n_runs - first, output_sink, &pk, throttle, progress) != 0) {
+        goto cleanup;
+    }
+    FILE* closing = out;
+    out = NULL;
+    int closed = fclose(closing);
+    stats_end(stats);
+    if (closed != 0) {
+        fprintf(stderr, "Error: Could not write output file %s\n", output_file);
+        fflush(stderr);
+        goto cleanup;
+    }
+
+    format_size(get_memory_usage(), memory_str);
+    printf("Processing complete. Processed %zu rows grouped by trip (peak memory: %s).\n",
+           total, memory_str);
+    fflush(stdout);
+    cpu_throttle_report(throttle);
+    result = 0;
+
+cleanup:
+    stats_end(stats);
+    input_close(&input);
+    if (out) fclose(out);
+    free(rows);
+    free(text);
+    free_batch(batch);
+    for (size_t i = 0; i < n_runs; i++) {
+        run_path(path, sizeof(path), output_file, i);
+        remove(path);
+    }
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Incremental mode
+//
+// The output is written grouped by trip, in order of first appearance, and
+// `<output>.index` records where each trip's section starts, how long it is
+// and a hash of its converted rows. The next run over a new version of the
+// feed hashes every trip again (reading and tokenizing, no packing), copies
+// the sections of unchanged trips from the previous output, and only packs
+// the rows of trips that were added or changed. Only the changed rows are
+// held in memory; when they exceed max_memory (on a first run, every row
+// has changed) they are packed and written a run of consecutive trips at a
+// time, re-reading the input once per run, so the output stays the same.
+// ---------------------------------------------------------------------------
+
+#define INDEX_MAGIC "GTFSIDX1"
+// Memory to repack a row besides its text: the map keys and headers of the
+// packed row and its entries in the changed row arrays
+#define INCREMENTAL_ROW_MEMORY 96
+#define COPY_BUFFER_SIZE (256 * 1024)
+#define FNV64_OFFSET 14695981039346656037ULL
+#define FNV64_PRIME 1099511628211ULL
+
+typedef struct {
+    uint32_t name;          // Offset of trip_id in TripTable.names
+    uint32_t rows;
+    uint64_t hash;          // Of the trip's converted rows, in input order
+    uint64_t offset;        // Section in the output file
+    uint64_t size;
+    int64_t previous;       // Same section in the previous output, -1 when changed
+    uint64_t memory;        // Estimated memory to repack the trip, not in the index
+} TripSection;
+
+typedef struct {
+    StringInterner names;
+    TripSection* trips;     // In order of first appearance
+    size_t count;
+    size_t cap;
+    uint32_t* slots;        // Trip index + 1, 0 for empty slots
+    uint32_t mask;
+} TripTable;
+
+static uint64_t hash_bytes(uint64_t h, const void* data, size_t len) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= FNV64_PRIME;
+    }
+    return h;
+}
+
+// Path of a file next to output_file. Fails rather than truncating it, so
+// a long output path never reads or writes the wrong sidecar.
+static int sidecar_path(char* path, size_t size, const char* output_file, const char* suffix) {
+    int n = snprintf(path, size, "%s%s", output_file, suffix);
+    if (n < 0 || (size_t)n >= size) {
+        fprintf(stderr, "Error: Path too long: %s%s\n", output_file, suffix);
+        fflush(stderr);
+        return -1;
+    }
+    return 0;
+}
+
+static int index_path(char* path, size_t size, const char* output_file) {
+    return sidecar_path(path, size, output_file, ".index");
+}
+
+static int seek_to(FILE* fp, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(fp, (long long)offset, SEEK_SET);
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static void trip_table_free(TripTable* table) {
+    interner_free(&table->names);
+    free(table->trips);
+    free(table->slots);
+    memset(table, 0, sizeof(*table));
+}
+
+static const char* trip_name(const TripTable* table, size_t trip) {
+    return table->names.data + table->trips[trip].name;
+}
+
+// Index of trip_id, or -1 when the table does not have it
+static long long trip_table_find(const TripTable* table, const char* trip_id, uint32_t hash) {
+    if (!table->slots) return -1;
+    for (uint32_t i = hash & table->mask; table->slots[i]; i = (i + 1) & table->mask) {
+        size_t trip = table->slots[i] - 1;
+        if (strcmp(trip_name(table, trip), trip_id) == 0) return (long long)trip;
+    }
+    return -1;
+}
+
+// Add a trip that is not in the table yet. Returns its index, -1 when out
+// of memory.
+static long long trip_table_add(TripTable* table, const char* trip_id, uint32_t hash) {
+    if (table->count == table->cap) {
+        size_t cap = table->cap ? table->cap * 2 : 1024;
+        TripSection* trips = realloc(table->trips, sizeof(TripSection) * cap);
+        if (!trips) goto oom;
+        table->trips = trips;
+        table->cap = cap;
+    }
+    if (!table->slots || (table->count + 1) * 2 > (size_t)table->mask + 1) {
+        size_t n_slots = table->slots ? ((size_t)table->mask + 1) * 2 : 2048;
+        uint32_t* slots = calloc(n_slots, sizeof(uint32_t));
+        if (!slots) goto oom;
+        uint32_t mask = (uint32_t)(n_slots - 1);
+        for (size_t t = 0; t < table->count; t++) {
+            uint32_t i = gtfs_hash(trip_name(table, t)) & mask;
+            while (slots[i]) i = (i + 1) & mask;
+            slots[i] = (uint32_t)t + 1;
+        }
+        free(table->slots);
+        table->slots = slots;
+        table->mask = mask;
+    }
+    int64_t name = interner_add(&table->names, trip_id, hash);
+    if (name < 0) return -1;
+
+    TripSection* trip = &table->trips[table->count];
+    memset(trip, 0, sizeof(*trip));
+    trip->name = (uint32_t)name;
+    trip->hash = FNV64_OFFSET;
+    trip->previous = -1;
+    uint32_t i = hash & table->mask;
+    while (table->slots[i]) i = (i + 1) & table->mask;
+    table->slots[i] = (uint32_t)table->count + 1;
+    return (long long)table->count++;
+
+oom:
+    fprintf(stderr, "Error: Out of memory indexing trips\n");
+    fflush(stderr);
+    return -1;
+}
+
+// Write the section index of output_file:
+// magic, uint64 trip count, uint64 output size, then per trip uint64 hash,
+// offset and size, uint32 rows, uint32 trip_id length and the trip_id
+static int write_index(const char* path, const TripTable* table, uint64_t output_size) {
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not create index file %s\n", path);
+        fflush(stderr);
+        return -1;
+    }
+    uint64_t count = table->count;
+    int ok = fwrite(INDEX_MAGIC, 1, 8, fp) == 8 &&
+             fwrite(&count, sizeof(count), 1, fp) == 1 &&
+             fwrite(&output_size, sizeof(output_size), 1, fp) == 1;
+    for (size_t t = 0; ok && t < table->count; t++) {
+        const TripSection* trip = &table->trips[t];
+        const char* name = trip_name(table, t);
+        uint32_t len = (uint32_t)strlen(name);
+        ok = fwrite(&trip->hash, sizeof(trip->hash), 1, fp) == 1 &&
+             fwrite(&trip->offset, sizeof(trip->offset), 1, fp) == 1 &&
+             fwrite(&trip->size, sizeof(trip->size), 1, fp) == 1 &&
+             fwrite(&trip->rows, sizeof(trip->rows), 1, fp) == 1 &&
+             fwrite(&len, sizeof(len), 1, fp) == 1 &&
+             fwrite(name, 1, len, fp) == len;
+    }
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write index file %s\n", path);
+        fflush(stderr);
+        remove(path);
+        return -1;
+    }
+    return 0;
+}
+
+// Load the index of a previous output. Returns -1 when it is missing or
+// does not describe that output, in which case every trip is rebuilt.
+static int load_index(const char* output_file, TripTable* table) {
+    char path[PATH_MAX];
+    if (index_path(path, sizeof(path), output_file) != 0) return -1;
+    struct stat st;
+    FILE* fp = fopen(path, "rb");
+    if (!fp || stat(output_file, &st) != 0) {
+        if (fp) fclose(fp);
+        return -1;
+    }
+
+    char magic[8];
+    uint64_t count, output_size;
+    char name[MAX_LINE_LENGTH];
+    int ok = fread(magic, 1, 8, fp) == 8 && memcmp(magic, INDEX_MAGIC, 8) == 0 &&
+             fread(&count, sizeof(count), 1, fp) == 1 &&
+             fread(&output_size, sizeof(output_size), 1, fp) == 1 &&
+             output_size == (uint64_t)st.st_size;
+    for (uint64_t t = 0; ok && t < count; t++) {
+        TripSection section;
+        uint32_t len;
+        ok = fread(&section.hash, sizeof(section.hash), 1, fp) == 1 &&
+             fread(&section.offset, sizeof(section.offset), 1, fp) == 1 &&
+             fread(&section.size, sizeof(section.size), 1, fp) == 1 &&
+             fread(&section.rows, sizeof(section.rows), 1, fp) == 1 &&
+             fread(&len, sizeof(len), 1, fp) == 1 &&
+             len < sizeof(name) && fread(name, 1, len, fp) == len &&
+             section.offset + section.size <= output_size;
+        if (!ok) break;
+        name[len] = '\0';
+        uint32_t hash = gtfs_hash(name);
+        long long trip = trip_table_find(table, name, hash);
+        if (trip < 0) trip = trip_table_add(table, name, hash);
+        if (trip < 0) {
+            ok = 0;
+            break;
+        }
+        section.name = table->trips[trip].name;
+        section.previous = -1;
+        section.memory = 0;
+        table->trips[trip] = section;
+    }
+    fclose(fp);
+    if (!ok) {
+        printf("Ignoring index %s: it does not match %s\n", path, output_file);
+        fflush(stdout);
+        trip_table_free(table);
+        return -1;
+    }
+    return 0;
+}
+
+static int copy_section(FILE* from, uint64_t offset, uint64_t size, FILE* to, char* buffer) {
+    if (seek_to(from, offset) != 0) return -1;
+    while (size > 0) {
+        size_t chunk = size < COPY_BUFFER_SIZE ? (size_t)size : COPY_BUFFER_SIZE;
+        if (fread(buffer, 1, chunk, from) != chunk || fwrite(buffer, 1, chunk, to) != chunk) {
+            return -1;
+        }
+        size -= chunk;
+    }
+    return 0;
+}
+
+int process_stop_times_incremental(const char* input_file, const char* output_file,
+                                   const char* previous_file, long long max_memory,
+                                   CpuThrottle* throttle, ProgressReporter* progress,
+                                   PhaseStats* stats) {
+    TripTable trips, previous;
+    memset(&trips, 0, sizeof(trips));
+    memset(&previous, 0, sizeof(previous));
+    LineBatch* batch = calloc(1, sizeof(LineBatch));
+    uint32_t* row_trips = NULL;         // Trip of each input row
+    size_t row_cap = 0;
+    msgpack_sbuffer packed;             // Rows of the changed trips
+    msgpack_sbuffer_init(&packed);
+    uint64_t* changed_starts = NULL;    // Where each changed row starts in packed
+    uint32_t* changed_trips = NULL;
+    size_t* trip_first = NULL;          // Per trip, its first row in changed_order
+    size_t* changed_order = NULL;
+    char* copy_buffer = NULL;
+    InputFile input = {input_file, NULL, NULL};
+    FILE* prev = NULL;
+    FILE* out = NULL;
+    int result = 1;
+    char tmp_path[PATH_MAX], index_tmp[PATH_MAX], final_index[PATH_MAX];
+    char line[MAX_LINE_LENGTH];
+    index_tmp[0] = '\0';
+    if (sidecar_path(tmp_path, sizeof(tmp_path), output_file, ".tmp") != 0 ||
+        index_path(final_index, sizeof(final_index), output_file) != 0 ||
+        sidecar_path(index_tmp, sizeof(index_tmp), output_file, ".index.tmp") != 0) {
+        tmp_path[0] = '\0';
+        index_tmp[0] = '\0';
+        goto cleanup;
+    }
+
+    if (!batch) {
+        fprintf(stderr, "Error: Out of memory\n");
+        fflush(stderr);
+        goto cleanup;
+    }
+    if (previous_file && load_index(previous_file, &previous) == 0) {
+        prev = fopen(previous_file, "rb");
+        if (!prev) trip_table_free(&previous);
+    }
+    if (prev) {
+        printf("Reusing unchanged trips from %s (%zu trips)\n", previous_file, previous.count);
+    } else {
+        printf("No previous output to reuse, converting every trip\n");
+    }
+    fflush(stdout);
+
+    if (input_open(&input, input_file) != 0) goto cleanup;
+    int columns[5];
+    if (!fgets(line, sizeof(line), input.fp)) {
+        fprintf(stderr, "Error: Could not read header line\n");
+        fflush(stderr);
+        goto cleanup;
+    }
+    size_t bytes = strlen(line);
+    if (get_column_indices(line, columns) != 0) goto cleanup;
+
+    // Pass 1: hash the rows of every trip
+    size_t total = 0;
+    long long last_trip = -1;
+    progress_phase(progress, PHASE_HASH, 0);
+    for (;;) {
+        stats_begin(stats, STAT_READ);
+        long n = read_batch(input.fp, batch, &bytes);
+        if (n < 0) goto cleanup;
+        if (n == 0) break;
+        if (parse_batch(batch, columns, total + 1, stats) != 0) goto cleanup;
+
+        stats_begin(stats, STAT_HASH);
+        if (total + batch->count > row_cap) {
+            size_t cap = row_cap ? row_cap * 2 : 1 << 20;
+            uint32_t* grown = realloc(row_trips, sizeof(uint32_t) * cap);
+            if (!grown) {
+                fprintf(stderr, "Error: Out of memory indexing trips\n");
+                fflush(stderr);
+                goto cleanup;
+            }
+            row_trips = grown;
+            row_cap = cap;
+        }
+        for (size_t i = 0; i < batch->count; i++) {
+            char** values = batch->fields[i];
+            // Rows of a trip are nearly always consecutive
+            if (last_trip < 0 || strcmp(trip_name(&trips, (size_t)last_trip), values[0]) != 0) {
+                uint32_t hash = gtfs_hash(values[0]);
+                last_trip = trip_table_find(&trips, values[0], hash);
+                if (last_trip < 0) last_trip = trip_table_add(&trips, values[0], hash);
+                if (last_trip < 0) goto cleanup;
+            }
+            TripSection* trip = &trips.trips[last_trip];
+            uint64_t h = trip->hash;
+            size_t text = strlen(values[0]);
+            for (int f = 1; f < 4; f++) {
+                size_t len = strlen(values[f]);
+                h = hash_bytes(h, values[f], len + 1);
+                text += len;
+            }
+            trip->hash = hash_bytes(h, &batch->seqs[i], sizeof(int32_t));
+            trip->memory += text + INCREMENTAL_ROW_MEMORY;
+            trip->rows++;
+            row_trips[total + i] = (uint32_t)last_trip;
+        }
+        stats_end(stats);
+        total += batch->count;
+        PROGRESS_STORE(progress->rows, total);
+        PROGRESS_STORE(progress->bytes, bytes);
+        cpu_throttle(throttle);
+    }
+    stats_end(stats);
+    stats->rows = total;
+    stats->bytes = bytes;
+
+    // Trips whose rows did not change keep their previous section
+    size_t changed_rows = 0;
+    size_t changed_trip_count = 0;
+    for (size_t t = 0; t < trips.count; t++) {
+        TripSection* trip = &trips.trips[t];
+        const char* name = trip_name(&trips, t);
+        long long p = prev ? trip_table_find(&previous, name, gtfs_hash(name)) : -1;
+        if (p >= 0 && previous.trips[p].hash == trip->hash && previous.trips[p].rows == trip->rows) {
+            trip->previous = p;
+        } else {
+            changed_rows += trip->rows;
+            changed_trip_count++;
+        }
+    }
+    printf("%zu of %zu trips changed (%zu of %zu rows)\n",
+           changed_trip_count, trips.count, changed_rows, total);
+    fflush(stdout);
+
+    // Open the output before packing: with a budget, the changed trips are
+    // packed a run of consecutive trips at a time and written out in between
+    copy_buffer = malloc(COPY_BUFFER_SIZE);
+    trip_first = calloc(trips.count + 1, sizeof(size_t));
+    out = fopen(tmp_path, "wb");
+    if (!copy_buffer || !trip_first || !out) {
+        fprintf(stderr, "Error: Could not open output file %s\n", tmp_path);
+        fflush(stderr);
+        goto cleanup;
+    }
+    msgpack_sbuffer header;
+    msgpack_sbuffer_init(&header);
+    msgpack_packer hk;
+    msgpack_packer_init(&hk, &header, msgpack_sbuffer_write);
+    int packed_header = msgpack_pack_map(&hk, 1) == 0 &&
+                        msgpack_pack_str(&hk, 10) == 0 &&
+                        msgpack_pack_str_body(&hk, "stop_times", 10) == 0 &&
+                        msgpack_pack_array(&hk, total) == 0 &&
+                        fwrite(header.data, 1, header.size, out) == header.size;
+    uint64_t pos = header.size;
+    msgpack_sbuffer_destroy(&header);
+    if (!packed_header) goto write_error;
+
+    size_t written_rows = 0;
+    size_t reused_bytes = 0;
+    size_t passes = 0;
+    size_t changed_cap = 0;
+    for (size_t first = 0, end; first < trips.count; first = end) {
+        // Take trips, in order of first appearance, until their changed rows
+        // would not fit in the budget (a trip larger than it goes alone)
+        size_t chunk_rows = 0;
+        uint64_t chunk_memory = 0;
+        for (end = first; end < trips.count; end++) {
+            const TripSection* trip = &trips.trips[end];
+            if (trip->previous >= 0) continue;
+            if (max_memory > 0 && chunk_rows > 0 && chunk_memory + trip->memory > (uint64_t)max_memory) break;
+            chunk_memory += trip->memory;
+            chunk_rows += trip->rows;
+        }
+
+        // Pass 2: pack the rows of the changed trips in [first, end)
+        if (chunk_rows > 0) {
+            if (chunk_rows > changed_cap) {
+                free(changed_starts);
+                free(changed_trips);
+                free(changed_order);
+                changed_starts = malloc(sizeof(uint64_t) * (chunk_rows + 1));
+                changed_trips = malloc(sizeof(uint32_t) * chunk_rows);
+                changed_order = malloc(sizeof(size_t) * chunk_rows);
+                if (!changed_starts || !changed_trips || !changed_order) {
+                    fprintf(stderr, "Error: Out of memory packing changed trips\n");
+                    fflush(stderr);
+                    goto cleanup;
+                }
+                changed_cap = chunk_rows;
+            }
+            msgpack_sbuffer_clear(&packed);
+            msgpack_packer pk;
+            msgpack_packer_init(&pk, &packed, msgpack_sbuffer_write);
+            if (input_rewind(&input) != 0) goto cleanup;
+            if (!fgets(line, sizeof(line), input.fp)) goto cleanup;
+            size_t scanned = 0;
+            size_t n_changed = 0;
+            bytes = strlen(line);
+            progress_phase(progress, PHASE_PARSE, total);
+            for (;;) {
+                stats_begin(stats, STAT_READ);
+                long n = read_batch(input.fp, batch, &bytes);
+                if (n < 0) goto cleanup;
+                if (n == 0) break;
+                if (scanned + batch->count > total) goto changed_input;
+                // Keep only the lines of this run's changed trips
+                size_t first_changed = n_changed;
+                size_t kept = 0;
+                for (size_t i = 0; i < batch->count; i++) {
+                    uint32_t trip = row_trips[scanned + i];
+                    if (trip >= first && trip < end && trips.trips[trip].previous < 0) {
+                        if (n_changed == chunk_rows) goto changed_input;
+                        batch->offsets[kept++] = batch->offsets[i];
+                        changed_trips[n_changed++] = trip;
+                    }
+                }
+                scanned += batch->count;
+                batch->count = kept;
+                if (parse_batch(batch, columns, scanned, stats) != 0) goto cleanup;
+
+                stats_begin(stats, STAT_PACK);
+                for (size_t i = 0; i < batch->count; i++) {
+                    char** values = batch->fields[i];
+                    changed_starts[first_changed + i] = packed.size;
+                    if (pack_stop_time(&pk, values[0], values[1], values[2], values[3], batch->seqs[i]) != 0) {
+                        goto cleanup;
+                    }
+                }
+                stats_end(stats);
+                PROGRESS_STORE(progress->rows, scanned);
+                PROGRESS_STORE(progress->bytes, bytes);
+                cpu_throttle(throttle);
+            }
+            stats_end(stats);
+            if (n_changed != chunk_rows || scanned != total) goto changed_input;
+            changed_starts[n_changed] = packed.size;
+            passes++;
+
+            // Group the changed rows by trip, keeping their input order
+            memset(trip_first + first, 0, sizeof(size_t) * (end - first + 1));
+            for (size_t r = 0; r < n_changed; r++) trip_first[changed_trips[r] + 1]++;
+            for (size_t t = first; t < end; t++) trip_first[t + 1] += trip_first[t];
+            for (size_t r = 0; r < n_changed; r++) changed_order[trip_first[changed_trips[r]]++] = r;
+            for (size_t t = end; t > first; t--) trip_first[t] = trip_first[t - 1];
+            trip_first[first] = 0;
+        }
+
+        // Write the sections of [first, end)
+        progress_phase(progress, PHASE_WRITE, total);
+        PROGRESS_STORE(progress->rows, written_rows);
+        stats_begin(stats, STAT_WRITE);
+        for (size_t t = first; t < end; t++) {
+            TripSection* trip = &trips.trips[t];
+            trip->offset = pos;
+            if (trip->previous >= 0) {
+                const TripSection* old = &previous.trips[trip->previous];
+                if (copy_section(prev, old->offset, old->size, out, copy_buffer) != 0) goto write_error;
+                trip->size = old->size;
+                reused_bytes += old->size;
+            } else {
+                trip->size = 0;
+                for (size_t k = trip_first[t]; k < trip_first[t + 1]; k++) {
+                    size_t r = changed_order[k];
+                    size_t len = (size_t)(changed_starts[r + 1] - changed_starts[r]);
+                    if (fwrite(packed.data + changed_starts[r], 1, len, out) != len) goto write_error;
+                    trip->size += len;
+                }
+            }
+            pos += trip->size;
+            written_rows += trip->rows;
+            PROGRESS_STORE(progress->rows, written_rows);
+        }
+        stats_end(stats);
+    }
+    if (input_close(&input) != 0) goto cleanup;
+    stats_begin(stats, STAT_WRITE);
+    FILE* closing = out;
+    out = NULL;
+    if (fclose(closing) != 0) goto write_error;
+    if (prev) {
+        fclose(prev);
+        prev = NULL;
+    }
+    if (write_index(index_tmp, &trips, pos) != 0) goto cleanup;
+    stats_end(stats);
+
+#ifdef _WIN32
+    remove(output_file);
+    remove(final_index);
+#endif
+    if (rename(tmp_path, output_file) != 0 || rename(index_tmp, final_index) != 0) {
+        fprintf(stderr, "Error: Could not replace %s\n", output_file);
+        fflush(stderr);
+        remove(final_index);
+        goto cleanup;
+    }
+
+    char reused_str[32], memory_str[32];
+    format_size((long)reused_bytes, reused_str);
+    format_size(get_memory_usage(), memory_str);
+    printf("Processing complete. Processed %zu rows grouped by trip, repacked %zu in %zu pass%s, "
+           "reused %s (peak memory: %s).\n", total, changed_rows, passes, passes == 1 ? "" : "es",
+           reused_str, memory_str);
+    fflush(stdout);
+    cpu_throttle_report(throttle);
+    result = 0;
+    goto cleanup;
+
+changed_input:
+    fprintf(stderr, "Error: %s changed while it was being read\n", input_file);
+    fflush(stderr);
+    goto cleanup;
+write_error:
+    fprintf(stderr, "Error: Could not write output file %s\n", tmp_path);
+    fflush(stderr);
+cleanup:
+    stats_end(stats);
+    input_close(&input);
+    if (prev) fclose(prev);
+    if (out) fclose(out);
+    if (result != 0 && tmp_path[0]) {
+        remove(tmp_path);
+        remove(index_tmp);
+    }
+    trip_table_free(&trips);
+    trip_table_free(&previous);
+    msgpack_sbuffer_destroy(&packed);
+    free_batch(batch);
+    free(row_trips);
+    free(changed_starts);
+    free(changed_trips);
+    free(trip_first);
+    free(changed_order);
+    free(copy_buffer);
+    return result;
+}
+
+// Run one conversion: incremental when asked to (repacking the changed
+// trips within max_memory when it is set), in bounded memory when max_memory
+// is set, else in memory with the given number of parser threads
+static int convert(const char* input_file, const char* output_file, int incremental,
+                   const char* previous_file, long long max_memory, int threads,
+                   CpuThrottle* throttle, ProgressReporter* progress, PhaseStats* stats) {
+    if (incremental) {
+        return process_stop_times_incremental(input_file, output_file, previous_file, max_memory,
+                                              throttle, progress, stats);
+    }
+    // The output is rewritten without trip sections, so an index left by
+    // an incremental run would no longer describe it
+    char path[PATH_MAX];
+    if (index_path(path, sizeof(path), output_file) != 0) return 1;
+    remove(path);
+    return max_memory > 0
+        ? process_stop_times_external(input_file, output_file, max_memory, throttle, progress, stats)
+        : process_stop_times(input_file, output_file, threads, throttle, progress, stats);
+}
+
+// Parser threads for a conversion given a number of cores: the reader and
+// the packer take a core each, and a single core converts without threads
+static int default_threads(int cpus) {
+    int threads = cpus - 2;
+    if (threads > 4) threads = 4;
+    if (threads < 1) threads = cpus > 1 ? 1 : 0;
+    return threads;
+}
+
+// ---------------------------------------------------------------------------
+// Batch mode
+// ---------------------------------------------------------------------------
+
+/*
+ * gtfs_precache --batch [--jobs N] [--max-memory MB] [--max-cpu PERCENT]
+ *
+ * Converts the stop times of several feeds at once. Commands are read from
+ * stdin, one per line, fields separated by tabs:
+ *
+ *   job <id> <priority> <input> <output> [incremental[=<previous_output>]]
+ *   prioritize <id>
+ *
+ * N workers take queued jobs, highest priority first and oldest first
+ * within a priority; prioritize moves a queued job ahead of all others (the
+ * server uses it for the feed a user is waiting on). Jobs are whole feeds,
+ * so the workers share one queue rather than stealing from each other; the
+ * fine-grained parallelism is the pipeline inside each job.
+ *
+ * Each job is admitted only when its memory estimate fits in what the
+ * running jobs leave of --max-memory, and the head of the queue is never
+ * overtaken, so a large prioritized job cannot be starved by small ones.
+ * Estimates are multiples of the uncompressed input size measured on real
+ * feeds (see batch_estimate). A job larger than the whole budget runs in
+ * bounded-memory mode, or alone when it is incremental. All jobs share one
+ * CPU throttle, --max-cpu in percent of one core (default: every core).
+ *
+ * With JSON events, every event of a job carries its "job" ID; the
+ * scheduler adds "queued" and "started" events and a final "batch" event.
+ * The batch ends once stdin is closed and the queue has drained; the exit
+ * status is 1 when any job failed.
+ */
+
+#define BATCH_MAX_JOBS 16
+#define BATCH_LINE_LENGTH (3 * PATH_MAX + 256)
+#define BATCH_PIPELINE_MEMORY (64LL * 1024 * 1024)  // Blocks in flight, whatever the input size
+
+typedef struct BatchJob {
+    char id[64];
+    int priority;
+    long seq;                       // Submission order
+    char input[PATH_MAX];
+    char output[PATH_MAX];
+    char previous[PATH_MAX];        // Empty: the output itself
+    int incremental;
+    uint64_t memory;                // Budget charged while running
+    long long max_memory;           // Bounded-memory mode when > 0
+    double queued_at;
+    struct BatchJob* next;
+} BatchJob;
+
+typedef struct {
+    BatchJob* queue;
+    long seq;
+    int running;
+    int closed;                     // stdin is at its end
+    int finished;
+    int failed;
+    uint64_t memory_used;
+    uint64_t memory_budget;
+    int threads;                    // Parser threads per job
+    int json;
+    CpuThrottle* throttle;
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE changed;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+#endif
+} BatchScheduler;
+
+static void batch_lock(BatchScheduler* s) {
+#ifdef _WIN32
+    EnterCriticalSection(&s->lock);
+#else
+    pthread_mutex_lock(&s->lock);
+#endif
+}
+
+static void batch_unlock(BatchScheduler* s) {
+#ifdef _WIN32
+    LeaveCriticalSection(&s->lock);
+#else
+    pthread_mutex_unlock(&s->lock);
+#endif
+}
+
+static void batch_wait(BatchScheduler* s) {
+#ifdef _WIN32
+    SleepConditionVariableCS(&s->changed, &s->lock, INFINITE);
+#else
+    pthread_cond_wait(&s->changed, &s->lock);
+#endif
+}
+
+static void batch_broadcast(BatchScheduler* s) {
+#ifdef _WIN32
+    WakeAllConditionVariable(&s->changed);
+#else
+    pthread_cond_broadcast(&s->changed);
+#endif
+}
+
+// The job to run next, or NULL. Called with the lock held.
+static BatchJob** batch_head(BatchScheduler* s) {
+    BatchJob** best = NULL;
+    for (BatchJob** j = &s->queue; *j; j = &(*j)->next) {
+        if (!best || (*j)->priority > (*best)->priority ||
+            ((*j)->priority == (*best)->priority && (*j)->seq < (*best)->seq)) {
+            best = j;
+        }
+    }
+    return best;
+}
+
+static BatchJob** batch_find(BatchScheduler* s, const char* id) {
+    for (BatchJob** j = &s->queue; *j; j = &(*j)->next) {
+        if (strcmp((*j)->id, id) == 0) return j;
+    }
+    return NULL;
+}
+
+static void batch_run_job(BatchScheduler* s, BatchJob* job) {
+    const char* mode = job->incremental ? "incremental"
+        : job->max_memory > 0 ? "bounded" : s->threads > 0 ? "pipeline" : "sequential";
+    if (s->json) {
+        printf("{\"event\":\"started\",\"job\":\"%s\",\"mode\":\"%s\",\"threads\":%d,"
+               "\"memory_bytes\":%llu,\"queued_s\":%.2f}\n",
+               job->id, mode, s->threads, (unsigned long long)job->memory,
+               get_timestamp() - job->queued_at);
+    } else {
+        printf("Job %s: %s -> %s (%s)\n", job->id, job->input, job->output, mode);
+    }
+    fflush(stdout);
+
+    uint64_t input_bytes = 0;
+    int have_size = input_size(job->input, &input_bytes) == 0;
+    ProgressReporter progress;
+    PhaseStats stats;
+    stats_init(&stats, 0);
+    progress_start(&progress, s->json, s->throttle, job->id);
+    PROGRESS_STORE(progress.total_bytes, have_size ? (size_t)input_bytes : 0);
+    int result = convert(job->input, job->output, job->incremental,
+                         job->previous[0] ? job->previous : job->output,
+                         job->max_memory, s->threads, s->throttle, &progress, &stats);
+    progress_stop(&progress, result, &stats);
+    stats_free(&stats);
+    if (!s->json) {
+        printf("Job %s %s\n", job->id, result == 0 ? "done" : "failed");
+        fflush(stdout);
+    }
+
+    batch_lock(s);
+    s->running--;
+    s->memory_used -= job->memory;
+    s->finished++;
+    if (result != 0) s->failed++;
+    batch_broadcast(s);
+    batch_unlock(s);
+    free(job);
+}
+
+static void batch_worker(BatchScheduler* s) {
+    batch_lock(s);
+    for (;;) {
+        BatchJob** head = batch_head(s);
+        if (head && (s->running == 0 || s->memory_used + (*head)->memory <= s->memory_budget)) {
+            BatchJob* job = *head;
+            *head = job->next;
+            s->running++;
+            s->memory_used += job->memory;
+            batch_unlock(s);
+            batch_run_job(s, job);
+            batch_lock(s);
+            continue;
+        }
+        if (!head && s->closed) {
+            break;
+        }
+        batch_wait(s);
+    }
+    batch_unlock(s);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI batch_thread(LPVOID arg) {
+    batch_worker(arg);
+    return 0;
+}
+#else
+static void* batch_thread(void* arg) {
+    batch_worker(arg);
+    return NULL;
+}
+#endif
+
+// Split line at tabs into at most max fields; returns the count
+static int split_tabs(char* line, char** fields, int max) {
+    line[strcspn(line, "\r\n")] = '\0';
+    int n = 0;
+    while (n < max) {
+        fields[n++] = line;
+        char* tab = strchr(line, '\t');
+        if (!tab) break;
+        *tab = '\0';
+        line = tab + 1;
+    }
+    return n;
+}
+
+// IDs are echoed in JSON events unescaped
+static int valid_job_id(const char* id) {
+    if (!*id || strlen(id) >= sizeof(((BatchJob*)0)->id)) return 0;
+    for (const char* c = id; *c; c++) {
+        if (*c == '"' || *c == '\\' || (unsigned char)*c < 0x20) return 0;
+    }
+    return 1;
+}
+
+// Peak memory of a job. The in-memory conversion holds the packed output,
+// about 3x the input; an incremental one also holds the rows grouped by
+// trip, about 4x; the pipeline streams its output.
+static uint64_t batch_estimate(const BatchJob* job, uint64_t input_bytes, int threads) {
+    if (job->incremental) {
+        return input_bytes * 4;
+    }
+    if (threads > 0) {
+        uint64_t memory = input_bytes * 3;
+        return memory < BATCH_PIPELINE_MEMORY ? memory : BATCH_PIPELINE_MEMORY;
+    }
+    return input_bytes * 3;
+}
+
+// Handle one command line from stdin
+static void batch_command(BatchScheduler* s, char* line) {
+    char* fields[6] = {0};
+    int n = split_tabs(line, fields, 6);
+    if (n == 1 && fields[0][0] == '\0') {
+        return;
+    }
+
+    if (strcmp(fields[0], "prioritize") == 0 && n == 2) {
+        batch_lock(s);
+        BatchJob** job = batch_find(s, fields[1]);
+        if (job) {
+            BatchJob** head = batch_head(s);
+            if ((*head)->priority >= (*job)->priority) {
+                (*job)->priority = (*head)->priority + 1;
+            }
+            batch_broadcast(s);
+        }
+        batch_unlock(s);
+        return;
+    }
+
+    if (strcmp(fields[0], "job") != 0 || n < 5) {
+        fprintf(stderr, "Error: Unknown batch command: %s\n", fields[0]);
+        fflush(stderr);
+        return;
+    }
+    if (!valid_job_id(fields[1])) {
+        fprintf(stderr, "Error: Invalid job ID: %s\n", fields[1]);
+        fflush(stderr);
+        return;
+    }
+
+    BatchJob* job = calloc(1, sizeof(BatchJob));
+    if (!job) {
+        fprintf(stderr, "Error: Out of memory queueing job %s\n", fields[1]);
+        fflush(stderr);
+        return;
+    }
+    snprintf(job->id, sizeof(job->id), "%s", fields[1]);
+    job->priority = atoi(fields[2]);
+    snprintf(job->input, sizeof(job->input), "%s", fields[3]);
+    snprintf(job->output, sizeof(job->output), "%s", fields[4]);
+    if (n > 5 && fields[5] && strncmp(fields[5], "incremental", 11) == 0) {
+        job->incremental = 1;
+        if (fields[5][11] == '=') {
+            snprintf(job->previous, sizeof(job->previous), "%s", fields[5] + 12);
+        }
+    }
+
+    uint64_t input_bytes = 0;
+    if (input_size(job->input, &input_bytes) != 0) {
+        input_bytes = 0;
+    }
+    job->memory = batch_estimate(job, input_bytes, s->threads);
+    // A job that would not fit runs in bounded memory: a sorted conversion,
+    // or an incremental one that repacks its changed trips in passes
+    if (job->memory > s->memory_budget) {
+        job->max_memory = (long long)(s->memory_budget / 2);
+        job->memory = s->memory_budget / 2;
+    }
+    job->queued_at = get_timestamp();
+
+    batch_lock(s);
+    if (batch_find(s, job->id)) {
+        batch_unlock(s);
+        fprintf(stderr, "Error: Job %s is already queued\n", job->id);
+        fflush(stderr);
+        free(job);
+        return;
+    }
+    job->seq = s->seq++;
+    job->next = s->queue;
+    s->queue = job;
+    if (s->json) {
+        printf("{\"event\":\"queued\",\"job\":\"%s\",\"priority\":%d,\"memory_bytes\":%llu}\n",
+               job->id, job->priority, (unsigned long long)job->memory);
+        fflush(stdout);
+    }
+    batch_broadcast(s);
+    batch_unlock(s);
+}
+
+static int run_batch(int workers, long long max_memory, int max_cpu, int json) {
+    int cpus = get_cpu_count();
+    if (workers <= 0) {
+        workers = cpus / 2;
+        if (workers > 4) workers = 4;
+        if (workers < 1) workers = 1;
+    }
+    if (workers > BATCH_MAX_JOBS) workers = BATCH_MAX_JOBS;
+    if (max_memory <= 0) {
+        long long available = get_available_memory();
+        max_memory = available > 0 ? available / 2 : 1024LL * 1024 * 1024;
+    }
+
+    CpuThrottle throttle;
+    cpu_throttle_init(&throttle, max_cpu > 0 ? max_cpu : 100 * cpus);
+    throttle.unlimited = throttle.limit >= 100 * cpus;
+
+    BatchScheduler s;
+    memset(&s, 0, sizeof(s));
+    s.memory_budget = (uint64_t)max_memory;
+    s.threads = default_threads(cpus / workers);
+    s.json = json;
+    s.throttle = &throttle;
+#ifdef _WIN32
+    InitializeCriticalSection(&s.lock);
+    InitializeConditionVariable(&s.changed);
+    HANDLE threads[BATCH_MAX_JOBS];
+#else
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.changed, NULL);
+    pthread_t threads[BATCH_MAX_JOBS];
+#endif
+
+    char memory_str[32];
+    format_size((long)max_memory, memory_str);
+    printf("Batch: %d worker%s, %d parser thread%s per job, memory budget %s, CPU limit %d%%\n",
+           workers, workers == 1 ? "" : "s", s.threads, s.threads == 1 ? "" : "s",
+           memory_str, throttle.limit);
+    fflush(stdout);
+
+    int started = 0;
+    for (; started < workers; started++) {
+#ifdef _WIN32
+        threads[started] = CreateThread(NULL, 0, batch_thread, &s, 0, NULL);
+        if (!threads[started]) break;
+#else
+        if (pthread_create(&threads[started], NULL, batch_thread, &s) != 0) break;
+#endif
+    }
+    if (started == 0) {
+        fprintf(stderr, "Error: Could not start batch workers\n");
+        fflush(stderr);
+        cpu_throttle_free(&throttle);
+        return 1;
+    }
+
+    char* line = malloc(BATCH_LINE_LENGTH);
+    while (line && fgets(line, BATCH_LINE_LENGTH, stdin)) {
+        batch_command(&s, line);
+    }
+    free(line);
+
+    batch_lock(&s);
+    s.closed = 1;
+    batch_broadcast(&s);
+    batch_unlock(&s);
+    for (int i = 0; i < started; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+
+    if (json) {
+        printf("{\"event\":\"batch\",\"jobs\":%d,\"failed\":%d,\"peak_rss_bytes\":%ld,\"cpu_percent\":%.1f}\n",
+               s.finished, s.failed, get_memory_usage(), cpu_throttle_usage(&throttle));
+    } else {
+        printf("Batch done: %d job%s, %d failed\n", s.finished, s.finished == 1 ? "" : "s", s.failed);
+    }
+    fflush(stdout);
+#ifdef _WIN32
+    DeleteCriticalSection(&s.lock);
+#else
+    pthread_mutex_destroy(&s.lock);
+    pthread_cond_destroy(&s.changed);
+#endif
+    cpu_throttle_free(&throttle);
+    return s.failed ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    // Get version
+    const char* version = get_version();
+    
+    // Check for version flag
+    if (argc == 2 && strcmp(argv[1], "--version") == 0) {
+        printf("GTFS Precache Tool v%s\n", version);
+        return 0;  // Success exit code for version
+    }
+    
+    // Print version and check arguments
+    printf("GTFS Precache Tool v%s\n", version);
+
+    // Compile a whole GTFS directory into a native timetable file
+    if (argc >= 2 && strcmp(argv[1], "--timetable") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "Usage: %s --timetable <gtfs_dir|feed.zip> <output_file> [cache_key]\n", argv[0]);
+            return 1;
+        }
+        return gtt_build(argv[2], argv[3], argc > 4 ? argv[4] : NULL);
+    }
+
+    // The options may appear anywhere among the positional arguments
+    const char* args[3];
+    int batch = 0;
+    int jobs = 0;
+    int max_cpu = 0;
+    int n_args = 0;
+    long long max_memory = 0;
+    int json_progress = 0;
+    int show_stats = 0;
+    int incremental = 0;
+    int threads = -1;
+    const char* previous_file = NULL;
+    for (int i = 1; i < argc; i++) {
+        const char* value = NULL;
+        if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = 1;
+            continue;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+            continue;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            continue;
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            jobs = atoi(argv[i] + 7);
+            continue;
+        } else if (strcmp(argv[i], "--max-cpu") == 0 && i + 1 < argc) {
+            max_cpu = atoi(argv[++i]);
+            continue;
+        } else if (strncmp(argv[i], "--max-cpu=", 10) == 0) {
+            max_cpu = atoi(argv[i] + 10);
+            continue;
+        } else if (strcmp(argv[i], "--incremental") == 0) {
+            incremental = 1;
+            continue;
+        } else if (strncmp(argv[i], "--incremental=", 14) == 0) {
+            incremental = 1;
+            previous_file = argv[i] + 14;
+            continue;
+        } else if (strncmp(argv[i], "--progress=", 11) == 0) {
+            json_progress = strcmp(argv[i] + 11, "json") == 0;
+            continue;
+        } else if (strcmp(argv[i], "--progress") == 0 && i + 1 < argc) {
+            json_progress = strcmp(argv[++i], "json") == 0;
+            continue;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            continue;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+            continue;
+        } else if (strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc) {
+            value = argv[++i];
+        } else if (strncmp(argv[i], "--max-memory=", 13) == 0) {
+            value = argv[i] + 13;
+        } else if (n_args < 3) {
+            args[n_args++] = argv[i];
+            continue;
+        } else {
+            continue;
+        }
+        max_memory = atoll(value) * 1024LL * 1024LL;
+        if (max_memory <= 0) {
+            fprintf(stderr, "--max-memory must be a positive number of MB\n");
+            return 1;
+        }
+    }
+
+    if (batch) {
+        return run_batch(jobs, max_memory, max_cpu, json_progress);
+    }
+
+    if (n_args < 2) {
+        fprintf(stderr, "Usage: %s <stop_times.txt|feed.zip[/stop_times.txt]> <output_file> [cpu_limit] [--max-memory MB] [--incremental[=previous_output]] [--threads N] [--progress=json] [--stats]\n", argv[0]);
+        fprintf(stderr, "       %s --batch [--jobs N] [--max-memory MB] [--max-cpu PERCENT] [--progress=json] < commands\n", argv[0]);
+        fprintf(stderr, "       %s --timetable <gtfs_dir|feed.zip> <output_file> [cache_key]\n", argv[0]);
+        return 1;
+    }
+    
+    const char* input_file = args[0];
+    const char* output_file = args[1];
+    int cpu_limit = DEFAULT_CPU_LIMIT;
+    if (incremental && !previous_file) {
+        previous_file = output_file;
+    }
+    if (threads > PIPELINE_MAX_PARSERS) {
+        threads = PIPELINE_MAX_PARSERS;
+    } else if (threads < 0) {
+        threads = default_threads(get_cpu_count());
+    }
+    
+    if (n_args > 2) {
+        cpu_limit = atoi(args[2]);
+        if (cpu_limit < 1 || cpu_limit > 100) {
             fprintf(stderr, "CPU limit must be between 1 and 100\n");
             return 1;
         }
     }
     
     printf("Processing %s -> %s (CPU limit: %d%%)\n", input_file, output_file, cpu_limit);
-    
-    return process_stop_times(input_file, output_file);
+
+    // Without an explicit budget, sort on disk when the input would not fit
+    // in memory: without threads the in-memory path holds about the input
+    // size as msgpack, while the pipeline streams it out. An incremental run
+    // only learns how many rows changed once it has hashed them, so it gets
+    // the same budget and repacks in several passes when they exceed it.
+    uint64_t input_bytes = 0;
+    int have_size = input_size(input_file, &input_bytes) == 0;
+    if (max_memory == 0 && incremental) {
+        long long available = get_available_memory();
+        if (available > 0) max_memory = available / 4;
+    } else if (max_memory == 0 && threads == 0) {
+        long long available = get_available_memory();
+        if (available > 0 && have_size && (long long)input_bytes > available) {
+            char size_str[32], available_str[32];
+            format_size((long)input_bytes, size_str);
+            format_size((long)available, available_str);
+            printf("Input (%s) exceeds available memory (%s), using bounded-memory mode\n",
+                   size_str, available_str);
+            fflush(stdout);
+            max_memory = available / 4;
+        }
+    }
+    CpuThrottle throttle;
+    ProgressReporter progress;
+    PhaseStats stats;
+    cpu_throttle_init(&throttle, cpu_limit);
+    stats_init(&stats, show_stats);
+    progress_start(&progress, json_progress, &throttle, NULL);
+    PROGRESS_STORE(progress.total_bytes, have_size ? (size_t)input_bytes : 0);
+    int result = convert(input_file, output_file, incremental, previous_file, max_memory,
+                         threads, &throttle, &progress, &stats);
+    progress_stop(&progress, result, &stats);
+    stats_free(&stats);
+    cpu_throttle_free(&throttle);
+    return result;
 }
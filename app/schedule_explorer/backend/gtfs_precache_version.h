@@ -2,9 +2,9 @@
 #define GTFS_PRECACHE_VERSION_H
 
 #define GTFS_PRECACHE_VERSION_MAJOR 1
-#define GTFS_PRECACHE_VERSION_MINOR 0
-#define GTFS_PRECACHE_VERSION_PATCH 6
+#define GTFS_PRECACHE_VERSION_MINOR 6
+#define GTFS_PRECACHE_VERSION_PATCH 0
 
-#define GTFS_PRECACHE_VERSION_STRING "1.0.6"
+#define GTFS_PRECACHE_VERSION_STRING "1.6.0"
 
 #endif // GTFS_PRECACHE_VERSION_H 
\ No newline at end of file
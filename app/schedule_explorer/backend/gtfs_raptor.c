@@ -0,0 +1,682 @@
+#include "gtfs_timetable_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+// Round-based public transit routing (RAPTOR) over the pattern arrays of a
+// compiled timetable. Round k holds the earliest arrival at every stop using
+// k trips. Transit labels and footpath labels are kept apart so that a
+// journey never chains two footpaths, and the departure window is handled
+// by range RAPTOR: departures are scanned from latest to earliest while the
+// labels of later departures are kept as upper bounds. A run of a
+// frequency-based trip is its template trip with every time shifted, so
+// labels keep the template and the shift.
+
+#define INF INT32_MAX
+#define DAY_SECONDS 86400
+
+typedef struct {
+    int32_t arrival;
+    uint32_t trip;
+    uint32_t board_stop;
+    uint32_t board_pos;
+    uint32_t alight_pos;
+    int32_t offset;         // Added to the trip's times: -DAY_SECONDS for trips of the
+                            // previous service day, plus the shift
+    int32_t shift;          // Run of a frequency-based trip
+} TransitLabel;
+
+typedef struct {
+    int32_t arrival;
+    uint32_t from_stop;     // The stop itself for origin labels
+    int32_t duration;
+} WalkLabel;
+
+typedef struct {
+    const GttTimetable* tt;
+    uint32_t n_stops;
+    uint32_t rounds;
+    uint8_t* active;        // Per service: bit 0 runs on the day, bit 1 the day before
+    TransitLabel* transit;  // (rounds + 1) * n_stops
+    WalkLabel* walk;        // (rounds + 1) * n_stops
+    uint8_t* is_target;
+    uint8_t* marked;
+    uint32_t* marked_list;
+    size_t n_marked;
+    uint8_t* next_marked;
+    uint32_t* next_list;
+    size_t n_next;
+    uint8_t* rode;          // Stops improved by a trip in the current round
+    uint32_t* rode_list;
+    size_t n_rode;
+    uint32_t* queue_pos;    // Per pattern: earliest marked position, GTT_NONE if not queued
+    uint32_t* queue;
+    size_t n_queue;
+    uint32_t* origins;      // Copy of the marked origins while walking from them
+    int32_t target_bound;
+    uint8_t target_improved[GTT_MAX_TRANSFERS + 2];
+} Raptor;
+
+typedef struct {
+    GttJourney* journeys;
+    size_t n_journeys;
+    size_t journeys_cap;
+    GttLeg* legs;
+    size_t n_legs;
+    size_t legs_cap;
+} ResultBuilder;
+
+static int grow_array(void** data, size_t* cap, size_t need, size_t elem_size) {
+    if (need <= *cap) return 0;
+    size_t new_cap = *cap ? *cap * 2 : 16;
+    while (new_cap < need) new_cap *= 2;
+    void* p = realloc(*data, new_cap * elem_size);
+    if (!p) return -1;
+    *data = p;
+    *cap = new_cap;
+    return 0;
+}
+
+static inline TransitLabel* transit_at(const Raptor* r, uint32_t round, uint32_t stop) {
+    return &r->transit[(size_t)round * r->n_stops + stop];
+}
+
+static inline WalkLabel* walk_at(const Raptor* r, uint32_t round, uint32_t stop) {
+    return &r->walk[(size_t)round * r->n_stops + stop];
+}
+
+static inline int32_t arrival_at(const Raptor* r, uint32_t round, uint32_t stop) {
+    int32_t t = transit_at(r, round, stop)->arrival;
+    int32_t w = walk_at(r, round, stop)->arrival;
+    return t < w ? t : w;
+}
+
+// Earliest arrival at a stop using at most `round` trips
+static int32_t best_upto(const Raptor* r, uint32_t round, uint32_t stop) {
+    int32_t best = INF;
+    for (uint32_t k = 0; k <= round; k++) {
+        int32_t a = arrival_at(r, k, stop);
+        if (a < best) best = a;
+    }
+    return best;
+}
+
+static void mark_stop(Raptor* r, uint32_t stop) {
+    if (!r->next_marked[stop]) {
+        r->next_marked[stop] = 1;
+        r->next_list[r->n_next++] = stop;
+    }
+}
+
+static void raptor_free(Raptor* r) {
+    free(r->active);
+    free(r->transit);
+    free(r->walk);
+    free(r->is_target);
+    free(r->marked);
+    free(r->marked_list);
+    free(r->next_marked);
+    free(r->next_list);
+    free(r->rode);
+    free(r->rode_list);
+    free(r->queue_pos);
+    free(r->queue);
+    free(r->origins);
+}
+
+static int raptor_init(Raptor* r, const GttTimetable* tt, const GttJourneyQuery* q) {
+    memset(r, 0, sizeof(*r));
+    r->tt = tt;
+    r->n_stops = tt->header.n_stops;
+    r->rounds = (q->max_transfers > GTT_MAX_TRANSFERS ? GTT_MAX_TRANSFERS : q->max_transfers) + 1;
+
+    size_t n = r->n_stops + 1;
+    size_t labels = (size_t)(r->rounds + 1) * n;
+    r->active = calloc(tt->header.n_services + 1, 1);
+    r->transit = malloc(sizeof(TransitLabel) * labels);
+    r->walk = malloc(sizeof(WalkLabel) * labels);
+    r->is_target = calloc(n, 1);
+    r->marked = calloc(n, 1);
+    r->marked_list = malloc(sizeof(uint32_t) * n);
+    r->next_marked = calloc(n, 1);
+    r->next_list = malloc(sizeof(uint32_t) * n);
+    r->rode = calloc(n, 1);
+    r->rode_list = malloc(sizeof(uint32_t) * n);
+    r->queue_pos = malloc(sizeof(uint32_t) * (tt->header.n_patterns + 1));
+    r->queue = malloc(sizeof(uint32_t) * (tt->header.n_patterns + 1));
+    r->origins = malloc(sizeof(uint32_t) * n);
+    if (!r->active || !r->transit || !r->walk || !r->is_target || !r->marked ||
+        !r->marked_list || !r->next_marked || !r->next_list || !r->rode ||
+        !r->rode_list || !r->queue_pos || !r->queue || !r->origins) {
+        raptor_free(r);
+        return -1;
+    }
+
+    for (size_t i = 0; i < labels; i++) {
+        r->transit[i].arrival = INF;
+        r->walk[i].arrival = INF;
+    }
+    for (uint32_t p = 0; p < tt->header.n_patterns; p++) {
+        r->queue_pos[p] = GTT_NONE;
+    }
+    for (uint32_t s = 0; s < tt->header.n_services; s++) {
+        r->active[s] = (uint8_t)(gtt_service_active(tt, s, q->day) |
+                                 (gtt_service_active(tt, s, q->day - 1) << 1));
+    }
+    for (size_t i = 0; i < q->n_to; i++) {
+        if (q->to_stops[i] < r->n_stops) r->is_target[q->to_stops[i]] = 1;
+    }
+    return 0;
+}
+
+static inline int32_t trip_departure(const GttTimetable* tt, uint32_t trip, uint32_t pos) {
+    return tt->departures[tt->trip_times[trip] + pos];
+}
+
+// Earliest run of the frequency-based trips of a pattern
+static int find_run(const Raptor* r, uint32_t pattern, uint32_t pos, int32_t time,
+                    uint32_t* out_trip, int32_t* out_offset, int32_t* out_shift) {
+    const GttTimetable* tt = r->tt;
+    uint32_t first = tt->pattern_trips_start[pattern];
+    uint32_t last = first + tt->pattern_n_trips[pattern];
+    int found = 0;
+    int32_t best = INF;
+
+    for (uint32_t t = first; t < last; t++) {
+        int32_t dep0 = trip_departure(tt, t, 0);
+        int32_t dep = trip_departure(tt, t, pos);
+        for (int day = 0; day < 2; day++) {
+            int32_t offset = day == 0 ? 0 : -DAY_SECONDS;
+            if (!(r->active[tt->trip_service[t]] & (1u << day))) continue;
+            int32_t shift = frequency_next_shift(tt, t, dep0, dep, (int64_t)time - offset);
+            if (shift == INT32_MAX || (int64_t)dep + shift + offset >= best) continue;
+            best = dep + shift + offset;
+            *out_trip = t;
+            *out_offset = offset + shift;
+            *out_shift = shift;
+            found = 1;
+        }
+    }
+    return found;
+}
+
+// Earliest trip of a pattern that departs from pos at or after time and
+// runs on the query day (offset 0) or the day before (offset -DAY_SECONDS).
+static int find_trip(const Raptor* r, uint32_t pattern, uint32_t pos, int32_t time,
+                     uint32_t* out_trip, int32_t* out_offset, int32_t* out_shift) {
+    const GttTimetable* tt = r->tt;
+    uint32_t first = tt->pattern_trips_start[pattern];
+    uint32_t last = first + tt->pattern_n_trips[pattern];
+    int found = 0;
+    int32_t best = INF;
+
+    if (trip_is_frequent(tt, first)) {
+        return find_run(r, pattern, pos, time, out_trip, out_offset, out_shift);
+    }
+    for (int day = 0; day < 2; day++) {
+        int32_t offset = day == 0 ? 0 : -DAY_SECONDS;
+        int64_t wanted = (int64_t)time - offset;
+        if (wanted > INT32_MAX) continue;
+
+        // Departures at a position never decrease along a pattern's trips
+        uint32_t lo = first, hi = last;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (trip_departure(tt, mid, pos) < wanted) lo = mid + 1;
+            else hi = mid;
+        }
+        for (uint32_t t = lo; t < last; t++) {
+            int32_t dep = trip_departure(tt, t, pos) + offset;
+            if (dep >= best) break;
+            if (r->active[tt->trip_service[t]] & (1u << day)) {
+                best = dep;
+                *out_trip = t;
+                *out_offset = offset;
+                *out_shift = 0;
+                found = 1;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+static void update_target_bound(Raptor* r, const GttJourneyQuery* q, uint32_t round) {
+    r->target_bound = INF;
+    for (size_t i = 0; i < q->n_to; i++) {
+        if (q->to_stops[i] >= r->n_stops) continue;
+        int32_t a = best_upto(r, round, q->to_stops[i]);
+        if (a < r->target_bound) r->target_bound = a;
+    }
+}
+
+static void scan_pattern(Raptor* r, uint32_t pattern, uint32_t round) {
+    const GttTimetable* tt = r->tt;
+    const uint32_t* stops = tt->pattern_stops + tt->pattern_stops_start[pattern];
+    uint32_t n = tt->pattern_n_stops[pattern];
+    uint32_t trip = GTT_NONE;
+    int32_t offset = 0;
+    int32_t shift = 0;
+    uint32_t board_stop = 0, board_pos = 0;
+
+    for (uint32_t pos = r->queue_pos[pattern]; pos < n; pos++) {
+        uint32_t stop = stops[pos];
+
+        if (trip != GTT_NONE) {
+            int32_t arrival = tt->arrivals[tt->trip_times[trip] + pos] + offset;
+            int32_t bound = best_upto(r, round, stop);
+            if (r->target_bound < bound) bound = r->target_bound;
+            if (arrival < bound) {
+                TransitLabel* label = transit_at(r, round, stop);
+                label->arrival = arrival;
+                label->trip = trip;
+                label->board_stop = board_stop;
+                label->board_pos = board_pos;
+                label->alight_pos = pos;
+                label->offset = offset;
+                label->shift = shift;
+                mark_stop(r, stop);
+                if (!r->rode[stop]) {
+                    r->rode[stop] = 1;
+                    r->rode_list[r->n_rode++] = stop;
+                }
+                if (r->is_target[stop]) {
+                    r->target_bound = arrival;
+                    r->target_improved[round] = 1;
+                }
+            }
+        }
+
+        // Catch an earlier trip if the previous round reached this stop in time
+        if (pos + 1 < n) {
+            int32_t ready = arrival_at(r, round - 1, stop);
+            if (ready != INF &&
+                (trip == GTT_NONE || ready <= trip_departure(tt, trip, pos) + offset)) {
+                uint32_t candidate;
+                int32_t candidate_offset;
+                int32_t candidate_shift = 0;
+                if (find_trip(r, pattern, pos, ready, &candidate, &candidate_offset, &candidate_shift) &&
+                    (trip == GTT_NONE ||
+                     trip_departure(tt, candidate, pos) + candidate_offset <
+                         trip_departure(tt, trip, pos) + offset)) {
+                    trip = candidate;
+                    offset = candidate_offset;
+                    shift = candidate_shift;
+                    board_stop = stop;
+                    board_pos = pos;
+                }
+            }
+        }
+    }
+}
+
+static void relax_footpaths(Raptor* r, const uint32_t* from, size_t n_from, uint32_t round,
+                            int from_walk) {
+    const GttTimetable* tt = r->tt;
+    for (size_t i = 0; i < n_from; i++) {
+        uint32_t stop = from[i];
+        int32_t base = from_walk ? walk_at(r, round, stop)->arrival : transit_at(r, round, stop)->arrival;
+        for (uint32_t k = tt->transfers_start[stop]; k < tt->transfers_start[stop + 1]; k++) {
+            uint32_t target = tt->transfer_stops[k];
+            int32_t arrival = base + tt->transfer_times[k];
+            int32_t bound = best_upto(r, round, target);
+            if (r->target_bound < bound) bound = r->target_bound;
+            if (arrival < bound) {
+                WalkLabel* label = walk_at(r, round, target);
+                label->arrival = arrival;
+                label->from_stop = stop;
+                label->duration = tt->transfer_times[k];
+                mark_stop(r, target);
+                if (r->is_target[target]) {
+                    r->target_bound = arrival;
+                    r->target_improved[round] = 1;
+                }
+            }
+        }
+    }
+}
+
+static void swap_marks(Raptor* r) {
+    for (size_t i = 0; i < r->n_marked; i++) r->marked[r->marked_list[i]] = 0;
+    uint8_t* flags = r->marked;
+    uint32_t* list = r->marked_list;
+    r->marked = r->next_marked;
+    r->marked_list = r->next_list;
+    r->n_marked = r->n_next;
+    r->next_marked = flags;
+    r->next_list = list;
+    r->n_next = 0;
+}
+
+// Run all rounds for one departure time from the origin stops
+static void raptor_iteration(Raptor* r, const GttJourneyQuery* q, int32_t departure) {
+    const GttTimetable* tt = r->tt;
+    memset(r->target_improved, 0, sizeof(r->target_improved));
+    r->n_next = 0;
+
+    update_target_bound(r, q, 0);
+    for (size_t i = 0; i < q->n_from; i++) {
+        uint32_t stop = q->from_stops[i];
+        if (stop >= r->n_stops) continue;
+        WalkLabel* label = walk_at(r, 0, stop);
+        if (departure < label->arrival) {
+            label->arrival = departure;
+            label->from_stop = stop;
+            label->duration = 0;
+            mark_stop(r, stop);
+            if (r->is_target[stop] && departure < r->target_bound) r->target_bound = departure;
+        }
+    }
+    // Walk from the origins; they are the only round 0 labels marked so far
+    size_t n_origins = r->n_next;
+    memcpy(r->origins, r->next_list, sizeof(uint32_t) * n_origins);
+    relax_footpaths(r, r->origins, n_origins, 0, 1);
+    r->target_improved[0] = 0;
+    swap_marks(r);
+
+    for (uint32_t round = 1; round <= r->rounds && r->n_marked > 0; round++) {
+        update_target_bound(r, q, round);
+
+        // Queue every pattern serving a marked stop from its earliest marked position
+        r->n_queue = 0;
+        for (size_t i = 0; i < r->n_marked; i++) {
+            uint32_t stop = r->marked_list[i];
+            for (uint32_t k = tt->stop_patterns_start[stop]; k < tt->stop_patterns_start[stop + 1]; k++) {
+                uint32_t pattern = tt->stop_patterns[k];
+                uint32_t pos = tt->stop_pattern_pos[k];
+                if (r->queue_pos[pattern] == GTT_NONE) {
+                    r->queue[r->n_queue++] = pattern;
+                    r->queue_pos[pattern] = pos;
+                } else if (pos < r->queue_pos[pattern]) {
+                    r->queue_pos[pattern] = pos;
+                }
+            }
+        }
+
+        r->n_rode = 0;
+        for (size_t i = 0; i < r->n_queue; i++) {
+            scan_pattern(r, r->queue[i], round);
+            r->queue_pos[r->queue[i]] = GTT_NONE;
+        }
+
+        relax_footpaths(r, r->rode_list, r->n_rode, round, 0);
+        for (size_t i = 0; i < r->n_rode; i++) r->rode[r->rode_list[i]] = 0;
+        swap_marks(r);
+    }
+    for (size_t i = 0; i < r->n_marked; i++) r->marked[r->marked_list[i]] = 0;
+    r->n_marked = 0;
+}
+
+// Append the journey ending at the best target of a round
+static int extract_journey(const Raptor* r, const GttJourneyQuery* q, uint32_t round,
+                           ResultBuilder* out) {
+    const GttTimetable* tt = r->tt;
+    uint32_t target = GTT_NONE;
+    int32_t best = INF;
+    for (size_t i = 0; i < q->n_to; i++) {
+        uint32_t stop = q->to_stops[i];
+        if (stop < r->n_stops && arrival_at(r, round, stop) < best) {
+            best = arrival_at(r, round, stop);
+            target = stop;
+        }
+    }
+    if (target == GTT_NONE) {
+        return 0;
+    }
+
+    // Walk the labels back to an origin, collecting legs in reverse
+    GttLeg legs[2 * (GTT_MAX_TRANSFERS + 1) + 1];
+    uint32_t n_legs = 0;
+    uint32_t stop = target;
+    uint32_t k = round;
+    int take_transit = transit_at(r, k, stop)->arrival <= walk_at(r, k, stop)->arrival;
+    for (;;) {
+        if (n_legs >= sizeof(legs) / sizeof(legs[0])) {
+            return 0;
+        }
+        if (!take_transit) {
+            const WalkLabel* w = walk_at(r, k, stop);
+            if (w->from_stop == stop) {
+                break;  // Reached an origin
+            }
+            GttLeg leg = {GTT_LEG_WALK, GTT_NONE, w->from_stop, stop, 0, 0,
+                          w->arrival - w->duration, w->arrival, 0};
+            legs[n_legs++] = leg;
+            stop = w->from_stop;
+            take_transit = k > 0;
+            continue;
+        }
+        const TransitLabel* t = transit_at(r, k, stop);
+        GttLeg leg = {GTT_LEG_TRANSIT, t->trip, t->board_stop, stop, t->board_pos, t->alight_pos,
+                      trip_departure(tt, t->trip, t->board_pos) + t->offset, t->arrival, t->shift};
+        legs[n_legs++] = leg;
+        stop = t->board_stop;
+        k--;
+        take_transit = transit_at(r, k, stop)->arrival < walk_at(r, k, stop)->arrival;
+    }
+
+    uint32_t n_transit = 0;
+    for (uint32_t i = 0; i < n_legs; i++) {
+        if (legs[i].kind == GTT_LEG_TRANSIT) n_transit++;
+    }
+    if (n_transit == 0) {
+        return 0;
+    }
+
+    if (grow_array((void**)&out->legs, &out->legs_cap, out->n_legs + n_legs, sizeof(GttLeg)) != 0 ||
+        grow_array((void**)&out->journeys, &out->journeys_cap, out->n_journeys + 1, sizeof(GttJourney)) != 0) {
+        return -1;
+    }
+
+    // Reverse into the result and re-time walking legs around the trips
+    GttLeg* dst = out->legs + out->n_legs;
+    for (uint32_t i = 0; i < n_legs; i++) {
+        dst[i] = legs[n_legs - 1 - i];
+    }
+    for (uint32_t i = 0; i < n_legs; i++) {
+        if (dst[i].kind != GTT_LEG_WALK) continue;
+        int32_t duration = dst[i].arrival - dst[i].departure;
+        if (i > 0) {
+            dst[i].departure = dst[i - 1].arrival;
+            dst[i].arrival = dst[i].departure + duration;
+        } else if (i + 1 < n_legs) {
+            dst[i].arrival = dst[i + 1].departure;
+            dst[i].departure = dst[i].arrival - duration;
+        }
+    }
+
+    GttJourney* journey = &out->journeys[out->n_journeys++];
+    journey->first_leg = (uint32_t)out->n_legs;
+    journey->n_legs = n_legs;
+    journey->n_transfers = n_transit - 1;
+    journey->departure = dst[0].departure;
+    journey->arrival = dst[n_legs - 1].arrival;
+    out->n_legs += n_legs;
+    return 0;
+}
+
+static int compare_int32_desc(const void* a, const void* b) {
+    int32_t x = *(const int32_t*)a;
+    int32_t y = *(const int32_t*)b;
+    return (x < y) - (x > y);
+}
+
+static int push_time(int32_t** times, size_t* n, size_t* cap, int32_t time) {
+    if (grow_array((void**)times, cap, *n + 1, sizeof(int32_t)) != 0) {
+        return -1;
+    }
+    (*times)[(*n)++] = time;
+    return 0;
+}
+
+// Departures from pos of the runs of a frequency-based trip between lo_time
+// and hi_time (template day), appended as in collect_departures
+static int push_runs(const GttTimetable* tt, uint32_t trip, uint32_t pos, int64_t lo_time,
+                     int64_t hi_time, int32_t adjust, int32_t** times, size_t* n, size_t* cap) {
+    int32_t dep0 = trip_departure(tt, trip, 0);
+    int32_t dep = trip_departure(tt, trip, pos);
+    for (uint32_t f = tt->trip_frequencies_start[trip]; f < tt->trip_frequencies_start[trip + 1]; f++) {
+        const GttFrequency* w = &tt->frequencies[f];
+        int64_t first = (int64_t)w->start + dep - dep0;
+        int64_t k = lo_time > first ? (lo_time - first + w->headway - 1) / w->headway : 0;
+        for (int64_t run = w->start + k * w->headway; run < w->end; run += w->headway) {
+            int64_t time = run + dep - dep0;
+            if (time > hi_time) break;
+            if (push_time(times, n, cap, (int32_t)(time + adjust)) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+// Departure times from the origins (or stops a footpath away) in the window
+static int32_t* collect_departures(const Raptor* r, const GttJourneyQuery* q, size_t* out_n) {
+    const GttTimetable* tt = r->tt;
+    int32_t* times = NULL;
+    size_t n = 0, cap = 0;
+
+    for (size_t i = 0; i < q->n_from; i++) {
+        uint32_t origin = q->from_stops[i];
+        if (origin >= r->n_stops) continue;
+        uint32_t first_transfer = tt->transfers_start[origin];
+        uint32_t n_transfers = tt->transfers_start[origin + 1] - first_transfer;
+
+        for (uint32_t f = 0; f <= n_transfers; f++) {
+            uint32_t stop = f == 0 ? origin : tt->transfer_stops[first_transfer + f - 1];
+            int32_t walk = f == 0 ? 0 : tt->transfer_times[first_transfer + f - 1];
+            for (uint32_t k = tt->stop_patterns_start[stop]; k < tt->stop_patterns_start[stop + 1]; k++) {
+                uint32_t pattern = tt->stop_patterns[k];
+                uint32_t pos = tt->stop_pattern_pos[k];
+                if (pos + 1 >= tt->pattern_n_stops[pattern]) continue;
+                uint32_t trip_first = tt->pattern_trips_start[pattern];
+                uint32_t trip_last = trip_first + tt->pattern_n_trips[pattern];
+                for (int day = 0; day < 2; day++) {
+                    int32_t offset = day == 0 ? 0 : -DAY_SECONDS;
+                    int64_t lo_time = (int64_t)q->departure_min + walk - offset;
+                    int64_t hi_time = (int64_t)q->departure_max + walk - offset;
+                    if (trip_is_frequent(tt, trip_first)) {
+                        for (uint32_t t = trip_first; t < trip_last; t++) {
+                            if (!(r->active[tt->trip_service[t]] & (1u << day))) continue;
+                            if (push_runs(tt, t, pos, lo_time, hi_time, offset - walk, &times, &n, &cap) != 0) {
+                                free(times);
+                                return NULL;
+                            }
+                        }
+                        continue;
+                    }
+                    uint32_t lo = trip_first, hi = trip_last;
+                    while (lo < hi) {
+                        uint32_t mid = lo + (hi - lo) / 2;
+                        if (trip_departure(tt, mid, pos) < lo_time) lo = mid + 1;
+                        else hi = mid;
+                    }
+                    for (uint32_t t = lo; t < trip_last && trip_departure(tt, t, pos) <= hi_time; t++) {
+                        if (!(r->active[tt->trip_service[t]] & (1u << day))) continue;
+                        if (push_time(&times, &n, &cap, trip_departure(tt, t, pos) + offset - walk) != 0) {
+                            free(times);
+                            return NULL;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (n > 1) {
+        qsort(times, n, sizeof(int32_t), compare_int32_desc);
+        size_t unique = 1;
+        for (size_t i = 1; i < n; i++) {
+            if (times[i] != times[unique - 1]) times[unique++] = times[i];
+        }
+        n = unique;
+    }
+    *out_n = n;
+    if (!times) times = malloc(sizeof(int32_t));
+    return times;
+}
+
+static int journey_dominates(const GttJourney* a, const GttJourney* b) {
+    return a->departure >= b->departure && a->arrival <= b->arrival && a->n_transfers <= b->n_transfers;
+}
+
+static int compare_journeys(const void* x, const void* y) {
+    const GttJourney* a = x;
+    const GttJourney* b = y;
+    if (a->departure != b->departure) return a->departure < b->departure ? -1 : 1;
+    if (a->arrival != b->arrival) return a->arrival < b->arrival ? -1 : 1;
+    return (a->n_transfers > b->n_transfers) - (a->n_transfers < b->n_transfers);
+}
+
+// Keep only Pareto-optimal journeys, dropping duplicates
+static void pareto_filter(ResultBuilder* out) {
+    size_t kept = 0;
+    for (size_t i = 0; i < out->n_journeys; i++) {
+        int dominated = 0;
+        for (size_t j = 0; j < out->n_journeys && !dominated; j++) {
+            if (i == j || !journey_dominates(&out->journeys[j], &out->journeys[i])) continue;
+            // Among identical journeys keep the first one
+            int equal = journey_dominates(&out->journeys[i], &out->journeys[j]);
+            dominated = !equal || j < i;
+        }
+        if (!dominated) out->journeys[kept++] = out->journeys[i];
+    }
+    out->n_journeys = kept;
+    qsort(out->journeys, out->n_journeys, sizeof(GttJourney), compare_journeys);
+}
+
+GttJourneyResult* gtt_plan_journeys(const GttTimetable* tt, const GttJourneyQuery* query) {
+    Raptor r;
+    ResultBuilder out;
+    memset(&out, 0, sizeof(out));
+
+    if (raptor_init(&r, tt, query) != 0) {
+        fprintf(stderr, "Error: Out of memory planning journeys\n");
+        fflush(stderr);
+        return NULL;
+    }
+
+    size_t n_departures = 0;
+    int32_t* departures = collect_departures(&r, query, &n_departures);
+    GttJourneyResult* result = calloc(1, sizeof(GttJourneyResult));
+    if (!departures || !result) {
+        goto fail;
+    }
+
+    for (size_t i = 0; i < n_departures; i++) {
+        raptor_iteration(&r, query, departures[i]);
+        for (uint32_t round = 1; round <= r.rounds; round++) {
+            if (r.target_improved[round] && extract_journey(&r, query, round, &out) != 0) {
+                goto fail;
+            }
+        }
+    }
+    free(departures);
+    raptor_free(&r);
+
+    pareto_filter(&out);
+    result->journeys = out.journeys;
+    result->n_journeys = out.n_journeys;
+    result->legs = out.legs;
+    result->n_legs = out.n_legs;
+    return result;
+
+fail:
+    fprintf(stderr, "Error: Out of memory planning journeys\n");
+    fflush(stderr);
+    free(departures);
+    free(result);
+    free(out.journeys);
+    free(out.legs);
+    raptor_free(&r);
+    return NULL;
+}
+
+void gtt_free_journeys(GttJourneyResult* result) {
+    if (!result) {
+        return;
+    }
+    free(result->journeys);
+    free(result->legs);
+    free(result);
+}
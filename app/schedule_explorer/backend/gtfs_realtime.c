@@ -0,0 +1,661 @@
+#include "gtfs_timetable_internal.h"
+#include "gtfs_csv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// GTFS-Realtime messages decoded from the protobuf wire format. Each
+// message is read once, front to back: nested messages are byte ranges of
+// their parent, read in place, and strings are kept as ranges of the
+// message, so decoding allocates nothing but the three output arrays.
+//
+// Field numbers are those of gtfs-realtime.proto. The BKK feeds extend
+// VehicleDescriptor and StopTimeUpdate with a realcity message in field
+// 1006 (gtfs-realtime-realcity.proto): vehicle model, doors and distance to
+// the stop, and the scheduled times of the stop. Fields outside the subset
+// below, alerts included, are skipped.
+
+#define REALCITY_EXTENSION 1006
+#define ID_MAX 256
+
+enum {
+    WIRE_VARINT = 0,
+    WIRE_FIXED64 = 1,
+    WIRE_LEN = 2,
+    WIRE_FIXED32 = 5,
+};
+
+typedef struct {
+    const uint8_t* p;
+    const uint8_t* end;
+} Wire;
+
+typedef struct {
+    uint32_t number;
+    uint32_t type;
+    uint64_t value;             // Varint and fixed-size fields
+    Wire sub;                   // Length-delimited fields
+} Field;
+
+static int read_varint(Wire* w, uint64_t* out) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (w->p >= w->end) return -1;
+        uint8_t b = *w->p++;
+        value |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *out = value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static uint64_t read_fixed(Wire* w, int n) {
+    uint64_t value = 0;
+    for (int i = 0; i < n; i++) value |= (uint64_t)w->p[i] << (8 * i);
+    w->p += n;
+    return value;
+}
+
+// Next field of a message: 1 for a field, 0 at the end of the message, -1
+// when malformed. Groups are not used by GTFS-Realtime and count as
+// malformed.
+static int next_field(Wire* w, Field* f) {
+    if (w->p >= w->end) return 0;
+    uint64_t key;
+    uint64_t length;
+    if (read_varint(w, &key) != 0 || (key >> 3) == 0 || (key >> 3) > UINT32_MAX) return -1;
+    f->number = (uint32_t)(key >> 3);
+    f->type = (uint32_t)(key & 7);
+    f->value = 0;
+    switch (f->type) {
+    case WIRE_VARINT:
+        return read_varint(w, &f->value) == 0 ? 1 : -1;
+    case WIRE_FIXED64:
+        if (w->end - w->p < 8) return -1;
+        f->value = read_fixed(w, 8);
+        return 1;
+    case WIRE_FIXED32:
+        if (w->end - w->p < 4) return -1;
+        f->value = read_fixed(w, 4);
+        return 1;
+    case WIRE_LEN:
+        if (read_varint(w, &length) != 0 || length > (uint64_t)(w->end - w->p)) return -1;
+        f->sub.p = w->p;
+        f->sub.end = w->p + length;
+        w->p += length;
+        return 1;
+    default:
+        return -1;
+    }
+}
+
+static double fixed_float(uint64_t bits) {
+    uint32_t b = (uint32_t)bits;
+    float value;
+    memcpy(&value, &b, sizeof(value));
+    return value;
+}
+
+static double fixed_double(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// ---------------------------------------------------------------------------
+// Decoder
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    const GttTimetable* tt;
+    const GttRtOptions* options;
+    const uint8_t* base;
+    GttRtFeed* feed;
+    size_t trip_update_cap;
+    size_t stop_time_update_cap;
+    size_t vehicle_cap;
+} Decoder;
+
+typedef struct {
+    GttRtString trip_id;
+    GttRtString route_id;
+    int32_t start_day;
+    int32_t start_time;
+    uint32_t direction_id;
+    uint32_t schedule_relationship;
+} TripFields;
+
+typedef struct {
+    GttRtString id;
+    GttRtString label;
+    GttRtString license_plate;
+    GttRtString model;
+    uint32_t flags;
+    int32_t vehicle_type;
+    int32_t stop_distance;
+} VehicleFields;
+
+static int grow_array(void** data, size_t* cap, size_t need, size_t elem_size) {
+    if (need <= *cap) return 0;
+    size_t new_cap = *cap ? *cap * 2 : 16;
+    while (new_cap < need) new_cap *= 2;
+    void* p = realloc(*data, new_cap * elem_size);
+    if (!p) return -1;
+    *data = p;
+    *cap = new_cap;
+    return 0;
+}
+
+static GttRtString string_of(const Decoder* d, const Field* f) {
+    GttRtString s;
+    s.offset = (uint32_t)(f->sub.p - d->base);
+    s.length = (uint32_t)(f->sub.end - f->sub.p);
+    return s;
+}
+
+// Copy of a string field, NUL-terminated; empty when too long
+static void copy_string(const Decoder* d, GttRtString s, char* out, size_t size) {
+    size_t n = s.length < size ? s.length : 0;
+    memcpy(out, d->base + s.offset, n);
+    out[n] = '\0';
+}
+
+// Apply the id options to an id in place and look it up with find.
+// Platforms are only cut from stop ids.
+static uint32_t resolve_id(const Decoder* d, GttRtString* s, int is_stop,
+                           int32_t (*find)(const GttTimetable*, const char*)) {
+    const GttRtOptions* o = d->options;
+    const char* text = (const char*)d->base + s->offset;
+    if (o && o->id_prefixes) {
+        for (const char* prefix = o->id_prefixes; *prefix; prefix += strlen(prefix) + 1) {
+            size_t n = strlen(prefix);
+            if (n <= s->length && memcmp(text, prefix, n) == 0) {
+                s->offset += (uint32_t)n;
+                s->length -= (uint32_t)n;
+                text += n;
+                break;
+            }
+        }
+    }
+    if (is_stop && o && o->stop_separator) {
+        const char* cut = memchr(text, o->stop_separator, s->length);
+        if (cut) s->length = (uint32_t)(cut - text);
+    }
+    char id[ID_MAX];
+    if (!d->tt || s->length == 0 || s->length >= sizeof(id)) return GTT_NONE;
+    memcpy(id, text, s->length);
+    id[s->length] = '\0';
+    int32_t index = find(d->tt, id);
+    return index >= 0 ? (uint32_t)index : GTT_NONE;
+}
+
+// Route of a route_id, or else of the trip
+static uint32_t resolve_route(const Decoder* d, GttRtString* route_id, uint32_t trip) {
+    uint32_t route = resolve_id(d, route_id, 0, gtt_find_route);
+    if (route == GTT_NONE && trip != GTT_NONE) route = d->tt->trip_route[trip];
+    return route;
+}
+
+static int decode_trip(const Decoder* d, Wire w, TripFields* trip) {
+    char text[16];
+    Field f;
+    int status;
+    while ((status = next_field(&w, &f)) > 0) {
+        switch (f.number) {
+        case 1:
+            if (f.type == WIRE_LEN) trip->trip_id = string_of(d, &f);
+            break;
+        case 2:
+            if (f.type == WIRE_LEN) {
+                copy_string(d, string_of(d, &f), text, sizeof(text));
+                trip->start_time = csv_parse_time(text);
+            }
+            break;
+        case 3:
+            if (f.type == WIRE_LEN) {
+                copy_string(d, string_of(d, &f), text, sizeof(text));
+                trip->start_day = csv_parse_date(text);
+            }
+            break;
+        case 4:
+            if (f.type == WIRE_VARINT) trip->schedule_relationship = (uint32_t)f.value;
+            break;
+        case 5:
+            if (f.type == WIRE_LEN) trip->route_id = string_of(d, &f);
+            break;
+        case 6:
+            if (f.type == WIRE_VARINT) trip->direction_id = (uint32_t)f.value;
+            break;
+        }
+    }
+    return status;
+}
+
+static int decode_realcity_vehicle(const Decoder* d, Wire w, VehicleFields* vehicle) {
+    Field f;
+    int status;
+    while ((status = next_field(&w, &f)) > 0) {
+        if (f.type == WIRE_LEN) {
+            if (f.number == 1) vehicle->model = string_of(d, &f);
+            continue;
+        }
+        if (f.type != WIRE_VARINT) continue;
+        switch (f.number) {
+        case 2:
+            if (f.value) vehicle->flags |= GTT_RT_DEVIATED;
+            break;
+        case 3:
+            vehicle->vehicle_type = (int32_t)f.value;
+            vehicle->flags |= GTT_RT_HAS_VEHICLE_TYPE;
+            break;
+        case 4:
+            if (f.value) vehicle->flags |= GTT_RT_DOOR_OPEN;
+            break;
+        case 5:
+            vehicle->stop_distance = (int32_t)f.value;
+            vehicle->flags |= GTT_RT_HAS_STOP_DISTANCE;
+            break;
+        }
+    }
+    return status;
+}
+
+static int decode_vehicle_descriptor(const Decoder* d, Wire w, VehicleFields* vehicle) {
+    Field f;
+    int status;
+    while ((status = next_field(&w, &f)) > 0) {
+        if (f.type != WIRE_LEN) continue;
+        switch (f.number) {
+        case 1:
+            vehicle->id = string_of(d, &f);
+            break;
+        case 2:
+            vehicle->label = string_of(d, &f);
+            break;
+        case 3:
+            vehicle->license_plate = string_of(d, &f);
+            break;
+        case REALCITY_EXTENSION:
+            if (decode_realcity_vehicle(d, f.sub, vehicle) != 0) return -1;
+            break;
+        }
+    }
+    return status;
+}
+
+// StopTimeEvent: delay and time, with the flags telling which were set
+static int decode_stop_time_event(Wire w, int32_t* delay, int64_t* time, uint32_t* flags,
+                                  uint32_t delay_flag, uint32_t time_flag) {
+    Field f;
+    int status;
+    while ((status = next_field(&w, &f)) > 0) {
+        if (f.type != WIRE_VARINT) continue;
+        if (f.number == 1 && delay) {
+            *delay = (int32_t)f.value;
+            *flags |= delay_flag;
+        } else if (f.number == 2) {
+            *time = (int64_t)f.value;
+            *flags |= time_flag;
+        }
+    }
+    return status;
+}
+
+static int decode_realcity_stop_time(Wire w, GttRtStopTimeUpdate* u) {
+    Field f;
+    int status;
+    while ((status = next_field(&w, &f)) > 0) {
+        if (f.type != WIRE_LEN) continue;
+        if (f.number == 1 &&
+            decode_stop_time_event(f.sub, NULL, &u->scheduled_arrival, &u->flags, 0,
+                                   GTT_RT_HAS_SCHEDULED_ARRIVAL) != 0) {
+            return -1;
+        }
+        if (f.number == 2 &&
+            decode_stop_time_event(f.sub, NULL, &u->scheduled_departure, &u->flags, 0,
+                                   GTT_RT_HAS_SCHEDULED_DEPARTURE) != 0) {
+            return -1;
+        }
+    }
+    return status;
+}
+
+static int decode_stop_time_update(Decoder* d, Wire w) {
+    GttRtFeed* feed = d->feed;
+    if (grow_array((void**)&feed->stop_time_updates, &d->stop_time_update_cap,
+                   feed->n_stop_time_updates + 1, sizeof(GttRtStopTimeUpdate)) != 0) {
+        return -1;
+    }
+    GttRtStopTimeUpdate* u = &feed->stop_time_updates[feed->n_stop_time_updates++];
+    memset(u, 0, sizeof(*u));
+    u->stop_sequence = GTT_NONE;
+
+    Field f;
+    int status;
+    while ((status = next_field(&w, &f)) > 0) {
+        switch (f.number) {
+        case 1:
+            if (f.type == WIRE_VARINT) u->stop_sequence = (uint32_t)f.value;
+            break;
+        case 2:
+            if (f.type == WIRE_LEN &&
+                decode_stop_time_event(f.sub, &u->arrival_delay, &u->arrival_time, &u->flags,
+                                       GTT_RT_HAS_ARRIVAL_DELAY, GTT_RT_HAS_ARRIVAL_TIME) != 0) {
+                return -1;
+            }
+            break;
+        case 3:
+            if (f.type == WIRE_LEN &&
+                decode_stop_time_event(f.sub, &u->departure_delay, &u->departure_time, &u->flags,
+                                       GTT_RT_HAS_DEPARTURE_DELAY, GTT_RT_HAS_DEPARTURE_TIME) != 0) {
+                return -1;
+            }
+            break;
+        case 4:
+            if (f.type == WIRE_LEN) u->stop_id = string_of(d, &f);
+            break;
+        case 5:
+            if (f.type == WIRE_VARINT) u->schedule_relationship = (uint32_t)f.value;
+            break;
+        case REALCITY_EXTENSION:
+            if (f.type == WIRE_LEN && decode_realcity_stop_time(f.sub, u) != 0) return -1;
+            break;
+        }
+    }
+    if (status == 0) u->stop = resolve_id(d, &u->stop_id, 1, gtt_find_stop);
+    return status;
+}
+
+static int decode_trip_update(Decoder* d, Wire w) {
+    GttRtFeed* feed = d->feed;
+    if (grow_array((void**)&feed->trip_updates, &d->trip_update_cap,
+                   feed->n_trip_updates + 1, sizeof(GttRtTripUpdate)) != 0) {
+        return -1;
+    }
+    // Stop time updates only grow their own array, so u stays valid
+    GttRtTripUpdate* u = &feed->trip_updates[feed->n_trip_updates++];
+    memset(u, 0, sizeof(*u));
+    u->first_update = (uint32_t)feed->n_stop_time_updates;
+    TripFields trip = {.start_day = INT32_MIN, .start_time = -1, .direction_id = GTT_NONE};
+    VehicleFields vehicle;
+    memset(&vehicle, 0, sizeof(vehicle));
+
+    Field f;
+    int status;
+    while ((status = next_field(&w, &f)) > 0) {
+        switch (f.number) {
+        case 1:
+            if (f.type == WIRE_LEN && decode_trip(d, f.sub, &trip) != 0) return -1;
+            break;
+        case 2:
+            if (f.type == WIRE_LEN && decode_stop_time_update(d, f.sub) != 0) return -1;
+            break;
+        case 3:
+            if (f.type == WIRE_LEN && decode_vehicle_descriptor(d, f.sub, &vehicle) != 0) return -1;
+            break;
+        case 4:
+            if (f.type == WIRE_VARINT) {
+                u->timestamp = f.value;
+                u->flags |= GTT_RT_HAS_TIMESTAMP;
+            }
+            break;
+        case 5:
+            if (f.type == WIRE_VARINT) {
+                u->delay = (int32_t)f.value;
+                u->flags |= GTT_RT_HAS_DELAY;
+            }
+            break;
+        }
+    }
+    if (status != 0) return status;
+
+    u->n_updates = (uint32_t)(feed->n_stop_time_updates - u->first_update);
+    u->trip_id = trip.trip_id;
+    u->route_id = trip.route_id;
+    u->vehicle_id = vehicle.id;
+    u->start_day = trip.start_day;
+    u->start_time = trip.start_time;
+    u->schedule_relationship = trip.schedule_relationship;
+    u->direction_id = trip.direction_id;
+    u->trip = resolve_id(d, &u->trip_id, 0, gtt_find_trip);
+    u->route = resolve_route(d, &u->route_id, u->trip);
+    return 0;
+}
+
+static int decode_position(Wire w, GttRtVehicle* v) {
+    Field f;
+    int status;
+    while ((status = next_field(&w, &f)) > 0) {
+        if (f.type == WIRE_FIXED64) {
+            if (f.number == 4) {
+                v->odometer = fixed_double(f.value);
+                v->flags |= GTT_RT_HAS_ODOMETER;
+            }
+            continue;
+        }
+        if (f.type != WIRE_FIXED32) continue;
+        switch (f.number) {
+        case 1:
+            v->lat = fixed_float(f.value);
+            break;
+        case 2:
+            v->lon = fixed_float(f.value);
+            break;
+        case 3:
+            v->bearing = fixed_float(f.value);
+            v->flags |= GTT_RT_HAS_BEARING;
+            break;
+        case 5:
+            v->speed = fixed_float(f.value);
+            v->flags |= GTT_RT_HAS_SPEED;
+            break;
+        }
+    }
+    v->flags |= GTT_RT_HAS_POSITION;
+    return status;
+}
+
+static int decode_vehicle_position(Decoder* d, Wire w) {
+    GttRtFeed* feed = d->feed;
+    if (grow_array((void**)&feed->vehicles, &d->vehicle_cap, feed->n_vehicles + 1,
+                   sizeof(GttRtVehicle)) != 0) {
+        return -1;
+    }
+    GttRtVehicle* v = &feed->vehicles[feed->n_vehicles++];
+    memset(v, 0, sizeof(*v));
+    v->current_stop_sequence = GTT_NONE;
+    TripFields trip = {.start_day = INT32_MIN, .start_time = -1, .direction_id = GTT_NONE};
+    VehicleFields vehicle;
+    memset(&vehicle, 0, sizeof(vehicle));
+
+    Field f;
+    int status;
+    while ((status = next_field(&w, &f)) > 0) {
+        if (f.type == WIRE_LEN) {
+            int sub_status = 0;
+            if (f.number == 1) sub_status = decode_trip(d, f.sub, &trip);
+            else if (f.number == 2) sub_status = decode_position(f.sub, v);
+            else if (f.number == 7) v->stop_id = string_of(d, &f);
+            else if (f.number == 8) sub_status = decode_vehicle_descriptor(d, f.sub, &vehicle);
+            if (sub_status != 0) return -1;
+            continue;
+        }
+        if (f.type != WIRE_VARINT) continue;
+        switch (f.number) {
+        case 3:
+            v->current_stop_sequence = (uint32_t)f.value;
+            break;
+        case 4:
+            v->current_status = (uint32_t)f.value;
+            v->flags |= GTT_RT_HAS_STATUS;
+            break;
+        case 5:
+            v->timestamp = f.value;
+            v->flags |= GTT_RT_HAS_TIMESTAMP;
+            break;
+        case 6:
+            v->congestion_level = (uint32_t)f.value;
+            break;
+        case 9:
+            v->occupancy_status = (uint32_t)f.value;
+            break;
+        }
+    }
+    if (status != 0) return status;
+
+    v->trip_id = trip.trip_id;
+    v->route_id = trip.route_id;
+    v->start_day = trip.start_day;
+    v->start_time = trip.start_time;
+    v->direction_id = trip.direction_id;
+    v->vehicle_id = vehicle.id;
+    v->label = vehicle.label;
+    v->license_plate = vehicle.license_plate;
+    v->vehicle_model = vehicle.model;
+    v->vehicle_type = vehicle.vehicle_type;
+    v->stop_distance = vehicle.stop_distance;
+    v->flags |= vehicle.flags;
+    v->trip = resolve_id(d, &v->trip_id, 0, gtt_find_trip);
+    v->route = resolve_route(d, &v->route_id, v->trip);
+    v->stop = resolve_id(d, &v->stop_id, 1, gtt_find_stop);
+    return 0;
+}
+
+// An entity's id and is_deleted may follow its trip update or vehicle, so
+// they are set on what it added once it is read
+static int decode_entity(Decoder* d, Wire w) {
+    GttRtFeed* feed = d->feed;
+    size_t first_trip_update = feed->n_trip_updates;
+    size_t first_vehicle = feed->n_vehicles;
+    GttRtString id = {0, 0};
+    uint32_t flags = 0;
+
+    Field f;
+    int status;
+    while ((status = next_field(&w, &f)) > 0) {
+        switch (f.number) {
+        case 1:
+            if (f.type == WIRE_LEN) id = string_of(d, &f);
+            break;
+        case 2:
+            if (f.type == WIRE_VARINT && f.value) flags |= GTT_RT_DELETED;
+            break;
+        case 3:
+            if (f.type == WIRE_LEN && decode_trip_update(d, f.sub) != 0) return -1;
+            break;
+        case 4:
+            if (f.type == WIRE_LEN && decode_vehicle_position(d, f.sub) != 0) return -1;
+            break;
+        }
+    }
+    for (size_t i = first_trip_update; i < feed->n_trip_updates; i++) {
+        feed->trip_updates[i].entity_id = id;
+        feed->trip_updates[i].flags |= flags;
+    }
+    for (size_t i = first_vehicle; i < feed->n_vehicles; i++) {
+        feed->vehicles[i].entity_id = id;
+        feed->vehicles[i].flags |= flags;
+    }
+    feed->n_entities++;
+    return status;
+}
+
+static int decode_feed(Decoder* d, Wire w) {
+    Field f;
+    Field h;
+    int status;
+    while ((status = next_field(&w, &f)) > 0) {
+        if (f.type != WIRE_LEN) continue;
+        if (f.number == 1) {
+            // FeedHeader: only its timestamp
+            int header_status;
+            while ((header_status = next_field(&f.sub, &h)) > 0) {
+                if (h.number == 3 && h.type == WIRE_VARINT) d->feed->timestamp = h.value;
+            }
+            if (header_status != 0) return -1;
+        } else if (f.number == 2 && decode_entity(d, f.sub) != 0) {
+            return -1;
+        }
+    }
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Entry points
+// ---------------------------------------------------------------------------
+
+GttRtFeed* gtt_rt_decode(const GttTimetable* tt, const uint8_t* data, size_t size,
+                         const GttRtOptions* options) {
+    // String ranges are 32-bit
+    if (size > UINT32_MAX || (!data && size > 0)) {
+        return NULL;
+    }
+    GttRtFeed* feed = calloc(1, sizeof(GttRtFeed));
+    if (!feed) {
+        return NULL;
+    }
+    feed->data = data;
+    feed->size = size;
+
+    Decoder d;
+    memset(&d, 0, sizeof(d));
+    d.tt = tt;
+    d.options = options;
+    d.base = data;
+    d.feed = feed;
+    Wire w = {data, data + size};
+    if (decode_feed(&d, w) != 0) {
+        gtt_free_rt_feed(feed);
+        return NULL;
+    }
+    return feed;
+}
+
+GttRtFeed* gtt_rt_decode_file(const GttTimetable* tt, const char* path, const GttRtOptions* options) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot open %s\n", path);
+        fflush(stderr);
+        return NULL;
+    }
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    uint8_t* data = malloc(size + 1);
+    if (!data || fread(data, 1, size, fp) != size) {
+        fprintf(stderr, "Error: Cannot read %s\n", path);
+        fflush(stderr);
+        fclose(fp);
+        free(data);
+        return NULL;
+    }
+    fclose(fp);
+
+    GttRtFeed* feed = gtt_rt_decode(tt, data, size, options);
+    if (!feed) {
+        fprintf(stderr, "Error: Malformed GTFS-Realtime message in %s\n", path);
+        fflush(stderr);
+        free(data);
+        return NULL;
+    }
+    feed->owned = data;
+    return feed;
+}
+
+void gtt_free_rt_feed(GttRtFeed* feed) {
+    if (!feed) {
+        return;
+    }
+    free(feed->trip_updates);
+    free(feed->stop_time_updates);
+    free(feed->vehicles);
+    free(feed->owned);
+    free(feed);
+}
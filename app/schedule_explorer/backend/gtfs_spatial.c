@@ -0,0 +1,213 @@
+#include "gtfs_spatial.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EARTH_RADIUS_M 6371000.0
+#define METERS_PER_DEGREE 111320.0
+#define MAX_CELLS_PER_POINT 4   // Bound grid memory for sparse, wide feeds
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static int has_position(double lat, double lon) {
+    return !isnan(lat) && !isnan(lon) && !(lat == 0.0 && lon == 0.0) &&
+           lat >= -90.0 && lat <= 90.0 && lon >= -180.0 && lon <= 180.0;
+}
+
+double geo_distance_m(double lat1, double lon1, double lat2, double lon2) {
+    double p1 = lat1 * M_PI / 180.0;
+    double p2 = lat2 * M_PI / 180.0;
+    double dp = p2 - p1;
+    double dl = (lon2 - lon1) * M_PI / 180.0;
+    double a = sin(dp / 2) * sin(dp / 2) + cos(p1) * cos(p2) * sin(dl / 2) * sin(dl / 2);
+    return 2.0 * EARTH_RADIUS_M * atan2(sqrt(a), sqrt(1.0 - a));
+}
+
+double geo_segment_distance_m(double lat, double lon, double lat1, double lon1,
+                              double lat2, double lon2, double* t) {
+    double scale = cos(lat1 * M_PI / 180.0);
+    double x = (lon - lon1) * scale * METERS_PER_DEGREE;
+    double y = (lat - lat1) * METERS_PER_DEGREE;
+    double dx = (lon2 - lon1) * scale * METERS_PER_DEGREE;
+    double dy = (lat2 - lat1) * METERS_PER_DEGREE;
+    double length2 = dx * dx + dy * dy;
+    double f = length2 > 0 ? (x * dx + y * dy) / length2 : 0.0;
+    if (f < 0) f = 0;
+    if (f > 1) f = 1;
+    *t = f;
+    return hypot(x - f * dx, y - f * dy);
+}
+
+double geo_bearing_deg(double lat1, double lon1, double lat2, double lon2) {
+    double p1 = lat1 * M_PI / 180.0;
+    double p2 = lat2 * M_PI / 180.0;
+    double dl = (lon2 - lon1) * M_PI / 180.0;
+    double y = sin(dl) * cos(p2);
+    double x = cos(p1) * sin(p2) - sin(p1) * cos(p2) * cos(dl);
+    double bearing = atan2(y, x) * 180.0 / M_PI;
+    return fmod(bearing + 360.0, 360.0);
+}
+
+int spatial_grid_build(SpatialGrid* grid, const double* lat, const double* lon,
+                       size_t n, double cell_m) {
+    memset(grid, 0, sizeof(*grid));
+
+    double min_lat = 90.0, max_lat = -90.0, min_lon = 180.0, max_lon = -180.0;
+    size_t n_positioned = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!has_position(lat[i], lon[i])) continue;
+        if (lat[i] < min_lat) min_lat = lat[i];
+        if (lat[i] > max_lat) max_lat = lat[i];
+        if (lon[i] < min_lon) min_lon = lon[i];
+        if (lon[i] > max_lon) max_lon = lon[i];
+        n_positioned++;
+    }
+    if (n_positioned == 0) {
+        min_lat = max_lat = min_lon = max_lon = 0.0;
+    }
+
+    // Size cells in degrees at the middle latitude of the data
+    double mid_lat = (min_lat + max_lat) / 2.0;
+    double lon_scale = cos(mid_lat * M_PI / 180.0);
+    if (lon_scale < 0.01) lon_scale = 0.01;
+    double cell_lat = cell_m / METERS_PER_DEGREE;
+    double cell_lon = cell_m / (METERS_PER_DEGREE * lon_scale);
+
+    // Grow the cells until the grid stays proportional to the point count
+    size_t max_cells = (n_positioned + 1) * MAX_CELLS_PER_POINT;
+    uint64_t rows, cols;
+    for (;;) {
+        rows = (uint64_t)((max_lat - min_lat) / cell_lat) + 1;
+        cols = (uint64_t)((max_lon - min_lon) / cell_lon) + 1;
+        if (rows * cols <= max_cells) break;
+        cell_lat *= 2.0;
+        cell_lon *= 2.0;
+    }
+
+    grid->min_lat = min_lat;
+    grid->min_lon = min_lon;
+    grid->cell_lat = cell_lat;
+    grid->cell_lon = cell_lon;
+    grid->rows = (uint32_t)rows;
+    grid->cols = (uint32_t)cols;
+    grid->cell_start = calloc(rows * cols + 1, sizeof(uint32_t));
+    grid->cell_items = malloc(sizeof(uint32_t) * (n_positioned + 1));
+    uint32_t* cell_of = malloc(sizeof(uint32_t) * (n + 1));
+    if (!grid->cell_start || !grid->cell_items || !cell_of) {
+        fprintf(stderr, "Error: Out of memory building spatial grid\n");
+        fflush(stderr);
+        free(cell_of);
+        spatial_grid_free(grid);
+        return -1;
+    }
+
+    // Counting sort of points into cells
+    for (size_t i = 0; i < n; i++) {
+        if (!has_position(lat[i], lon[i])) {
+            cell_of[i] = UINT32_MAX;
+            continue;
+        }
+        uint32_t r = (uint32_t)((lat[i] - min_lat) / cell_lat);
+        uint32_t c = (uint32_t)((lon[i] - min_lon) / cell_lon);
+        if (r >= grid->rows) r = grid->rows - 1;
+        if (c >= grid->cols) c = grid->cols - 1;
+        cell_of[i] = r * grid->cols + c;
+        grid->cell_start[cell_of[i] + 1]++;
+    }
+    for (uint64_t cell = 0; cell < rows * cols; cell++) {
+        grid->cell_start[cell + 1] += grid->cell_start[cell];
+    }
+    uint32_t* fill = malloc(sizeof(uint32_t) * (rows * cols + 1));
+    if (!fill) {
+        free(cell_of);
+        spatial_grid_free(grid);
+        return -1;
+    }
+    memcpy(fill, grid->cell_start, sizeof(uint32_t) * rows * cols);
+    for (size_t i = 0; i < n; i++) {
+        if (cell_of[i] != UINT32_MAX) {
+            grid->cell_items[fill[cell_of[i]]++] = (uint32_t)i;
+        }
+    }
+    free(fill);
+    free(cell_of);
+    return 0;
+}
+
+void spatial_grid_free(SpatialGrid* grid) {
+    free(grid->cell_start);
+    free(grid->cell_items);
+    memset(grid, 0, sizeof(*grid));
+}
+
+// Clamp a coordinate range to grid cell indices. Returns 0 if it misses.
+static int cell_range(const SpatialGrid* grid, double min_lat, double min_lon,
+                      double max_lat, double max_lon,
+                      uint32_t* r0, uint32_t* r1, uint32_t* c0, uint32_t* c1) {
+    if (!grid->cell_start) return 0;
+    double fr0 = floor((min_lat - grid->min_lat) / grid->cell_lat);
+    double fr1 = floor((max_lat - grid->min_lat) / grid->cell_lat);
+    double fc0 = floor((min_lon - grid->min_lon) / grid->cell_lon);
+    double fc1 = floor((max_lon - grid->min_lon) / grid->cell_lon);
+    if (fr1 < 0 || fc1 < 0 || fr0 >= grid->rows || fc0 >= grid->cols) return 0;
+    *r0 = fr0 < 0 ? 0 : (uint32_t)fr0;
+    *c0 = fc0 < 0 ? 0 : (uint32_t)fc0;
+    *r1 = fr1 >= grid->rows ? grid->rows - 1 : (uint32_t)fr1;
+    *c1 = fc1 >= grid->cols ? grid->cols - 1 : (uint32_t)fc1;
+    return 1;
+}
+
+size_t spatial_grid_within(const SpatialGrid* grid, const double* lat, const double* lon,
+                           double qlat, double qlon, double radius_m,
+                           uint32_t* out, size_t capacity) {
+    double dlat = radius_m / METERS_PER_DEGREE;
+    double lon_scale = cos(qlat * M_PI / 180.0);
+    if (lon_scale < 0.01) lon_scale = 0.01;
+    double dlon = radius_m / (METERS_PER_DEGREE * lon_scale);
+
+    uint32_t r0, r1, c0, c1;
+    if (!cell_range(grid, qlat - dlat, qlon - dlon, qlat + dlat, qlon + dlon, &r0, &r1, &c0, &c1)) {
+        return 0;
+    }
+    size_t total = 0;
+    for (uint32_t r = r0; r <= r1; r++) {
+        for (uint32_t c = c0; c <= c1; c++) {
+            uint32_t cell = r * grid->cols + c;
+            for (uint32_t k = grid->cell_start[cell]; k < grid->cell_start[cell + 1]; k++) {
+                uint32_t i = grid->cell_items[k];
+                if (geo_distance_m(qlat, qlon, lat[i], lon[i]) <= radius_m) {
+                    if (total < capacity) out[total] = i;
+                    total++;
+                }
+            }
+        }
+    }
+    return total;
+}
+
+size_t spatial_grid_bbox(const SpatialGrid* grid, const double* lat, const double* lon,
+                         double min_lat, double min_lon, double max_lat, double max_lon,
+                         uint32_t* out, size_t capacity) {
+    uint32_t r0, r1, c0, c1;
+    if (!cell_range(grid, min_lat, min_lon, max_lat, max_lon, &r0, &r1, &c0, &c1)) {
+        return 0;
+    }
+    size_t total = 0;
+    for (uint32_t r = r0; r <= r1; r++) {
+        for (uint32_t c = c0; c <= c1; c++) {
+            uint32_t cell = r * grid->cols + c;
+            for (uint32_t k = grid->cell_start[cell]; k < grid->cell_start[cell + 1]; k++) {
+                uint32_t i = grid->cell_items[k];
+                if (lat[i] >= min_lat && lat[i] <= max_lat && lon[i] >= min_lon && lon[i] <= max_lon) {
+                    if (total < capacity) out[total] = i;
+                    total++;
+                }
+            }
+        }
+    }
+    return total;
+}
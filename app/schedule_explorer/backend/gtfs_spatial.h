@@ -0,0 +1,51 @@
+#ifndef GTFS_SPATIAL_H
+#define GTFS_SPATIAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Uniform lat/lon grid over a set of points (stops). Each cell lists the
+// indices of the points inside it, so radius and bounding box searches only
+// visit the cells that overlap the query.
+typedef struct {
+    double min_lat;
+    double min_lon;
+    double cell_lat;        // Cell height in degrees
+    double cell_lon;        // Cell width in degrees
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t* cell_start;   // rows * cols + 1 offsets into cell_items
+    uint32_t* cell_items;
+} SpatialGrid;
+
+// Build a grid with cells of roughly cell_m metres. Points with missing
+// coordinates (0/0 or NaN) are left out. Returns 0 on success.
+int spatial_grid_build(SpatialGrid* grid, const double* lat, const double* lon,
+                       size_t n, double cell_m);
+
+void spatial_grid_free(SpatialGrid* grid);
+
+// Points within radius_m of (qlat, qlon). Writes up to capacity indices to
+// out and returns the total number found.
+size_t spatial_grid_within(const SpatialGrid* grid, const double* lat, const double* lon,
+                           double qlat, double qlon, double radius_m,
+                           uint32_t* out, size_t capacity);
+
+// Points inside a bounding box. Same output convention as above.
+size_t spatial_grid_bbox(const SpatialGrid* grid, const double* lat, const double* lon,
+                         double min_lat, double min_lon, double max_lat, double max_lon,
+                         uint32_t* out, size_t capacity);
+
+// Great-circle distance in metres
+double geo_distance_m(double lat1, double lon1, double lat2, double lon2);
+
+// Distance in metres from a point to the segment (lat1, lon1) - (lat2, lon2),
+// on a local flat approximation. *t receives the position of the closest
+// point of the segment, from 0 at its start to 1 at its end.
+double geo_segment_distance_m(double lat, double lon, double lat1, double lon1,
+                              double lat2, double lon2, double* t);
+
+// Initial bearing from one point to another, in degrees clockwise from north
+double geo_bearing_deg(double lat1, double lon1, double lat2, double lon2);
+
+#endif // GTFS_SPATIAL_H
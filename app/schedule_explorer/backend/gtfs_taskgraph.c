@@ -0,0 +1,373 @@
+#include "gtfs_taskgraph.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+enum {
+    TASK_PENDING,
+    TASK_RUNNING,
+    TASK_DONE,
+    TASK_FAILED,
+    TASK_SKIPPED,
+};
+
+static double now_seconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+int task_graph_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+void task_graph_init(TaskGraph* graph) {
+    memset(graph, 0, sizeof(*graph));
+}
+
+int task_graph_add(TaskGraph* graph, const char* name, TaskFn fn, void* arg, uint32_t deps) {
+    int index = graph->n_tasks;
+    // Dependencies must be added first, which also rules out cycles
+    if (index >= TASK_GRAPH_MAX || (deps >> index) != 0) {
+        fprintf(stderr, "Error: Invalid task %s\n", name);
+        fflush(stderr);
+        return -1;
+    }
+    Task* task = &graph->tasks[index];
+    memset(task, 0, sizeof(*task));
+    task->name = name;
+    task->fn = fn;
+    task->arg = arg;
+    task->deps = deps;
+    graph->n_tasks++;
+    return index;
+}
+
+// ---------------------------------------------------------------------------
+// Running
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    TaskGraph* graph;
+    double t0;
+    int running;
+    int failed;
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE changed;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+#endif
+} GraphRun;
+
+static void run_lock(GraphRun* run) {
+#ifdef _WIN32
+    EnterCriticalSection(&run->lock);
+#else
+    pthread_mutex_lock(&run->lock);
+#endif
+}
+
+static void run_unlock(GraphRun* run) {
+#ifdef _WIN32
+    LeaveCriticalSection(&run->lock);
+#else
+    pthread_mutex_unlock(&run->lock);
+#endif
+}
+
+static void run_wait(GraphRun* run) {
+#ifdef _WIN32
+    SleepConditionVariableCS(&run->changed, &run->lock, INFINITE);
+#else
+    pthread_cond_wait(&run->changed, &run->lock);
+#endif
+}
+
+static void run_broadcast(GraphRun* run) {
+#ifdef _WIN32
+    WakeAllConditionVariable(&run->changed);
+#else
+    pthread_cond_broadcast(&run->changed);
+#endif
+}
+
+static int deps_done(const TaskGraph* graph, uint32_t deps) {
+    for (int i = 0; deps; i++, deps >>= 1) {
+        if ((deps & 1) && graph->tasks[i].state != TASK_DONE) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Take ready tasks until none are left to run
+static void run_tasks(GraphRun* run) {
+    TaskGraph* graph = run->graph;
+    run_lock(run);
+    for (;;) {
+        int next = -1;
+        int pending = 0;
+        for (int i = 0; i < graph->n_tasks; i++) {
+            Task* task = &graph->tasks[i];
+            if (task->state != TASK_PENDING) continue;
+            if (run->failed) {
+                task->state = TASK_SKIPPED;
+                continue;
+            }
+            pending++;
+            if (next < 0 && deps_done(graph, task->deps)) next = i;
+        }
+
+        if (next >= 0) {
+            Task* task = &graph->tasks[next];
+            task->state = TASK_RUNNING;
+            task->start = now_seconds() - run->t0;
+            run->running++;
+            run_unlock(run);
+
+            int status = task->fn(task->arg);
+
+            run_lock(run);
+            task->end = now_seconds() - run->t0;
+            task->state = status == 0 ? TASK_DONE : TASK_FAILED;
+            if (status != 0) run->failed = 1;
+            run->running--;
+            run_broadcast(run);
+            continue;
+        }
+        // Pending tasks wait on running ones; with nothing running there
+        // is nothing left to wait for
+        if (pending == 0 || run->running == 0) break;
+        run_wait(run);
+    }
+    run_unlock(run);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI graph_thread(LPVOID arg) {
+    run_tasks(arg);
+    return 0;
+}
+#else
+static void* graph_thread(void* arg) {
+    run_tasks(arg);
+    return NULL;
+}
+#endif
+
+int task_graph_run(TaskGraph* graph, int n_threads) {
+    if (n_threads < 1) n_threads = 1;
+    if (n_threads > graph->n_tasks) n_threads = graph->n_tasks > 0 ? graph->n_tasks : 1;
+
+    GraphRun run;
+    memset(&run, 0, sizeof(run));
+    run.graph = graph;
+#ifdef _WIN32
+    InitializeCriticalSection(&run.lock);
+    InitializeConditionVariable(&run.changed);
+    HANDLE threads[TASK_GRAPH_MAX];
+#else
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.changed, NULL);
+    pthread_t threads[TASK_GRAPH_MAX];
+#endif
+    uint8_t started[TASK_GRAPH_MAX] = {0};
+    for (int i = 0; i < graph->n_tasks; i++) {
+        graph->tasks[i].state = TASK_PENDING;
+        graph->tasks[i].start = graph->tasks[i].end = 0;
+    }
+
+    run.t0 = now_seconds();
+    // A thread that cannot be started leaves its share to the others
+    for (int t = 1; t < n_threads; t++) {
+#ifdef _WIN32
+        threads[t] = CreateThread(NULL, 0, graph_thread, &run, 0, NULL);
+        started[t] = threads[t] != NULL;
+#else
+        started[t] = pthread_create(&threads[t], NULL, graph_thread, &run) == 0;
+#endif
+    }
+    run_tasks(&run);
+    int used = 1;
+    for (int t = 1; t < n_threads; t++) {
+        if (!started[t]) continue;
+        used++;
+#ifdef _WIN32
+        WaitForSingleObject(threads[t], INFINITE);
+        CloseHandle(threads[t]);
+#else
+        pthread_join(threads[t], NULL);
+#endif
+    }
+    graph->elapsed = now_seconds() - run.t0;
+    graph->n_threads = used;
+
+#ifdef _WIN32
+    DeleteCriticalSection(&run.lock);
+#else
+    pthread_mutex_destroy(&run.lock);
+    pthread_cond_destroy(&run.changed);
+#endif
+    return run.failed ? -1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Parallel for
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    ParallelFn fn;
+    void* ctx;
+    int index;
+    int status;
+} ParallelShare;
+
+#ifdef _WIN32
+static DWORD WINAPI parallel_thread(LPVOID arg) {
+    ParallelShare* share = arg;
+    share->status = share->fn(share->ctx, share->index);
+    return 0;
+}
+#else
+static void* parallel_thread(void* arg) {
+    ParallelShare* share = arg;
+    share->status = share->fn(share->ctx, share->index);
+    return NULL;
+}
+#endif
+
+int parallel_for(int n_threads, ParallelFn fn, void* ctx) {
+    if (n_threads < 1) return 0;
+
+    ParallelShare* shares = calloc((size_t)n_threads, sizeof(ParallelShare));
+#ifdef _WIN32
+    HANDLE* threads = calloc((size_t)n_threads, sizeof(HANDLE));
+#else
+    pthread_t* threads = calloc((size_t)n_threads, sizeof(pthread_t));
+#endif
+    uint8_t* started = calloc((size_t)n_threads, 1);
+    if (!shares || !threads || !started) {
+        // Without room to track threads, run every share here
+        free(shares);
+        free(threads);
+        free(started);
+        int failed = 0;
+        for (int i = 0; i < n_threads; i++) failed |= fn(ctx, i) != 0;
+        return failed ? -1 : 0;
+    }
+
+    for (int i = 0; i < n_threads; i++) {
+        shares[i].fn = fn;
+        shares[i].ctx = ctx;
+        shares[i].index = i;
+    }
+    for (int i = 1; i < n_threads; i++) {
+#ifdef _WIN32
+        threads[i] = CreateThread(NULL, 0, parallel_thread, &shares[i], 0, NULL);
+        started[i] = threads[i] != NULL;
+#else
+        started[i] = pthread_create(&threads[i], NULL, parallel_thread, &shares[i]) == 0;
+#endif
+    }
+    shares[0].status = fn(ctx, 0);
+
+    int failed = shares[0].status != 0;
+    for (int i = 1; i < n_threads; i++) {
+        if (started[i]) {
+#ifdef _WIN32
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+#else
+            pthread_join(threads[i], NULL);
+#endif
+        } else {
+            shares[i].status = fn(ctx, i);
+        }
+        failed |= shares[i].status != 0;
+    }
+    free(shares);
+    free(threads);
+    free(started);
+    return failed ? -1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Report
+// ---------------------------------------------------------------------------
+
+void task_graph_report(const TaskGraph* graph) {
+    double path[TASK_GRAPH_MAX];    // Longest chain of durations ending at each task
+    int prev[TASK_GRAPH_MAX];
+    double work = 0;
+    int last = -1;
+
+    printf("Task graph: %d tasks on %d threads in %.3f s\n",
+           graph->n_tasks, graph->n_threads, graph->elapsed);
+    for (int i = 0; i < graph->n_tasks; i++) {
+        const Task* task = &graph->tasks[i];
+        double duration = task->state == TASK_DONE || task->state == TASK_FAILED
+                              ? task->end - task->start : 0;
+        work += duration;
+        path[i] = duration;
+        prev[i] = -1;
+        for (int d = 0; d < i; d++) {
+            if ((task->deps & TASK_DEP(d)) && path[d] + duration > path[i]) {
+                path[i] = path[d] + duration;
+                prev[i] = d;
+            }
+        }
+        if (last < 0 || path[i] > path[last]) last = i;
+
+        if (task->state == TASK_SKIPPED || task->state == TASK_PENDING) {
+            printf("  %-20s skipped\n", task->name);
+        } else {
+            printf("  %-20s %8.3f s  (%.3f - %.3f s)%s\n", task->name, duration,
+                   task->start, task->end, task->state == TASK_FAILED ? " failed" : "");
+        }
+    }
+    if (last < 0) {
+        fflush(stdout);
+        return;
+    }
+
+    // Walk the critical path back from its last task
+    int chain[TASK_GRAPH_MAX];
+    int n = 0;
+    for (int i = last; i >= 0; i = prev[i]) chain[n++] = i;
+    printf("Critical path: ");
+    for (int k = n - 1; k >= 0; k--) {
+        const Task* task = &graph->tasks[chain[k]];
+        printf("%s %.3f s%s", task->name, task->end - task->start, k > 0 ? " -> " : "");
+    }
+    printf(" = %.3f s\n", path[last]);
+    printf("Parallelism: %.3f s of work in %.3f s (%.2fx), critical path %.0f%% of the wall time\n",
+           work, graph->elapsed, graph->elapsed > 0 ? work / graph->elapsed : 1.0,
+           graph->elapsed > 0 ? 100.0 * path[last] / graph->elapsed : 100.0);
+    fflush(stdout);
+}
@@ -0,0 +1,64 @@
+#ifndef GTFS_TASKGRAPH_H
+#define GTFS_TASKGRAPH_H
+
+#include <stdint.h>
+
+// Small dependency graph of build steps run on a pool of threads. A task
+// starts as soon as every task it depends on has finished, so independent
+// steps (reading different GTFS files) overlap and the total time tends to
+// the longest chain of dependent steps: the critical path, which
+// task_graph_report() prints with the time of every task.
+//
+// Tasks are added after their dependencies and, when several are ready, the
+// one added first runs first: add the longest ones first.
+
+#define TASK_GRAPH_MAX 32
+
+// Dependency mask of a task index returned by task_graph_add()
+#define TASK_DEP(index) (1u << (index))
+
+typedef int (*TaskFn)(void* arg);   // 0 on success
+
+typedef struct {
+    const char* name;
+    TaskFn fn;
+    void* arg;
+    uint32_t deps;
+    int state;              // TASK_* in gtfs_taskgraph.c
+    double start;           // Seconds since the graph started
+    double end;
+} Task;
+
+typedef struct {
+    Task tasks[TASK_GRAPH_MAX];
+    int n_tasks;
+    int n_threads;          // Threads the last run used
+    double elapsed;         // Wall time of the last run
+} TaskGraph;
+
+void task_graph_init(TaskGraph* graph);
+
+// Add a task depending on the tasks in deps (TASK_DEP of earlier indices).
+// Returns its index, or -1 when the graph is full or deps is invalid.
+int task_graph_add(TaskGraph* graph, const char* name, TaskFn fn, void* arg, uint32_t deps);
+
+// Run every task on up to n_threads threads, the calling thread included.
+// After a task fails, tasks not yet started are skipped. Returns 0 when
+// every task succeeded.
+int task_graph_run(TaskGraph* graph, int n_threads);
+
+// Print the time of every task, the critical path and the parallelism
+// achieved to stdout
+void task_graph_report(const TaskGraph* graph);
+
+int task_graph_cpu_count(void);
+
+// Data parallel loop for queries: calls fn(ctx, index) once for every index
+// in 0 .. n_threads - 1, each on a thread of its own, the calling thread
+// taking index 0. The share of a thread that cannot be started is run on the
+// calling thread. Returns 0 when every call returned 0.
+typedef int (*ParallelFn)(void* ctx, int index);
+
+int parallel_for(int n_threads, ParallelFn fn, void* ctx);
+
+#endif // GTFS_TASKGRAPH_H
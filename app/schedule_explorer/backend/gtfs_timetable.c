@@ -0,0 +1,2733 @@
+#include "gtfs_timetable_internal.h"
+#include "gtfs_arena.h"
+#include "gtfs_csv.h"
+#include "gtfs_spatial.h"
+#include "gtfs_taskgraph.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <limits.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define PATH_SEPARATOR "\\"
+#else
+#define PATH_SEPARATOR "/"
+#endif
+
+#define MAX_CALENDAR_DAYS 3660  // Cap service bitsets at ten years
+#define FOOTPATH_RADIUS_M 400.0 // Generated footpaths between stops closer than this
+#define SHAPE_SNAP_M 50.0       // A stop this close to its shape is on it
+
+// Mapping between on-disk sections and timetable fields
+typedef struct {
+    GttSectionId id;
+    size_t field;
+    uint32_t elem_size;
+} SectionField;
+
+static const SectionField SECTION_FIELDS[] = {
+    {GTT_SEC_STRINGS, offsetof(GttTimetable, strings), 1},
+    {GTT_SEC_STOP_ID, offsetof(GttTimetable, stop_id), 4},
+    {GTT_SEC_STOP_NAME, offsetof(GttTimetable, stop_name), 4},
+    {GTT_SEC_STOP_LAT, offsetof(GttTimetable, stop_lat), 8},
+    {GTT_SEC_STOP_LON, offsetof(GttTimetable, stop_lon), 8},
+    {GTT_SEC_STOP_PARENT, offsetof(GttTimetable, stop_parent), 4},
+    {GTT_SEC_ROUTE_ID, offsetof(GttTimetable, route_id), 4},
+    {GTT_SEC_ROUTE_SHORT_NAME, offsetof(GttTimetable, route_short_name), 4},
+    {GTT_SEC_ROUTE_LONG_NAME, offsetof(GttTimetable, route_long_name), 4},
+    {GTT_SEC_ROUTE_TYPE, offsetof(GttTimetable, route_type), 4},
+    {GTT_SEC_SERVICE_ID, offsetof(GttTimetable, service_id), 4},
+    {GTT_SEC_SERVICE_WEEKDAYS, offsetof(GttTimetable, service_weekdays), 1},
+    {GTT_SEC_SERVICE_BITS, offsetof(GttTimetable, service_bits), 8},
+    {GTT_SEC_TRIP_ID, offsetof(GttTimetable, trip_id), 4},
+    {GTT_SEC_TRIP_ROUTE, offsetof(GttTimetable, trip_route), 4},
+    {GTT_SEC_TRIP_SERVICE, offsetof(GttTimetable, trip_service), 4},
+    {GTT_SEC_TRIP_HEADSIGN, offsetof(GttTimetable, trip_headsign), 4},
+    {GTT_SEC_TRIP_DIRECTION, offsetof(GttTimetable, trip_direction), 1},
+    {GTT_SEC_TRIP_SHAPE, offsetof(GttTimetable, trip_shape), 4},
+    {GTT_SEC_TRIP_PATTERN, offsetof(GttTimetable, trip_pattern), 4},
+    {GTT_SEC_TRIP_TIMES, offsetof(GttTimetable, trip_times), 4},
+    {GTT_SEC_PATTERN_ROUTE, offsetof(GttTimetable, pattern_route), 4},
+    {GTT_SEC_PATTERN_STOPS_START, offsetof(GttTimetable, pattern_stops_start), 4},
+    {GTT_SEC_PATTERN_N_STOPS, offsetof(GttTimetable, pattern_n_stops), 4},
+    {GTT_SEC_PATTERN_TRIPS_START, offsetof(GttTimetable, pattern_trips_start), 4},
+    {GTT_SEC_PATTERN_N_TRIPS, offsetof(GttTimetable, pattern_n_trips), 4},
+    {GTT_SEC_PATTERN_STOPS, offsetof(GttTimetable, pattern_stops), 4},
+    {GTT_SEC_ARRIVALS, offsetof(GttTimetable, arrivals), 4},
+    {GTT_SEC_DEPARTURES, offsetof(GttTimetable, departures), 4},
+    {GTT_SEC_STOP_PATTERNS_START, offsetof(GttTimetable, stop_patterns_start), 4},
+    {GTT_SEC_STOP_PATTERNS, offsetof(GttTimetable, stop_patterns), 4},
+    {GTT_SEC_STOP_PATTERN_POS, offsetof(GttTimetable, stop_pattern_pos), 4},
+    {GTT_SEC_TRANSFERS_START, offsetof(GttTimetable, transfers_start), 4},
+    {GTT_SEC_TRANSFER_STOPS, offsetof(GttTimetable, transfer_stops), 4},
+    {GTT_SEC_TRANSFER_TIMES, offsetof(GttTimetable, transfer_times), 4},
+    {GTT_SEC_CONNECTIONS, offsetof(GttTimetable, connections), sizeof(GttConnection)},
+    {GTT_SEC_DOWNSTREAM_START, offsetof(GttTimetable, downstream_start), 8},
+    {GTT_SEC_DOWNSTREAM, offsetof(GttTimetable, downstream), 1},
+    {GTT_SEC_UPSTREAM_START, offsetof(GttTimetable, upstream_start), 8},
+    {GTT_SEC_UPSTREAM, offsetof(GttTimetable, upstream), 1},
+    {GTT_SEC_LANGUAGES, offsetof(GttTimetable, languages), 4},
+    {GTT_SEC_STOP_TRANSLATIONS, offsetof(GttTimetable, stop_translations), 4},
+    {GTT_SEC_SERVICE_CALENDAR_DAYS, offsetof(GttTimetable, service_calendar_days), 1},
+    {GTT_SEC_SERVICE_START, offsetof(GttTimetable, service_start), 4},
+    {GTT_SEC_SERVICE_END, offsetof(GttTimetable, service_end), 4},
+    {GTT_SEC_EXCEPTIONS_START, offsetof(GttTimetable, exceptions_start), 4},
+    {GTT_SEC_EXCEPTION_DAYS, offsetof(GttTimetable, exception_days), 4},
+    {GTT_SEC_EXCEPTION_TYPES, offsetof(GttTimetable, exception_types), 1},
+    {GTT_SEC_TRIP_FREQUENCIES_START, offsetof(GttTimetable, trip_frequencies_start), 4},
+    {GTT_SEC_FREQUENCIES, offsetof(GttTimetable, frequencies), sizeof(GttFrequency)},
+    {GTT_SEC_SHAPE_ID, offsetof(GttTimetable, shape_id), 4},
+    {GTT_SEC_SHAPE_POINTS_START, offsetof(GttTimetable, shape_points_start), 4},
+    {GTT_SEC_SHAPE_LAT, offsetof(GttTimetable, shape_lat), 8},
+    {GTT_SEC_SHAPE_LON, offsetof(GttTimetable, shape_lon), 8},
+    {GTT_SEC_SHAPE_DISTANCE, offsetof(GttTimetable, shape_distance), 8},
+    {GTT_SEC_PATTERN_SHAPE, offsetof(GttTimetable, pattern_shape), 4},
+    {GTT_SEC_PATTERN_STOP_SHAPE_POS, offsetof(GttTimetable, pattern_stop_shape_pos), 4},
+    {GTT_SEC_PATTERN_STOP_SHAPE_DISTANCE, offsetof(GttTimetable, pattern_stop_shape_distance), 8},
+    {GTT_SEC_STOP_SEQUENCES, offsetof(GttTimetable, stop_sequences), 4},
+};
+
+#define N_SECTION_FIELDS (sizeof(SECTION_FIELDS) / sizeof(SECTION_FIELDS[0]))
+
+static const void** section_slot(GttTimetable* tt, const SectionField* f) {
+    return (const void**)((char*)tt + f->field);
+}
+
+// ---------------------------------------------------------------------------
+// Small building blocks
+// ---------------------------------------------------------------------------
+
+// Grow a heap array so it can hold at least `need` elements
+static int grow(void** data, size_t* cap, size_t need, size_t elem_size) {
+    if (need <= *cap) {
+        return 0;
+    }
+    size_t new_cap = *cap ? *cap : 64;
+    while (new_cap < need) new_cap *= 2;
+    void* p = realloc(*data, new_cap * elem_size);
+    if (!p) {
+        fprintf(stderr, "Error: Out of memory growing array to %zu elements\n", new_cap);
+        fflush(stderr);
+        return -1;
+    }
+    *data = p;
+    *cap = new_cap;
+    return 0;
+}
+
+#define VEC(T) struct { T* data; size_t len; size_t cap; }
+#define VEC_PUSH(v, value) \
+    (grow((void**)&(v).data, &(v).cap, (v).len + 1, sizeof(*(v).data)) == 0 \
+        ? ((v).data[(v).len++] = (value), 0) : -1)
+#define VEC_FREE(v) do { free((v).data); (v).data = NULL; (v).len = (v).cap = 0; } while (0)
+
+// Id lookup tables of a loaded timetable: open addressing from id strings to
+// indices. Slots hold index + 1 and keys are string offsets of the indexed
+// table.
+static int32_t idmap_find(const uint32_t* slots, uint32_t mask, const char* pool,
+                          const uint32_t* keys, const char* id) {
+    if (!slots) {
+        return -1;
+    }
+    uint32_t i = gtfs_hash(id) & mask;
+    while (slots[i]) {
+        uint32_t index = slots[i] - 1;
+        if (strcmp(pool + keys[index], id) == 0) {
+            return (int32_t)index;
+        }
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+static int idmap_build(uint32_t** out_slots, uint32_t* out_mask, const char* pool,
+                       const uint32_t* keys, size_t n, size_t min_keys) {
+    size_t cap = 16;
+    while (cap < n * 2 || cap < min_keys * 2) cap *= 2;
+    uint32_t* slots = calloc(cap, sizeof(uint32_t));
+    if (!slots) {
+        return -1;
+    }
+    uint32_t mask = (uint32_t)(cap - 1);
+    for (size_t index = 0; index < n; index++) {
+        uint32_t i = gtfs_hash(pool + keys[index]) & mask;
+        while (slots[i]) i = (i + 1) & mask;
+        slots[i] = (uint32_t)index + 1;
+    }
+    free(*out_slots);
+    *out_slots = slots;
+    *out_mask = mask;
+    return 0;
+}
+
+// Map from the interned ids of a builder table to its rows. Interned strings
+// are equal exactly when their offsets are, so the map hashes the offset and
+// never looks at the characters. Slots hold row + 1.
+typedef struct {
+    uint32_t* slots;
+    uint32_t mask;
+    uint32_t count;
+} RowMap;
+
+static uint32_t hash_offset(uint32_t offset) {
+    offset *= 2654435761u;
+    return offset ^ (offset >> 15);
+}
+
+static int32_t rowmap_get(const RowMap* map, const uint32_t* keys, int64_t offset) {
+    if (!map->slots || offset < 0) {
+        return -1;
+    }
+    uint32_t i = hash_offset((uint32_t)offset) & map->mask;
+    while (map->slots[i]) {
+        uint32_t row = map->slots[i] - 1;
+        if (keys[row] == offset) {
+            return (int32_t)row;
+        }
+        i = (i + 1) & map->mask;
+    }
+    return -1;
+}
+
+// Add keys[row]; rows must be added in order
+static int rowmap_put(RowMap* map, const uint32_t* keys, uint32_t row) {
+    if (!map->slots || ((size_t)map->count + 1) * 2 > (size_t)map->mask + 1) {
+        size_t cap = map->slots ? ((size_t)map->mask + 1) * 2 : 64;
+        uint32_t* slots = calloc(cap, sizeof(uint32_t));
+        if (!slots) {
+            fprintf(stderr, "Error: Out of memory building id map\n");
+            fflush(stderr);
+            return -1;
+        }
+        uint32_t mask = (uint32_t)(cap - 1);
+        for (uint32_t r = 0; r < row; r++) {
+            uint32_t i = hash_offset(keys[r]) & mask;
+            while (slots[i]) i = (i + 1) & mask;
+            slots[i] = r + 1;
+        }
+        free(map->slots);
+        map->slots = slots;
+        map->mask = mask;
+    }
+    uint32_t i = hash_offset(keys[row]) & map->mask;
+    while (map->slots[i]) i = (i + 1) & map->mask;
+    map->slots[i] = row + 1;
+    map->count++;
+    return 0;
+}
+
+static void join_path(char* out, size_t size, const char* dir, const char* file) {
+    snprintf(out, size, "%s%s%s", dir, PATH_SEPARATOR, file);
+}
+
+// ---------------------------------------------------------------------------
+// Builder
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    uint32_t trip;
+    uint32_t sequence;
+    uint32_t stop;
+    int32_t arrival;
+    int32_t departure;
+} RawStopTime;
+
+typedef struct {
+    uint32_t service;
+    int32_t day;
+    int32_t exception_type;
+} RawException;
+
+typedef struct {
+    uint32_t trip;
+    GttFrequency window;
+} RawFrequency;
+
+typedef struct {
+    uint32_t shape;
+    uint32_t sequence;
+    double lat;
+    double lon;
+} RawShapePoint;
+
+typedef struct {
+    StringInterner strings;
+
+    VEC(uint32_t) stop_id;
+    VEC(uint32_t) stop_name;
+    VEC(double) stop_lat;
+    VEC(double) stop_lon;
+    VEC(uint32_t) stop_parent_key;
+    RowMap stop_map;
+
+    VEC(uint32_t) route_id;
+    VEC(uint32_t) route_short_name;
+    VEC(uint32_t) route_long_name;
+    VEC(int32_t) route_type;
+    RowMap route_map;
+
+    VEC(uint32_t) service_id;
+    VEC(uint8_t) service_calendar_days;   // calendar.txt weekday mask
+    VEC(int32_t) service_start;
+    VEC(int32_t) service_end;
+    VEC(RawException) exceptions;
+    RowMap service_map;
+
+    VEC(uint32_t) trip_id;
+    VEC(uint32_t) trip_route;
+    VEC(uint32_t) trip_service;
+    VEC(uint32_t) trip_headsign;
+    VEC(int8_t) trip_direction;
+    VEC(uint32_t) trip_shape;
+    RowMap trip_map;
+
+    VEC(RawStopTime) stop_times;
+    VEC(RawFrequency) frequencies;
+
+    VEC(uint32_t) shape_id;             // Shapes used by a trip
+    VEC(uint32_t) shape_points_start;
+    VEC(double) shape_lat;
+    VEC(double) shape_lon;
+    VEC(double) shape_distance;
+    RowMap shape_map;
+
+    VEC(uint32_t) languages;
+    VEC(uint32_t) stop_translations;    // languages.len columns of stop_id.len names
+} Builder;
+
+static void builder_free(Builder* b) {
+    interner_free(&b->strings);
+    VEC_FREE(b->stop_id);
+    VEC_FREE(b->stop_name);
+    VEC_FREE(b->stop_lat);
+    VEC_FREE(b->stop_lon);
+    VEC_FREE(b->stop_parent_key);
+    free(b->stop_map.slots);
+    VEC_FREE(b->route_id);
+    VEC_FREE(b->route_short_name);
+    VEC_FREE(b->route_long_name);
+    VEC_FREE(b->route_type);
+    free(b->route_map.slots);
+    VEC_FREE(b->service_id);
+    VEC_FREE(b->service_calendar_days);
+    VEC_FREE(b->service_start);
+    VEC_FREE(b->service_end);
+    VEC_FREE(b->exceptions);
+    free(b->service_map.slots);
+    VEC_FREE(b->trip_id);
+    VEC_FREE(b->trip_route);
+    VEC_FREE(b->trip_service);
+    VEC_FREE(b->trip_headsign);
+    VEC_FREE(b->trip_direction);
+    VEC_FREE(b->trip_shape);
+    free(b->trip_map.slots);
+    VEC_FREE(b->stop_times);
+    VEC_FREE(b->frequencies);
+    VEC_FREE(b->shape_id);
+    VEC_FREE(b->shape_points_start);
+    VEC_FREE(b->shape_lat);
+    VEC_FREE(b->shape_lon);
+    VEC_FREE(b->shape_distance);
+    free(b->shape_map.slots);
+    VEC_FREE(b->languages);
+    VEC_FREE(b->stop_translations);
+}
+
+static int64_t builder_intern(Builder* b, const char* s) {
+    return interner_add(&b->strings, s, gtfs_hash(s));
+}
+
+// Row of a table by id, hashing the id once; -1 when unknown
+static int32_t builder_find(const Builder* b, const RowMap* map, const uint32_t* keys, const char* id) {
+    return rowmap_get(map, keys, interner_find(&b->strings, id, gtfs_hash(id)));
+}
+
+#define VEC_BYTES(v) ((v).cap * sizeof(*(v).data))
+#define ROWMAP_BYTES(m) ((m).slots ? ((size_t)(m).mask + 1) * sizeof(uint32_t) : 0)
+#define MB(bytes) ((double)(bytes) / (1024.0 * 1024.0))
+
+// Bytes held by each builder table once the GTFS files are read
+static void builder_report_memory(const Builder* b) {
+    const StringInterner* strings = &b->strings;
+    printf("Memory: strings %.1f MB (%.1f MB of text for %u distinct of %llu, %.1f MB without interning)\n",
+           MB(interner_bytes(strings)), MB(strings->len), strings->count,
+           (unsigned long long)strings->added, MB(strings->added_bytes));
+    printf("Memory: stops %.1f MB, routes %.1f MB, services %.1f MB, trips %.1f MB\n",
+           MB(VEC_BYTES(b->stop_id) + VEC_BYTES(b->stop_name) + VEC_BYTES(b->stop_lat) +
+              VEC_BYTES(b->stop_lon) + VEC_BYTES(b->stop_parent_key) + ROWMAP_BYTES(b->stop_map)),
+           MB(VEC_BYTES(b->route_id) + VEC_BYTES(b->route_short_name) + VEC_BYTES(b->route_long_name) +
+              VEC_BYTES(b->route_type) + ROWMAP_BYTES(b->route_map)),
+           MB(VEC_BYTES(b->service_id) + VEC_BYTES(b->service_calendar_days) +
+              VEC_BYTES(b->service_start) + VEC_BYTES(b->service_end) + VEC_BYTES(b->exceptions) +
+              ROWMAP_BYTES(b->service_map)),
+           MB(VEC_BYTES(b->trip_id) + VEC_BYTES(b->trip_route) + VEC_BYTES(b->trip_service) +
+              VEC_BYTES(b->trip_headsign) + VEC_BYTES(b->trip_direction) + VEC_BYTES(b->trip_shape) +
+              ROWMAP_BYTES(b->trip_map)));
+    printf("Memory: stop_times %.1f MB (%zu rows of %zu bytes)\n",
+           MB(VEC_BYTES(b->stop_times)), b->stop_times.len, sizeof(RawStopTime));
+    fflush(stdout);
+}
+
+// Find or create a service entry
+static int64_t builder_service(Builder* b, const char* id) {
+    int64_t key = builder_intern(b, id);
+    if (key < 0) {
+        return -1;
+    }
+    int32_t found = rowmap_get(&b->service_map, b->service_id.data, key);
+    if (found >= 0) {
+        return found;
+    }
+    if (VEC_PUSH(b->service_id, (uint32_t)key) != 0 ||
+        VEC_PUSH(b->service_calendar_days, 0) != 0 ||
+        VEC_PUSH(b->service_start, INT32_MAX) != 0 ||
+        VEC_PUSH(b->service_end, INT32_MIN) != 0) {
+        return -1;
+    }
+    uint32_t index = (uint32_t)(b->service_id.len - 1);
+    if (rowmap_put(&b->service_map, b->service_id.data, index) != 0) {
+        return -1;
+    }
+    return index;
+}
+
+// ---------------------------------------------------------------------------
+// Reading the GTFS files
+// ---------------------------------------------------------------------------
+
+// The files are read in parallel (see gtt_build), each into tables of its
+// own, and then applied to the builder one after another. Only applying
+// touches the shared string pool and id maps, and it does so in the order a
+// sequential read would, so the timetable does not depend on which file was
+// read first.
+
+// Rows of one GTFS file: every wanted field as an offset into a string pool
+// of the file
+typedef struct {
+    StringInterner strings;
+    VEC(uint32_t) cells;    // n_cols per row
+    size_t n_rows;
+    int n_cols;
+} StagedTable;
+
+#define MAX_STAGED_COLUMNS 16
+
+enum { STOP_ID, STOP_NAME, STOP_LAT, STOP_LON, STOP_PARENT, STOP_COLUMNS };
+static const char* const stop_columns[STOP_COLUMNS] = {
+    "stop_id", "stop_name", "stop_lat", "stop_lon", "parent_station"
+};
+
+enum { ROUTE_ID, ROUTE_SHORT_NAME, ROUTE_LONG_NAME, ROUTE_TYPE, ROUTE_COLUMNS };
+static const char* const route_columns[ROUTE_COLUMNS] = {
+    "route_id", "route_short_name", "route_long_name", "route_type"
+};
+
+enum { CALENDAR_ID, CALENDAR_START, CALENDAR_END, CALENDAR_MONDAY, CALENDAR_COLUMNS = CALENDAR_MONDAY + 7 };
+static const char* const calendar_columns[CALENDAR_COLUMNS] = {
+    "service_id", "start_date", "end_date",
+    "monday", "tuesday", "wednesday", "thursday", "friday", "saturday", "sunday"
+};
+
+enum { EXCEPTION_ID, EXCEPTION_DATE, EXCEPTION_TYPE, EXCEPTION_COLUMNS };
+static const char* const exception_columns[EXCEPTION_COLUMNS] = {
+    "service_id", "date", "exception_type"
+};
+
+enum { TRIP_ID, TRIP_ROUTE, TRIP_SERVICE, TRIP_HEADSIGN, TRIP_DIRECTION, TRIP_SHAPE, TRIP_COLUMNS };
+static const char* const trip_columns[TRIP_COLUMNS] = {
+    "trip_id", "route_id", "service_id", "trip_headsign", "direction_id", "shape_id"
+};
+
+enum { FREQUENCY_TRIP, FREQUENCY_START, FREQUENCY_END, FREQUENCY_HEADWAY, FREQUENCY_EXACT, FREQUENCY_COLUMNS };
+static const char* const frequency_columns[FREQUENCY_COLUMNS] = {
+    "trip_id", "start_time", "end_time", "headway_secs", "exact_times"
+};
+
+// translations.txt in either form: table_name/field_name/record_id or the
+// older trans_id/lang, where trans_id is the text being translated
+enum {
+    TRANSLATION_TABLE, TRANSLATION_FIELD, TRANSLATION_LANGUAGE, TRANSLATION_TEXT,
+    TRANSLATION_RECORD, TRANSLATION_VALUE, TRANSLATION_TRANS_ID, TRANSLATION_LANG,
+    TRANSLATION_COLUMNS
+};
+static const char* const translation_columns[TRANSLATION_COLUMNS] = {
+    "table_name", "field_name", "language", "translation",
+    "record_id", "field_value", "trans_id", "lang"
+};
+
+// Distinct ids of stop_times.txt numbered in order of first appearance
+typedef struct {
+    StringInterner strings;
+    VEC(uint32_t) keys;     // String offset of each id
+    RowMap map;
+} StagedIds;
+
+// stop_times.txt, with trip and stop numbered by StagedIds until applied
+typedef struct {
+    StagedIds trips;
+    StagedIds stops;
+    VEC(RawStopTime) rows;
+    size_t skipped;
+} StagedStopTimes;
+
+// shapes.txt, with shapes numbered by StagedIds until applied
+typedef struct {
+    StagedIds shapes;
+    VEC(RawShapePoint) points;
+} StagedShapes;
+
+typedef struct {
+    StagedTable stops;
+    StagedTable routes;
+    StagedTable calendar;
+    StagedTable exceptions;
+    StagedTable trips;
+    StagedTable translations;
+    StagedTable frequencies;
+    StagedStopTimes stop_times;
+    StagedShapes shapes;
+} StagedFeed;
+
+static void staged_table_free(StagedTable* t) {
+    interner_free(&t->strings);
+    VEC_FREE(t->cells);
+    t->n_rows = 0;
+}
+
+static void staged_ids_free(StagedIds* ids) {
+    interner_free(&ids->strings);
+    VEC_FREE(ids->keys);
+    free(ids->map.slots);
+    memset(&ids->map, 0, sizeof(ids->map));
+}
+
+static void staged_feed_free(StagedFeed* s) {
+    staged_table_free(&s->stops);
+    staged_table_free(&s->routes);
+    staged_table_free(&s->calendar);
+    staged_table_free(&s->exceptions);
+    staged_table_free(&s->trips);
+    staged_table_free(&s->translations);
+    staged_table_free(&s->frequencies);
+    staged_ids_free(&s->stop_times.trips);
+    staged_ids_free(&s->stop_times.stops);
+    VEC_FREE(s->stop_times.rows);
+    staged_ids_free(&s->shapes.shapes);
+    VEC_FREE(s->shapes.points);
+}
+
+static const char* staged_field(const StagedTable* t, size_t row, int column) {
+    return t->strings.data + t->cells.data[row * (size_t)t->n_cols + column];
+}
+
+// Read the given columns of a GTFS file into t. The first n_required
+// columns must exist. A missing optional file leaves t empty.
+static int stage_table(StagedTable* t, const char* gtfs_dir, const char* file,
+                       const char* const* columns, int n_cols, int n_required, int optional) {
+    char path[4096];
+    join_path(path, sizeof(path), gtfs_dir, file);
+    t->n_cols = n_cols;
+    CsvReader csv;
+    if (csv_open(&csv, path) != 0) {
+        if (optional) {
+            return 0;
+        }
+        fprintf(stderr, "Error: Could not open %s\n", path);
+        fflush(stderr);
+        return -1;
+    }
+    int c[MAX_STAGED_COLUMNS];
+    for (int k = 0; k < n_cols; k++) {
+        c[k] = csv_column(&csv, columns[k]);
+        if (k < n_required && c[k] < 0) {
+            fprintf(stderr, "Missing required column %s in %s\n", columns[k], file);
+            fflush(stderr);
+            csv_close(&csv);
+            return -1;
+        }
+    }
+
+    int status;
+    while ((status = csv_next(&csv)) == 1) {
+        for (int k = 0; k < n_cols; k++) {
+            const char* field = csv_field(&csv, c[k]);
+            int64_t offset = interner_add(&t->strings, field, gtfs_hash(field));
+            if (offset < 0 || VEC_PUSH(t->cells, (uint32_t)offset) != 0) {
+                csv_close(&csv);
+                return -1;
+            }
+        }
+        t->n_rows++;
+    }
+    csv_close(&csv);
+    return status < 0 ? -1 : 0;
+}
+
+// Number of an id, numbering it if it is new; -1 when out of memory
+static int64_t staged_id(StagedIds* ids, const char* s) {
+    uint32_t count = ids->strings.count;
+    int64_t offset = interner_add(&ids->strings, s, gtfs_hash(s));
+    if (offset < 0) {
+        return -1;
+    }
+    if (ids->strings.count == count) {
+        int32_t known = rowmap_get(&ids->map, ids->keys.data, offset);
+        if (known >= 0) {
+            return known;
+        }
+    }
+    if (VEC_PUSH(ids->keys, (uint32_t)offset) != 0 ||
+        rowmap_put(&ids->map, ids->keys.data, (uint32_t)(ids->keys.len - 1)) != 0) {
+        return -1;
+    }
+    return (int64_t)ids->keys.len - 1;
+}
+
+static int stage_stop_times(StagedStopTimes* s, const char* gtfs_dir) {
+    char path[4096];
+    join_path(path, sizeof(path), gtfs_dir, "stop_times.txt");
+    CsvReader csv;
+    if (csv_open(&csv, path) != 0) {
+        fprintf(stderr, "Error: Could not open %s\n", path);
+        fflush(stderr);
+        return -1;
+    }
+    int c_trip = csv_column(&csv, "trip_id");
+    int c_stop = csv_column(&csv, "stop_id");
+    int c_arrival = csv_column(&csv, "arrival_time");
+    int c_departure = csv_column(&csv, "departure_time");
+    int c_sequence = csv_column(&csv, "stop_sequence");
+    if (c_trip < 0 || c_stop < 0 || c_sequence < 0) {
+        fprintf(stderr, "Missing required column in stop_times.txt\n");
+        fflush(stderr);
+        csv_close(&csv);
+        return -1;
+    }
+
+    // Consecutive rows usually belong to the same trip
+    int64_t last_trip = -1;
+    int status;
+    while ((status = csv_next(&csv)) == 1) {
+        const char* trip_id = csv_field(&csv, c_trip);
+        int64_t trip = last_trip;
+        if (trip < 0 || strcmp(s->trips.strings.data + s->trips.keys.data[trip], trip_id) != 0) {
+            trip = staged_id(&s->trips, trip_id);
+            last_trip = trip;
+        }
+        int64_t stop = staged_id(&s->stops, csv_field(&csv, c_stop));
+        if (trip < 0 || stop < 0) {
+            csv_close(&csv);
+            return -1;
+        }
+        // Rows without a usable stop_sequence cannot be placed in their trip
+        const char* sequence_field = csv_field(&csv, c_sequence);
+        char* endptr;
+        long sequence = strtol(sequence_field, &endptr, 10);
+        if (endptr == sequence_field || *endptr != '\0' || sequence < 0 || sequence > INT_MAX) {
+            s->skipped++;
+            continue;
+        }
+        RawStopTime row = {
+            (uint32_t)trip,
+            (uint32_t)sequence,
+            (uint32_t)stop,
+            csv_parse_time(csv_field(&csv, c_arrival)),
+            csv_parse_time(csv_field(&csv, c_departure)),
+        };
+        if (VEC_PUSH(s->rows, row) != 0) {
+            csv_close(&csv);
+            return -1;
+        }
+    }
+    csv_close(&csv);
+    return status < 0 ? -1 : 0;
+}
+
+static int stage_shapes(StagedShapes* s, const char* gtfs_dir) {
+    char path[4096];
+    join_path(path, sizeof(path), gtfs_dir, "shapes.txt");
+    CsvReader csv;
+    if (csv_open(&csv, path) != 0) {
+        return 0;   // Optional
+    }
+    int c_shape = csv_column(&csv, "shape_id");
+    int c_lat = csv_column(&csv, "shape_pt_lat");
+    int c_lon = csv_column(&csv, "shape_pt_lon");
+    int c_sequence = csv_column(&csv, "shape_pt_sequence");
+    if (c_shape < 0 || c_lat < 0 || c_lon < 0 || c_sequence < 0) {
+        fprintf(stderr, "Missing required column in shapes.txt\n");
+        fflush(stderr);
+        csv_close(&csv);
+        return -1;
+    }
+
+    // Points of a shape are usually consecutive
+    int64_t last_shape = -1;
+    int status;
+    while ((status = csv_next(&csv)) == 1) {
+        const char* shape_id = csv_field(&csv, c_shape);
+        int64_t shape = last_shape;
+        if (shape < 0 || strcmp(s->shapes.strings.data + s->shapes.keys.data[shape], shape_id) != 0) {
+            shape = staged_id(&s->shapes, shape_id);
+            last_shape = shape;
+        }
+        if (shape < 0) {
+            csv_close(&csv);
+            return -1;
+        }
+        long sequence = strtol(csv_field(&csv, c_sequence), NULL, 10);
+        if (sequence < 0 || sequence > INT_MAX) {
+            continue;
+        }
+        RawShapePoint point = {
+            (uint32_t)shape,
+            (uint32_t)sequence,
+            atof(csv_field(&csv, c_lat)),
+            atof(csv_field(&csv, c_lon)),
+        };
+        if (VEC_PUSH(s->points, point) != 0) {
+            csv_close(&csv);
+            return -1;
+        }
+    }
+    csv_close(&csv);
+    return status < 0 ? -1 : 0;
+}
+
+static int apply_stops(Builder* b, const StagedTable* t) {
+    for (size_t r = 0; r < t->n_rows; r++) {
+        int64_t key = builder_intern(b, staged_field(t, r, STOP_ID));
+        if (key == 0 || rowmap_get(&b->stop_map, b->stop_id.data, key) >= 0) {
+            continue;
+        }
+        int64_t name = builder_intern(b, staged_field(t, r, STOP_NAME));
+        int64_t parent = builder_intern(b, staged_field(t, r, STOP_PARENT));
+        if (key < 0 || name < 0 || parent < 0 ||
+            VEC_PUSH(b->stop_id, (uint32_t)key) != 0 ||
+            VEC_PUSH(b->stop_name, (uint32_t)name) != 0 ||
+            VEC_PUSH(b->stop_lat, atof(staged_field(t, r, STOP_LAT))) != 0 ||
+            VEC_PUSH(b->stop_lon, atof(staged_field(t, r, STOP_LON))) != 0 ||
+            VEC_PUSH(b->stop_parent_key, (uint32_t)parent) != 0 ||
+            rowmap_put(&b->stop_map, b->stop_id.data, (uint32_t)(b->stop_id.len - 1)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int apply_routes(Builder* b, const StagedTable* t) {
+    for (size_t r = 0; r < t->n_rows; r++) {
+        int64_t key = builder_intern(b, staged_field(t, r, ROUTE_ID));
+        if (key == 0 || rowmap_get(&b->route_map, b->route_id.data, key) >= 0) {
+            continue;
+        }
+        int64_t short_name = builder_intern(b, staged_field(t, r, ROUTE_SHORT_NAME));
+        int64_t long_name = builder_intern(b, staged_field(t, r, ROUTE_LONG_NAME));
+        if (key < 0 || short_name < 0 || long_name < 0 ||
+            VEC_PUSH(b->route_id, (uint32_t)key) != 0 ||
+            VEC_PUSH(b->route_short_name, (uint32_t)short_name) != 0 ||
+            VEC_PUSH(b->route_long_name, (uint32_t)long_name) != 0 ||
+            VEC_PUSH(b->route_type, (int32_t)atoi(staged_field(t, r, ROUTE_TYPE))) != 0 ||
+            rowmap_put(&b->route_map, b->route_id.data, (uint32_t)(b->route_id.len - 1)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// calendar.txt, then calendar_dates.txt; either may be missing
+static int apply_calendars(Builder* b, const StagedTable* calendar, const StagedTable* exceptions) {
+    for (size_t r = 0; r < calendar->n_rows; r++) {
+        int64_t service = builder_service(b, staged_field(calendar, r, CALENDAR_ID));
+        if (service < 0) {
+            return -1;
+        }
+        uint8_t mask = 0;
+        for (int d = 0; d < 7; d++) {
+            if (atoi(staged_field(calendar, r, CALENDAR_MONDAY + d)) == 1) mask |= (uint8_t)(1u << d);
+        }
+        int start = csv_parse_date(staged_field(calendar, r, CALENDAR_START));
+        int end = csv_parse_date(staged_field(calendar, r, CALENDAR_END));
+        b->service_calendar_days.data[service] = mask;
+        if (start != INT32_MIN && end != INT32_MIN) {
+            b->service_start.data[service] = start;
+            b->service_end.data[service] = end;
+        }
+    }
+
+    for (size_t r = 0; r < exceptions->n_rows; r++) {
+        int day = csv_parse_date(staged_field(exceptions, r, EXCEPTION_DATE));
+        int type = atoi(staged_field(exceptions, r, EXCEPTION_TYPE));
+        if (day == INT32_MIN || (type != 1 && type != 2)) {
+            continue;
+        }
+        int64_t service = builder_service(b, staged_field(exceptions, r, EXCEPTION_ID));
+        if (service < 0) {
+            return -1;
+        }
+        RawException exception = {(uint32_t)service, day, type};
+        if (VEC_PUSH(b->exceptions, exception) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int apply_trips(Builder* b, const StagedTable* t) {
+    size_t skipped = 0;
+    for (size_t r = 0; r < t->n_rows; r++) {
+        int64_t key = builder_intern(b, staged_field(t, r, TRIP_ID));
+        int32_t route = builder_find(b, &b->route_map, b->route_id.data, staged_field(t, r, TRIP_ROUTE));
+        if (key == 0 || route < 0 || rowmap_get(&b->trip_map, b->trip_id.data, key) >= 0) {
+            skipped++;
+            continue;
+        }
+        int64_t service = builder_service(b, staged_field(t, r, TRIP_SERVICE));
+        int64_t headsign = builder_intern(b, staged_field(t, r, TRIP_HEADSIGN));
+        int64_t shape = builder_intern(b, staged_field(t, r, TRIP_SHAPE));
+        const char* direction = staged_field(t, r, TRIP_DIRECTION);
+        if (service < 0 || key < 0 || headsign < 0 || shape < 0 ||
+            VEC_PUSH(b->trip_id, (uint32_t)key) != 0 ||
+            VEC_PUSH(b->trip_route, (uint32_t)route) != 0 ||
+            VEC_PUSH(b->trip_service, (uint32_t)service) != 0 ||
+            VEC_PUSH(b->trip_headsign, (uint32_t)headsign) != 0 ||
+            VEC_PUSH(b->trip_direction, (int8_t)(*direction ? atoi(direction) : -1)) != 0 ||
+            VEC_PUSH(b->trip_shape, (uint32_t)shape) != 0 ||
+            rowmap_put(&b->trip_map, b->trip_id.data, (uint32_t)(b->trip_id.len - 1)) != 0) {
+            return -1;
+        }
+    }
+    if (skipped > 0) {
+        printf("Skipped %zu trips with unknown routes or duplicate ids\n", skipped);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+// Index of a language, adding it and an empty column of stop names if new
+static int64_t builder_language(Builder* b, const char* code) {
+    int64_t key = builder_intern(b, code);
+    if (key < 0) {
+        return -1;
+    }
+    for (size_t l = 0; l < b->languages.len; l++) {
+        if (b->languages.data[l] == key) return (int64_t)l;
+    }
+    size_t n_stops = b->stop_id.len;
+    if (VEC_PUSH(b->languages, (uint32_t)key) != 0 ||
+        grow((void**)&b->stop_translations.data, &b->stop_translations.cap,
+             b->languages.len * n_stops, sizeof(uint32_t)) != 0) {
+        return -1;
+    }
+    memset(b->stop_translations.data + b->stop_translations.len, 0, n_stops * sizeof(uint32_t));
+    b->stop_translations.len += n_stops;
+    return (int64_t)b->languages.len - 1;
+}
+
+// Translated stop names. Translations of a text apply to every stop with
+// that name; translations of a record_id override them for that stop. Each
+// distinct translation is stored once in the string pool.
+static int apply_translations(Builder* b, const StagedTable* t) {
+    size_t n_stops = b->stop_id.len;
+    if (t->n_rows == 0) {
+        return 0;
+    }
+
+    // Stops by name: the first stop of each distinct name, chained through
+    // next_same_name
+    VEC(uint32_t) names = {0};
+    VEC(int32_t) first_stop = {0};
+    RowMap name_map = {0};
+    int32_t* next_same_name = malloc(sizeof(int32_t) * (n_stops + 1));
+    int result = -1;
+    if (!next_same_name) goto done;
+    for (size_t s = n_stops; s-- > 0;) {
+        uint32_t name = b->stop_name.data[s];
+        int32_t row = rowmap_get(&name_map, names.data, name);
+        if (row < 0) {
+            if (VEC_PUSH(names, name) != 0 || VEC_PUSH(first_stop, -1) != 0 ||
+                rowmap_put(&name_map, names.data, (uint32_t)(names.len - 1)) != 0) {
+                goto done;
+            }
+            row = (int32_t)(names.len - 1);
+        }
+        next_same_name[s] = first_stop.data[row];
+        first_stop.data[row] = (int32_t)s;
+    }
+
+    size_t applied = 0;
+    for (int by_record = 0; by_record <= 1; by_record++) {
+        for (size_t r = 0; r < t->n_rows; r++) {
+            const char* table = staged_field(t, r, TRANSLATION_TABLE);
+            const char* record = "";
+            const char* text;
+            const char* language;
+            if (*table) {
+                if (strcmp(table, "stops") != 0 ||
+                    strcmp(staged_field(t, r, TRANSLATION_FIELD), "stop_name") != 0) {
+                    continue;
+                }
+                record = staged_field(t, r, TRANSLATION_RECORD);
+                text = staged_field(t, r, TRANSLATION_VALUE);
+                language = staged_field(t, r, TRANSLATION_LANGUAGE);
+            } else {
+                text = staged_field(t, r, TRANSLATION_TRANS_ID);
+                language = staged_field(t, r, TRANSLATION_LANG);
+            }
+            if ((*record != '\0') != by_record || (!*record && !*text) || !*language) {
+                continue;
+            }
+
+            int32_t stop = -1;
+            if (*record) {
+                stop = builder_find(b, &b->stop_map, b->stop_id.data, record);
+            } else {
+                int32_t row = rowmap_get(&name_map, names.data,
+                                         interner_find(&b->strings, text, gtfs_hash(text)));
+                stop = row >= 0 ? first_stop.data[row] : -1;
+            }
+            if (stop < 0) {
+                continue;
+            }
+            int64_t l = builder_language(b, language);
+            int64_t translation = builder_intern(b, staged_field(t, r, TRANSLATION_TEXT));
+            if (l < 0 || translation < 0) {
+                goto done;
+            }
+            uint32_t* column = b->stop_translations.data + (size_t)l * n_stops;
+            if (*record) {
+                column[stop] = (uint32_t)translation;
+                applied++;
+            } else {
+                for (int32_t s = stop; s >= 0; s = next_same_name[s]) {
+                    column[s] = (uint32_t)translation;
+                    applied++;
+                }
+            }
+        }
+    }
+    printf("Loaded %zu stop name translations in %zu languages\n", applied, b->languages.len);
+    fflush(stdout);
+    result = 0;
+
+done:
+    VEC_FREE(names);
+    VEC_FREE(first_stop);
+    free(name_map.slots);
+    free(next_same_name);
+    return result;
+}
+
+// Resolve the numbered trips and stops to builder rows, once per distinct
+// id, and hand the rows over to the builder
+static int apply_stop_times(Builder* b, StagedStopTimes* s) {
+    size_t n_trips = s->trips.keys.len;
+    size_t n_stops = s->stops.keys.len;
+    int32_t* trips = malloc(sizeof(int32_t) * (n_trips + 1));
+    int32_t* stops = malloc(sizeof(int32_t) * (n_stops + 1));
+    if (!trips || !stops) {
+        free(trips);
+        free(stops);
+        return -1;
+    }
+    for (size_t i = 0; i < n_trips; i++) {
+        trips[i] = builder_find(b, &b->trip_map, b->trip_id.data,
+                                s->trips.strings.data + s->trips.keys.data[i]);
+    }
+    for (size_t i = 0; i < n_stops; i++) {
+        stops[i] = builder_find(b, &b->stop_map, b->stop_id.data,
+                                s->stops.strings.data + s->stops.keys.data[i]);
+    }
+
+    RawStopTime* rows = s->rows.data;
+    size_t n = 0;
+    size_t skipped = s->skipped;
+    for (size_t r = 0; r < s->rows.len; r++) {
+        RawStopTime row = rows[r];
+        int32_t trip = trips[row.trip];
+        int32_t stop = stops[row.stop];
+        if (trip < 0 || stop < 0) {
+            skipped++;
+            continue;
+        }
+        row.trip = (uint32_t)trip;
+        row.stop = (uint32_t)stop;
+        rows[n++] = row;
+    }
+    free(trips);
+    free(stops);
+
+    b->stop_times.data = rows;
+    b->stop_times.len = n;
+    b->stop_times.cap = s->rows.cap;
+    s->rows.data = NULL;
+    s->rows.len = s->rows.cap = 0;
+    staged_ids_free(&s->trips);
+    staged_ids_free(&s->stops);
+    if (skipped > 0) {
+        printf("Skipped %zu stop_times rows with unknown trips or stops, or an invalid stop_sequence\n",
+               skipped);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+// Windows of frequency-based trips. Only looks up trips, so it can run
+// alongside apply_stop_times.
+static int apply_frequencies(Builder* b, const StagedTable* t) {
+    size_t skipped = 0;
+    for (size_t r = 0; r < t->n_rows; r++) {
+        int32_t trip = builder_find(b, &b->trip_map, b->trip_id.data, staged_field(t, r, FREQUENCY_TRIP));
+        int32_t start = csv_parse_time(staged_field(t, r, FREQUENCY_START));
+        int32_t end = csv_parse_time(staged_field(t, r, FREQUENCY_END));
+        int32_t headway = atoi(staged_field(t, r, FREQUENCY_HEADWAY));
+        if (trip < 0 || start < 0 || end <= start || headway <= 0) {
+            skipped++;
+            continue;
+        }
+        RawFrequency frequency = {(uint32_t)trip, {start, end, headway,
+                                                   atoi(staged_field(t, r, FREQUENCY_EXACT)) == 1}};
+        if (VEC_PUSH(b->frequencies, frequency) != 0) {
+            return -1;
+        }
+    }
+    if (skipped > 0) {
+        printf("Skipped %zu frequencies rows with unknown trips or invalid windows\n", skipped);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+static int compare_shape_points(const void* a, const void* b) {
+    const RawShapePoint* x = a;
+    const RawShapePoint* y = b;
+    if (x->shape != y->shape) return x->shape < y->shape ? -1 : 1;
+    if (x->sequence != y->sequence) return x->sequence < y->sequence ? -1 : 1;
+    return 0;
+}
+
+// Keep the shapes some trip refers to, with the distance travelled at each
+// point. Only looks up strings, so it can run alongside apply_stop_times.
+static int apply_shapes(Builder* b, StagedShapes* s) {
+    size_t n_staged = s->shapes.keys.len;
+    int32_t* shapes = malloc(sizeof(int32_t) * (n_staged + 1));
+    if (!shapes) {
+        return -1;
+    }
+    for (size_t i = 0; i < n_staged; i++) {
+        const char* id = s->shapes.strings.data + s->shapes.keys.data[i];
+        int64_t key = *id ? interner_find(&b->strings, id, gtfs_hash(id)) : -1;
+        shapes[i] = -1;
+        if (key < 0) continue;
+        if (VEC_PUSH(b->shape_id, (uint32_t)key) != 0 ||
+            rowmap_put(&b->shape_map, b->shape_id.data, (uint32_t)(b->shape_id.len - 1)) != 0) {
+            free(shapes);
+            return -1;
+        }
+        shapes[i] = (int32_t)(b->shape_id.len - 1);
+    }
+
+    RawShapePoint* points = s->points.data;
+    size_t n = 0;
+    for (size_t i = 0; i < s->points.len; i++) {
+        int32_t shape = shapes[points[i].shape];
+        if (shape < 0) continue;
+        points[n] = points[i];
+        points[n].shape = (uint32_t)shape;
+        n++;
+    }
+    free(shapes);
+    if (n > 0) {
+        qsort(points, n, sizeof(RawShapePoint), compare_shape_points);
+    }
+
+    size_t n_shapes = b->shape_id.len;
+    if (grow((void**)&b->shape_points_start.data, &b->shape_points_start.cap, n_shapes + 1, sizeof(uint32_t)) != 0 ||
+        grow((void**)&b->shape_lat.data, &b->shape_lat.cap, n + 1, sizeof(double)) != 0 ||
+        grow((void**)&b->shape_lon.data, &b->shape_lon.cap, n + 1, sizeof(double)) != 0 ||
+        grow((void**)&b->shape_distance.data, &b->shape_distance.cap, n + 1, sizeof(double)) != 0) {
+        return -1;
+    }
+    memset(b->shape_points_start.data, 0, sizeof(uint32_t) * (n_shapes + 1));
+    for (size_t i = 0; i < n; i++) {
+        b->shape_points_start.data[points[i].shape + 1]++;
+        b->shape_lat.data[i] = points[i].lat;
+        b->shape_lon.data[i] = points[i].lon;
+        int first = i == 0 || points[i - 1].shape != points[i].shape;
+        b->shape_distance.data[i] = first ? 0.0 : b->shape_distance.data[i - 1] +
+            geo_distance_m(points[i - 1].lat, points[i - 1].lon, points[i].lat, points[i].lon);
+    }
+    for (size_t i = 0; i < n_shapes; i++) {
+        b->shape_points_start.data[i + 1] += b->shape_points_start.data[i];
+    }
+    b->shape_points_start.len = n_shapes + 1;
+    b->shape_lat.len = b->shape_lon.len = b->shape_distance.len = n;
+    return 0;
+}
+
+static int compare_stop_times(const void* a, const void* b) {
+    const RawStopTime* x = a;
+    const RawStopTime* y = b;
+    if (x->trip != y->trip) return x->trip < y->trip ? -1 : 1;
+    if (x->sequence != y->sequence) return x->sequence < y->sequence ? -1 : 1;
+    return 0;
+}
+
+// Fill in missing arrival/departure times of one trip
+static void interpolate_times(RawStopTime* rows, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (rows[i].arrival < 0) rows[i].arrival = rows[i].departure;
+        if (rows[i].departure < 0) rows[i].departure = rows[i].arrival;
+    }
+    size_t prev = SIZE_MAX;
+    for (size_t i = 0; i < n; i++) {
+        if (rows[i].arrival < 0) continue;
+        if (prev == SIZE_MAX) {
+            for (size_t k = 0; k < i; k++) rows[k].arrival = rows[k].departure = rows[i].arrival;
+        } else if (i > prev + 1) {
+            int32_t from = rows[prev].departure;
+            int32_t to = rows[i].arrival;
+            for (size_t k = prev + 1; k < i; k++) {
+                int32_t t = from + (int32_t)((int64_t)(to - from) * (int64_t)(k - prev) / (int64_t)(i - prev));
+                rows[k].arrival = rows[k].departure = t;
+            }
+        }
+        prev = i;
+    }
+    if (prev == SIZE_MAX) {
+        for (size_t k = 0; k < n; k++) rows[k].arrival = rows[k].departure = 0;
+    } else {
+        for (size_t k = prev + 1; k < n; k++) rows[k].arrival = rows[k].departure = rows[prev].departure;
+    }
+}
+
+static int compare_frequencies(const void* a, const void* b) {
+    const RawFrequency* x = a;
+    const RawFrequency* y = b;
+    if (x->trip != y->trip) return x->trip < y->trip ? -1 : 1;
+    if (x->window.start != y->window.start) return x->window.start < y->window.start ? -1 : 1;
+    return 0;
+}
+
+// Candidate pattern: trips of one route with one stop sequence
+typedef struct {
+    uint32_t route;
+    uint32_t stops_start;
+    uint32_t n_stops;
+    uint32_t first_trip;   // Linked list of member trips
+    uint32_t last_trip;
+    uint32_t n_trips;
+} PatternGroup;
+
+// Trip sort key: departure at the first stop, then trip index
+typedef struct {
+    int32_t departure;
+    uint32_t trip;
+} TripDeparture;
+
+static int compare_trip_departures(const void* a, const void* b) {
+    const TripDeparture* x = a;
+    const TripDeparture* y = b;
+    if (x->departure != y->departure) return x->departure < y->departure ? -1 : 1;
+    return x->trip < y->trip ? -1 : x->trip > y->trip;
+}
+
+// Whether trip `later` never runs ahead of trip `earlier` along the pattern
+static int trip_follows(const RawStopTime* earlier, const RawStopTime* later, uint32_t n) {
+    for (uint32_t k = 0; k < n; k++) {
+        if (later[k].departure < earlier[k].departure || later[k].arrival < earlier[k].arrival) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static uint32_t hash_pattern(uint32_t route, const RawStopTime* rows, size_t n) {
+    uint32_t h = 2166136261u ^ route;
+    for (size_t i = 0; i < n; i++) {
+        h ^= rows[i].stop;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Assemble patterns, trips and the stop index into tt (heap owned)
+static int build_patterns(Builder* b, GttTimetable* tt, Arena* scratch) {
+    RawStopTime* rows = b->stop_times.data;
+    size_t n_rows = b->stop_times.len;
+    size_t n_trips_in = b->trip_id.len;
+    int result = -1;
+
+    qsort(rows, n_rows, sizeof(RawStopTime), compare_stop_times);
+
+    size_t* trip_first_row = arena_alloc(scratch, sizeof(size_t) * (n_trips_in + 1));
+    uint32_t* trip_n_rows = arena_calloc(scratch, n_trips_in + 1, sizeof(uint32_t));
+    uint32_t* trip_next = arena_alloc(scratch, sizeof(uint32_t) * (n_trips_in + 1));
+    uint32_t* trip_frequencies = arena_calloc(scratch, n_trips_in + 2, sizeof(uint32_t));
+    VEC(PatternGroup) groups = {0};
+    VEC(uint32_t) group_stops = {0};
+    uint32_t* group_slots = NULL;
+    uint32_t group_mask = 0;
+    uint32_t* order = NULL;
+    TripDeparture* trip_departures = NULL;
+    uint32_t* sub_last = NULL;
+    uint32_t* sub_of = NULL;
+
+    VEC(uint32_t) out_pattern_route = {0};
+    VEC(uint32_t) out_pattern_stops_start = {0};
+    VEC(uint32_t) out_pattern_n_stops = {0};
+    VEC(uint32_t) out_pattern_trips_start = {0};
+    VEC(uint32_t) out_pattern_n_trips = {0};
+    VEC(uint32_t) out_pattern_stops = {0};
+    VEC(uint32_t) out_trip_order = {0};
+    uint32_t* trip_pattern_out = NULL;
+
+    if (!trip_first_row || !trip_n_rows || !trip_next || !trip_frequencies) {
+        goto done;
+    }
+
+    // Windows of each frequency-based trip, as offsets into the sorted rows
+    RawFrequency* frequencies = b->frequencies.data;
+    if (b->frequencies.len > 0) {
+        qsort(frequencies, b->frequencies.len, sizeof(RawFrequency), compare_frequencies);
+    }
+    for (size_t f = 0; f < b->frequencies.len; f++) {
+        trip_frequencies[frequencies[f].trip + 1]++;
+    }
+    for (size_t t = 0; t < n_trips_in; t++) {
+        trip_frequencies[t + 1] += trip_frequencies[t];
+    }
+
+    for (size_t t = 0; t < n_trips_in; t++) {
+        trip_first_row[t] = 0;
+    }
+
+    // Group rows by trip and interpolate missing times
+    for (size_t i = 0; i < n_rows;) {
+        size_t j = i;
+        while (j < n_rows && rows[j].trip == rows[i].trip) j++;
+        trip_first_row[rows[i].trip] = i;
+        trip_n_rows[rows[i].trip] = (uint32_t)(j - i);
+        interpolate_times(rows + i, j - i);
+        i = j;
+    }
+
+    // Group trips into candidate patterns by (route, stop sequence). A
+    // frequency-based trip gets a pattern of its own: its runs are ordered
+    // by construction, but not against other trips.
+    size_t slot_cap = 64;
+    while (slot_cap < n_trips_in * 2) slot_cap *= 2;
+    group_slots = arena_calloc(scratch, slot_cap, sizeof(uint32_t));
+    if (!group_slots) goto done;
+    group_mask = (uint32_t)(slot_cap - 1);
+
+    for (size_t t = 0; t < n_trips_in; t++) {
+        uint32_t n = trip_n_rows[t];
+        if (n == 0) continue;
+        const RawStopTime* r = rows + trip_first_row[t];
+        uint32_t route = b->trip_route.data[t];
+        uint32_t i = hash_pattern(route, r, n) & group_mask;
+        uint32_t group = GTT_NONE;
+        int frequent = trip_frequencies[t + 1] > trip_frequencies[t];
+        while (!frequent && group_slots[i]) {
+            PatternGroup* g = &groups.data[group_slots[i] - 1];
+            if (g->route == route && g->n_stops == n) {
+                uint32_t k = 0;
+                while (k < n && group_stops.data[g->stops_start + k] == r[k].stop) k++;
+                if (k == n) {
+                    group = group_slots[i] - 1;
+                    break;
+                }
+            }
+            i = (i + 1) & group_mask;
+        }
+        if (group == GTT_NONE) {
+            PatternGroup g = {route, (uint32_t)group_stops.len, n, (uint32_t)t, (uint32_t)t, 0};
+            for (uint32_t k = 0; k < n; k++) {
+                if (VEC_PUSH(group_stops, r[k].stop) != 0) goto done;
+            }
+            if (VEC_PUSH(groups, g) != 0) goto done;
+            group = (uint32_t)(groups.len - 1);
+            if (!frequent) group_slots[i] = group + 1;
+        } else {
+            trip_next[groups.data[group].last_trip] = (uint32_t)t;
+            groups.data[group].last_trip = (uint32_t)t;
+        }
+        trip_next[t] = GTT_NONE;
+        groups.data[group].n_trips++;
+    }
+
+    // Split every group into FIFO patterns (no trip overtakes another)
+    order = arena_alloc(scratch, sizeof(uint32_t) * (n_trips_in + 1));
+    trip_departures = arena_alloc(scratch, sizeof(TripDeparture) * (n_trips_in + 1));
+    sub_last = arena_alloc(scratch, sizeof(uint32_t) * (n_trips_in + 1));
+    sub_of = arena_alloc(scratch, sizeof(uint32_t) * (n_trips_in + 1));
+    trip_pattern_out = arena_alloc(scratch, sizeof(uint32_t) * (n_trips_in + 1));
+    if (!order || !trip_departures || !sub_last || !sub_of || !trip_pattern_out) goto done;
+
+    for (size_t gi = 0; gi < groups.len; gi++) {
+        PatternGroup* g = &groups.data[gi];
+        uint32_t n = 0;
+        for (uint32_t t = g->first_trip; t != GTT_NONE; t = trip_next[t]) {
+            trip_departures[n].departure = rows[trip_first_row[t]].departure;
+            trip_departures[n++].trip = t;
+        }
+        qsort(trip_departures, n, sizeof(TripDeparture), compare_trip_departures);
+        for (uint32_t k = 0; k < n; k++) order[k] = trip_departures[k].trip;
+
+        uint32_t n_sub = 0;
+        for (uint32_t k = 0; k < n; k++) {
+            const RawStopTime* r = rows + trip_first_row[order[k]];
+            uint32_t s = 0;
+            while (s < n_sub &&
+                   !trip_follows(rows + trip_first_row[sub_last[s]], r, g->n_stops)) {
+                s++;
+            }
+            if (s == n_sub) n_sub++;
+            sub_last[s] = order[k];
+            sub_of[k] = s;
+        }
+
+        for (uint32_t s = 0; s < n_sub; s++) {
+            uint32_t pattern = (uint32_t)out_pattern_route.len;
+            if (VEC_PUSH(out_pattern_route, g->route) != 0 ||
+                VEC_PUSH(out_pattern_stops_start, (uint32_t)out_pattern_stops.len) != 0 ||
+                VEC_PUSH(out_pattern_n_stops, g->n_stops) != 0 ||
+                VEC_PUSH(out_pattern_trips_start, (uint32_t)out_trip_order.len) != 0) {
+                goto done;
+            }
+            for (uint32_t k = 0; k < g->n_stops; k++) {
+                if (VEC_PUSH(out_pattern_stops, group_stops.data[g->stops_start + k]) != 0) goto done;
+            }
+            uint32_t count = 0;
+            for (uint32_t k = 0; k < n; k++) {
+                if (sub_of[k] != s) continue;
+                if (VEC_PUSH(out_trip_order, order[k]) != 0) goto done;
+                trip_pattern_out[order[k]] = pattern;
+                count++;
+            }
+            if (VEC_PUSH(out_pattern_n_trips, count) != 0) goto done;
+        }
+    }
+
+    // Lay out trips and times in pattern order
+    size_t n_trips = out_trip_order.len;
+    size_t n_patterns = out_pattern_route.len;
+    size_t n_times = 0;
+    size_t n_frequencies = 0;
+    for (size_t i = 0; i < n_trips; i++) {
+        uint32_t t = out_trip_order.data[i];
+        n_times += trip_n_rows[t];
+        n_frequencies += trip_frequencies[t + 1] - trip_frequencies[t];
+    }
+
+    uint32_t* trip_id = malloc(sizeof(uint32_t) * (n_trips + 1));
+    uint32_t* trip_route = malloc(sizeof(uint32_t) * (n_trips + 1));
+    uint32_t* trip_service = malloc(sizeof(uint32_t) * (n_trips + 1));
+    uint32_t* trip_headsign = malloc(sizeof(uint32_t) * (n_trips + 1));
+    int8_t* trip_direction = malloc(sizeof(int8_t) * (n_trips + 1));
+    uint32_t* trip_shape = malloc(sizeof(uint32_t) * (n_trips + 1));
+    uint32_t* trip_pattern = malloc(sizeof(uint32_t) * (n_trips + 1));
+    uint32_t* trip_times = malloc(sizeof(uint32_t) * (n_trips + 1));
+    int32_t* arrivals = malloc(sizeof(int32_t) * (n_times + 1));
+    int32_t* departures = malloc(sizeof(int32_t) * (n_times + 1));
+    uint32_t* stop_sequences = malloc(sizeof(uint32_t) * (n_times + 1));
+    uint32_t* frequencies_start = malloc(sizeof(uint32_t) * (n_trips + 1));
+    GttFrequency* windows = malloc(sizeof(GttFrequency) * (n_frequencies + 1));
+
+    tt->trip_id = trip_id;
+    tt->trip_route = trip_route;
+    tt->trip_service = trip_service;
+    tt->trip_headsign = trip_headsign;
+    tt->trip_direction = trip_direction;
+    tt->trip_shape = trip_shape;
+    tt->trip_pattern = trip_pattern;
+    tt->trip_times = trip_times;
+    tt->arrivals = arrivals;
+    tt->departures = departures;
+    tt->stop_sequences = stop_sequences;
+    tt->trip_frequencies_start = frequencies_start;
+    tt->frequencies = windows;
+    if (!trip_id || !trip_route || !trip_service || !trip_headsign || !trip_direction ||
+        !trip_shape || !trip_pattern || !trip_times || !arrivals || !departures ||
+        !stop_sequences || !frequencies_start || !windows) {
+        goto done;
+    }
+
+    size_t time_pos = 0;
+    size_t frequency_pos = 0;
+    for (size_t i = 0; i < n_trips; i++) {
+        uint32_t t = out_trip_order.data[i];
+        trip_id[i] = b->trip_id.data[t];
+        trip_route[i] = b->trip_route.data[t];
+        trip_service[i] = b->trip_service.data[t];
+        trip_headsign[i] = b->trip_headsign.data[t];
+        trip_direction[i] = b->trip_direction.data[t];
+        trip_shape[i] = b->trip_shape.data[t];
+        trip_pattern[i] = trip_pattern_out[t];
+        trip_times[i] = (uint32_t)time_pos;
+        frequencies_start[i] = (uint32_t)frequency_pos;
+        for (uint32_t f = trip_frequencies[t]; f < trip_frequencies[t + 1]; f++) {
+            windows[frequency_pos++] = frequencies[f].window;
+        }
+        const RawStopTime* r = rows + trip_first_row[t];
+        for (uint32_t k = 0; k < trip_n_rows[t]; k++) {
+            arrivals[time_pos] = r[k].arrival;
+            departures[time_pos] = r[k].departure;
+            stop_sequences[time_pos] = r[k].sequence;
+            time_pos++;
+        }
+    }
+    tt->counts[GTT_SEC_TRIP_ID] = tt->counts[GTT_SEC_TRIP_ROUTE] = tt->counts[GTT_SEC_TRIP_SERVICE] =
+        tt->counts[GTT_SEC_TRIP_HEADSIGN] = tt->counts[GTT_SEC_TRIP_DIRECTION] =
+        tt->counts[GTT_SEC_TRIP_SHAPE] = tt->counts[GTT_SEC_TRIP_PATTERN] =
+        tt->counts[GTT_SEC_TRIP_TIMES] = n_trips;
+    tt->counts[GTT_SEC_ARRIVALS] = tt->counts[GTT_SEC_DEPARTURES] =
+        tt->counts[GTT_SEC_STOP_SEQUENCES] = n_times;
+    frequencies_start[n_trips] = (uint32_t)frequency_pos;
+    tt->counts[GTT_SEC_TRIP_FREQUENCIES_START] = n_trips + 1;
+    tt->counts[GTT_SEC_FREQUENCIES] = n_frequencies;
+
+    // Stop -> (pattern, position) index
+    size_t n_stops = b->stop_id.len;
+    uint32_t* stop_patterns_start = calloc(n_stops + 1, sizeof(uint32_t));
+    uint32_t* stop_patterns = malloc(sizeof(uint32_t) * (out_pattern_stops.len + 1));
+    uint32_t* stop_pattern_pos = malloc(sizeof(uint32_t) * (out_pattern_stops.len + 1));
+    tt->stop_patterns_start = stop_patterns_start;
+    tt->stop_patterns = stop_patterns;
+    tt->stop_pattern_pos = stop_pattern_pos;
+    if (!stop_patterns_start || !stop_patterns || !stop_pattern_pos) goto done;
+
+    for (size_t i = 0; i < out_pattern_stops.len; i++) {
+        stop_patterns_start[out_pattern_stops.data[i] + 1]++;
+    }
+    for (size_t s = 0; s < n_stops; s++) {
+        stop_patterns_start[s + 1] += stop_patterns_start[s];
+    }
+    uint32_t* fill = arena_alloc(scratch, sizeof(uint32_t) * (n_stops + 1));
+    if (!fill) goto done;
+    memcpy(fill, stop_patterns_start, sizeof(uint32_t) * n_stops);
+    for (size_t p = 0; p < n_patterns; p++) {
+        uint32_t start = out_pattern_stops_start.data[p];
+        for (uint32_t k = 0; k < out_pattern_n_stops.data[p]; k++) {
+            uint32_t stop = out_pattern_stops.data[start + k];
+            stop_patterns[fill[stop]] = (uint32_t)p;
+            stop_pattern_pos[fill[stop]] = k;
+            fill[stop]++;
+        }
+    }
+    tt->counts[GTT_SEC_STOP_PATTERNS_START] = n_stops + 1;
+    tt->counts[GTT_SEC_STOP_PATTERNS] = tt->counts[GTT_SEC_STOP_PATTERN_POS] = out_pattern_stops.len;
+
+    tt->pattern_route = out_pattern_route.data;
+    tt->pattern_stops_start = out_pattern_stops_start.data;
+    tt->pattern_n_stops = out_pattern_n_stops.data;
+    tt->pattern_trips_start = out_pattern_trips_start.data;
+    tt->pattern_n_trips = out_pattern_n_trips.data;
+    tt->pattern_stops = out_pattern_stops.data;
+    out_pattern_route.data = NULL;
+    out_pattern_stops_start.data = NULL;
+    out_pattern_n_stops.data = NULL;
+    out_pattern_trips_start.data = NULL;
+    out_pattern_n_trips.data = NULL;
+    out_pattern_stops.data = NULL;
+    tt->counts[GTT_SEC_PATTERN_ROUTE] = tt->counts[GTT_SEC_PATTERN_STOPS_START] =
+        tt->counts[GTT_SEC_PATTERN_N_STOPS] = tt->counts[GTT_SEC_PATTERN_TRIPS_START] =
+        tt->counts[GTT_SEC_PATTERN_N_TRIPS] = n_patterns;
+    tt->counts[GTT_SEC_PATTERN_STOPS] = tt->counts[GTT_SEC_STOP_PATTERNS];
+
+    tt->header.n_trips = (uint32_t)n_trips;
+    tt->header.n_patterns = (uint32_t)n_patterns;
+    tt->header.n_stop_times = (uint32_t)n_times;
+    result = 0;
+
+done:
+    if (result != 0) {
+        fprintf(stderr, "Error: Out of memory building patterns\n");
+        fflush(stderr);
+    }
+    VEC_FREE(groups);
+    VEC_FREE(group_stops);
+    VEC_FREE(out_pattern_route);
+    VEC_FREE(out_pattern_stops_start);
+    VEC_FREE(out_pattern_n_stops);
+    VEC_FREE(out_pattern_trips_start);
+    VEC_FREE(out_pattern_n_trips);
+    VEC_FREE(out_pattern_stops);
+    VEC_FREE(out_trip_order);
+    return result;
+}
+
+// Project the stops of a pattern onto a shape, in order: each stop goes to
+// the first stretch of shape after the previous stop that passes within
+// SHAPE_SNAP_M of it (the closest point of that stretch), or to the closest
+// point of the rest of the shape when none does. Loops that pass a stop
+// twice thus take the pass that matches the stop order.
+static void project_stops(const Builder* b, uint32_t shape, const uint32_t* stops, uint32_t n_stops,
+                          uint32_t* out_pos, double* out_distance) {
+    uint32_t first = b->shape_points_start.data[shape];
+    uint32_t n_points = b->shape_points_start.data[shape + 1] - first;
+    const double* lat = b->shape_lat.data + first;
+    const double* lon = b->shape_lon.data + first;
+    const double* distance = b->shape_distance.data + first;
+    uint32_t from = 0;
+    double along = 0.0;
+
+    for (uint32_t k = 0; k < n_stops; k++) {
+        double stop_lat = b->stop_lat.data[stops[k]];
+        double stop_lon = b->stop_lon.data[stops[k]];
+        double best = INFINITY;
+        uint32_t best_pos = from;
+        double best_along = along;
+        for (uint32_t i = from; i + 1 < n_points; i++) {
+            double t;
+            double d = geo_segment_distance_m(stop_lat, stop_lon, lat[i], lon[i], lat[i + 1], lon[i + 1], &t);
+            if (d < best) {
+                best = d;
+                best_pos = i;
+                best_along = distance[i] + t * (distance[i + 1] - distance[i]);
+            } else if (best <= SHAPE_SNAP_M && d > best + SHAPE_SNAP_M) {
+                break;  // Past the stop
+            }
+        }
+        // Never behind the previous stop
+        if (best_along < along) best_along = along;
+        out_pos[k] = best_pos;
+        out_distance[k] = best_along;
+        from = best_pos;
+        along = best_along;
+    }
+}
+
+// Shape of every pattern (that of its first trip with a known shape) and
+// the projection of its stops onto it
+static int build_projections(Builder* b, GttTimetable* tt) {
+    size_t n_patterns = tt->header.n_patterns;
+    size_t n_pattern_stops = tt->counts[GTT_SEC_PATTERN_STOPS];
+    uint32_t* pattern_shape = malloc(sizeof(uint32_t) * (n_patterns + 1));
+    uint32_t* shape_pos = calloc(n_pattern_stops + 1, sizeof(uint32_t));
+    double* shape_distance = calloc(n_pattern_stops + 1, sizeof(double));
+    tt->pattern_shape = pattern_shape;
+    tt->pattern_stop_shape_pos = shape_pos;
+    tt->pattern_stop_shape_distance = shape_distance;
+    if (!pattern_shape || !shape_pos || !shape_distance) {
+        fprintf(stderr, "Error: Out of memory projecting stops on shapes\n");
+        fflush(stderr);
+        return -1;
+    }
+
+    size_t n_projected = 0;
+    for (size_t p = 0; p < n_patterns; p++) {
+        uint32_t first = tt->pattern_trips_start[p];
+        uint32_t last = first + tt->pattern_n_trips[p];
+        int32_t shape = -1;
+        for (uint32_t t = first; t < last && shape < 0; t++) {
+            shape = rowmap_get(&b->shape_map, b->shape_id.data, tt->trip_shape[t]);
+        }
+        pattern_shape[p] = shape < 0 ? GTT_NONE : (uint32_t)shape;
+        if (shape < 0) continue;
+
+        uint32_t start = tt->pattern_stops_start[p];
+        uint32_t n = tt->pattern_n_stops[p];
+        // Patterns split off the same stop sequence follow each other
+        if (p > 0 && pattern_shape[p - 1] == (uint32_t)shape && tt->pattern_n_stops[p - 1] == n &&
+            memcmp(tt->pattern_stops + tt->pattern_stops_start[p - 1], tt->pattern_stops + start,
+                   sizeof(uint32_t) * n) == 0) {
+            memcpy(shape_pos + start, shape_pos + tt->pattern_stops_start[p - 1], sizeof(uint32_t) * n);
+            memcpy(shape_distance + start, shape_distance + tt->pattern_stops_start[p - 1], sizeof(double) * n);
+        } else {
+            project_stops(b, (uint32_t)shape, tt->pattern_stops + start, n, shape_pos + start, shape_distance + start);
+        }
+        n_projected++;
+    }
+    tt->counts[GTT_SEC_PATTERN_SHAPE] = n_patterns;
+    tt->counts[GTT_SEC_PATTERN_STOP_SHAPE_POS] = n_pattern_stops;
+    tt->counts[GTT_SEC_PATTERN_STOP_SHAPE_DISTANCE] = n_pattern_stops;
+    if (b->shape_id.len > 0) {
+        printf("Projected the stops of %zu patterns on %zu shapes\n", n_projected, b->shape_id.len);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+static int compare_exceptions(const void* a, const void* b) {
+    const RawException* x = a;
+    const RawException* y = b;
+    if (x->service != y->service) return x->service < y->service ? -1 : 1;
+    if (x->day != y->day) return x->day < y->day ? -1 : 1;
+    return (x->exception_type > y->exception_type) - (x->exception_type < y->exception_type);
+}
+
+// Index calendar_dates.txt by service, for the route calendars of
+// gtfs_calendar.c
+static int build_exceptions(Builder* b, GttTimetable* tt) {
+    size_t n_services = b->service_id.len;
+    size_t n = b->exceptions.len;
+    uint32_t* start = calloc(n_services + 1, sizeof(uint32_t));
+    int32_t* days = malloc(sizeof(int32_t) * (n + 1));
+    uint8_t* types = malloc(n + 1);
+    tt->exceptions_start = start;
+    tt->exception_days = days;
+    tt->exception_types = types;
+    if (!start || !days || !types) {
+        return -1;
+    }
+
+    if (n > 0) {
+        qsort(b->exceptions.data, n, sizeof(RawException), compare_exceptions);
+    }
+    for (size_t e = 0; e < n; e++) {
+        const RawException* ex = &b->exceptions.data[e];
+        start[ex->service + 1]++;
+        days[e] = ex->day;
+        types[e] = (uint8_t)ex->exception_type;
+    }
+    for (size_t s = 0; s < n_services; s++) {
+        start[s + 1] += start[s];
+    }
+    tt->counts[GTT_SEC_EXCEPTIONS_START] = n_services + 1;
+    tt->counts[GTT_SEC_EXCEPTION_DAYS] = n;
+    tt->counts[GTT_SEC_EXCEPTION_TYPES] = n;
+    return 0;
+}
+
+// Compile the service calendars into per-service day bitsets
+static int build_services(Builder* b, GttTimetable* tt) {
+    size_t n_services = b->service_id.len;
+    int32_t first = INT32_MAX;
+    int32_t last = INT32_MIN;
+
+    for (size_t s = 0; s < n_services; s++) {
+        if (b->service_start.data[s] <= b->service_end.data[s]) {
+            if (b->service_start.data[s] < first) first = b->service_start.data[s];
+            if (b->service_end.data[s] > last) last = b->service_end.data[s];
+        }
+    }
+    for (size_t e = 0; e < b->exceptions.len; e++) {
+        if (b->exceptions.data[e].day < first) first = b->exceptions.data[e].day;
+        if (b->exceptions.data[e].day > last) last = b->exceptions.data[e].day;
+    }
+
+    uint32_t days = 0;
+    if (first <= last) {
+        int64_t span = (int64_t)last - first + 1;
+        days = span > MAX_CALENDAR_DAYS ? MAX_CALENDAR_DAYS : (uint32_t)span;
+    }
+    uint32_t words = (days + 63) / 64;
+
+    uint64_t* bits = calloc(n_services * words + 1, sizeof(uint64_t));
+    uint8_t* weekdays = calloc(n_services + 1, 1);
+    tt->service_bits = bits;
+    tt->service_weekdays = weekdays;
+    if (!bits || !weekdays) {
+        return -1;
+    }
+
+    for (size_t s = 0; s < n_services; s++) {
+        uint64_t* row = bits + s * words;
+        uint8_t mask = b->service_calendar_days.data[s];
+        if (mask && b->service_start.data[s] <= b->service_end.data[s]) {
+            int32_t from = b->service_start.data[s] - first;
+            int32_t to = b->service_end.data[s] - first;
+            if (from < 0) from = 0;
+            if (to >= (int32_t)days) to = (int32_t)days - 1;
+            for (int32_t d = from; d <= to; d++) {
+                if (mask & (1u << weekday_of(first + d))) {
+                    row[d / 64] |= 1ull << (d % 64);
+                }
+            }
+        }
+    }
+    for (size_t e = 0; e < b->exceptions.len; e++) {
+        const RawException* ex = &b->exceptions.data[e];
+        int32_t d = ex->day - first;
+        if (d < 0 || d >= (int32_t)days) continue;
+        uint64_t* row = bits + (size_t)ex->service * words;
+        if (ex->exception_type == 1) {
+            row[d / 64] |= 1ull << (d % 64);
+        } else {
+            row[d / 64] &= ~(1ull << (d % 64));
+        }
+    }
+
+    // Weekdays on which each service actually runs
+    for (size_t s = 0; s < n_services; s++) {
+        const uint64_t* row = bits + s * words;
+        uint8_t mask = 0;
+        for (uint32_t d = 0; d < days && mask != 0x7f; d++) {
+            if (row[d / 64] & (1ull << (d % 64))) {
+                mask |= (uint8_t)(1u << weekday_of(first + (int32_t)d));
+            }
+        }
+        weekdays[s] = mask;
+    }
+
+    tt->header.calendar_start = days ? first : 0;
+    tt->header.calendar_days = days;
+    tt->header.service_words = words;
+    tt->counts[GTT_SEC_SERVICE_BITS] = n_services * words;
+    tt->counts[GTT_SEC_SERVICE_WEEKDAYS] = n_services;
+    return build_exceptions(b, tt);
+}
+
+typedef struct {
+    uint32_t from;
+    uint32_t to;
+    int32_t time;       // Seconds, -1 when transfers.txt forbids the transfer
+    uint32_t explicit_;  // 1 for transfers.txt entries, which win over generated ones
+} RawTransfer;
+
+static int compare_transfers(const void* a, const void* b) {
+    const RawTransfer* x = a;
+    const RawTransfer* y = b;
+    if (x->from != y->from) return x->from < y->from ? -1 : 1;
+    if (x->to != y->to) return x->to < y->to ? -1 : 1;
+    if (x->explicit_ != y->explicit_) return x->explicit_ > y->explicit_ ? -1 : 1;
+    return 0;
+}
+
+static int32_t walking_time(const Builder* b, uint32_t from, uint32_t to) {
+    double d = geo_distance_m(b->stop_lat.data[from], b->stop_lon.data[from],
+                              b->stop_lat.data[to], b->stop_lon.data[to]);
+    return (int32_t)ceil(d / WALKING_SPEED_MPS);
+}
+
+// Footpaths from transfers.txt and between stops within walking distance
+static int build_transfers(Builder* b, const char* gtfs_dir, GttTimetable* tt) {
+    size_t n_stops = b->stop_id.len;
+    VEC(RawTransfer) raw = {0};
+    SpatialGrid grid;
+    uint32_t* near = NULL;
+    size_t near_cap = 256;
+    int result = -1;
+
+    char path[4096];
+    join_path(path, sizeof(path), gtfs_dir, "transfers.txt");
+    CsvReader csv;
+    if (csv_open(&csv, path) == 0) {
+        int c_from = csv_column(&csv, "from_stop_id");
+        int c_to = csv_column(&csv, "to_stop_id");
+        int c_type = csv_column(&csv, "transfer_type");
+        int c_time = csv_column(&csv, "min_transfer_time");
+        int status;
+        while ((status = csv_next(&csv)) == 1) {
+            int32_t from = builder_find(b, &b->stop_map, b->stop_id.data, csv_field(&csv, c_from));
+            int32_t to = builder_find(b, &b->stop_map, b->stop_id.data, csv_field(&csv, c_to));
+            if (from < 0 || to < 0 || from == to) {
+                continue;
+            }
+            int type = atoi(csv_field(&csv, c_type));
+            const char* min_time = csv_field(&csv, c_time);
+            RawTransfer t = {(uint32_t)from, (uint32_t)to, 0, 1};
+            if (type == 3) {
+                t.time = -1;
+            } else if (*min_time) {
+                t.time = atoi(min_time);
+            } else {
+                t.time = walking_time(b, (uint32_t)from, (uint32_t)to);
+            }
+            if (VEC_PUSH(raw, t) != 0) {
+                csv_close(&csv);
+                goto done;
+            }
+        }
+        csv_close(&csv);
+        if (status < 0) goto done;
+    }
+
+    if (spatial_grid_build(&grid, b->stop_lat.data, b->stop_lon.data, n_stops, FOOTPATH_RADIUS_M) != 0) {
+        goto done;
+    }
+    near = malloc(sizeof(uint32_t) * near_cap);
+    if (!near) goto grid_done;
+    for (size_t s = 0; s < n_stops; s++) {
+        size_t n = spatial_grid_within(&grid, b->stop_lat.data, b->stop_lon.data,
+                                       b->stop_lat.data[s], b->stop_lon.data[s],
+                                       FOOTPATH_RADIUS_M, near, near_cap);
+        if (n > near_cap) {
+            uint32_t* bigger = realloc(near, sizeof(uint32_t) * n);
+            if (!bigger) goto grid_done;
+            near = bigger;
+            near_cap = n;
+            n = spatial_grid_within(&grid, b->stop_lat.data, b->stop_lon.data,
+                                    b->stop_lat.data[s], b->stop_lon.data[s],
+                                    FOOTPATH_RADIUS_M, near, near_cap);
+        }
+        for (size_t k = 0; k < n; k++) {
+            if (near[k] == s) continue;
+            RawTransfer t = {(uint32_t)s, near[k], walking_time(b, (uint32_t)s, near[k]), 0};
+            if (VEC_PUSH(raw, t) != 0) goto grid_done;
+        }
+    }
+
+    // Keep one footpath per stop pair, explicit entries first
+    qsort(raw.data, raw.len, sizeof(RawTransfer), compare_transfers);
+    uint32_t* start = calloc(n_stops + 1, sizeof(uint32_t));
+    uint32_t* stops = malloc(sizeof(uint32_t) * (raw.len + 1));
+    int32_t* times = malloc(sizeof(int32_t) * (raw.len + 1));
+    tt->transfers_start = start;
+    tt->transfer_stops = stops;
+    tt->transfer_times = times;
+    if (!start || !stops || !times) goto grid_done;
+
+    size_t n_transfers = 0;
+    for (size_t i = 0; i < raw.len; i++) {
+        if (i > 0 && raw.data[i].from == raw.data[i - 1].from && raw.data[i].to == raw.data[i - 1].to) {
+            continue;
+        }
+        if (raw.data[i].time < 0) {
+            continue;
+        }
+        stops[n_transfers] = raw.data[i].to;
+        times[n_transfers] = raw.data[i].time;
+        start[raw.data[i].from + 1]++;
+        n_transfers++;
+    }
+    for (size_t s = 0; s < n_stops; s++) {
+        start[s + 1] += start[s];
+    }
+    tt->counts[GTT_SEC_TRANSFERS_START] = n_stops + 1;
+    tt->counts[GTT_SEC_TRANSFER_STOPS] = tt->counts[GTT_SEC_TRANSFER_TIMES] = n_transfers;
+    printf("Built %zu footpaths between stops\n", n_transfers);
+    fflush(stdout);
+    result = 0;
+
+grid_done:
+    spatial_grid_free(&grid);
+done:
+    if (result != 0) {
+        fprintf(stderr, "Error: Out of memory building transfers\n");
+        fflush(stderr);
+    }
+    free(near);
+    VEC_FREE(raw);
+    return result;
+}
+
+// Connection sort key; seq keeps the hops of a trip in order when times tie
+typedef struct {
+    GttConnection c;
+    uint32_t seq;
+} SortedConnection;
+
+static int compare_connections(const void* a, const void* b) {
+    const SortedConnection* x = a;
+    const SortedConnection* y = b;
+    if (x->c.departure != y->c.departure) return x->c.departure < y->c.departure ? -1 : 1;
+    if (x->c.arrival != y->c.arrival) return x->c.arrival < y->c.arrival ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+// One connection per hop of every timed trip, sorted by departure
+static int build_connections(GttTimetable* tt, Arena* scratch) {
+    size_t n = 0;
+    for (uint32_t t = 0; t < tt->header.n_trips; t++) {
+        uint32_t n_stops = tt->pattern_n_stops[tt->trip_pattern[t]];
+        if (n_stops > 1 && !trip_is_frequent(tt, t)) n += n_stops - 1;
+    }
+
+    SortedConnection* sorted = arena_alloc(scratch, sizeof(SortedConnection) * (n + 1));
+    GttConnection* connections = malloc(sizeof(GttConnection) * (n + 1));
+    tt->connections = connections;
+    if (!sorted || !connections) {
+        fprintf(stderr, "Error: Out of memory building connections\n");
+        fflush(stderr);
+        return -1;
+    }
+
+    size_t k = 0;
+    for (uint32_t t = 0; t < tt->header.n_trips; t++) {
+        if (trip_is_frequent(tt, t)) continue;
+        uint32_t pattern = tt->trip_pattern[t];
+        uint32_t n_stops = tt->pattern_n_stops[pattern];
+        const uint32_t* stops = tt->pattern_stops + tt->pattern_stops_start[pattern];
+        const int32_t* arr = tt->arrivals + tt->trip_times[t];
+        const int32_t* dep = tt->departures + tt->trip_times[t];
+        for (uint32_t pos = 0; pos + 1 < n_stops; pos++) {
+            sorted[k].c.departure = dep[pos];
+            sorted[k].c.arrival = arr[pos + 1];
+            sorted[k].c.from_stop = stops[pos];
+            sorted[k].c.to_stop = stops[pos + 1];
+            sorted[k].c.trip = t;
+            sorted[k].seq = (uint32_t)k;
+            k++;
+        }
+    }
+    qsort(sorted, n, sizeof(SortedConnection), compare_connections);
+    for (size_t i = 0; i < n; i++) {
+        connections[i] = sorted[i].c;
+    }
+    tt->counts[GTT_SEC_CONNECTIONS] = n;
+    printf("Built %zu connections\n", n);
+    fflush(stdout);
+    return 0;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+typedef VEC(uint8_t) ByteVec;
+
+static int push_varint(ByteVec* bytes, uint32_t value) {
+    while (value >= 0x80) {
+        if (VEC_PUSH(*bytes, (uint8_t)(value | 0x80)) != 0) return -1;
+        value >>= 7;
+    }
+    return VEC_PUSH(*bytes, (uint8_t)value);
+}
+
+// Stops after (or before) every stop on any of its patterns, as sorted sets
+// of stop indices: a varint count, then the gaps from the previous stop
+// (from 0 for the first)
+static int build_reachable(GttTimetable* tt, int upstream, Arena* scratch) {
+    uint32_t n_stops = (uint32_t)(tt->counts[GTT_SEC_STOP_PATTERNS_START] - 1);
+    uint64_t* start = malloc(sizeof(uint64_t) * (n_stops + 1));
+    uint32_t* seen = arena_alloc(scratch, sizeof(uint32_t) * (n_stops + 1));
+    uint32_t* found = arena_alloc(scratch, sizeof(uint32_t) * (n_stops + 1));
+    ByteVec bytes = {0};
+    int result = -1;
+    if (upstream) {
+        tt->upstream_start = start;
+    } else {
+        tt->downstream_start = start;
+    }
+    if (!start || !seen || !found) goto done;
+
+    for (uint32_t s = 0; s < n_stops; s++) seen[s] = GTT_NONE;
+    for (uint32_t s = 0; s < n_stops; s++) {
+        uint32_t n_found = 0;
+        seen[s] = s;
+        for (uint32_t k = tt->stop_patterns_start[s]; k < tt->stop_patterns_start[s + 1]; k++) {
+            uint32_t pattern = tt->stop_patterns[k];
+            uint32_t pos = tt->stop_pattern_pos[k];
+            const uint32_t* stops = tt->pattern_stops + tt->pattern_stops_start[pattern];
+            uint32_t first = upstream ? 0 : pos + 1;
+            uint32_t last = upstream ? pos : tt->pattern_n_stops[pattern];
+            for (uint32_t i = first; i < last; i++) {
+                if (seen[stops[i]] != s) {
+                    seen[stops[i]] = s;
+                    found[n_found++] = stops[i];
+                }
+            }
+        }
+        qsort(found, n_found, sizeof(uint32_t), compare_u32);
+
+        start[s] = bytes.len;
+        if (push_varint(&bytes, n_found) != 0) goto done;
+        for (uint32_t i = 0; i < n_found; i++) {
+            if (push_varint(&bytes, found[i] - (i ? found[i - 1] : 0)) != 0) goto done;
+        }
+    }
+    start[n_stops] = bytes.len;
+    result = 0;
+
+done:
+    if (result != 0) {
+        fprintf(stderr, "Error: Out of memory building reachable stops\n");
+        fflush(stderr);
+        VEC_FREE(bytes);
+    }
+    if (upstream) {
+        tt->upstream = bytes.data;
+        tt->counts[GTT_SEC_UPSTREAM_START] = n_stops + 1;
+        tt->counts[GTT_SEC_UPSTREAM] = bytes.len;
+    } else {
+        tt->downstream = bytes.data;
+        tt->counts[GTT_SEC_DOWNSTREAM_START] = n_stops + 1;
+        tt->counts[GTT_SEC_DOWNSTREAM] = bytes.len;
+    }
+    return result;
+}
+
+static int build_reachability(GttTimetable* tt, Arena* scratch) {
+    if (build_reachable(tt, 0, scratch) != 0 || build_reachable(tt, 1, scratch) != 0) {
+        return -1;
+    }
+    printf("Built reachable stop sets: %llu bytes downstream, %llu bytes upstream\n",
+           (unsigned long long)tt->counts[GTT_SEC_DOWNSTREAM],
+           (unsigned long long)tt->counts[GTT_SEC_UPSTREAM]);
+    fflush(stdout);
+    return 0;
+}
+
+// Move builder tables that need no reordering into tt
+static int build_tables(Builder* b, GttTimetable* tt) {
+    size_t n_stops = b->stop_id.len;
+    int32_t* parent = malloc(sizeof(int32_t) * (n_stops + 1));
+    if (!parent) {
+        return -1;
+    }
+    for (size_t s = 0; s < n_stops; s++) {
+        uint32_t key = b->stop_parent_key.data[s];
+        parent[s] = key ? rowmap_get(&b->stop_map, b->stop_id.data, key) : -1;
+    }
+    tt->stop_parent = parent;
+
+#define TAKE(field, vec, section) \
+    do { tt->field = (vec).data; tt->counts[section] = (vec).len; (vec).data = NULL; (vec).len = (vec).cap = 0; } while (0)
+    if (!b->strings.data && builder_intern(b, "") < 0) {
+        return -1;
+    }
+    tt->strings = b->strings.data;
+    tt->counts[GTT_SEC_STRINGS] = b->strings.len;
+    b->strings.data = NULL;
+    TAKE(stop_id, b->stop_id, GTT_SEC_STOP_ID);
+    TAKE(stop_name, b->stop_name, GTT_SEC_STOP_NAME);
+    TAKE(stop_lat, b->stop_lat, GTT_SEC_STOP_LAT);
+    TAKE(stop_lon, b->stop_lon, GTT_SEC_STOP_LON);
+    TAKE(route_id, b->route_id, GTT_SEC_ROUTE_ID);
+    TAKE(route_short_name, b->route_short_name, GTT_SEC_ROUTE_SHORT_NAME);
+    TAKE(route_long_name, b->route_long_name, GTT_SEC_ROUTE_LONG_NAME);
+    TAKE(route_type, b->route_type, GTT_SEC_ROUTE_TYPE);
+    TAKE(service_id, b->service_id, GTT_SEC_SERVICE_ID);
+    TAKE(service_calendar_days, b->service_calendar_days, GTT_SEC_SERVICE_CALENDAR_DAYS);
+    TAKE(service_start, b->service_start, GTT_SEC_SERVICE_START);
+    TAKE(service_end, b->service_end, GTT_SEC_SERVICE_END);
+    tt->header.n_languages = (uint32_t)b->languages.len;
+    TAKE(languages, b->languages, GTT_SEC_LANGUAGES);
+    TAKE(stop_translations, b->stop_translations, GTT_SEC_STOP_TRANSLATIONS);
+    tt->header.n_shapes = (uint32_t)b->shape_id.len;
+    TAKE(shape_id, b->shape_id, GTT_SEC_SHAPE_ID);
+    TAKE(shape_points_start, b->shape_points_start, GTT_SEC_SHAPE_POINTS_START);
+    TAKE(shape_lat, b->shape_lat, GTT_SEC_SHAPE_LAT);
+    TAKE(shape_lon, b->shape_lon, GTT_SEC_SHAPE_LON);
+    TAKE(shape_distance, b->shape_distance, GTT_SEC_SHAPE_DISTANCE);
+#undef TAKE
+    tt->counts[GTT_SEC_STOP_PARENT] = n_stops;
+    tt->header.n_stops = (uint32_t)n_stops;
+    tt->header.n_routes = (uint32_t)tt->counts[GTT_SEC_ROUTE_ID];
+    tt->header.n_services = (uint32_t)tt->counts[GTT_SEC_SERVICE_ID];
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// File format
+// ---------------------------------------------------------------------------
+
+static uint64_t align8(uint64_t v) {
+    return (v + 7) & ~(uint64_t)7;
+}
+
+static int write_timetable(GttTimetable* tt, const char* output_file) {
+    GttSection sections[N_SECTION_FIELDS];
+    uint64_t offset = align8(sizeof(GttHeader) + sizeof(sections));
+
+    for (size_t i = 0; i < N_SECTION_FIELDS; i++) {
+        const SectionField* f = &SECTION_FIELDS[i];
+        sections[i].id = f->id;
+        sections[i].elem_size = f->elem_size;
+        sections[i].offset = offset;
+        sections[i].count = tt->counts[f->id];
+        offset = align8(offset + sections[i].count * f->elem_size);
+    }
+
+    memcpy(tt->header.magic, GTT_FILE_MAGIC, sizeof(tt->header.magic));
+    tt->header.version = GTT_FILE_VERSION;
+    tt->header.n_sections = (uint32_t)N_SECTION_FIELDS;
+
+    // Write to a temporary file and rename, so readers never see a partial file
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", output_file);
+    FILE* out = fopen(tmp_path, "wb");
+    if (!out) {
+        fprintf(stderr, "Error: Could not open output file %s\n", tmp_path);
+        fflush(stderr);
+        return -1;
+    }
+
+    static const char padding[8] = {0};
+    uint64_t pos = 0;
+    int ok = fwrite(&tt->header, sizeof(GttHeader), 1, out) == 1 &&
+             fwrite(sections, sizeof(sections), 1, out) == 1;
+    pos = sizeof(GttHeader) + sizeof(sections);
+    for (size_t i = 0; ok && i < N_SECTION_FIELDS; i++) {
+        if (sections[i].offset > pos) {
+            ok = fwrite(padding, 1, (size_t)(sections[i].offset - pos), out) == sections[i].offset - pos;
+            pos = sections[i].offset;
+        }
+        size_t bytes = (size_t)(sections[i].count * sections[i].elem_size);
+        const void* data = *section_slot(tt, &SECTION_FIELDS[i]);
+        if (ok && bytes > 0) {
+            ok = fwrite(data, 1, bytes, out) == bytes;
+        }
+        pos += bytes;
+    }
+    if (ok && offset > pos) {
+        ok = fwrite(padding, 1, (size_t)(offset - pos), out) == offset - pos;
+    }
+    if (fclose(out) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write timetable to %s\n", tmp_path);
+        fflush(stderr);
+        remove(tmp_path);
+        return -1;
+    }
+#ifdef _WIN32
+    remove(output_file);
+#endif
+    if (rename(tmp_path, output_file) != 0) {
+        fprintf(stderr, "Error: Could not rename %s to %s\n", tmp_path, output_file);
+        fflush(stderr);
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Free heap arrays of a timetable that was not loaded from a blob
+static void free_owned_arrays(GttTimetable* tt) {
+    for (size_t i = 0; i < N_SECTION_FIELDS; i++) {
+        const void** slot = section_slot(tt, &SECTION_FIELDS[i]);
+        free((void*)*slot);
+        *slot = NULL;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Build graph
+// ---------------------------------------------------------------------------
+
+// The GTFS files are read in parallel; applying them to the builder is a
+// chain in a fixed order (see "Reading the GTFS files"). Each step waits for:
+//
+//   read stop_times, trips, calendars, routes, stops,
+//   translations, frequencies, shapes                  nothing
+//   stops, routes, calendars, trips, translations      their file and the step before
+//   stop_times, frequencies, shapes                    their file, translations
+//   patterns                                           stop_times, frequencies
+//   services, transfers                                translations
+//   connections, reachability                          patterns
+//   projections                                        patterns, shapes
+//   tables                                             patterns, services, transfers,
+//                                                      projections
+//
+// The steps after patterns that run together have a scratch arena each.
+
+// Widest level of the graph: the eight GTFS files read at once
+#define BUILD_MAX_THREADS 8
+
+typedef struct {
+    const char* gtfs_dir;
+    Builder* b;
+    GttTimetable* tt;
+    StagedFeed staged;
+    Arena pattern_scratch;
+    Arena connection_scratch;
+    Arena reachability_scratch;
+} BuildContext;
+
+static int task_read_stop_times(void* arg) {
+    BuildContext* c = arg;
+    return stage_stop_times(&c->staged.stop_times, c->gtfs_dir);
+}
+
+static int task_read_trips(void* arg) {
+    BuildContext* c = arg;
+    return stage_table(&c->staged.trips, c->gtfs_dir, "trips.txt", trip_columns, TRIP_COLUMNS, 3, 0);
+}
+
+static int task_read_calendars(void* arg) {
+    BuildContext* c = arg;
+    if (stage_table(&c->staged.calendar, c->gtfs_dir, "calendar.txt",
+                    calendar_columns, CALENDAR_COLUMNS, 0, 1) != 0) {
+        return -1;
+    }
+    return stage_table(&c->staged.exceptions, c->gtfs_dir, "calendar_dates.txt",
+                       exception_columns, EXCEPTION_COLUMNS, 0, 1);
+}
+
+static int task_read_routes(void* arg) {
+    BuildContext* c = arg;
+    return stage_table(&c->staged.routes, c->gtfs_dir, "routes.txt", route_columns, ROUTE_COLUMNS, 1, 0);
+}
+
+static int task_read_translations(void* arg) {
+    BuildContext* c = arg;
+    return stage_table(&c->staged.translations, c->gtfs_dir, "translations.txt",
+                       translation_columns, TRANSLATION_COLUMNS, 0, 1);
+}
+
+static int task_read_frequencies(void* arg) {
+    BuildContext* c = arg;
+    return stage_table(&c->staged.frequencies, c->gtfs_dir, "frequencies.txt",
+                       frequency_columns, FREQUENCY_COLUMNS, 4, 1);
+}
+
+static int task_read_shapes(void* arg) {
+    BuildContext* c = arg;
+    return stage_shapes(&c->staged.shapes, c->gtfs_dir);
+}
+
+static int task_read_stops(void* arg) {
+    BuildContext* c = arg;
+    return stage_table(&c->staged.stops, c->gtfs_dir, "stops.txt", stop_columns, STOP_COLUMNS, 1, 0);
+}
+
+static int task_stops(void* arg) {
+    BuildContext* c = arg;
+    int result = apply_stops(c->b, &c->staged.stops);
+    staged_table_free(&c->staged.stops);
+    return result;
+}
+
+static int task_routes(void* arg) {
+    BuildContext* c = arg;
+    int result = apply_routes(c->b, &c->staged.routes);
+    staged_table_free(&c->staged.routes);
+    return result;
+}
+
+static int task_calendars(void* arg) {
+    BuildContext* c = arg;
+    int result = apply_calendars(c->b, &c->staged.calendar, &c->staged.exceptions);
+    staged_table_free(&c->staged.calendar);
+    staged_table_free(&c->staged.exceptions);
+    return result;
+}
+
+static int task_trips(void* arg) {
+    BuildContext* c = arg;
+    int result = apply_trips(c->b, &c->staged.trips);
+    staged_table_free(&c->staged.trips);
+    return result;
+}
+
+static int task_translations(void* arg) {
+    BuildContext* c = arg;
+    int result = apply_translations(c->b, &c->staged.translations);
+    staged_table_free(&c->staged.translations);
+    return result;
+}
+
+static int task_stop_times(void* arg) {
+    BuildContext* c = arg;
+    if (apply_stop_times(c->b, &c->staged.stop_times) != 0) {
+        return -1;
+    }
+    printf("Loaded %zu stops, %zu routes, %zu trips, %zu stop times\n",
+           c->b->stop_id.len, c->b->route_id.len, c->b->trip_id.len, c->b->stop_times.len);
+    fflush(stdout);
+    builder_report_memory(c->b);
+    return 0;
+}
+
+static int task_frequencies(void* arg) {
+    BuildContext* c = arg;
+    int result = apply_frequencies(c->b, &c->staged.frequencies);
+    staged_table_free(&c->staged.frequencies);
+    if (result == 0 && c->b->frequencies.len > 0) {
+        printf("Loaded %zu frequency windows\n", c->b->frequencies.len);
+        fflush(stdout);
+    }
+    return result;
+}
+
+static int task_shapes(void* arg) {
+    BuildContext* c = arg;
+    int result = apply_shapes(c->b, &c->staged.shapes);
+    staged_ids_free(&c->staged.shapes.shapes);
+    VEC_FREE(c->staged.shapes.points);
+    return result;
+}
+
+static int task_patterns(void* arg) {
+    BuildContext* c = arg;
+    return build_patterns(c->b, c->tt, &c->pattern_scratch);
+}
+
+static int task_services(void* arg) {
+    BuildContext* c = arg;
+    return build_services(c->b, c->tt);
+}
+
+static int task_transfers(void* arg) {
+    BuildContext* c = arg;
+    return build_transfers(c->b, c->gtfs_dir, c->tt);
+}
+
+static int task_connections(void* arg) {
+    BuildContext* c = arg;
+    return build_connections(c->tt, &c->connection_scratch);
+}
+
+static int task_reachability(void* arg) {
+    BuildContext* c = arg;
+    return build_reachability(c->tt, &c->reachability_scratch);
+}
+
+static int task_projections(void* arg) {
+    BuildContext* c = arg;
+    return build_projections(c->b, c->tt);
+}
+
+static int task_tables(void* arg) {
+    BuildContext* c = arg;
+    return build_tables(c->b, c->tt);
+}
+
+// Add the build steps to graph. Returns 0 on success.
+static int build_graph(TaskGraph* graph, BuildContext* c) {
+    // The largest file first: it is the head of the critical path
+    int read_stop_times = task_graph_add(graph, "read stop_times", task_read_stop_times, c, 0);
+    int read_shapes = task_graph_add(graph, "read shapes", task_read_shapes, c, 0);
+    int read_trips = task_graph_add(graph, "read trips", task_read_trips, c, 0);
+    int read_calendars = task_graph_add(graph, "read calendars", task_read_calendars, c, 0);
+    int read_routes = task_graph_add(graph, "read routes", task_read_routes, c, 0);
+    int read_stops = task_graph_add(graph, "read stops", task_read_stops, c, 0);
+    int read_translations = task_graph_add(graph, "read translations", task_read_translations, c, 0);
+    int read_frequencies = task_graph_add(graph, "read frequencies", task_read_frequencies, c, 0);
+    int stops = task_graph_add(graph, "stops", task_stops, c, TASK_DEP(read_stops));
+    int routes = task_graph_add(graph, "routes", task_routes, c,
+                                TASK_DEP(read_routes) | TASK_DEP(stops));
+    int calendars = task_graph_add(graph, "calendars", task_calendars, c,
+                                   TASK_DEP(read_calendars) | TASK_DEP(routes));
+    int trips = task_graph_add(graph, "trips", task_trips, c,
+                               TASK_DEP(read_trips) | TASK_DEP(calendars));
+    int translations = task_graph_add(graph, "translations", task_translations, c,
+                                      TASK_DEP(read_translations) | TASK_DEP(trips));
+    int stop_times = task_graph_add(graph, "stop_times", task_stop_times, c,
+                                    TASK_DEP(read_stop_times) | TASK_DEP(translations));
+    int frequencies = task_graph_add(graph, "frequencies", task_frequencies, c,
+                                     TASK_DEP(read_frequencies) | TASK_DEP(translations));
+    int shapes = task_graph_add(graph, "shapes", task_shapes, c,
+                                TASK_DEP(read_shapes) | TASK_DEP(translations));
+    int patterns = task_graph_add(graph, "patterns", task_patterns, c,
+                                  TASK_DEP(stop_times) | TASK_DEP(frequencies));
+    // The string pool and id maps are complete once the translations are applied
+    int services = task_graph_add(graph, "services", task_services, c, TASK_DEP(translations));
+    int transfers = task_graph_add(graph, "transfers", task_transfers, c, TASK_DEP(translations));
+    int connections = task_graph_add(graph, "connections", task_connections, c, TASK_DEP(patterns));
+    int reachability = task_graph_add(graph, "reachability", task_reachability, c, TASK_DEP(patterns));
+    int projections = task_graph_add(graph, "projections", task_projections, c,
+                                     TASK_DEP(patterns) | TASK_DEP(shapes));
+    // Moves the stop tables and strings the steps above read
+    int tables = task_graph_add(graph, "tables", task_tables, c,
+                                TASK_DEP(patterns) | TASK_DEP(services) | TASK_DEP(transfers) |
+                                TASK_DEP(projections));
+    return connections < 0 || reachability < 0 || tables < 0 ? -1 : 0;
+}
+
+int gtt_build(const char* gtfs_dir, const char* output_file, const char* cache_key) {
+    Builder b;
+    GttTimetable tt;
+    BuildContext context;
+    TaskGraph graph;
+    memset(&b, 0, sizeof(b));
+    memset(&tt, 0, sizeof(tt));
+    memset(&context, 0, sizeof(context));
+    context.gtfs_dir = gtfs_dir;
+    context.b = &b;
+    context.tt = &tt;
+    arena_init(&context.pattern_scratch, 1 << 20);
+    arena_init(&context.connection_scratch, 1 << 20);
+    arena_init(&context.reachability_scratch, 1 << 20);
+    task_graph_init(&graph);
+    int result = 1;
+
+    if (cache_key) {
+        strncpy(tt.header.cache_key, cache_key, GTT_CACHE_KEY_SIZE - 1);
+    }
+
+    // GTT_BUILD_THREADS overrides the number of threads
+    const char* env_threads = getenv("GTT_BUILD_THREADS");
+    int threads = env_threads && atoi(env_threads) > 0 ? atoi(env_threads) : task_graph_cpu_count();
+    if (threads > BUILD_MAX_THREADS) threads = BUILD_MAX_THREADS;
+    printf("Building timetable from %s on %d threads\n", gtfs_dir, threads);
+    fflush(stdout);
+
+    if (build_graph(&graph, &context) != 0) {
+        goto cleanup;
+    }
+    int failed = task_graph_run(&graph, threads);
+    task_graph_report(&graph);
+    if (failed) {
+        goto cleanup;
+    }
+    printf("Built %u patterns for %u trips\n", tt.header.n_patterns, tt.header.n_trips);
+    printf("Memory: scratch arena peaks %.1f MB patterns, %.1f MB connections, %.1f MB reachability\n",
+           MB(context.pattern_scratch.peak), MB(context.connection_scratch.peak),
+           MB(context.reachability_scratch.peak));
+    fflush(stdout);
+
+    if (write_timetable(&tt, output_file) != 0) {
+        goto cleanup;
+    }
+    printf("Wrote timetable to %s\n", output_file);
+    fflush(stdout);
+    result = 0;
+
+cleanup:
+    free_owned_arrays(&tt);
+    builder_free(&b);
+    staged_feed_free(&context.staged);
+    arena_free(&context.pattern_scratch);
+    arena_free(&context.connection_scratch);
+    arena_free(&context.reachability_scratch);
+    return result;
+}
+
+GttTimetable* gtt_open(const char* path, const char* expected_key) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    struct stat st;
+    if (stat(path, &st) != 0 || (size_t)st.st_size < sizeof(GttHeader)) {
+        fclose(fp);
+        return NULL;
+    }
+
+    GttTimetable* tt = calloc(1, sizeof(GttTimetable));
+    size_t size = (size_t)st.st_size;
+    void* blob = malloc(size);
+    if (!tt || !blob || fread(blob, 1, size, fp) != size) {
+        fclose(fp);
+        free(tt);
+        free(blob);
+        return NULL;
+    }
+    fclose(fp);
+    tt->blob = blob;
+    memcpy(&tt->header, blob, sizeof(GttHeader));
+
+    if (memcmp(tt->header.magic, GTT_FILE_MAGIC, sizeof(tt->header.magic)) != 0 ||
+        tt->header.version != GTT_FILE_VERSION ||
+        sizeof(GttHeader) + (uint64_t)tt->header.n_sections * sizeof(GttSection) > size) {
+        gtt_close(tt);
+        return NULL;
+    }
+    if (expected_key && strncmp(tt->header.cache_key, expected_key, GTT_CACHE_KEY_SIZE) != 0) {
+        gtt_close(tt);
+        return NULL;
+    }
+
+    const GttSection* sections = (const GttSection*)((const char*)blob + sizeof(GttHeader));
+    for (uint32_t i = 0; i < tt->header.n_sections; i++) {
+        const GttSection* s = &sections[i];
+        for (size_t k = 0; k < N_SECTION_FIELDS; k++) {
+            const SectionField* f = &SECTION_FIELDS[k];
+            if (f->id != s->id) continue;
+            if (f->elem_size != s->elem_size || s->offset + s->count * s->elem_size > size) {
+                fprintf(stderr, "Error: Corrupt timetable section %u in %s\n", s->id, path);
+                fflush(stderr);
+                gtt_close(tt);
+                return NULL;
+            }
+            *section_slot(tt, f) = (const char*)blob + s->offset;
+            tt->counts[s->id] = s->count;
+        }
+    }
+    for (size_t k = 0; k < N_SECTION_FIELDS; k++) {
+        if (!*section_slot(tt, &SECTION_FIELDS[k])) {
+            fprintf(stderr, "Error: Timetable %s is missing section %u\n", path, SECTION_FIELDS[k].id);
+            fflush(stderr);
+            gtt_close(tt);
+            return NULL;
+        }
+    }
+
+    if (idmap_build(&tt->stop_lookup, &tt->stop_lookup_mask, tt->strings, tt->stop_id, tt->header.n_stops, 0) != 0 ||
+        idmap_build(&tt->trip_lookup, &tt->trip_lookup_mask, tt->strings, tt->trip_id, tt->header.n_trips, 0) != 0 ||
+        idmap_build(&tt->route_lookup, &tt->route_lookup_mask, tt->strings, tt->route_id, tt->header.n_routes, 0) != 0) {
+        gtt_close(tt);
+        return NULL;
+    }
+    return tt;
+}
+
+void gtt_close(GttTimetable* tt) {
+    if (!tt) {
+        return;
+    }
+    if (!tt->blob) {
+        free_owned_arrays(tt);
+    }
+    free(tt->blob);
+    free(tt->stop_lookup);
+    free(tt->trip_lookup);
+    free(tt->route_lookup);
+    free(tt);
+}
+
+// ---------------------------------------------------------------------------
+// Accessors
+// ---------------------------------------------------------------------------
+
+const GttHeader* gtt_header(const GttTimetable* tt) {
+    return &tt->header;
+}
+
+int32_t gtt_find_stop(const GttTimetable* tt, const char* stop_id) {
+    return idmap_find(tt->stop_lookup, tt->stop_lookup_mask, tt->strings, tt->stop_id, stop_id);
+}
+
+int32_t gtt_find_trip(const GttTimetable* tt, const char* trip_id) {
+    return idmap_find(tt->trip_lookup, tt->trip_lookup_mask, tt->strings, tt->trip_id, trip_id);
+}
+
+int32_t gtt_find_route(const GttTimetable* tt, const char* route_id) {
+    return idmap_find(tt->route_lookup, tt->route_lookup_mask, tt->strings, tt->route_id, route_id);
+}
+
+const char* gtt_stop_id(const GttTimetable* tt, uint32_t stop) {
+    return stop < tt->header.n_stops ? tt->strings + tt->stop_id[stop] : NULL;
+}
+
+const char* gtt_stop_name(const GttTimetable* tt, uint32_t stop) {
+    return stop < tt->header.n_stops ? tt->strings + tt->stop_name[stop] : NULL;
+}
+
+const char* gtt_language(const GttTimetable* tt, uint32_t language) {
+    return language < tt->header.n_languages ? tt->strings + tt->languages[language] : NULL;
+}
+
+const char* gtt_stop_translation(const GttTimetable* tt, uint32_t stop, uint32_t language) {
+    if (stop >= tt->header.n_stops || language >= tt->header.n_languages) {
+        return NULL;
+    }
+    uint32_t name = tt->stop_translations[(size_t)language * tt->header.n_stops + stop];
+    return name ? tt->strings + name : NULL;
+}
+
+const char* gtt_route_id(const GttTimetable* tt, uint32_t route) {
+    return route < tt->header.n_routes ? tt->strings + tt->route_id[route] : NULL;
+}
+
+const char* gtt_service_id(const GttTimetable* tt, uint32_t service) {
+    return service < tt->header.n_services ? tt->strings + tt->service_id[service] : NULL;
+}
+
+const char* gtt_trip_id(const GttTimetable* tt, uint32_t trip) {
+    return trip < tt->header.n_trips ? tt->strings + tt->trip_id[trip] : NULL;
+}
+
+const char* gtt_trip_headsign(const GttTimetable* tt, uint32_t trip) {
+    return trip < tt->header.n_trips ? tt->strings + tt->trip_headsign[trip] : NULL;
+}
+
+uint32_t gtt_trip_route(const GttTimetable* tt, uint32_t trip) {
+    return trip < tt->header.n_trips ? tt->trip_route[trip] : GTT_NONE;
+}
+
+int32_t gtt_trip_direction(const GttTimetable* tt, uint32_t trip) {
+    return trip < tt->header.n_trips ? tt->trip_direction[trip] : -1;
+}
+
+uint32_t gtt_trip_stop_times(const GttTimetable* tt, uint32_t trip,
+                             uint32_t from_pos, uint32_t to_pos,
+                             uint32_t* stops, int32_t* arrivals, int32_t* departures,
+                             uint32_t* sequences) {
+    if (trip >= tt->header.n_trips) {
+        return 0;
+    }
+    uint32_t pattern = tt->trip_pattern[trip];
+    uint32_t n = tt->pattern_n_stops[pattern];
+    if (to_pos >= n) to_pos = n - 1;
+    if (from_pos > to_pos) {
+        return 0;
+    }
+    const uint32_t* pattern_stops = tt->pattern_stops + tt->pattern_stops_start[pattern];
+    const int32_t* arr = tt->arrivals + tt->trip_times[trip];
+    const int32_t* dep = tt->departures + tt->trip_times[trip];
+    const uint32_t* seq = tt->stop_sequences + tt->trip_times[trip];
+    for (uint32_t k = from_pos; k <= to_pos; k++) {
+        if (stops) stops[k - from_pos] = pattern_stops[k];
+        if (arrivals) arrivals[k - from_pos] = arr[k];
+        if (departures) departures[k - from_pos] = dep[k];
+        if (sequences) sequences[k - from_pos] = seq[k];
+    }
+    return to_pos - from_pos + 1;
+}
+
+uint32_t gtt_stop_transfers(const GttTimetable* tt, uint32_t stop,
+                            uint32_t* stops, int32_t* times, uint32_t capacity) {
+    if (stop >= tt->header.n_stops) {
+        return 0;
+    }
+    uint32_t first = tt->transfers_start[stop];
+    uint32_t n = tt->transfers_start[stop + 1] - first;
+    for (uint32_t k = 0; k < n && k < capacity; k++) {
+        if (stops) stops[k] = tt->transfer_stops[first + k];
+        if (times) times[k] = tt->transfer_times[first + k];
+    }
+    return n;
+}
+
+static uint32_t read_varint(const uint8_t** p) {
+    uint32_t value = 0;
+    int shift = 0;
+    while (**p & 0x80) {
+        value |= (uint32_t)(*(*p)++ & 0x7f) << shift;
+        shift += 7;
+    }
+    return value | (uint32_t)*(*p)++ << shift;
+}
+
+uint32_t gtt_stop_reachable(const GttTimetable* tt, uint32_t stop, int upstream,
+                            uint32_t* out, uint32_t capacity) {
+    if (stop >= tt->header.n_stops) {
+        return 0;
+    }
+    const uint64_t* start = upstream ? tt->upstream_start : tt->downstream_start;
+    const uint8_t* p = (upstream ? tt->upstream : tt->downstream) + start[stop];
+    uint32_t n = read_varint(&p);
+    uint32_t value = 0;
+    for (uint32_t k = 0; k < n && k < capacity; k++) {
+        value += read_varint(&p);
+        out[k] = value;
+    }
+    return n;
+}
+
+int gtt_service_active(const GttTimetable* tt, uint32_t service, int32_t day) {
+    if (service >= tt->header.n_services) {
+        return 0;
+    }
+    int64_t d = (int64_t)day - tt->header.calendar_start;
+    if (d < 0 || d >= tt->header.calendar_days) {
+        return 0;
+    }
+    const uint64_t* row = tt->service_bits + (size_t)service * tt->header.service_words;
+    return (row[d / 64] >> (d % 64)) & 1;
+}
+
+// ---------------------------------------------------------------------------
+// Queries
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    uint32_t pattern;
+    uint32_t pos;
+} PatternStop;
+
+static int compare_pattern_stops(const void* a, const void* b) {
+    const PatternStop* x = a;
+    const PatternStop* y = b;
+    if (x->pattern != y->pattern) return x->pattern < y->pattern ? -1 : 1;
+    if (x->pos != y->pos) return x->pos < y->pos ? -1 : 1;
+    return 0;
+}
+
+// Collect the (pattern, position) pairs of a set of stops, sorted
+static PatternStop* collect_pattern_stops(const GttTimetable* tt, const uint32_t* stops,
+                                          size_t n_stops, size_t* out_len) {
+    size_t total = 0;
+    for (size_t i = 0; i < n_stops; i++) {
+        if (stops[i] < tt->header.n_stops) {
+            total += tt->stop_patterns_start[stops[i] + 1] - tt->stop_patterns_start[stops[i]];
+        }
+    }
+    PatternStop* entries = malloc(sizeof(PatternStop) * (total + 1));
+    if (!entries) {
+        return NULL;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < n_stops; i++) {
+        if (stops[i] >= tt->header.n_stops) continue;
+        for (uint32_t k = tt->stop_patterns_start[stops[i]]; k < tt->stop_patterns_start[stops[i] + 1]; k++) {
+            entries[n].pattern = tt->stop_patterns[k];
+            entries[n].pos = tt->stop_pattern_pos[k];
+            n++;
+        }
+    }
+    qsort(entries, n, sizeof(PatternStop), compare_pattern_stops);
+    *out_len = n;
+    return entries;
+}
+
+static void push_trip_match(const GttTimetable* tt, uint32_t trip, uint32_t pattern,
+                            uint32_t from_pos, uint32_t to_pos, int32_t shift,
+                            GttTripMatch* out, size_t capacity, size_t* total) {
+    if (*total < capacity) {
+        GttTripMatch* m = &out[*total];
+        memset(m, 0, sizeof(*m));
+        m->trip = trip;
+        m->pattern = pattern;
+        m->from_pos = from_pos;
+        m->to_pos = to_pos;
+        m->departure = tt->departures[tt->trip_times[trip] + from_pos] + shift;
+        m->arrival = tt->arrivals[tt->trip_times[trip] + to_pos] + shift;
+        m->service = tt->trip_service[trip];
+        m->weekdays = tt->service_weekdays[m->service];
+        m->shift = shift;
+    }
+    (*total)++;
+}
+
+size_t gtt_trips_between(const GttTimetable* tt,
+                         const uint32_t* from_stops, size_t n_from,
+                         const uint32_t* to_stops, size_t n_to,
+                         int32_t day, GttTripMatch* out, size_t capacity) {
+    size_t n_from_entries = 0;
+    size_t n_to_entries = 0;
+    PatternStop* from_entries = collect_pattern_stops(tt, from_stops, n_from, &n_from_entries);
+    PatternStop* to_entries = collect_pattern_stops(tt, to_stops, n_to, &n_to_entries);
+    size_t total = 0;
+    int weekday_bit = day != INT32_MIN ? 1 << weekday_of(day) : 0x7f;
+
+    if (!from_entries || !to_entries) {
+        free(from_entries);
+        free(to_entries);
+        return 0;
+    }
+
+    size_t i = 0;
+    size_t j = 0;
+    while (i < n_from_entries && j < n_to_entries) {
+        uint32_t pattern = from_entries[i].pattern;
+        if (to_entries[j].pattern < pattern) {
+            j++;
+            continue;
+        }
+        if (to_entries[j].pattern > pattern) {
+            while (i < n_from_entries && from_entries[i].pattern == pattern) i++;
+            continue;
+        }
+
+        // Board at the first visit of a from-stop, alight at the next to-stop
+        uint32_t from_pos = from_entries[i].pos;
+        uint32_t to_pos = GTT_NONE;
+        while (j < n_to_entries && to_entries[j].pattern == pattern) {
+            if (to_pos == GTT_NONE && to_entries[j].pos > from_pos) {
+                to_pos = to_entries[j].pos;
+            }
+            j++;
+        }
+        while (i < n_from_entries && from_entries[i].pattern == pattern) i++;
+        if (to_pos == GTT_NONE) {
+            continue;
+        }
+
+        uint32_t first = tt->pattern_trips_start[pattern];
+        uint32_t last = first + tt->pattern_n_trips[pattern];
+        for (uint32_t trip = first; trip < last; trip++) {
+            if (!(tt->service_weekdays[tt->trip_service[trip]] & weekday_bit)) {
+                continue;
+            }
+            if (!trip_is_frequent(tt, trip)) {
+                push_trip_match(tt, trip, pattern, from_pos, to_pos, 0, out, capacity, &total);
+                continue;
+            }
+            // One match per run of a frequency-based trip, none for its template
+            int32_t dep0 = tt->departures[tt->trip_times[trip]];
+            for (uint32_t f = tt->trip_frequencies_start[trip]; f < tt->trip_frequencies_start[trip + 1]; f++) {
+                const GttFrequency* w = &tt->frequencies[f];
+                for (int64_t run = w->start; run < w->end; run += w->headway) {
+                    push_trip_match(tt, trip, pattern, from_pos, to_pos, (int32_t)(run - dep0),
+                                    out, capacity, &total);
+                }
+            }
+        }
+    }
+
+    free(from_entries);
+    free(to_entries);
+    return total;
+}
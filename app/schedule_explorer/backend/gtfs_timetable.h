@@ -0,0 +1,609 @@
+#ifndef GTFS_TIMETABLE_H
+#define GTFS_TIMETABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define GTT_API __declspec(dllexport)
+#else
+#define GTT_API __attribute__((visibility("default")))
+#endif
+
+// Compiled, read-only timetable built from a GTFS directory.
+//
+// Trips that share a route and an identical stop sequence are grouped into
+// patterns. Each pattern's trips are stored contiguously and ordered by
+// departure so that no trip overtakes another, and their arrival/departure
+// times live in flat int32 arrays (seconds after midnight of the service
+// day), next to the stop_sequence values of the feed. Every stop keeps the
+// list of (pattern, position) pairs that serve it, which is what the query
+// functions below use instead of scanning trips.
+// Footpaths between nearby stops (from transfers.txt, plus generated ones
+// for stops within walking distance) are stored per stop as well, and every
+// hop between consecutive stops of a trip is listed once more in a single
+// departure-sorted connection array for connection scan queries. Finally,
+// the stops reachable downstream (and upstream) of each stop on any pattern
+// are kept as sorted, delta-encoded varint lists. Stop names translated in
+// translations.txt are stored as one column per language aligned with the
+// stop table.
+//
+// Trips listed in frequencies.txt are kept once, as a template with the
+// (start, end, headway) windows it repeats in. Each template has a pattern
+// of its own and the queries below expand its runs as they scan it, so a
+// trip every five minutes all day costs one trip, not two hundred.
+//
+// shapes.txt polylines are stored with the distance travelled at each
+// point, and every stop of a pattern is projected once onto the shape of
+// the pattern's trips, so a vehicle between two stops is placed on the map
+// with a binary search.
+//
+// The timetable is written to disk as a single file of aligned sections and
+// loaded back without any parsing, so query structures cost nothing at
+// startup.
+
+#define GTT_FILE_MAGIC "GTFSTT\r\n"
+#define GTT_FILE_VERSION 9
+#define GTT_CACHE_KEY_SIZE 128
+#define GTT_NONE UINT32_MAX
+
+// Section identifiers of the on-disk format
+typedef enum {
+    GTT_SEC_STRINGS = 1,
+    GTT_SEC_STOP_ID,
+    GTT_SEC_STOP_NAME,
+    GTT_SEC_STOP_LAT,
+    GTT_SEC_STOP_LON,
+    GTT_SEC_STOP_PARENT,
+    GTT_SEC_ROUTE_ID,
+    GTT_SEC_ROUTE_SHORT_NAME,
+    GTT_SEC_ROUTE_LONG_NAME,
+    GTT_SEC_ROUTE_TYPE,
+    GTT_SEC_SERVICE_ID,
+    GTT_SEC_SERVICE_WEEKDAYS,
+    GTT_SEC_SERVICE_BITS,
+    GTT_SEC_TRIP_ID,
+    GTT_SEC_TRIP_ROUTE,
+    GTT_SEC_TRIP_SERVICE,
+    GTT_SEC_TRIP_HEADSIGN,
+    GTT_SEC_TRIP_DIRECTION,
+    GTT_SEC_TRIP_SHAPE,
+    GTT_SEC_TRIP_PATTERN,
+    GTT_SEC_TRIP_TIMES,
+    GTT_SEC_PATTERN_ROUTE,
+    GTT_SEC_PATTERN_STOPS_START,
+    GTT_SEC_PATTERN_N_STOPS,
+    GTT_SEC_PATTERN_TRIPS_START,
+    GTT_SEC_PATTERN_N_TRIPS,
+    GTT_SEC_PATTERN_STOPS,
+    GTT_SEC_ARRIVALS,
+    GTT_SEC_DEPARTURES,
+    GTT_SEC_STOP_PATTERNS_START,
+    GTT_SEC_STOP_PATTERNS,
+    GTT_SEC_STOP_PATTERN_POS,
+    GTT_SEC_TRANSFERS_START,
+    GTT_SEC_TRANSFER_STOPS,
+    GTT_SEC_TRANSFER_TIMES,
+    GTT_SEC_CONNECTIONS,
+    GTT_SEC_DOWNSTREAM_START,
+    GTT_SEC_DOWNSTREAM,
+    GTT_SEC_UPSTREAM_START,
+    GTT_SEC_UPSTREAM,
+    GTT_SEC_LANGUAGES,
+    GTT_SEC_STOP_TRANSLATIONS,
+    GTT_SEC_SERVICE_CALENDAR_DAYS,
+    GTT_SEC_SERVICE_START,
+    GTT_SEC_SERVICE_END,
+    GTT_SEC_EXCEPTIONS_START,
+    GTT_SEC_EXCEPTION_DAYS,
+    GTT_SEC_EXCEPTION_TYPES,
+    GTT_SEC_TRIP_FREQUENCIES_START,
+    GTT_SEC_FREQUENCIES,
+    GTT_SEC_SHAPE_ID,
+    GTT_SEC_SHAPE_POINTS_START,
+    GTT_SEC_SHAPE_LAT,
+    GTT_SEC_SHAPE_LON,
+    GTT_SEC_SHAPE_DISTANCE,
+    GTT_SEC_PATTERN_SHAPE,
+    GTT_SEC_PATTERN_STOP_SHAPE_POS,
+    GTT_SEC_PATTERN_STOP_SHAPE_DISTANCE,
+    GTT_SEC_STOP_SEQUENCES,
+    GTT_SEC_COUNT
+} GttSectionId;
+
+typedef struct {
+    uint32_t id;
+    uint32_t elem_size;
+    uint64_t offset;
+    uint64_t count;
+} GttSection;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_sections;
+    char cache_key[GTT_CACHE_KEY_SIZE];
+    uint32_t n_stops;
+    uint32_t n_routes;
+    uint32_t n_services;
+    uint32_t n_trips;
+    uint32_t n_patterns;
+    uint32_t n_stop_times;
+    int32_t calendar_start;   // First calendar day, in days since 1970-01-01
+    uint32_t calendar_days;   // Number of days covered by the service bitsets
+    uint32_t service_words;   // uint64 words per service bitset
+    uint32_t n_languages;     // Languages of translated stop names
+    uint32_t n_shapes;        // Shapes of shapes.txt some trip refers to
+    uint32_t reserved;        // Keeps the section table after the header 8-byte aligned
+} GttHeader;
+
+typedef struct GttTimetable GttTimetable;
+
+// One trip matched by gtt_trips_between()
+typedef struct {
+    uint32_t trip;
+    uint32_t pattern;
+    uint32_t from_pos;      // Position of the boarding stop in the pattern
+    uint32_t to_pos;        // Position of the alighting stop in the pattern
+    int32_t departure;      // Seconds after midnight at the boarding stop
+    int32_t arrival;        // Seconds after midnight at the alighting stop
+    uint32_t service;
+    uint8_t weekdays;       // Weekdays the service runs on (bit 0 = Monday)
+    uint8_t reserved[3];
+    int32_t shift;          // Seconds added to the stop times of a frequency-based trip
+} GttTripMatch;
+
+// Build a timetable from a GTFS directory (or zip archive) and write it to
+// output_file.
+// cache_key is stored in the header so callers can detect stale files.
+// Returns 0 on success.
+GTT_API int gtt_build(const char* gtfs_dir, const char* output_file, const char* cache_key);
+
+// Load a timetable file. When expected_key is not NULL the file is only
+// accepted if it was built with that key. Returns NULL on failure.
+GTT_API GttTimetable* gtt_open(const char* path, const char* expected_key);
+GTT_API void gtt_close(GttTimetable* tt);
+
+GTT_API const GttHeader* gtt_header(const GttTimetable* tt);
+
+// Id lookups, returning -1 when the id is unknown
+GTT_API int32_t gtt_find_stop(const GttTimetable* tt, const char* stop_id);
+GTT_API int32_t gtt_find_trip(const GttTimetable* tt, const char* trip_id);
+GTT_API int32_t gtt_find_route(const GttTimetable* tt, const char* route_id);
+
+GTT_API const char* gtt_stop_id(const GttTimetable* tt, uint32_t stop);
+GTT_API const char* gtt_stop_name(const GttTimetable* tt, uint32_t stop);
+GTT_API const char* gtt_route_id(const GttTimetable* tt, uint32_t route);
+GTT_API const char* gtt_service_id(const GttTimetable* tt, uint32_t service);
+GTT_API const char* gtt_trip_id(const GttTimetable* tt, uint32_t trip);
+GTT_API const char* gtt_trip_headsign(const GttTimetable* tt, uint32_t trip);
+GTT_API uint32_t gtt_trip_route(const GttTimetable* tt, uint32_t trip);
+GTT_API int32_t gtt_trip_direction(const GttTimetable* tt, uint32_t trip);
+
+// Language code of a translation language (0 .. n_languages - 1)
+GTT_API const char* gtt_language(const GttTimetable* tt, uint32_t language);
+
+// Name of a stop in a language, NULL when translations.txt has none
+GTT_API const char* gtt_stop_translation(const GttTimetable* tt, uint32_t stop, uint32_t language);
+
+// Copy the stops, times and GTFS stop_sequence values of a trip between two
+// pattern positions (inclusive). Any output pointer may be NULL. Returns the
+// number of stops.
+// The times of frequency-based trips are those of the template: add the
+// shift of a match or leg for the run it describes.
+GTT_API uint32_t gtt_trip_stop_times(const GttTimetable* tt, uint32_t trip,
+                                     uint32_t from_pos, uint32_t to_pos,
+                                     uint32_t* stops, int32_t* arrivals, int32_t* departures,
+                                     uint32_t* sequences);
+
+// Whether a service runs on a day (days since 1970-01-01)
+GTT_API int gtt_service_active(const GttTimetable* tt, uint32_t service, int32_t day);
+
+// Find every trip that calls at one of from_stops and later at one of
+// to_stops. When day is not INT32_MIN only trips whose service runs on that
+// weekday are returned. Matches are written to out (up to capacity) and the
+// total number of matches is returned, so callers can retry with a larger
+// buffer. Cost is proportional to the patterns serving the stops plus the
+// number of matches. Frequency-based trips match once per run.
+GTT_API size_t gtt_trips_between(const GttTimetable* tt,
+                                 const uint32_t* from_stops, size_t n_from,
+                                 const uint32_t* to_stops, size_t n_to,
+                                 int32_t day, GttTripMatch* out, size_t capacity);
+
+// Footpaths leaving a stop: writes up to capacity target stops and walking
+// times (seconds) and returns the total number of footpaths.
+GTT_API uint32_t gtt_stop_transfers(const GttTimetable* tt, uint32_t stop,
+                                    uint32_t* stops, int32_t* times, uint32_t capacity);
+
+// Stops that can be reached from a stop without changing vehicles (or, when
+// upstream is set, the stops from which it can be reached), sorted by stop
+// index. Writes up to capacity stops to out and returns the total.
+GTT_API uint32_t gtt_stop_reachable(const GttTimetable* tt, uint32_t stop, int upstream,
+                                    uint32_t* out, uint32_t capacity);
+
+// ---------------------------------------------------------------------------
+// Journey planning (RAPTOR, gtfs_raptor.c)
+// ---------------------------------------------------------------------------
+
+#define GTT_MAX_TRANSFERS 8
+
+typedef enum {
+    GTT_LEG_TRANSIT = 1,
+    GTT_LEG_WALK = 2
+} GttLegKind;
+
+typedef struct {
+    const uint32_t* from_stops;
+    size_t n_from;
+    const uint32_t* to_stops;
+    size_t n_to;
+    int32_t day;             // Service day, in days since 1970-01-01
+    int32_t departure_min;   // Departure window, seconds after midnight of day
+    int32_t departure_max;
+    uint32_t max_transfers;  // Capped at GTT_MAX_TRANSFERS
+} GttJourneyQuery;
+
+typedef struct {
+    uint32_t kind;           // GttLegKind
+    uint32_t trip;           // GTT_NONE for walking legs
+    uint32_t from_stop;
+    uint32_t to_stop;
+    uint32_t from_pos;       // Pattern positions, transit legs only
+    uint32_t to_pos;
+    int32_t departure;       // Seconds after midnight of the query day
+    int32_t arrival;
+    int32_t shift;           // Run of a frequency-based trip, as in GttTripMatch
+} GttLeg;
+
+typedef struct {
+    uint32_t first_leg;      // Index into GttJourneyResult.legs
+    uint32_t n_legs;
+    uint32_t n_transfers;
+    int32_t departure;
+    int32_t arrival;
+} GttJourney;
+
+typedef struct {
+    GttJourney* journeys;
+    size_t n_journeys;
+    GttLeg* legs;
+    size_t n_legs;
+} GttJourneyResult;
+
+// Plan journeys with range RAPTOR: every departure from the origin stops
+// within the window is scanned (latest first) and the journeys that are
+// Pareto-optimal in departure time, arrival time and number of transfers are
+// returned, sorted by departure. Trips of the previous service day that run
+// past midnight are included, as are the runs of frequency-based trips.
+// Returns NULL on allocation failure.
+GTT_API GttJourneyResult* gtt_plan_journeys(const GttTimetable* tt, const GttJourneyQuery* query);
+GTT_API void gtt_free_journeys(GttJourneyResult* result);
+
+// ---------------------------------------------------------------------------
+// Connection scan queries (CSA, gtfs_csa.c)
+// ---------------------------------------------------------------------------
+
+// The connection array holds the hops of timed trips only: frequency-based
+// trips are left out of these queries and of the isochrones below.
+
+// Earliest arrival at every stop when leaving one of from_stops at departure
+// (seconds after midnight of day). arrivals must hold n_stops entries and
+// receives INT32_MAX for unreachable stops. Only connections departing up to
+// departure + max_duration are scanned (the whole rest of the timetable when
+// max_duration <= 0). Returns the number of stops reached, or -1 on
+// allocation failure.
+GTT_API int64_t gtt_earliest_arrivals(const GttTimetable* tt,
+                                      const uint32_t* from_stops, size_t n_from,
+                                      int32_t day, int32_t departure, int32_t max_duration,
+                                      int32_t* arrivals);
+
+typedef struct {
+    int32_t departure;       // Leaving the stop, seconds after midnight of the query day
+    int32_t arrival;         // Earliest arrival at the targets for that departure
+} GttProfileEntry;
+
+typedef struct {
+    uint32_t* stop_start;    // n_stops + 1 offsets into entries
+    GttProfileEntry* entries;
+    size_t n_entries;
+} GttProfile;
+
+// Profile towards to_stops: for every stop, the departures between
+// departure_min and departure_max that are not beaten by a later departure
+// arriving as early, each with its earliest arrival at the targets. Entries
+// of a stop are sorted by departure. Returns NULL on allocation failure.
+GTT_API GttProfile* gtt_profile(const GttTimetable* tt,
+                                const uint32_t* to_stops, size_t n_to,
+                                int32_t day, int32_t departure_min, int32_t departure_max);
+GTT_API void gtt_free_profile(GttProfile* profile);
+
+// ---------------------------------------------------------------------------
+// Isochrones (gtfs_isochrone.c)
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    const uint32_t* from_stops;
+    size_t n_from;
+    int32_t day;
+    const int32_t* departures;  // Departure times to evaluate, seconds after midnight
+    size_t n_departures;
+    int32_t max_duration;       // Seconds; <= 0 for no limit
+    uint32_t n_threads;         // Departures are spread over this many threads
+} GttIsochroneQuery;
+
+typedef struct {
+    int32_t first_arrival;      // Arrival for the first departure, INT32_MAX if unreachable
+    int32_t min_travel;         // Shortest travel time over all departures
+    int32_t median_travel;      // Median travel time over the departures reaching the stop
+} GttStopReach;
+
+typedef struct {
+    double lat;                 // Cell centre
+    double lon;
+    int32_t travel_time;        // Seconds, including the walk from the nearest stop
+    uint32_t reserved;
+} GttCell;
+
+// Earliest-arrival scans for every departure of the query, run in parallel,
+// summarised per stop into reach (n_stops entries). Travel times are
+// INT32_MAX for stops that are not reached within max_duration. Returns 0 on
+// success.
+GTT_API int gtt_isochrone(const GttTimetable* tt, const GttIsochroneQuery* query, GttStopReach* reach);
+
+// Rasterize the median travel times of reach into square cells of cell_m
+// metres, or hexagons whose centres are cell_m apart. A cell takes the best
+// time of the stops within walk_radius_m, plus the walk. Cells slower than
+// max_time are dropped. Writes up to capacity cells to out and returns the
+// total, so callers can retry with a larger buffer.
+GTT_API size_t gtt_rasterize(const GttTimetable* tt, const GttStopReach* reach,
+                             int32_t max_time, double cell_m, double walk_radius_m,
+                             int hexagonal, GttCell* out, size_t capacity);
+
+// ---------------------------------------------------------------------------
+// Route service calendars (gtfs_calendar.c)
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    const uint32_t* services_start;  // n_routes + 1 offsets into services
+    const uint32_t* services;        // Services of the trips of each route
+    const uint32_t* active_start;    // n_routes + 1 offsets into active
+    const uint32_t* active;          // Services whose days count as the route's
+    size_t n_routes;
+    uint32_t n_threads;              // Routes are spread over this many threads
+} GttCalendarQuery;
+
+// Days of one route, in GttRouteCalendars.days from first_day on: the valid
+// days, the days added and removed by calendar_dates.txt, then the valid
+// days grouped into (first, last) ranges of consecutive days
+typedef struct {
+    uint32_t first_day;
+    uint32_t n_valid;
+    uint32_t n_additions;
+    uint32_t n_removals;
+    uint32_t n_ranges;
+    uint8_t calendar_weekdays;   // Weekdays set in calendar.txt (bit 0 = Monday)
+    uint8_t valid_weekdays;      // Weekdays of the valid days
+    uint8_t addition_weekdays;   // Weekdays of the added days
+    uint8_t reserved;
+} GttRouteCalendar;
+
+typedef struct {
+    GttRouteCalendar* routes;
+    size_t n_routes;
+    int32_t* days;               // Days since 1970-01-01
+    size_t n_days;
+} GttRouteCalendars;
+
+// Service calendars of many routes at once. Routes whose services have a
+// calendar.txt entry with any weekday set are valid on the days between the
+// earliest start and the latest end of those entries on which one of their
+// active services runs; other routes are valid on their added days. Added
+// and removed days are sorted. Returns NULL on allocation failure.
+GTT_API GttRouteCalendars* gtt_route_calendars(const GttTimetable* tt, const GttCalendarQuery* query);
+GTT_API void gtt_free_route_calendars(GttRouteCalendars* calendars);
+
+// ---------------------------------------------------------------------------
+// Vehicle positions (gtfs_vehicles.c)
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    uint32_t trip;
+    uint32_t next_stop;         // Stop the vehicle is heading to
+    uint32_t next_pos;          // Its pattern position, GTT_NONE for the first visit of next_stop
+    uint32_t reserved;
+    double distance_to_next;    // Metres left to the next stop
+} GttVehicleQuery;
+
+typedef struct {
+    double lat;
+    double lon;
+    double bearing;             // Degrees clockwise from north
+    double segment_length;      // Metres along the shape between the two stops
+    uint32_t located;           // 0 without a shape or when heading to the first stop
+    uint32_t from_pos;          // Pattern position of the previous stop
+} GttVehicleLocation;
+
+// Place vehicles on the shapes of their trips, between the stop before
+// next_stop and next_stop. The distance to the next stop is capped at the
+// length of that stretch of shape. Writes one location per vehicle to out
+// and returns the number located.
+GTT_API size_t gtt_locate_vehicles(const GttTimetable* tt, const GttVehicleQuery* vehicles,
+                                   size_t n, GttVehicleLocation* out);
+
+typedef struct {
+    int32_t day;                // Days since 1970-01-01
+    int32_t time;               // Seconds after midnight of day
+    uint32_t has_bbox;          // Only vehicles within the box below
+    uint32_t n_threads;         // Patterns are spread over this many threads
+    double min_lat;
+    double min_lon;
+    double max_lat;
+    double max_lon;
+} GttScheduleQuery;
+
+typedef struct {
+    uint32_t trip;
+    int32_t shift;              // Run of a frequencies.txt trip, 0 for timed trips
+    int32_t day;                // Service day of the trip: the query day or the day before
+    uint32_t from_pos;          // Pattern position of the last stop reached
+    uint32_t from_stop;
+    uint32_t to_stop;           // Next stop, from_stop at the end of the trip
+    uint32_t on_shape;          // 1 when placed on the shape, 0 between stop coordinates
+    uint32_t reserved;
+    double progress;            // Fraction of the time to the next stop, 0 while at from_stop
+    double lat;
+    double lon;
+    double bearing;             // Degrees clockwise from north
+} GttScheduledVehicle;
+
+typedef struct {
+    GttScheduledVehicle* vehicles;
+    size_t n_vehicles;
+} GttScheduledVehicles;
+
+// Where every trip running at a time should be according to the timetable:
+// trips of the query day and, after midnight, of the day before that have
+// left their first stop and not yet reached their last, including the runs
+// of frequency-based trips. A vehicle between two stops is placed at the
+// fraction of the scheduled time it has travelled, along the shape when the
+// trip has one. Vehicles are listed by pattern. Returns NULL on allocation
+// failure.
+GTT_API GttScheduledVehicles* gtt_scheduled_vehicles(const GttTimetable* tt, const GttScheduleQuery* query);
+GTT_API void gtt_free_scheduled_vehicles(GttScheduledVehicles* vehicles);
+
+// ---------------------------------------------------------------------------
+// GTFS-Realtime (gtfs_realtime.c)
+// ---------------------------------------------------------------------------
+
+// Decoded GTFS-Realtime TripUpdates and VehiclePositions messages, read
+// straight from the protobuf wire format into flat arrays: the subset of
+// the specification the providers use, plus the realcity extensions
+// (field 1006) of the BKK feeds. Trip, route and stop ids are resolved to
+// the indices of a timetable; the ids themselves are not copied but kept
+// as byte ranges of the message.
+
+#define GTT_RT_DELETED                  (1u << 0)     // Entity marked is_deleted
+#define GTT_RT_HAS_DELAY                (1u << 1)     // Trip update delay
+#define GTT_RT_HAS_TIMESTAMP            (1u << 2)
+#define GTT_RT_HAS_ARRIVAL_TIME         (1u << 3)
+#define GTT_RT_HAS_ARRIVAL_DELAY        (1u << 4)
+#define GTT_RT_HAS_DEPARTURE_TIME       (1u << 5)
+#define GTT_RT_HAS_DEPARTURE_DELAY      (1u << 6)
+#define GTT_RT_HAS_SCHEDULED_ARRIVAL    (1u << 7)     // realcity
+#define GTT_RT_HAS_SCHEDULED_DEPARTURE  (1u << 8)     // realcity
+#define GTT_RT_HAS_POSITION             (1u << 9)
+#define GTT_RT_HAS_BEARING              (1u << 10)
+#define GTT_RT_HAS_SPEED                (1u << 11)
+#define GTT_RT_HAS_ODOMETER             (1u << 12)
+#define GTT_RT_HAS_STATUS               (1u << 13)    // current_status
+#define GTT_RT_HAS_STOP_DISTANCE        (1u << 14)    // realcity
+#define GTT_RT_HAS_VEHICLE_TYPE         (1u << 15)    // realcity
+#define GTT_RT_DOOR_OPEN                (1u << 16)    // realcity
+#define GTT_RT_DEVIATED                 (1u << 17)    // realcity
+
+// Byte range of a string in the decoded message
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} GttRtString;
+
+typedef struct {
+    uint32_t trip;              // GTT_NONE when unknown to the timetable
+    uint32_t route;             // Of route_id, or else of the trip
+    uint32_t first_update;      // Stop time updates [first_update, first_update + n_updates)
+    uint32_t n_updates;
+    GttRtString entity_id;
+    GttRtString trip_id;
+    GttRtString route_id;
+    GttRtString vehicle_id;
+    int32_t start_day;          // Days since 1970-01-01, INT32_MIN when absent
+    int32_t start_time;         // Seconds after midnight, -1 when absent
+    int32_t delay;
+    uint32_t flags;             // GTT_RT_*
+    uint32_t schedule_relationship;
+    uint32_t direction_id;      // GTT_NONE when absent
+    uint64_t timestamp;
+} GttRtTripUpdate;
+
+typedef struct {
+    uint32_t stop;              // GTT_NONE when unknown to the timetable
+    uint32_t stop_sequence;     // GTT_NONE when absent
+    GttRtString stop_id;
+    int32_t arrival_delay;
+    int32_t departure_delay;
+    uint32_t flags;
+    uint32_t schedule_relationship;
+    int64_t arrival_time;       // POSIX times
+    int64_t departure_time;
+    int64_t scheduled_arrival;
+    int64_t scheduled_departure;
+} GttRtStopTimeUpdate;
+
+typedef struct {
+    uint32_t trip;
+    uint32_t route;
+    uint32_t stop;
+    uint32_t current_stop_sequence;
+    GttRtString entity_id;
+    GttRtString trip_id;
+    GttRtString route_id;
+    GttRtString stop_id;
+    GttRtString vehicle_id;
+    GttRtString label;
+    GttRtString license_plate;
+    GttRtString vehicle_model;  // realcity
+    int32_t start_day;
+    int32_t start_time;
+    uint32_t direction_id;
+    uint32_t flags;
+    uint32_t current_status;
+    uint32_t congestion_level;
+    uint32_t occupancy_status;
+    int32_t vehicle_type;       // realcity
+    int32_t stop_distance;      // realcity, metres
+    uint32_t reserved;
+    uint64_t timestamp;
+    double lat;
+    double lon;
+    double bearing;
+    double speed;               // Metres per second
+    double odometer;
+} GttRtVehicle;
+
+typedef struct {
+    const uint8_t* data;        // The message the string ranges point into
+    size_t size;
+    uint64_t timestamp;         // Of the feed header, 0 when absent
+    size_t n_entities;
+    GttRtTripUpdate* trip_updates;
+    size_t n_trip_updates;
+    GttRtStopTimeUpdate* stop_time_updates;
+    size_t n_stop_time_updates;
+    GttRtVehicle* vehicles;
+    size_t n_vehicles;
+    uint8_t* owned;             // Message read by gtt_rt_decode_file
+} GttRtFeed;
+
+typedef struct {
+    // Prefixes removed from trip, route and stop ids before they are looked
+    // up, as consecutive NUL-terminated strings ending with an empty one.
+    // NULL for none.
+    const char* id_prefixes;
+    // Stop ids are cut at the first of this character (platforms of a
+    // station), 0 to keep them whole
+    char stop_separator;
+} GttRtOptions;
+
+// Decode a FeedMessage of size bytes. data must outlive the result. tt and
+// options may be NULL, leaving every index GTT_NONE and the ids whole; the
+// string ranges are those of the ids after options are applied. Returns
+// NULL for malformed messages or on allocation failure.
+GTT_API GttRtFeed* gtt_rt_decode(const GttTimetable* tt, const uint8_t* data, size_t size,
+                                 const GttRtOptions* options);
+// Decode a FeedMessage saved to a file (a recorded .pb), which the result
+// keeps
+GTT_API GttRtFeed* gtt_rt_decode_file(const GttTimetable* tt, const char* path,
+                                      const GttRtOptions* options);
+GTT_API void gtt_free_rt_feed(GttRtFeed* feed);
+
+#endif // GTFS_TIMETABLE_H
@@ -0,0 +1,138 @@
+#ifndef GTFS_TIMETABLE_INTERNAL_H
+#define GTFS_TIMETABLE_INTERNAL_H
+
+#include "gtfs_timetable.h"
+
+// Timetable layout shared by the native query modules. Not part of the
+// library interface.
+
+#define WALKING_SPEED_MPS 1.2
+
+// One hop of a trip between two consecutive stops. The connection array is
+// sorted by departure (then arrival, then position along the trip) for the
+// connection scan queries in gtfs_csa.c.
+typedef struct {
+    int32_t departure;
+    int32_t arrival;
+    uint32_t from_stop;
+    uint32_t to_stop;
+    uint32_t trip;
+} GttConnection;
+
+// One frequencies.txt window of a template trip: runs leave the first stop
+// at start, start + headway, ... while before end
+typedef struct {
+    int32_t start;
+    int32_t end;
+    int32_t headway;
+    int32_t exact_times;
+} GttFrequency;
+
+// Loaded or freshly built timetable. Array pointers either point into the
+// blob of a loaded file or are heap allocations owned by the builder.
+struct GttTimetable {
+    GttHeader header;
+    void* blob;
+    uint64_t counts[GTT_SEC_COUNT];
+
+    const char* strings;
+    const uint32_t* stop_id;
+    const uint32_t* stop_name;
+    const double* stop_lat;
+    const double* stop_lon;
+    const int32_t* stop_parent;
+    const uint32_t* route_id;
+    const uint32_t* route_short_name;
+    const uint32_t* route_long_name;
+    const int32_t* route_type;
+    const uint32_t* service_id;
+    const uint8_t* service_weekdays;
+    const uint64_t* service_bits;
+    const uint32_t* trip_id;
+    const uint32_t* trip_route;
+    const uint32_t* trip_service;
+    const uint32_t* trip_headsign;
+    const int8_t* trip_direction;
+    const uint32_t* trip_shape;
+    const uint32_t* trip_pattern;
+    const uint32_t* trip_times;
+    const uint32_t* pattern_route;
+    const uint32_t* pattern_stops_start;
+    const uint32_t* pattern_n_stops;
+    const uint32_t* pattern_trips_start;
+    const uint32_t* pattern_n_trips;
+    const uint32_t* pattern_stops;
+    const int32_t* arrivals;
+    const int32_t* departures;
+    const uint32_t* stop_patterns_start;
+    const uint32_t* stop_patterns;
+    const uint32_t* stop_pattern_pos;
+    const uint32_t* transfers_start;
+    const uint32_t* transfer_stops;
+    const int32_t* transfer_times;
+    const GttConnection* connections;
+    const uint64_t* downstream_start;   // Byte offsets of each stop's list
+    const uint8_t* downstream;          // Varint count, then stop index deltas
+    const uint64_t* upstream_start;
+    const uint8_t* upstream;
+    const uint32_t* languages;          // String offsets of the language codes
+    const uint32_t* stop_translations;  // n_languages columns of n_stops name offsets, 0 for none
+    const uint8_t* service_calendar_days;   // calendar.txt weekday mask
+    const int32_t* service_start;       // calendar.txt dates, start > end without an entry
+    const int32_t* service_end;
+    const uint32_t* exceptions_start;   // n_services + 1 offsets into the exceptions
+    const int32_t* exception_days;      // calendar_dates.txt, sorted by day per service
+    const uint8_t* exception_types;     // 1 added, 2 removed
+    const uint32_t* trip_frequencies_start; // n_trips + 1 offsets into frequencies
+    const GttFrequency* frequencies;    // Sorted by start per trip
+    const uint32_t* shape_id;
+    const uint32_t* shape_points_start; // n_shapes + 1 offsets into the points
+    const double* shape_lat;
+    const double* shape_lon;
+    const double* shape_distance;       // Metres travelled from the first point
+    const uint32_t* pattern_shape;      // GTT_NONE when its trips have no known shape
+    const uint32_t* pattern_stop_shape_pos;  // Aligned with pattern_stops: shape segment
+                                             // (first point) the stop projects onto
+    const double* pattern_stop_shape_distance;  // Distance along the shape of the projection
+    const uint32_t* stop_sequences;     // Aligned with arrivals: GTFS stop_sequence values
+
+    // Id lookup tables, rebuilt on load
+    uint32_t* stop_lookup;
+    uint32_t* trip_lookup;
+    uint32_t* route_lookup;
+    uint32_t stop_lookup_mask;
+    uint32_t trip_lookup_mask;
+    uint32_t route_lookup_mask;
+};
+
+// 1970-01-01 was a Thursday; Monday = 0
+static inline int weekday_of(int32_t day) {
+    return (int)(((day % 7) + 7 + 3) % 7);
+}
+
+// Whether a trip is a frequencies.txt template. Such a trip is the only
+// trip of its pattern.
+static inline int trip_is_frequent(const GttTimetable* tt, uint32_t trip) {
+    return tt->trip_frequencies_start[trip + 1] > tt->trip_frequencies_start[trip];
+}
+
+// Shift of the first run of a template trip, in any of its windows, that
+// leaves pos at or after time; INT32_MAX when there is none. dep0 and dep
+// are the template departures at the first stop and at pos.
+static inline int32_t frequency_next_shift(const GttTimetable* tt, uint32_t trip,
+                                           int32_t dep0, int32_t dep, int64_t time) {
+    int64_t best = INT32_MAX;
+    for (uint32_t f = tt->trip_frequencies_start[trip]; f < tt->trip_frequencies_start[trip + 1]; f++) {
+        const GttFrequency* w = &tt->frequencies[f];
+        // Run k leaves pos at w->start + k * headway + (dep - dep0)
+        int64_t first = (int64_t)w->start + dep - dep0;
+        int64_t k = time > first ? (time - first + w->headway - 1) / w->headway : 0;
+        int64_t run_start = (int64_t)w->start + k * w->headway;
+        if (run_start < w->end && run_start - dep0 < best) {
+            best = run_start - dep0;
+        }
+    }
+    return (int32_t)best;
+}
+
+#endif // GTFS_TIMETABLE_INTERNAL_H
@@ -0,0 +1,315 @@
+#include "gtfs_timetable_internal.h"
+#include "gtfs_spatial.h"
+#include "gtfs_taskgraph.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Vehicle positions on the shapes of their trips. The stops of every
+// pattern are projected onto its shape when the timetable is built
+// (build_projections), so a point between two stops is a binary search
+// over the distances travelled at the shape's points between theirs.
+//
+// Realtime vehicles are located from the stop they are heading to and the
+// distance left. Scheduled vehicles are every trip running at a time,
+// placed at the fraction of the scheduled time between two stops they have
+// travelled; patterns are spread over threads, each collecting its own
+// vehicles, which are then concatenated in pattern order.
+
+#define SCHEDULE_MAX_THREADS 64
+#define DAY_SECONDS 86400
+
+// Point of a shape at distance target along it, between its points lo and
+// hi. The bearing is that of the stretch the point is on.
+static void shape_point(const GttTimetable* tt, uint32_t shape, uint32_t lo, uint32_t hi,
+                        double target, double* lat_out, double* lon_out, double* bearing_out) {
+    uint32_t first = tt->shape_points_start[shape];
+    uint32_t n_points = tt->shape_points_start[shape + 1] - first;
+    const double* distance = tt->shape_distance + first;
+    const double* lat = tt->shape_lat + first;
+    const double* lon = tt->shape_lon + first;
+    if (hi > n_points - 1) hi = n_points - 1;
+    if (lo > hi) lo = hi;
+    // Last point at or before target
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        if (distance[mid] <= target) lo = mid;
+        else hi = mid - 1;
+    }
+
+    uint32_t next = lo + 1 < n_points ? lo + 1 : lo;
+    double length = distance[next] - distance[lo];
+    double t = length > 0 ? (target - distance[lo]) / length : 0.0;
+    if (t < 0) t = 0;
+    if (t > 1) t = 1;
+    *lat_out = lat[lo] + t * (lat[next] - lat[lo]);
+    *lon_out = lon[lo] + t * (lon[next] - lon[lo]);
+    // At the last point, keep the heading of the stretch into it
+    uint32_t from = next != lo ? lo : (lo > 0 ? lo - 1 : lo);
+    *bearing_out = from != next ? geo_bearing_deg(lat[from], lon[from], lat[next], lon[next]) : 0.0;
+}
+
+static int shape_usable(const GttTimetable* tt, uint32_t shape) {
+    return shape != GTT_NONE && tt->shape_points_start[shape + 1] > tt->shape_points_start[shape];
+}
+
+// ---------------------------------------------------------------------------
+// Realtime positions
+// ---------------------------------------------------------------------------
+
+static int locate_vehicle(const GttTimetable* tt, const GttVehicleQuery* v, GttVehicleLocation* out) {
+    if (v->trip >= tt->header.n_trips) {
+        return 0;
+    }
+    uint32_t pattern = tt->trip_pattern[v->trip];
+    uint32_t shape = tt->pattern_shape[pattern];
+    if (!shape_usable(tt, shape)) {
+        return 0;
+    }
+    uint32_t start = tt->pattern_stops_start[pattern];
+    uint32_t n_stops = tt->pattern_n_stops[pattern];
+    uint32_t pos = v->next_pos;
+    if (pos == GTT_NONE) {
+        for (pos = 0; pos < n_stops && tt->pattern_stops[start + pos] != v->next_stop; pos++) {
+        }
+    }
+    if (pos == 0 || pos >= n_stops) {
+        return 0;
+    }
+
+    double from = tt->pattern_stop_shape_distance[start + pos - 1];
+    double to = tt->pattern_stop_shape_distance[start + pos];
+    double left = v->distance_to_next;
+    if (left < 0) left = 0;
+    if (left > to - from) left = to - from;
+    shape_point(tt, shape, tt->pattern_stop_shape_pos[start + pos - 1],
+                tt->pattern_stop_shape_pos[start + pos] + 1, to - left,
+                &out->lat, &out->lon, &out->bearing);
+    out->segment_length = to - from;
+    out->located = 1;
+    out->from_pos = pos - 1;
+    return 1;
+}
+
+size_t gtt_locate_vehicles(const GttTimetable* tt, const GttVehicleQuery* vehicles,
+                           size_t n, GttVehicleLocation* out) {
+    size_t located = 0;
+    for (size_t i = 0; i < n; i++) {
+        memset(&out[i], 0, sizeof(out[i]));
+        located += (size_t)locate_vehicle(tt, &vehicles[i], &out[i]);
+    }
+    return located;
+}
+
+// ---------------------------------------------------------------------------
+// Scheduled positions
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    const GttTimetable* tt;
+    const GttScheduleQuery* query;
+    const uint8_t* running;     // Per service: bit 0 runs on the query day, bit 1 the day before
+    size_t first_pattern;       // This worker handles patterns [first_pattern, end_pattern)
+    size_t end_pattern;
+    GttScheduledVehicle* vehicles;
+    size_t n_vehicles;
+    size_t cap;
+    int failed;
+} ScheduleWorker;
+
+static int grow_array(void** data, size_t* cap, size_t need, size_t elem_size) {
+    if (need <= *cap) return 0;
+    size_t new_cap = *cap ? *cap * 2 : 16;
+    while (new_cap < need) new_cap *= 2;
+    void* p = realloc(*data, new_cap * elem_size);
+    if (!p) return -1;
+    *data = p;
+    *cap = new_cap;
+    return 0;
+}
+
+// Place a run of a trip at time (seconds after midnight of its service
+// day), known to be between its first departure and last arrival
+static void place_vehicle(ScheduleWorker* w, uint32_t pattern, uint32_t trip, int32_t shift,
+                          int32_t day, int64_t time) {
+    const GttTimetable* tt = w->tt;
+    const GttScheduleQuery* q = w->query;
+    uint32_t start = tt->pattern_stops_start[pattern];
+    uint32_t n = tt->pattern_n_stops[pattern];
+    const int32_t* arr = tt->arrivals + tt->trip_times[trip];
+    const int32_t* dep = tt->departures + tt->trip_times[trip];
+    int64_t local = time - shift;
+
+    // Last stop reached
+    uint32_t lo = 0;
+    uint32_t hi = n - 1;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        if (arr[mid] <= local) lo = mid;
+        else hi = mid - 1;
+    }
+    uint32_t k = lo;
+    uint32_t next = k + 1 < n ? k + 1 : k;
+    double progress = 0.0;
+    if (next != k && local >= dep[k]) {
+        int32_t hop = arr[next] - dep[k];
+        progress = hop > 0 ? (double)(local - dep[k]) / hop : 1.0;
+        if (progress > 1) progress = 1;
+    }
+
+    GttScheduledVehicle v;
+    memset(&v, 0, sizeof(v));
+    v.trip = trip;
+    v.shift = shift;
+    v.day = day;
+    v.from_pos = k;
+    v.from_stop = tt->pattern_stops[start + k];
+    v.to_stop = tt->pattern_stops[start + next];
+    v.progress = progress;
+    uint32_t shape = tt->pattern_shape[pattern];
+    if (shape_usable(tt, shape)) {
+        double from = tt->pattern_stop_shape_distance[start + k];
+        double to = tt->pattern_stop_shape_distance[start + next];
+        shape_point(tt, shape, tt->pattern_stop_shape_pos[start + k],
+                    tt->pattern_stop_shape_pos[start + next] + 1, from + progress * (to - from),
+                    &v.lat, &v.lon, &v.bearing);
+        v.on_shape = 1;
+    } else {
+        uint32_t a = v.from_stop;
+        uint32_t b = v.to_stop;
+        v.lat = tt->stop_lat[a] + progress * (tt->stop_lat[b] - tt->stop_lat[a]);
+        v.lon = tt->stop_lon[a] + progress * (tt->stop_lon[b] - tt->stop_lon[a]);
+        // At the last stop, keep the heading of the hop into it
+        if (next == k && k > 0) a = tt->pattern_stops[start + k - 1];
+        v.bearing = a != b ? geo_bearing_deg(tt->stop_lat[a], tt->stop_lon[a],
+                                             tt->stop_lat[b], tt->stop_lon[b]) : 0.0;
+    }
+
+    if (q->has_bbox && (v.lat < q->min_lat || v.lat > q->max_lat ||
+                        v.lon < q->min_lon || v.lon > q->max_lon)) {
+        return;
+    }
+    if (grow_array((void**)&w->vehicles, &w->cap, w->n_vehicles + 1, sizeof(GttScheduledVehicle)) != 0) {
+        w->failed = 1;
+        return;
+    }
+    w->vehicles[w->n_vehicles++] = v;
+}
+
+// Runs of the trips of a pattern on one service day that are under way at
+// time. Trips of a pattern never overtake each other, so those that have
+// not yet arrived at the last stop start with a binary search and end at
+// the first trip still to leave.
+static void pattern_vehicles(ScheduleWorker* w, uint32_t pattern, int32_t day, int64_t time, uint8_t bit) {
+    const GttTimetable* tt = w->tt;
+    uint32_t first = tt->pattern_trips_start[pattern];
+    uint32_t n_trips = tt->pattern_n_trips[pattern];
+    uint32_t last_pos = tt->pattern_n_stops[pattern] - 1;
+
+    if (n_trips == 1 && trip_is_frequent(tt, first)) {
+        if (!(w->running[tt->trip_service[first]] & bit)) return;
+        int32_t dep0 = tt->departures[tt->trip_times[first]];
+        int32_t duration = tt->arrivals[tt->trip_times[first] + last_pos] - dep0;
+        for (uint32_t f = tt->trip_frequencies_start[first]; f < tt->trip_frequencies_start[first + 1]; f++) {
+            const GttFrequency* window = &tt->frequencies[f];
+            // Runs that left from time - duration to time
+            int64_t earliest = time - duration;
+            int64_t k = earliest > window->start
+                            ? (earliest - window->start + window->headway - 1) / window->headway : 0;
+            for (int64_t run = window->start + k * window->headway;
+                 run <= time && run < window->end; run += window->headway) {
+                place_vehicle(w, pattern, first, (int32_t)(run - dep0), day, time);
+            }
+        }
+        return;
+    }
+
+    uint32_t lo = 0;
+    uint32_t hi = n_trips;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (tt->arrivals[tt->trip_times[first + mid] + last_pos] < time) lo = mid + 1;
+        else hi = mid;
+    }
+    for (uint32_t i = lo; i < n_trips; i++) {
+        uint32_t trip = first + i;
+        if (tt->departures[tt->trip_times[trip]] > time) break;
+        if (w->running[tt->trip_service[trip]] & bit) {
+            place_vehicle(w, pattern, trip, 0, day, time);
+        }
+    }
+}
+
+static int run_schedule_worker(void* workers, int index) {
+    ScheduleWorker* w = (ScheduleWorker*)workers + index;
+    const GttTimetable* tt = w->tt;
+    const GttScheduleQuery* q = w->query;
+    for (size_t p = w->first_pattern; p < w->end_pattern && !w->failed; p++) {
+        if (tt->pattern_n_stops[p] < 2 || tt->pattern_n_trips[p] == 0) continue;
+        pattern_vehicles(w, (uint32_t)p, q->day, q->time, 1);
+        // Trips of the day before still running after midnight
+        pattern_vehicles(w, (uint32_t)p, q->day - 1, (int64_t)q->time + DAY_SECONDS, 2);
+    }
+    return w->failed ? -1 : 0;
+}
+
+GttScheduledVehicles* gtt_scheduled_vehicles(const GttTimetable* tt, const GttScheduleQuery* query) {
+    size_t n_patterns = tt->header.n_patterns;
+    uint32_t n_threads = query->n_threads ? query->n_threads : 1;
+    if (n_threads > SCHEDULE_MAX_THREADS) n_threads = SCHEDULE_MAX_THREADS;
+    if (n_threads > n_patterns) n_threads = n_patterns > 0 ? (uint32_t)n_patterns : 1;
+
+    GttScheduledVehicles* result = calloc(1, sizeof(GttScheduledVehicles));
+    ScheduleWorker* workers = calloc(n_threads, sizeof(ScheduleWorker));
+    uint8_t* running = malloc(tt->header.n_services + 1);
+    if (!result || !workers || !running) {
+        free(result);
+        free(workers);
+        free(running);
+        return NULL;
+    }
+    for (uint32_t s = 0; s < tt->header.n_services; s++) {
+        running[s] = (uint8_t)(gtt_service_active(tt, s, query->day) |
+                               gtt_service_active(tt, s, query->day - 1) << 1);
+    }
+
+    // Contiguous ranges of patterns keep the output in pattern order
+    for (uint32_t t = 0; t < n_threads; t++) {
+        workers[t].tt = tt;
+        workers[t].query = query;
+        workers[t].running = running;
+        workers[t].first_pattern = n_patterns * t / n_threads;
+        workers[t].end_pattern = n_patterns * (t + 1) / n_threads;
+    }
+    int failed = parallel_for((int)n_threads, run_schedule_worker, workers) != 0;
+
+    size_t n_vehicles = 0;
+    for (uint32_t t = 0; t < n_threads; t++) {
+        n_vehicles += workers[t].n_vehicles;
+    }
+    result->vehicles = failed ? NULL : malloc(sizeof(GttScheduledVehicle) * (n_vehicles + 1));
+    failed |= result->vehicles == NULL;
+    for (uint32_t t = 0; t < n_threads; t++) {
+        if (!failed) {
+            memcpy(result->vehicles + result->n_vehicles, workers[t].vehicles,
+                   sizeof(GttScheduledVehicle) * workers[t].n_vehicles);
+            result->n_vehicles += workers[t].n_vehicles;
+        }
+        free(workers[t].vehicles);
+    }
+    free(workers);
+    free(running);
+    if (failed) {
+        gtt_free_scheduled_vehicles(result);
+        return NULL;
+    }
+    return result;
+}
+
+void gtt_free_scheduled_vehicles(GttScheduledVehicles* vehicles) {
+    if (!vehicles) {
+        return;
+    }
+    free(vehicles->vehicles);
+    free(vehicles);
+}
@@ -0,0 +1,535 @@
+#include "gtfs_zip.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#ifdef GTFS_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#ifndef S_ISREG
+#define S_ISREG(mode) (((mode) & S_IFMT) == S_IFREG)
+#endif
+#else
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#define ZIP_CHUNK (256 * 1024)          // Compressed and inflated bytes per step
+#define ZIP_PIPE_SIZE (1024 * 1024)     // How far inflating may run ahead of the reader
+#define ZIP_MAX_CENTRAL_DIR (256u * 1024 * 1024)
+
+#define SIG_LOCAL 0x04034b50u
+#define SIG_CENTRAL 0x02014b50u
+#define SIG_EOCD 0x06054b50u
+#define SIG_ZIP64_LOCATOR 0x07064b50u
+#define SIG_ZIP64_EOCD 0x06064b50u
+
+typedef struct {
+    uint16_t flags;
+    uint16_t method;
+    uint32_t crc;
+    uint64_t compressed_size;
+    uint64_t size;
+    uint64_t local_offset;
+} ZipEntry;
+
+struct ZipStream {
+    FILE* archive;
+    FILE* reader;           // Read end of the pipe
+    int write_fd;
+    char* name;             // "<archive>/<member>", for messages
+    ZipEntry entry;
+    uint64_t data_offset;
+    int status;             // Set by the inflate thread: 0 when complete and intact
+    int started;
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+};
+
+static uint16_t rd16(const unsigned char* p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t rd32(const unsigned char* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t rd64(const unsigned char* p) {
+    return (uint64_t)rd32(p) | (uint64_t)rd32(p + 4) << 32;
+}
+
+static int seek_to(FILE* fp, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(fp, (long long)offset, SEEK_SET);
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static int read_at(FILE* fp, uint64_t offset, void* buffer, size_t len) {
+    return seek_to(fp, offset) == 0 && fread(buffer, 1, len, fp) == len ? 0 : -1;
+}
+
+#ifdef GTFS_HAVE_ZLIB
+static uint32_t zip_crc32(uint32_t crc, const unsigned char* data, size_t len) {
+    while (len > 0) {
+        uInt n = len > UINT_MAX ? UINT_MAX : (uInt)len;
+        crc = (uint32_t)crc32(crc, data, n);
+        data += n;
+        len -= n;
+    }
+    return crc;
+}
+#else
+static uint32_t zip_crc32(uint32_t crc, const unsigned char* data, size_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *data++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+#endif
+
+int zip_split_path(const char* path, const char* default_member,
+                   char* archive, size_t archive_size, const char** member) {
+    size_t len = strlen(path);
+    // The last ".zip" that ends the path or a directory name
+    for (size_t i = len; i >= 4; i--) {
+        if (i < len && path[i] != '/' && path[i] != '\\') continue;
+        const char* ext = path + i - 4;
+        if (ext[0] != '.' || tolower((unsigned char)ext[1]) != 'z' ||
+            tolower((unsigned char)ext[2]) != 'i' || tolower((unsigned char)ext[3]) != 'p') {
+            continue;
+        }
+        if (i + 1 > archive_size) return -1;
+        memcpy(archive, path, i);
+        archive[i] = '\0';
+        struct stat st;
+        if (stat(archive, &st) != 0 || !S_ISREG(st.st_mode)) return -1;
+        *member = i < len ? path + i + 1 : default_member;
+        return *member && **member ? 0 : -1;
+    }
+    return -1;
+}
+
+// Locate the central directory from the end of central directory record
+// (or its zip64 version)
+static int find_central_directory(FILE* fp, uint64_t* offset, uint64_t* size, uint64_t* entries) {
+    if (fseek(fp, 0, SEEK_END) != 0) return -1;
+#ifdef _WIN32
+    long long file_size = _ftelli64(fp);
+#else
+    long long file_size = (long long)ftello(fp);
+#endif
+    if (file_size < 22) return -1;
+
+    // The record is 22 bytes followed by a comment of up to 65535 bytes
+    size_t tail_size = file_size < 22 + 65535 ? (size_t)file_size : 22 + 65535;
+    uint64_t tail_offset = (uint64_t)file_size - tail_size;
+    unsigned char* tail = malloc(tail_size);
+    if (!tail || read_at(fp, tail_offset, tail, tail_size) != 0) {
+        free(tail);
+        return -1;
+    }
+    long long eocd = -1;
+    for (size_t i = tail_size - 22 + 1; i-- > 0;) {
+        if (rd32(tail + i) == SIG_EOCD) {
+            eocd = (long long)i;
+            break;
+        }
+    }
+    if (eocd < 0) {
+        free(tail);
+        return -1;
+    }
+    const unsigned char* p = tail + eocd;
+    *entries = rd16(p + 10);
+    *size = rd32(p + 12);
+    *offset = rd32(p + 16);
+    int zip64 = *entries == 0xFFFF || *size == 0xFFFFFFFFu || *offset == 0xFFFFFFFFu;
+    uint64_t locator = tail_offset + (uint64_t)eocd - 20;
+    free(tail);
+    if (!zip64) return 0;
+
+    unsigned char buffer[56];
+    if (tail_offset + (uint64_t)eocd < 20 || read_at(fp, locator, buffer, 20) != 0 ||
+        rd32(buffer) != SIG_ZIP64_LOCATOR) {
+        return -1;
+    }
+    uint64_t record = rd64(buffer + 8);
+    if (read_at(fp, record, buffer, 56) != 0 || rd32(buffer) != SIG_ZIP64_EOCD) {
+        return -1;
+    }
+    *entries = rd64(buffer + 32);
+    *size = rd64(buffer + 40);
+    *offset = rd64(buffer + 48);
+    return 0;
+}
+
+// Fill in sizes and offset stored in a zip64 extra field
+static void read_zip64_extra(const unsigned char* extra, size_t len, ZipEntry* entry) {
+    while (len >= 4) {
+        uint16_t id = rd16(extra);
+        uint16_t size = rd16(extra + 2);
+        if (4u + size > len) return;
+        if (id == 0x0001) {
+            const unsigned char* p = extra + 4;
+            const unsigned char* end = p + size;
+            if (entry->size == 0xFFFFFFFFu && p + 8 <= end) {
+                entry->size = rd64(p);
+                p += 8;
+            }
+            if (entry->compressed_size == 0xFFFFFFFFu && p + 8 <= end) {
+                entry->compressed_size = rd64(p);
+                p += 8;
+            }
+            if (entry->local_offset == 0xFFFFFFFFu && p + 8 <= end) {
+                entry->local_offset = rd64(p);
+            }
+            return;
+        }
+        extra += 4 + size;
+        len -= 4u + size;
+    }
+}
+
+// Find a member in the central directory. Returns 1 when found, 0 when the
+// archive has no such member and -1 when the archive cannot be read.
+static int find_member(FILE* fp, const char* member, ZipEntry* found) {
+    uint64_t offset, size, entries;
+    if (find_central_directory(fp, &offset, &size, &entries) != 0 || size > ZIP_MAX_CENTRAL_DIR) {
+        return -1;
+    }
+    unsigned char* dir = malloc(size ? (size_t)size : 1);
+    if (!dir || read_at(fp, offset, dir, (size_t)size) != 0) {
+        free(dir);
+        return -1;
+    }
+
+    size_t member_len = strlen(member);
+    int result = 0;
+    size_t pos = 0;
+    for (uint64_t i = 0; i < entries; i++) {
+        if (pos + 46 > size || rd32(dir + pos) != SIG_CENTRAL) {
+            result = -1;
+            break;
+        }
+        const unsigned char* p = dir + pos;
+        size_t name_len = rd16(p + 28);
+        size_t extra_len = rd16(p + 30);
+        size_t comment_len = rd16(p + 32);
+        if (pos + 46 + name_len + extra_len + comment_len > size) {
+            result = -1;
+            break;
+        }
+        const char* name = (const char*)p + 46;
+        int exact = name_len == member_len && memcmp(name, member, member_len) == 0;
+        int nested = name_len > member_len && name[name_len - member_len - 1] == '/' &&
+                     memcmp(name + name_len - member_len, member, member_len) == 0;
+        if (exact || (nested && result == 0)) {
+            found->flags = rd16(p + 8);
+            found->method = rd16(p + 10);
+            found->crc = rd32(p + 16);
+            found->compressed_size = rd32(p + 20);
+            found->size = rd32(p + 24);
+            found->local_offset = rd32(p + 42);
+            read_zip64_extra(p + 46 + name_len, extra_len, found);
+            result = 1;
+            if (exact) break;
+        }
+        pos += 46 + name_len + extra_len + comment_len;
+    }
+    free(dir);
+    return result;
+}
+
+static int write_all(int fd, const unsigned char* data, size_t len) {
+    while (len > 0) {
+#ifdef _WIN32
+        int n = _write(fd, data, len > INT_MAX ? INT_MAX : (unsigned int)len);
+#else
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+#endif
+        if (n <= 0) return -1;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Inflate the member into the pipe. The pipe is closed at the end, which
+// the reader sees as the end of the file.
+static void run_stream(ZipStream* stream) {
+#ifndef _WIN32
+    // A reader that stops early makes write() fail with EPIPE rather than
+    // raising SIGPIPE in the process
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+#endif
+    const ZipEntry* entry = &stream->entry;
+    unsigned char* in = malloc(ZIP_CHUNK);
+    unsigned char* out = malloc(ZIP_CHUNK);
+    uint64_t remaining = entry->compressed_size;
+    uint64_t produced = 0;
+    uint32_t crc = 0;
+    int ok = in && out && seek_to(stream->archive, stream->data_offset) == 0;
+    int write_failed = 0;
+
+    if (ok && entry->method == 0) {
+        while (ok && remaining > 0) {
+            size_t n = remaining < ZIP_CHUNK ? (size_t)remaining : ZIP_CHUNK;
+            if (fread(in, 1, n, stream->archive) != n) {
+                ok = 0;
+                break;
+            }
+            remaining -= n;
+            crc = zip_crc32(crc, in, n);
+            produced += n;
+            if (write_all(stream->write_fd, in, n) != 0) {
+                ok = 0;
+                write_failed = 1;
+            }
+        }
+    }
+#ifdef GTFS_HAVE_ZLIB
+    else if (ok) {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        ok = inflateInit2(&zs, -MAX_WBITS) == Z_OK;
+        int status = Z_OK;
+        while (ok && status != Z_STREAM_END) {
+            if (zs.avail_in == 0) {
+                if (remaining == 0) {
+                    ok = 0;  // Truncated
+                    break;
+                }
+                size_t n = remaining < ZIP_CHUNK ? (size_t)remaining : ZIP_CHUNK;
+                if (fread(in, 1, n, stream->archive) != n) {
+                    ok = 0;
+                    break;
+                }
+                remaining -= n;
+                zs.next_in = in;
+                zs.avail_in = (uInt)n;
+            }
+            zs.next_out = out;
+            zs.avail_out = ZIP_CHUNK;
+            status = inflate(&zs, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END) {
+                ok = 0;
+                break;
+            }
+            size_t have = ZIP_CHUNK - zs.avail_out;
+            crc = zip_crc32(crc, out, have);
+            produced += have;
+            if (have > 0 && write_all(stream->write_fd, out, have) != 0) {
+                ok = 0;
+                write_failed = 1;
+            }
+        }
+        inflateEnd(&zs);
+    }
+#endif
+
+    if (ok && (produced != entry->size || crc != entry->crc)) {
+        ok = 0;
+    }
+    if (!ok && !write_failed) {
+        fprintf(stderr, "Error: Could not inflate %s (corrupt or truncated archive)\n", stream->name);
+        fflush(stderr);
+    }
+    stream->status = ok ? 0 : -1;
+#ifdef _WIN32
+    _close(stream->write_fd);
+#else
+    close(stream->write_fd);
+#endif
+    stream->write_fd = -1;
+    free(in);
+    free(out);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI stream_thread(LPVOID arg) {
+    run_stream((ZipStream*)arg);
+    return 0;
+}
+#else
+static void* stream_thread(void* arg) {
+    run_stream((ZipStream*)arg);
+    return NULL;
+}
+#endif
+
+int zip_member_size(const char* archive, const char* member, uint64_t* size) {
+    FILE* fp = fopen(archive, "rb");
+    if (!fp) {
+        return -1;
+    }
+    ZipEntry entry;
+    int found = find_member(fp, member, &entry);
+    fclose(fp);
+    if (found != 1) {
+        return -1;
+    }
+    *size = entry.size;
+    return 0;
+}
+
+ZipStream* zip_stream_open(const char* archive, const char* member) {
+    FILE* fp = fopen(archive, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    ZipStream* stream = calloc(1, sizeof(ZipStream));
+    size_t name_size = strlen(archive) + strlen(member) + 2;
+    char* name = malloc(name_size);
+    if (!stream || !name) {
+        fprintf(stderr, "Error: Out of memory opening %s\n", archive);
+        fflush(stderr);
+        free(stream);
+        free(name);
+        fclose(fp);
+        return NULL;
+    }
+    snprintf(name, name_size, "%s/%s", archive, member);
+    stream->archive = fp;
+    stream->name = name;
+    stream->write_fd = -1;
+
+    int found = find_member(fp, member, &stream->entry);
+    const ZipEntry* entry = &stream->entry;
+    unsigned char local[30];
+    const char* problem = NULL;
+    if (found < 0) {
+        problem = "not a readable zip archive";
+    } else if (found == 0) {
+        zip_stream_close(stream);
+        return NULL;
+    } else if (entry->flags & 1) {
+        problem = "encrypted members are not supported";
+#ifdef GTFS_HAVE_ZLIB
+    } else if (entry->method != 0 && entry->method != 8) {
+#else
+    } else if (entry->method != 0) {
+#endif
+        problem = "unsupported compression method";
+    } else if (read_at(fp, entry->local_offset, local, sizeof(local)) != 0 || rd32(local) != SIG_LOCAL) {
+        problem = "bad local header";
+    }
+    if (problem) {
+        fprintf(stderr, "Error: Could not read %s: %s\n", name, problem);
+        fflush(stderr);
+        zip_stream_close(stream);
+        return NULL;
+    }
+    stream->data_offset = entry->local_offset + 30 + rd16(local + 26) + rd16(local + 28);
+
+    int fds[2];
+#ifdef _WIN32
+    int piped = _pipe(fds, ZIP_PIPE_SIZE, _O_BINARY | _O_NOINHERIT) == 0;
+#else
+    int piped = pipe(fds) == 0;
+    if (piped) {
+        // Child processes must not hold the write end open
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#ifdef F_SETPIPE_SZ
+        fcntl(fds[1], F_SETPIPE_SZ, ZIP_PIPE_SIZE);
+#endif
+    }
+#endif
+    if (!piped) {
+        fprintf(stderr, "Error: Could not create a pipe for %s\n", name);
+        fflush(stderr);
+        zip_stream_close(stream);
+        return NULL;
+    }
+    stream->write_fd = fds[1];
+#ifdef _WIN32
+    stream->reader = _fdopen(fds[0], "rb");
+#else
+    stream->reader = fdopen(fds[0], "rb");
+#endif
+    if (!stream->reader) {
+#ifdef _WIN32
+        _close(fds[0]);
+#else
+        close(fds[0]);
+#endif
+        zip_stream_close(stream);
+        return NULL;
+    }
+
+#ifdef _WIN32
+    stream->thread = CreateThread(NULL, 0, stream_thread, stream, 0, NULL);
+    stream->started = stream->thread != NULL;
+#else
+    stream->started = pthread_create(&stream->thread, NULL, stream_thread, stream) == 0;
+#endif
+    if (!stream->started) {
+        fprintf(stderr, "Error: Could not start a thread for %s\n", name);
+        fflush(stderr);
+        zip_stream_close(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+FILE* zip_stream_file(ZipStream* stream) {
+    return stream->reader;
+}
+
+int zip_stream_wait(ZipStream* stream) {
+    if (stream->started) {
+#ifdef _WIN32
+        WaitForSingleObject(stream->thread, INFINITE);
+        CloseHandle(stream->thread);
+#else
+        pthread_join(stream->thread, NULL);
+#endif
+        stream->started = 0;
+        return stream->status;
+    }
+    return stream->reader ? stream->status : -1;
+}
+
+int zip_stream_close(ZipStream* stream) {
+    if (!stream) {
+        return -1;
+    }
+    // Closing the read end first stops a thread blocked on a full pipe
+    if (stream->reader) fclose(stream->reader);
+    int status = zip_stream_wait(stream);
+    if (stream->write_fd >= 0) {
+#ifdef _WIN32
+        _close(stream->write_fd);
+#else
+        close(stream->write_fd);
+#endif
+    }
+    if (stream->archive) fclose(stream->archive);
+    free(stream->name);
+    free(stream);
+    return status;
+}
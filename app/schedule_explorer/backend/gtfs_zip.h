@@ -0,0 +1,50 @@
+#ifndef GTFS_ZIP_H
+#define GTFS_ZIP_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Reading GTFS tables straight from the downloaded zip archive.
+//
+// A member is inflated on its own thread into a pipe, and the caller reads
+// the other end as an ordinary FILE*. The pipe is the bounded buffer
+// between the two: decompression runs ahead of parsing by at most its size,
+// and nothing is extracted to disk. Stored and deflated members are
+// supported, as are zip64 archives. Built without zlib (GTFS_HAVE_ZLIB
+// unset), only stored members can be read.
+//
+// Paths name a member as "<archive>.zip/<member>" (either path separator).
+// A member is found by its exact name or, for archives with a top-level
+// folder, by its name inside any folder.
+
+typedef struct ZipStream ZipStream;
+
+// Split "<archive>.zip/<member>" into archive and member. A path ending in
+// ".zip" names default_member. Returns 0 when path is inside a zip archive,
+// -1 otherwise.
+int zip_split_path(const char* path, const char* default_member,
+                   char* archive, size_t archive_size, const char** member);
+
+// Uncompressed size of a member, read from the central directory. Returns 0
+// on success, -1 when the archive or the member cannot be found.
+int zip_member_size(const char* archive, const char* member, uint64_t* size);
+
+// Start inflating a member. Returns NULL when the archive or the member does
+// not exist (silently, like fopen) or cannot be read (with an error).
+ZipStream* zip_stream_open(const char* archive, const char* member);
+
+// Read end of the stream. Owned by the stream.
+FILE* zip_stream_file(ZipStream* stream);
+
+
+// Wait for the inflate thread, once the reader has seen the end of the
+// file. Returns 0 when the whole member was inflated and its CRC matched,
+// -1 when the data read is incomplete or corrupt.
+int zip_stream_wait(ZipStream* stream);
+
+// Close the stream, stopping the inflate thread if the member was not read
+// to the end. Returns the result of zip_stream_wait.
+int zip_stream_close(ZipStream* stream);
+
+#endif // GTFS_ZIP_H
@@ -9,10 +9,12 @@ import logging
 import sys
 import logging.config
 import json
+import asyncio
 from mobility_db_api import MobilityAPI
 import time
 from zoneinfo import ZoneInfo
 from contextlib import asynccontextmanager
+from enum import Enum
 
 from .models import (
     RouteResponse,
@@ -33,8 +35,19 @@ from .models import (
     RouteColors,
     LineInfo,
     BoundingBox,
+    Journey,
+    JourneyLeg,
+    JourneyResponse,
+    IsochroneStop,
+    IsochroneCell,
+    IsochroneResponse,
+    ScheduledVehicle,
+    ScheduledVehiclesResponse,
 )
 from .gtfs_loader import FlixbusFeed, load_feed
+from .feed_registry import FeedRegistry, load_measured
+from .precache_scheduler import PrecacheScheduler
+from .native_timetable import format_gtfs_time
 
 # Configure download directory - hardcoded to project root/downloads
 DOWNLOAD_DIR = FilePath(os.environ["PROJECT_ROOT"]) / "downloads"
@@ -68,11 +81,44 @@ async def health():
     return {"status": "ok", "timestamp": datetime.now().isoformat()}
 
 # Global variables
+# Feed of the provider the current request is for; every loaded feed stays in
+# `feeds` until evicted, so switching back to it does not reload it
 feed: Optional[FlixbusFeed] = None
 current_provider: Optional[str] = None
+feeds = FeedRegistry.from_env()
+# Converts the stop times of downloaded feeds in the background
+precache = PrecacheScheduler.from_env()
 available_providers: List[Provider] = []
 logger = logging.getLogger("schedule_explorer.backend")
 db: Optional[MobilityAPI] = None
+# Providers being loaded -> latest gtfs_precache progress event
+# (see gtfs_loader.handle_precache_output)
+loading_status: Dict[str, Dict] = {}
+
+
+class ProviderState(Enum):
+    """Outcome of ensure_provider_loaded"""
+
+    READY = "ready"
+    LOADING = "loading"  # Another provider is being loaded, retry shortly
+    NEEDS_DOWNLOAD = "needs_download"  # Known to MobilityDB but not downloaded
+    DOWNLOAD_FAILED = "download_failed"
+    UNAVAILABLE = "unavailable"  # Unknown provider, or its data could not be loaded
+
+
+def describe_loading_status(status: Dict) -> str:
+    """Human readable summary of a gtfs_precache progress event."""
+    phase = status.get("phase", "starting")
+    rows = status.get("rows") or 0
+    total = status.get("total_rows") or 0
+    parts = [phase]
+    if total:
+        parts.append(f"{rows / total:.0%} of {total} stop times")
+    elif rows:
+        parts.append(f"{rows} stop times")
+    if status.get("eta_s") is not None:
+        parts.append(f"about {status['eta_s']:.0f}s left")
+    return ", ".join(parts)
 
 
 @asynccontextmanager
@@ -133,7 +179,7 @@ async def check_provider_availability(
 
 async def ensure_provider_loaded(
     provider_id: str, auto_download: bool = False
-) -> Tuple[bool, str, Optional[Provider]]:
+) -> Tuple[ProviderState, str, Optional[Provider]]:
     """Ensure provider is loaded, loading or downloading it if available.
 
     Args:
@@ -141,8 +187,8 @@ async def ensure_provider_loaded(
         auto_download: If True, will attempt to download the provider if not available locally
 
     Returns:
-        Tuple[bool, str, Optional[Provider]]:
-            - is_ready: True if provider is loaded and ready
+        Tuple[ProviderState, str, Optional[Provider]]:
+            - state: ProviderState.READY if provider is loaded and ready
             - message: Status message explaining the current state
             - provider: Provider object if found, None otherwise
     """
@@ -153,7 +199,7 @@ async def ensure_provider_loaded(
 
     if not is_local and not can_download:
         return (
-            False,
+            ProviderState.UNAVAILABLE,
             f"Provider {provider_id} is not available. Please check the provider ID or use GET /api/providers/be to list available providers.",
             None,
         )
@@ -161,7 +207,7 @@ async def ensure_provider_loaded(
     if not is_local and can_download:
         if not auto_download:
             return (
-                False,
+                ProviderState.NEEDS_DOWNLOAD,
                 f"Provider {provider_id} needs to be downloaded first. Add download=true to your request to automatically download it.",
                 None,
             )
@@ -171,7 +217,11 @@ async def ensure_provider_loaded(
             logger.info(f"Downloading provider {provider_id}...")
             result = db.download_latest_dataset(provider_id, str(DOWNLOAD_DIR))
             if not result:
-                return False, f"Failed to download provider {provider_id}", None
+                return (
+                    ProviderState.DOWNLOAD_FAILED,
+                    f"Failed to download provider {provider_id}",
+                    None,
+                )
 
             # Refresh available providers after download
             available_providers = find_gtfs_directories()
@@ -182,7 +232,7 @@ async def ensure_provider_loaded(
             )
             if not is_local:
                 return (
-                    False,
+                    ProviderState.DOWNLOAD_FAILED,
                     f"Provider {provider_id} download succeeded but provider not found locally",
                     None,
                 )
@@ -190,18 +240,41 @@ async def ensure_provider_loaded(
             logger.info(f"Successfully downloaded provider {provider_id}")
         except Exception as e:
             logger.error(f"Error downloading provider {provider_id}: {str(e)}")
-            return False, f"Error downloading provider {provider_id}: {str(e)}", None
+            return (
+                ProviderState.DOWNLOAD_FAILED,
+                f"Error downloading provider {provider_id}: {str(e)}",
+                None,
+            )
 
     # At this point, provider exists locally
     if feed is not None and current_provider == provider.id:
-        return True, "Provider already loaded", provider
+        return ProviderState.READY, "Provider already loaded", provider
+
+    resident = feeds.get(resident_key(provider))
+    if resident is not None:
+        feed = resident
+        current_provider = provider.id
+        return ProviderState.READY, "Provider already loaded", provider
+
+    # Only one feed is loaded at a time
+    if loading_status:
+        loading_id, status = next(iter(loading_status.items()))
+        return (
+            ProviderState.LOADING,
+            f"Provider {loading_id} is being loaded ({describe_loading_status(status)}), please retry shortly",
+            provider,
+        )
 
     # Try to load the provider
     try:
         # Find the provider's dataset directory from metadata
         metadata_file = DOWNLOAD_DIR / "datasets_metadata.json"
         if not metadata_file.exists():
-            return False, f"No metadata found for provider {provider_id}", None
+            return (
+                ProviderState.UNAVAILABLE,
+                f"No metadata found for provider {provider_id}",
+                None,
+            )
 
         with open(metadata_file, "r") as f:
             metadata = json.load(f)
@@ -215,7 +288,11 @@ async def ensure_provider_loaded(
                     break
 
             if not dataset_info:
-                return False, f"No dataset info found for provider {provider_id}", None
+                return (
+                    ProviderState.UNAVAILABLE,
+                    f"No dataset info found for provider {provider_id}",
+                    None,
+                )
 
             dataset_dir = FilePath(dataset_info["download_path"])
 
@@ -227,21 +304,54 @@ async def ensure_provider_loaded(
             all((dataset_dir / file).exists() for file in required_files)
             and any((dataset_dir / file).exists() for file in calendar_files)
         ):
-            return False, f"GTFS data not found for provider {provider_id}", None
+            return (
+                ProviderState.UNAVAILABLE,
+                f"GTFS data not found for provider {provider_id}",
+                None,
+            )
 
         logger.info(f"Loading GTFS data for provider {provider_id}...")
-        feed = load_feed(str(dataset_dir))
+
+        def record_progress(event: Dict) -> None:
+            loading_status[provider.id] = event
+
+        # Load in a worker thread so requests arriving meanwhile get the
+        # loading status instead of waiting
+        loading_status[provider.id] = {"phase": "starting"}
+        try:
+            # A background conversion of this feed goes first and is waited
+            # for; loading then finds its stop times converted
+            if precache.prioritize(dataset_dir):
+                await asyncio.to_thread(
+                    precache.wait, dataset_dir, progress_fn=record_progress
+                )
+            loaded, load_seconds, heap_bytes = await asyncio.to_thread(
+                load_measured, load_feed, str(dataset_dir), progress_fn=record_progress
+            )
+        finally:
+            loading_status.pop(provider.id, None)
+        feeds.put(resident_key(provider), loaded, load_seconds, heap_bytes)
+        feed = loaded
         current_provider = provider.id
         logger.info(f"Successfully loaded GTFS data for provider {provider_id}")
-        return True, f"Loaded GTFS data for {provider_id}", provider
+        return ProviderState.READY, f"Loaded GTFS data for {provider_id}", provider
     except Exception as e:
         logger.error(f"Error loading provider {provider_id}: {str(e)}")
-        return False, f"Error loading provider {provider_id}: {str(e)}", None
+        return (
+            ProviderState.UNAVAILABLE,
+            f"Error loading provider {provider_id}: {str(e)}",
+            None,
+        )
+
+
+def resident_key(provider: Provider) -> str:
+    """Registry key of a provider's feed; a new dataset is a new feed."""
+    return f"{provider.id}/{provider.latest_dataset.id}"
 
 
 async def handle_provider_request(
     provider_id: str, request: Request
-) -> Tuple[bool, str, Optional[Provider]]:
+) -> Tuple[ProviderState, str, Optional[Provider]]:
     """Handle a request that requires a specific provider, automatically loading or downloading if needed.
 
     Args:
@@ -255,19 +365,17 @@ async def handle_provider_request(
     auto_download = request.query_params.get("download", "").lower() == "true"
 
     # Try to ensure the provider is loaded
-    is_ready, message, provider = await ensure_provider_loaded(
+    state, message, provider = await ensure_provider_loaded(
         provider_id, auto_download
     )
 
-    if not is_ready:
+    if state is not ProviderState.READY:
         raise HTTPException(
-            status_code=(
-                409 if "being loaded" in message or "download" in message else 404
-            ),
+            status_code=404 if state is ProviderState.UNAVAILABLE else 409,
             detail=message,
         )
 
-    return is_ready, message, provider
+    return state, message, provider
 
 
 def find_gtfs_directories() -> List[Provider]:
@@ -512,6 +620,10 @@ async def download_gtfs(provider_id: str):
         result = db.download_latest_dataset(provider_id, str(DOWNLOAD_DIR))
 
         if result:
+            # Convert the new dataset in the background
+            global available_providers
+            available_providers = find_gtfs_directories()
+            schedule_precache()
             return {
                 "status": "success",
                 "message": f"Downloaded GTFS data for {provider_id}",
@@ -534,20 +646,65 @@ async def get_providers():
     return [p.id for p in providers]
 
 
+@app.get("/providers/resident", response_model=List[Dict], tags=["providers"])
+async def get_resident_providers():
+    """Feeds currently held in memory, most recently used first"""
+    return feeds.status()
+
+
+@app.get("/providers/precache", response_model=List[Dict], tags=["providers"])
+async def get_precache_status():
+    """Background stop times conversions, with their latest progress event"""
+    return precache.status()
+
+
+def latest_dataset_dirs() -> List[FilePath]:
+    """GTFS directories of the latest dataset of every provider."""
+    metadata_file = DOWNLOAD_DIR / "datasets_metadata.json"
+    if not metadata_file.exists():
+        return []
+    with open(metadata_file, "r") as f:
+        metadata = json.load(f)
+    latest = {
+        (p.raw_id, p.latest_dataset.id) for p in available_providers
+    }
+    return [
+        FilePath(info["download_path"])
+        for info in metadata.values()
+        if (info.get("provider_id"), info.get("dataset_id")) in latest
+        and info.get("download_path")
+    ]
+
+
+def schedule_precache() -> None:
+    """Queue the conversion of every feed whose stop times are out of date."""
+    if not precache.start():
+        return
+    try:
+        for dataset_dir in latest_dataset_dirs():
+            precache.submit(dataset_dir)
+    except Exception as e:
+        logger.error(f"Error scheduling precache: {str(e)}")
+
+
 @app.on_event("startup")
 async def startup_event():
     """Load available GTFS providers on startup"""
     global available_providers, db
     available_providers = find_gtfs_directories()
     db = MobilityAPI(data_dir=DOWNLOAD_DIR)
+    schedule_precache()
+
+
+@app.on_event("shutdown")
+async def shutdown_event():
+    precache.close()
 
 
 @app.post("/provider/{provider_id}", tags=["providers"])
 async def set_provider(provider_id: str):
     """Set the current GTFS provider and load its data"""
-    global feed, current_provider, available_providers
-
-    # Get provider info
+    # Only providers already downloaded can be selected here
     provider = get_provider_by_id(provider_id)
     if not provider:
         raise HTTPException(
@@ -555,70 +712,15 @@ async def set_provider(provider_id: str):
             detail=f"Provider {provider_id} not found",
         )
 
-    # If the requested provider is already loaded, return early
-    if feed is not None and current_provider == provider.raw_id:
-        logger.info(f"Provider {provider.raw_id} already loaded, skipping reload")
-        return {
-            "status": "success",
-            "message": f"Provider {provider.raw_id} already loaded",
-        }
-
-    try:
-        logger.info(f"Loading GTFS data for provider {provider.raw_id}")
-
-        # Find the provider's dataset directory
-        metadata_file = DOWNLOAD_DIR / "datasets_metadata.json"
-        if not metadata_file.exists():
-            raise HTTPException(
-                status_code=404,
-                detail=f"No metadata found for provider {provider.raw_id}",
-            )
-
-        with open(metadata_file, "r") as f:
-            metadata = json.load(f)
-
-            # Find the dataset info that matches both the provider ID and the dataset ID
-            dataset_info = None
-            for info in metadata.values():
-                if (
-                    info.get("provider_id") == provider.raw_id
-                    and info.get("dataset_id") == provider.latest_dataset.id
-                ):
-                    dataset_info = info
-                    break
-
-            if not dataset_info:
-                raise HTTPException(
-                    status_code=404,
-                    detail=f"No dataset info found for provider {provider.raw_id}",
-                )
-
-            dataset_dir = FilePath(dataset_info["download_path"])
-
-        # Check if the dataset directory exists and contains GTFS files
-        required_files = ["stops.txt", "routes.txt", "trips.txt", "stop_times.txt"]
-        calendar_files = ["calendar.txt", "calendar_dates.txt"]
-
-        if not dataset_dir.exists() or not (
-            all((dataset_dir / file).exists() for file in required_files)
-            and any((dataset_dir / file).exists() for file in calendar_files)
-        ):
-            raise HTTPException(
-                status_code=404,
-                detail=f"GTFS data not found for provider {provider.raw_id}",
-            )
-
-        feed = load_feed(str(dataset_dir))
-        current_provider = provider.raw_id
-        return {
-            "status": "success",
-            "message": f"Loaded GTFS data for {provider.raw_id}",
-        }
-    except HTTPException:
-        raise
-    except Exception as e:
-        logger.error(f"Error loading provider {provider.raw_id}: {str(e)}")
-        raise HTTPException(status_code=500, detail=str(e))
+    # Same path as the provider endpoints, so a load waits for a background
+    # conversion of the dataset instead of racing it
+    state, message, provider = await ensure_provider_loaded(provider_id)
+    if state is not ProviderState.READY:
+        raise HTTPException(
+            status_code=409 if state is ProviderState.LOADING else 404,
+            detail=message,
+        )
+    return {"status": "success", "message": message}
 
 
 @app.get("/api/{provider_id}/stations/search", response_model=List[StationResponse])
@@ -651,10 +753,10 @@ async def search_stations(
     """Search for stations by name or stop_id"""
     if provider_id:
         # Check provider availability and load if needed
-        is_ready, message, provider = await ensure_provider_loaded(provider_id)
-        if not is_ready:
+        state, message, provider = await ensure_provider_loaded(provider_id)
+        if state is not ProviderState.READY:
             raise HTTPException(
-                status_code=409 if "being loaded" in message else 404,
+                status_code=409 if state is ProviderState.LOADING else 404,
                 detail=message,
             )
 
@@ -770,10 +872,10 @@ async def get_routes(
     async with check_client_connected(request, "route search"):
         if provider_id:
             # Check provider availability and load if needed
-            is_ready, message, provider = await ensure_provider_loaded(provider_id)
-            if not is_ready:
+            state, message, provider = await ensure_provider_loaded(provider_id)
+            if state is not ProviderState.READY:
                 raise HTTPException(
-                    status_code=409 if "being loaded" in message else 404,
+                    status_code=409 if state is ProviderState.LOADING else 404,
                     detail=message,
                 )
 
@@ -797,25 +899,21 @@ async def get_routes(
                     status_code=404, detail=f"Station {station_id} not found"
                 )
 
-        # Find routes for all combinations
-        all_routes = []
-        for from_id in from_stations:
-            for to_id in to_stations:
-                async with check_client_connected(
-                    request, f"finding trips between {from_id} and {to_id}"
-                ):
-                    routes = feed.find_trips_between_stations(from_id, to_id)
-                    all_routes.extend(routes)
-
-        # Filter by date if provided
+        target_date = None
         if date:
             try:
                 target_date = datetime.strptime(date, "%Y-%m-%d")
-                day_name = target_date.strftime("%A").lower()
-                all_routes = [r for r in all_routes if day_name in r.service_days]
             except ValueError:
                 raise HTTPException(status_code=400, detail="Invalid date format")
 
+        # Find trips for all station combinations, filtered by date if provided
+        async with check_client_connected(
+            request, f"finding trips between {from_station} and {to_station}"
+        ):
+            all_routes = feed.find_trips_between(
+                from_stations, to_stations, target_date
+            )
+
         # Convert to response format
         route_responses = []
         for route in all_routes:
@@ -897,6 +995,314 @@ async def get_routes(
         return RouteResponse(routes=route_responses, total_routes=len(route_responses))
 
 
+@app.get("/api/{provider_id}/journeys", response_model=JourneyResponse)
+async def get_journeys(
+    request: Request,
+    provider_id: str = Path(...),
+    from_station: str = Query(..., description="Departure station ID(s), comma separated"),
+    to_station: str = Query(..., description="Destination station ID(s), comma separated"),
+    date: Optional[str] = Query(None, description="Date in YYYY-MM-DD format"),
+    departure_time: Optional[str] = Query(
+        None, description="Earliest departure in HH:MM format (default: now)"
+    ),
+    window_minutes: int = Query(
+        60, ge=0, le=240, description="Length of the departure window in minutes"
+    ),
+    max_transfers: int = Query(3, ge=0, le=8, description="Maximum number of transfers"),
+    language: Optional[str] = Query(
+        "default", description="Language code (e.g., 'fr', 'nl') or 'default'"
+    ),
+):
+    """Plan journeys with transfers between two stations.
+
+    Returns every journey that is not beaten on departure time, arrival time
+    and number of transfers at once, for departures within the window.
+    """
+    async with check_client_connected(request, "journey planning"):
+        await handle_provider_request(provider_id, request)
+
+        if not feed:
+            raise HTTPException(status_code=503, detail="GTFS data not loaded")
+        if feed.native is None:
+            raise HTTPException(
+                status_code=501,
+                detail="Journey planning needs the native timetable library",
+            )
+
+        from_stations = [s.strip() for s in from_station.split(",")]
+        to_stations = [s.strip() for s in to_station.split(",")]
+        for station_id in from_stations + to_stations:
+            if station_id not in feed.stops:
+                raise HTTPException(
+                    status_code=404, detail=f"Station {station_id} not found"
+                )
+
+        # Default to the current time in the feed's timezone
+        agency_timezone = None
+        if feed.agencies:
+            agency_timezone = next(iter(feed.agencies.values())).agency_timezone
+        now = (
+            datetime.now(ZoneInfo(agency_timezone))
+            if agency_timezone
+            else datetime.now()
+        )
+
+        try:
+            target_date = (
+                datetime.strptime(date, "%Y-%m-%d") if date else now.replace(tzinfo=None)
+            )
+        except ValueError:
+            raise HTTPException(status_code=400, detail="Invalid date format")
+        try:
+            start = (
+                datetime.strptime(departure_time, "%H:%M").time()
+                if departure_time
+                else now.time()
+            )
+        except ValueError:
+            raise HTTPException(
+                status_code=400, detail="Invalid time format. Use HH:MM"
+            )
+        departure_min = start.hour * 3600 + start.minute * 60
+        departure_max = departure_min + window_minutes * 60
+
+        journeys = feed.native.plan_journeys(
+            from_stations,
+            to_stations,
+            target_date,
+            departure_min,
+            departure_max,
+            max_transfers,
+        )
+
+        base_routes = {}
+        for route in feed.routes:
+            base_routes.setdefault(route.route_id, route)
+
+        def make_stop(stop_id: str, arrival: str, departure: str) -> Stop:
+            stop = feed.stops[stop_id]
+            return Stop(
+                id=stop_id,
+                name=(
+                    feed.get_stop_name(stop_id, language)
+                    if language != "default"
+                    else stop.name
+                ),
+                location=Location(lat=stop.lat, lon=stop.lon),
+                arrival_time=arrival,
+                departure_time=departure,
+            )
+
+        journey_responses = []
+        for journey in journeys:
+            legs = []
+            for leg in journey.legs:
+                departure = format_gtfs_time(leg.departure)
+                arrival = format_gtfs_time(leg.arrival)
+                duration = (leg.arrival - leg.departure) // 60
+                if leg.mode == "walk":
+                    legs.append(
+                        JourneyLeg(
+                            mode="walk",
+                            departure_time=departure,
+                            arrival_time=arrival,
+                            duration_minutes=duration,
+                            stops=[
+                                make_stop(leg.from_stop_id, departure, departure),
+                                make_stop(leg.to_stop_id, arrival, arrival),
+                            ],
+                        )
+                    )
+                    continue
+
+                base_route = base_routes.get(leg.route_id)
+                color = text_color = route_name = None
+                if base_route is not None:
+                    if isinstance(base_route.route_name, str):
+                        route_name = base_route.route_name
+                    if base_route.color and not pd.isna(base_route.color):
+                        color = base_route.color
+                    if base_route.text_color and not pd.isna(base_route.text_color):
+                        text_color = base_route.text_color
+                legs.append(
+                    JourneyLeg(
+                        mode="transit",
+                        departure_time=departure,
+                        arrival_time=arrival,
+                        duration_minutes=duration,
+                        stops=[
+                            make_stop(stop_id, arr, dep)
+                            for stop_id, arr, dep in leg.stop_times
+                            if stop_id in feed.stops
+                        ],
+                        route_id=leg.route_id,
+                        trip_id=leg.trip_id,
+                        line_number=base_route.short_name if base_route else None,
+                        route_name=route_name,
+                        headsign=leg.headsign,
+                        color=color,
+                        text_color=text_color,
+                    )
+                )
+            journey_responses.append(
+                Journey(
+                    departure_time=format_gtfs_time(journey.departure),
+                    arrival_time=format_gtfs_time(journey.arrival),
+                    duration_minutes=(journey.arrival - journey.departure) // 60,
+                    transfers=journey.transfers,
+                    legs=legs,
+                )
+            )
+
+        return JourneyResponse(
+            journeys=journey_responses, total_journeys=len(journey_responses)
+        )
+
+
+@app.get("/api/{provider_id}/isochrone", response_model=IsochroneResponse)
+async def get_isochrone(
+    request: Request,
+    provider_id: str = Path(...),
+    stop_id: str = Query(..., description="Origin stop or station ID"),
+    date: Optional[str] = Query(None, description="Date in YYYY-MM-DD format"),
+    departure_time: Optional[str] = Query(
+        None, description="First departure in HH:MM format (default: now)"
+    ),
+    max_minutes: int = Query(60, ge=1, le=240, description="Maximum travel time"),
+    window_minutes: int = Query(
+        0, ge=0, le=120, description="Also evaluate later departures within this window"
+    ),
+    step_minutes: int = Query(
+        10, ge=1, le=60, description="Minutes between evaluated departures"
+    ),
+    grid: Optional[str] = Query(
+        None, description="Rasterize onto 'hex' or 'square' cells for map display"
+    ),
+    cell_size: int = Query(
+        500, ge=200, le=5000, description="Metres between cell centres"
+    ),
+    language: Optional[str] = Query(
+        "default", description="Language code (e.g., 'fr', 'nl') or 'default'"
+    ),
+):
+    """Earliest arrival at every stop reachable from a stop.
+
+    With a departure window, every step_minutes departure is evaluated (in
+    parallel) and stops report the median and shortest travel time, so the
+    result does not hinge on just missing one connection.
+    """
+    async with check_client_connected(request, f"isochrone from {stop_id}"):
+        await handle_provider_request(provider_id, request)
+
+        if not feed:
+            raise HTTPException(status_code=503, detail="GTFS data not loaded")
+        if feed.native is None:
+            raise HTTPException(
+                status_code=501,
+                detail="Isochrones need the native timetable library",
+            )
+        if grid not in (None, "hex", "square"):
+            raise HTTPException(
+                status_code=400, detail="grid must be 'hex' or 'square'"
+            )
+        if stop_id not in feed.stops:
+            raise HTTPException(status_code=404, detail=f"Stop {stop_id} not found")
+
+        # A station departs from all of its platforms
+        origin_ids = [stop_id] + [
+            child_id
+            for child_id, stop in feed.stops.items()
+            if getattr(stop, "parent_station", None) == stop_id
+        ]
+
+        agency_timezone = None
+        if feed.agencies:
+            agency_timezone = next(iter(feed.agencies.values())).agency_timezone
+        now = (
+            datetime.now(ZoneInfo(agency_timezone))
+            if agency_timezone
+            else datetime.now()
+        )
+        try:
+            target_date = (
+                datetime.strptime(date, "%Y-%m-%d") if date else now.replace(tzinfo=None)
+            )
+        except ValueError:
+            raise HTTPException(status_code=400, detail="Invalid date format")
+        try:
+            start = (
+                datetime.strptime(departure_time, "%H:%M").time()
+                if departure_time
+                else now.time()
+            )
+        except ValueError:
+            raise HTTPException(
+                status_code=400, detail="Invalid time format. Use HH:MM"
+            )
+
+        first_departure = start.hour * 3600 + start.minute * 60
+        departures = list(
+            range(
+                first_departure,
+                first_departure + window_minutes * 60 + 1,
+                step_minutes * 60,
+            )
+        )
+        reach, cells = feed.native.isochrone(
+            origin_ids,
+            target_date,
+            departures,
+            max_minutes * 60,
+            cell_size=cell_size if grid else None,
+            hexagonal=grid == "hex",
+        )
+
+        stops = []
+        for reached_id, r in reach.items():
+            stop = feed.stops.get(reached_id)
+            if not stop:
+                continue
+            stops.append(
+                IsochroneStop(
+                    id=reached_id,
+                    name=(
+                        feed.get_stop_name(reached_id, language)
+                        if language != "default"
+                        else stop.name
+                    ),
+                    location=Location(lat=stop.lat, lon=stop.lon),
+                    arrival_time=(
+                        format_gtfs_time(r.first_arrival)
+                        if r.first_arrival is not None
+                        else None
+                    ),
+                    travel_minutes=r.median_travel // 60,
+                    min_travel_minutes=r.min_travel // 60,
+                )
+            )
+        stops.sort(key=lambda s: (s.travel_minutes, s.id))
+
+        return IsochroneResponse(
+            stop_id=stop_id,
+            date=target_date.strftime("%Y-%m-%d"),
+            departure_times=[format_gtfs_time(d)[:5] for d in departures],
+            max_minutes=max_minutes,
+            stops=stops,
+            grid=grid,
+            cell_size=cell_size if grid else None,
+            cells=(
+                [
+                    IsochroneCell(
+                        lat=c.lat, lon=c.lon, travel_minutes=c.travel_time // 60
+                    )
+                    for c in cells
+                ]
+                if grid
+                else None
+            ),
+        )
+
+
 @app.get(
     "/api/{provider_id}/stations/{station_id}/routes", response_model=List[RouteInfo]
 )
@@ -932,10 +1338,10 @@ async def get_station_routes(
     ):
         if provider_id:
             # Check provider availability and load if needed
-            is_ready, message, provider = await ensure_provider_loaded(provider_id)
-            if not is_ready:
+            state, message, provider = await ensure_provider_loaded(provider_id)
+            if state is not ProviderState.READY:
                 raise HTTPException(
-                    status_code=409 if "being loaded" in message else 404,
+                    status_code=409 if state is ProviderState.LOADING else 404,
                     detail=message,
                 )
 
@@ -1101,10 +1507,10 @@ async def get_destinations(
     ):
         if provider_id:
             # Check provider availability and load if needed
-            is_ready, message, provider = await ensure_provider_loaded(provider_id)
-            if not is_ready:
+            state, message, provider = await ensure_provider_loaded(provider_id)
+            if state is not ProviderState.READY:
                 raise HTTPException(
-                    status_code=409 if "being loaded" in message else 404,
+                    status_code=409 if state is ProviderState.LOADING else 404,
                     detail=message,
                 )
 
@@ -1116,17 +1522,20 @@ async def get_destinations(
                 status_code=404, detail=f"Station {station_id} not found"
             )
 
-        # Find all routes that start from this station
-        destinations = set()
-        for route in feed.routes:
-            # Get all stops in this route
-            stops = route.get_stops_between(station_id, None)
+        if feed.native is not None:
+            destinations = feed.native.reachable_stops(station_id)
+        else:
+            # Find all routes that start from this station
+            destinations = set()
+            for route in feed.routes:
+                # Get all stops in this route
+                stops = route.get_stops_between(station_id, None)
 
-            # If this station is in the route
-            if stops and stops[0].stop.id == station_id:
-                # Add all subsequent stops as potential destinations
-                for stop in stops[1:]:
-                    destinations.add(stop.stop.id)
+                # If this station is in the route
+                if stops and stops[0].stop.id == station_id:
+                    # Add all subsequent stops as potential destinations
+                    for stop in stops[1:]:
+                        destinations.add(stop.stop.id)
 
         # Convert to response format
         return [
@@ -1183,10 +1592,10 @@ async def get_origins(
     ):
         if provider_id:
             # Check provider availability and load if needed
-            is_ready, message, provider = await ensure_provider_loaded(provider_id)
-            if not is_ready:
+            state, message, provider = await ensure_provider_loaded(provider_id)
+            if state is not ProviderState.READY:
                 raise HTTPException(
-                    status_code=409 if "being loaded" in message else 404,
+                    status_code=409 if state is ProviderState.LOADING else 404,
                     detail=message,
                 )
 
@@ -1198,17 +1607,20 @@ async def get_origins(
                 status_code=404, detail=f"Station {station_id} not found"
             )
 
-        # Find all routes that end at this station
-        origins = set()
-        for route in feed.routes:
-            # Get all stops in this route
-            stops = route.get_stops_between(None, station_id)
+        if feed.native is not None:
+            origins = feed.native.reachable_stops(station_id, upstream=True)
+        else:
+            # Find all routes that end at this station
+            origins = set()
+            for route in feed.routes:
+                # Get all stops in this route
+                stops = route.get_stops_between(None, station_id)
 
-            # If this station is in the route
-            if stops and stops[-1].stop.id == station_id:
-                # Add all previous stops as potential origins
-                for stop in stops[:-1]:
-                    origins.add(stop.stop.id)
+                # If this station is in the route
+                if stops and stops[-1].stop.id == station_id:
+                    # Add all previous stops as potential origins
+                    for stop in stops[:-1]:
+                        origins.add(stop.stop.id)
 
         # Convert to response format
         return [
@@ -1620,6 +2032,128 @@ async def delete_all_datasets():
         raise HTTPException(status_code=500, detail=str(e))
 
 
+@app.get(
+    "/api/{provider_id}/vehicles/scheduled", response_model=ScheduledVehiclesResponse
+)
+async def get_scheduled_vehicles(
+    request: Request,
+    provider_id: str = Path(...),
+    date: Optional[str] = Query(None, description="Date in YYYY-MM-DD format"),
+    time_of_day: Optional[str] = Query(
+        None,
+        alias="time",
+        description="Time in HH:MM or HH:MM:SS format (default: now)",
+    ),
+    min_lat: Optional[float] = Query(None, description="Minimum latitude of bounding box"),
+    min_lon: Optional[float] = Query(None, description="Minimum longitude of bounding box"),
+    max_lat: Optional[float] = Query(None, description="Maximum latitude of bounding box"),
+    max_lon: Optional[float] = Query(None, description="Maximum longitude of bounding box"),
+):
+    """Where every vehicle should be according to the timetable.
+
+    For providers without realtime positions: every trip running at the
+    given time (trips of the day before still running after midnight
+    included) is placed between its last and next stop, along its shape
+    when the feed has one. Poll it every few seconds to animate a map.
+    """
+    async with check_client_connected(request, "scheduled vehicles"):
+        await handle_provider_request(provider_id, request)
+
+        if not feed:
+            raise HTTPException(status_code=503, detail="GTFS data not loaded")
+        if feed.native is None:
+            raise HTTPException(
+                status_code=501,
+                detail="Scheduled vehicle positions need the native timetable library",
+            )
+
+        corners = (min_lat, min_lon, max_lat, max_lon)
+        bbox = None
+        if any(c is not None for c in corners):
+            if any(c is None for c in corners):
+                raise HTTPException(
+                    status_code=400,
+                    detail="min_lat, min_lon, max_lat and max_lon go together",
+                )
+            try:
+                bbox = BoundingBox(
+                    min_lat=min_lat, min_lon=min_lon, max_lat=max_lat, max_lon=max_lon
+                )
+            except ValueError as e:
+                raise HTTPException(status_code=400, detail=str(e))
+
+        agency_timezone = None
+        if feed.agencies:
+            agency_timezone = next(iter(feed.agencies.values())).agency_timezone
+        now = (
+            datetime.now(ZoneInfo(agency_timezone))
+            if agency_timezone
+            else datetime.now()
+        )
+        try:
+            target_date = (
+                datetime.strptime(date, "%Y-%m-%d") if date else now.replace(tzinfo=None)
+            )
+        except ValueError:
+            raise HTTPException(status_code=400, detail="Invalid date format")
+        if time_of_day:
+            try:
+                parts = [int(p) for p in time_of_day.split(":")]
+                if len(parts) not in (2, 3) or not (0 <= parts[0] < 48 and 0 <= parts[1] < 60):
+                    raise ValueError(time_of_day)
+            except ValueError:
+                raise HTTPException(
+                    status_code=400, detail="Invalid time format. Use HH:MM or HH:MM:SS"
+                )
+            seconds = parts[0] * 3600 + parts[1] * 60 + (parts[2] if len(parts) == 3 else 0)
+        else:
+            seconds = now.hour * 3600 + now.minute * 60 + now.second
+
+        vehicles = feed.native.scheduled_vehicles(
+            target_date,
+            seconds,
+            (bbox.min_lat, bbox.min_lon, bbox.max_lat, bbox.max_lon) if bbox else None,
+        )
+
+        base_routes = {}
+        for route in feed.routes:
+            base_routes.setdefault(route.route_id, route)
+
+        responses = []
+        for v in vehicles:
+            base_route = base_routes.get(v.route_id)
+            color = text_color = None
+            if base_route is not None:
+                if base_route.color and not pd.isna(base_route.color):
+                    color = base_route.color
+                if base_route.text_color and not pd.isna(base_route.text_color):
+                    text_color = base_route.text_color
+            responses.append(
+                ScheduledVehicle(
+                    trip_id=v.trip_id,
+                    route_id=v.route_id,
+                    line_number=base_route.short_name if base_route else None,
+                    headsign=v.headsign,
+                    direction_id=v.direction_id,
+                    location=Location(lat=v.lat, lon=v.lon),
+                    bearing=round(v.bearing, 1),
+                    from_stop_id=v.from_stop_id,
+                    to_stop_id=v.to_stop_id,
+                    progress=round(v.progress, 3),
+                    color=color,
+                    text_color=text_color,
+                )
+            )
+
+        return ScheduledVehiclesResponse(
+            date=target_date.strftime("%Y-%m-%d"),
+            time=format_gtfs_time(seconds),
+            bbox=bbox,
+            vehicles=responses,
+            total_vehicles=len(responses),
+        )
+
+
 @app.get(
     "/api/{provider_id}/stops/bbox",
     response_model=Union[List[StationResponse], Dict[str, int]],
@@ -1654,10 +2188,10 @@ async def get_stops_in_bbox(
             raise HTTPException(status_code=400, detail=str(e))
 
         # Check provider availability and load if needed
-        is_ready, message, provider = await ensure_provider_loaded(provider_id)
-        if not is_ready:
+        state, message, provider = await ensure_provider_loaded(provider_id)
+        if state is not ProviderState.READY:
             raise HTTPException(
-                status_code=409 if "being loaded" in message else 404,
+                status_code=409 if state is ProviderState.LOADING else 404,
                 detail=message,
             )
 
@@ -1824,10 +2358,10 @@ async def find_route_by_name(
         )
 
     # Check provider availability and load if needed
-    is_ready, message, provider = await ensure_provider_loaded(provider_id)
-    if not is_ready:
+    state, message, provider = await ensure_provider_loaded(provider_id)
+    if state is not ProviderState.READY:
         raise HTTPException(
-            status_code=409 if "being loaded" in message else 404,
+            status_code=409 if state is ProviderState.LOADING else 404,
             detail=message,
         )
 
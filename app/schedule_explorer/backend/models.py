@@ -163,6 +163,83 @@ class RouteResponse(BaseModel):
     total_routes: int
 
 
+class JourneyLeg(BaseModel):
+    mode: str  # "transit" or "walk"
+    departure_time: str
+    arrival_time: str
+    duration_minutes: int
+    stops: List[Stop]  # Boarding to alighting stop, or both ends of a walk
+    route_id: Optional[str] = None
+    trip_id: Optional[str] = None
+    line_number: Optional[str] = None
+    route_name: Optional[str] = None
+    headsign: Optional[str] = None
+    color: Optional[str] = None
+    text_color: Optional[str] = None
+
+
+class Journey(BaseModel):
+    departure_time: str
+    arrival_time: str
+    duration_minutes: int
+    transfers: int
+    legs: List[JourneyLeg]
+
+
+class JourneyResponse(BaseModel):
+    journeys: List[Journey]
+    total_journeys: int
+
+
+class IsochroneStop(BaseModel):
+    id: str
+    name: str
+    location: Location
+    arrival_time: Optional[str] = None  # For the first departure time
+    travel_minutes: int  # Median over the departure times
+    min_travel_minutes: int
+
+
+class IsochroneCell(BaseModel):
+    lat: float  # Cell centre
+    lon: float
+    travel_minutes: int
+
+
+class IsochroneResponse(BaseModel):
+    stop_id: str
+    date: str
+    departure_times: List[str]
+    max_minutes: int
+    stops: List[IsochroneStop]
+    grid: Optional[str] = None  # "hex" or "square" when cells are included
+    cell_size: Optional[int] = None  # Metres between cell centres
+    cells: Optional[List[IsochroneCell]] = None
+
+
+class ScheduledVehicle(BaseModel):
+    trip_id: str
+    route_id: str
+    line_number: Optional[str] = None
+    headsign: str
+    direction_id: Optional[str] = None
+    location: Location
+    bearing: float  # Degrees clockwise from north
+    from_stop_id: str  # Last stop reached
+    to_stop_id: str  # Next stop
+    progress: float  # Fraction of the scheduled time to the next stop
+    color: Optional[str] = None
+    text_color: Optional[str] = None
+
+
+class ScheduledVehiclesResponse(BaseModel):
+    date: str
+    time: str
+    bbox: Optional[BoundingBox] = None
+    vehicles: List[ScheduledVehicle]
+    total_vehicles: int
+
+
 class ArrivalInfo(BaseModel):
     is_realtime: bool
     provider: str
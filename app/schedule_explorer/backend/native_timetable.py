@@ -0,0 +1,1496 @@
+"""
+ctypes bindings for the native timetable library (libgtfs_timetable).
+
+The library compiles a GTFS directory into a single file of flat arrays
+(see gtfs_timetable.h) and answers schedule queries directly on it. When the
+library has not been built, load_native_timetable() returns None and callers
+fall back to the Python implementation.
+"""
+
+import ctypes
+import logging
+import os
+import struct
+import sys
+import threading
+from dataclasses import dataclass, field
+from datetime import date, datetime, timedelta
+from pathlib import Path
+from typing import Dict, Iterable, List, Optional, Tuple
+
+logger = logging.getLogger("schedule_explorer.native_timetable")
+
+TIMETABLE_FILE = ".gtfs_timetable"
+INT32_MIN = -(2**31)
+INT32_MAX = 2**31 - 1
+NONE = 2**32 - 1  # GTT_NONE
+WEEKDAY_NAMES = [
+    "monday",
+    "tuesday",
+    "wednesday",
+    "thursday",
+    "friday",
+    "saturday",
+    "sunday",
+]
+
+
+class _TripMatch(ctypes.Structure):
+    _fields_ = [
+        ("trip", ctypes.c_uint32),
+        ("pattern", ctypes.c_uint32),
+        ("from_pos", ctypes.c_uint32),
+        ("to_pos", ctypes.c_uint32),
+        ("departure", ctypes.c_int32),
+        ("arrival", ctypes.c_int32),
+        ("service", ctypes.c_uint32),
+        ("weekdays", ctypes.c_uint8),
+        ("reserved", ctypes.c_uint8 * 3),
+        ("shift", ctypes.c_int32),
+    ]
+
+
+class _Header(ctypes.Structure):
+    _fields_ = [
+        ("magic", ctypes.c_char * 8),
+        ("version", ctypes.c_uint32),
+        ("n_sections", ctypes.c_uint32),
+        ("cache_key", ctypes.c_char * 128),
+        ("n_stops", ctypes.c_uint32),
+        ("n_routes", ctypes.c_uint32),
+        ("n_services", ctypes.c_uint32),
+        ("n_trips", ctypes.c_uint32),
+        ("n_patterns", ctypes.c_uint32),
+        ("n_stop_times", ctypes.c_uint32),
+        ("calendar_start", ctypes.c_int32),
+        ("calendar_days", ctypes.c_uint32),
+        ("service_words", ctypes.c_uint32),
+        ("n_languages", ctypes.c_uint32),
+        ("n_shapes", ctypes.c_uint32),
+        ("reserved", ctypes.c_uint32),
+    ]
+
+
+class _JourneyQuery(ctypes.Structure):
+    _fields_ = [
+        ("from_stops", ctypes.POINTER(ctypes.c_uint32)),
+        ("n_from", ctypes.c_size_t),
+        ("to_stops", ctypes.POINTER(ctypes.c_uint32)),
+        ("n_to", ctypes.c_size_t),
+        ("day", ctypes.c_int32),
+        ("departure_min", ctypes.c_int32),
+        ("departure_max", ctypes.c_int32),
+        ("max_transfers", ctypes.c_uint32),
+    ]
+
+
+class _Leg(ctypes.Structure):
+    _fields_ = [
+        ("kind", ctypes.c_uint32),
+        ("trip", ctypes.c_uint32),
+        ("from_stop", ctypes.c_uint32),
+        ("to_stop", ctypes.c_uint32),
+        ("from_pos", ctypes.c_uint32),
+        ("to_pos", ctypes.c_uint32),
+        ("departure", ctypes.c_int32),
+        ("arrival", ctypes.c_int32),
+        ("shift", ctypes.c_int32),
+    ]
+
+
+class _Journey(ctypes.Structure):
+    _fields_ = [
+        ("first_leg", ctypes.c_uint32),
+        ("n_legs", ctypes.c_uint32),
+        ("n_transfers", ctypes.c_uint32),
+        ("departure", ctypes.c_int32),
+        ("arrival", ctypes.c_int32),
+    ]
+
+
+class _JourneyResult(ctypes.Structure):
+    _fields_ = [
+        ("journeys", ctypes.POINTER(_Journey)),
+        ("n_journeys", ctypes.c_size_t),
+        ("legs", ctypes.POINTER(_Leg)),
+        ("n_legs", ctypes.c_size_t),
+    ]
+
+
+class _ProfileEntry(ctypes.Structure):
+    _fields_ = [
+        ("departure", ctypes.c_int32),
+        ("arrival", ctypes.c_int32),
+    ]
+
+
+class _Profile(ctypes.Structure):
+    _fields_ = [
+        ("stop_start", ctypes.POINTER(ctypes.c_uint32)),
+        ("entries", ctypes.POINTER(_ProfileEntry)),
+        ("n_entries", ctypes.c_size_t),
+    ]
+
+
+class _IsochroneQuery(ctypes.Structure):
+    _fields_ = [
+        ("from_stops", ctypes.POINTER(ctypes.c_uint32)),
+        ("n_from", ctypes.c_size_t),
+        ("day", ctypes.c_int32),
+        ("departures", ctypes.POINTER(ctypes.c_int32)),
+        ("n_departures", ctypes.c_size_t),
+        ("max_duration", ctypes.c_int32),
+        ("n_threads", ctypes.c_uint32),
+    ]
+
+
+class _StopReach(ctypes.Structure):
+    _fields_ = [
+        ("first_arrival", ctypes.c_int32),
+        ("min_travel", ctypes.c_int32),
+        ("median_travel", ctypes.c_int32),
+    ]
+
+
+class _CalendarQuery(ctypes.Structure):
+    _fields_ = [
+        ("services_start", ctypes.POINTER(ctypes.c_uint32)),
+        ("services", ctypes.POINTER(ctypes.c_uint32)),
+        ("active_start", ctypes.POINTER(ctypes.c_uint32)),
+        ("active", ctypes.POINTER(ctypes.c_uint32)),
+        ("n_routes", ctypes.c_size_t),
+        ("n_threads", ctypes.c_uint32),
+    ]
+
+
+class _RouteCalendar(ctypes.Structure):
+    _fields_ = [
+        ("first_day", ctypes.c_uint32),
+        ("n_valid", ctypes.c_uint32),
+        ("n_additions", ctypes.c_uint32),
+        ("n_removals", ctypes.c_uint32),
+        ("n_ranges", ctypes.c_uint32),
+        ("calendar_weekdays", ctypes.c_uint8),
+        ("valid_weekdays", ctypes.c_uint8),
+        ("addition_weekdays", ctypes.c_uint8),
+        ("reserved", ctypes.c_uint8),
+    ]
+
+
+class _RouteCalendars(ctypes.Structure):
+    _fields_ = [
+        ("routes", ctypes.POINTER(_RouteCalendar)),
+        ("n_routes", ctypes.c_size_t),
+        ("days", ctypes.POINTER(ctypes.c_int32)),
+        ("n_days", ctypes.c_size_t),
+    ]
+
+
+class _VehicleQuery(ctypes.Structure):
+    _fields_ = [
+        ("trip", ctypes.c_uint32),
+        ("next_stop", ctypes.c_uint32),
+        ("next_pos", ctypes.c_uint32),
+        ("reserved", ctypes.c_uint32),
+        ("distance_to_next", ctypes.c_double),
+    ]
+
+
+class _VehicleLocation(ctypes.Structure):
+    _fields_ = [
+        ("lat", ctypes.c_double),
+        ("lon", ctypes.c_double),
+        ("bearing", ctypes.c_double),
+        ("segment_length", ctypes.c_double),
+        ("located", ctypes.c_uint32),
+        ("from_pos", ctypes.c_uint32),
+    ]
+
+
+class _ScheduleQuery(ctypes.Structure):
+    _fields_ = [
+        ("day", ctypes.c_int32),
+        ("time", ctypes.c_int32),
+        ("has_bbox", ctypes.c_uint32),
+        ("n_threads", ctypes.c_uint32),
+        ("min_lat", ctypes.c_double),
+        ("min_lon", ctypes.c_double),
+        ("max_lat", ctypes.c_double),
+        ("max_lon", ctypes.c_double),
+    ]
+
+
+class _ScheduledVehicle(ctypes.Structure):
+    _fields_ = [
+        ("trip", ctypes.c_uint32),
+        ("shift", ctypes.c_int32),
+        ("day", ctypes.c_int32),
+        ("from_pos", ctypes.c_uint32),
+        ("from_stop", ctypes.c_uint32),
+        ("to_stop", ctypes.c_uint32),
+        ("on_shape", ctypes.c_uint32),
+        ("reserved", ctypes.c_uint32),
+        ("progress", ctypes.c_double),
+        ("lat", ctypes.c_double),
+        ("lon", ctypes.c_double),
+        ("bearing", ctypes.c_double),
+    ]
+
+
+class _ScheduledVehicles(ctypes.Structure):
+    _fields_ = [
+        ("vehicles", ctypes.POINTER(_ScheduledVehicle)),
+        ("n_vehicles", ctypes.c_size_t),
+    ]
+
+
+class _Cell(ctypes.Structure):
+    _fields_ = [
+        ("lat", ctypes.c_double),
+        ("lon", ctypes.c_double),
+        ("travel_time", ctypes.c_int32),
+        ("reserved", ctypes.c_uint32),
+    ]
+
+
+class _RtString(ctypes.Structure):
+    _fields_ = [("offset", ctypes.c_uint32), ("length", ctypes.c_uint32)]
+
+
+class _RtTripUpdate(ctypes.Structure):
+    _fields_ = [
+        ("trip", ctypes.c_uint32),
+        ("route", ctypes.c_uint32),
+        ("first_update", ctypes.c_uint32),
+        ("n_updates", ctypes.c_uint32),
+        ("entity_id", _RtString),
+        ("trip_id", _RtString),
+        ("route_id", _RtString),
+        ("vehicle_id", _RtString),
+        ("start_day", ctypes.c_int32),
+        ("start_time", ctypes.c_int32),
+        ("delay", ctypes.c_int32),
+        ("flags", ctypes.c_uint32),
+        ("schedule_relationship", ctypes.c_uint32),
+        ("direction_id", ctypes.c_uint32),
+        ("timestamp", ctypes.c_uint64),
+    ]
+
+
+class _RtStopTimeUpdate(ctypes.Structure):
+    _fields_ = [
+        ("stop", ctypes.c_uint32),
+        ("stop_sequence", ctypes.c_uint32),
+        ("stop_id", _RtString),
+        ("arrival_delay", ctypes.c_int32),
+        ("departure_delay", ctypes.c_int32),
+        ("flags", ctypes.c_uint32),
+        ("schedule_relationship", ctypes.c_uint32),
+        ("arrival_time", ctypes.c_int64),
+        ("departure_time", ctypes.c_int64),
+        ("scheduled_arrival", ctypes.c_int64),
+        ("scheduled_departure", ctypes.c_int64),
+    ]
+
+
+class _RtVehicle(ctypes.Structure):
+    _fields_ = [
+        ("trip", ctypes.c_uint32),
+        ("route", ctypes.c_uint32),
+        ("stop", ctypes.c_uint32),
+        ("current_stop_sequence", ctypes.c_uint32),
+        ("entity_id", _RtString),
+        ("trip_id", _RtString),
+        ("route_id", _RtString),
+        ("stop_id", _RtString),
+        ("vehicle_id", _RtString),
+        ("label", _RtString),
+        ("license_plate", _RtString),
+        ("vehicle_model", _RtString),
+        ("start_day", ctypes.c_int32),
+        ("start_time", ctypes.c_int32),
+        ("direction_id", ctypes.c_uint32),
+        ("flags", ctypes.c_uint32),
+        ("current_status", ctypes.c_uint32),
+        ("congestion_level", ctypes.c_uint32),
+        ("occupancy_status", ctypes.c_uint32),
+        ("vehicle_type", ctypes.c_int32),
+        ("stop_distance", ctypes.c_int32),
+        ("reserved", ctypes.c_uint32),
+        ("timestamp", ctypes.c_uint64),
+        ("lat", ctypes.c_double),
+        ("lon", ctypes.c_double),
+        ("bearing", ctypes.c_double),
+        ("speed", ctypes.c_double),
+        ("odometer", ctypes.c_double),
+    ]
+
+
+class _RtFeed(ctypes.Structure):
+    _fields_ = [
+        ("data", ctypes.c_void_p),
+        ("size", ctypes.c_size_t),
+        ("timestamp", ctypes.c_uint64),
+        ("n_entities", ctypes.c_size_t),
+        ("trip_updates", ctypes.POINTER(_RtTripUpdate)),
+        ("n_trip_updates", ctypes.c_size_t),
+        ("stop_time_updates", ctypes.POINTER(_RtStopTimeUpdate)),
+        ("n_stop_time_updates", ctypes.c_size_t),
+        ("vehicles", ctypes.POINTER(_RtVehicle)),
+        ("n_vehicles", ctypes.c_size_t),
+        ("owned", ctypes.c_void_p),
+    ]
+
+
+class _RtOptions(ctypes.Structure):
+    _fields_ = [("id_prefixes", ctypes.c_char_p), ("stop_separator", ctypes.c_char)]
+
+
+# Layouts of GttRtStopTimeUpdate, GttRtTripUpdate and GttRtVehicle, which
+# _realtime_feed() unpacks in bulk (strings are an offset and a length)
+_RT_STOP_TIME_UPDATE = "=IIIIiiIIqqqq"
+_RT_TRIP_UPDATE = "=IIII8IiiiIIIQ"
+_RT_VEHICLE = "=IIII16IiiIIIIIiiIQ5d"
+
+
+LEG_TRANSIT = 1
+LEG_WALK = 2
+MAX_TRANSFERS = 8
+
+# GTT_RT_* flags of the decoded GTFS-Realtime records
+RT_DELETED = 1 << 0
+RT_HAS_DELAY = 1 << 1
+RT_HAS_TIMESTAMP = 1 << 2
+RT_HAS_ARRIVAL_TIME = 1 << 3
+RT_HAS_ARRIVAL_DELAY = 1 << 4
+RT_HAS_DEPARTURE_TIME = 1 << 5
+RT_HAS_DEPARTURE_DELAY = 1 << 6
+RT_HAS_SCHEDULED_ARRIVAL = 1 << 7
+RT_HAS_SCHEDULED_DEPARTURE = 1 << 8
+RT_HAS_POSITION = 1 << 9
+RT_HAS_BEARING = 1 << 10
+RT_HAS_SPEED = 1 << 11
+RT_HAS_ODOMETER = 1 << 12
+RT_HAS_STATUS = 1 << 13
+RT_HAS_STOP_DISTANCE = 1 << 14
+RT_HAS_VEHICLE_TYPE = 1 << 15
+RT_DOOR_OPEN = 1 << 16
+RT_DEVIATED = 1 << 17
+
+
+@dataclass
+class TripMatch:
+    """A trip that serves a from-stop and later a to-stop"""
+
+    trip_id: str
+    route_id: str
+    service_id: str
+    direction_id: Optional[str]
+    headsign: str
+    departure: int  # Seconds after midnight at the boarding stop
+    arrival: int  # Seconds after midnight at the alighting stop
+    service_days: List[str]
+    # (stop_id, arrival_time, departure_time) from boarding to alighting stop
+    stop_times: List[Tuple[str, str, str]]
+    stop_sequences: List[int]  # GTFS stop_sequence of each of stop_times
+
+
+@dataclass
+class JourneyLeg:
+    """One trip or footpath of a planned journey"""
+
+    mode: str  # "transit" or "walk"
+    from_stop_id: str
+    to_stop_id: str
+    departure: int  # Seconds after midnight of the query day
+    arrival: int
+    trip_id: Optional[str] = None
+    route_id: Optional[str] = None
+    headsign: Optional[str] = None
+    # (stop_id, arrival_time, departure_time) along the trip, transit legs only
+    stop_times: Optional[List[Tuple[str, str, str]]] = None
+
+
+@dataclass
+class StopReach:
+    """Travel times from an isochrone origin to one stop, in seconds"""
+
+    first_arrival: Optional[int]  # Seconds after midnight, for the first departure
+    min_travel: int
+    median_travel: int
+
+
+@dataclass
+class IsochroneCell:
+    lat: float
+    lon: float
+    travel_time: int  # Seconds, including the walk from the nearest stop
+
+
+@dataclass
+class Journey:
+    departure: int
+    arrival: int
+    transfers: int
+    legs: List[JourneyLeg]
+
+
+@dataclass
+class RouteCalendar:
+    """Service calendar of a route; days are days since 1970-01-01"""
+
+    calendar_weekdays: List[str]  # Set in calendar.txt
+    valid_days: List[int]
+    additions: List[int]  # Added by calendar_dates.txt, sorted
+    removals: List[int]  # Removed by calendar_dates.txt, sorted
+    ranges: List[Tuple[int, int]]  # Runs of consecutive valid days
+    valid_weekdays: List[str]
+    addition_weekdays: List[str]
+
+
+@dataclass
+class VehicleLocation:
+    """Position of a vehicle on the shape of its trip"""
+
+    lat: float
+    lon: float
+    bearing: float  # Degrees clockwise from north
+    segment_length: float  # Metres along the shape from the previous stop to the next
+
+
+@dataclass
+class ScheduledVehicle:
+    """Where a running trip should be according to the timetable"""
+
+    trip_id: str
+    route_id: str
+    headsign: str
+    direction_id: Optional[str]
+    lat: float
+    lon: float
+    bearing: float  # Degrees clockwise from north
+    from_stop_id: str  # Last stop reached
+    to_stop_id: str  # Next stop, from_stop_id at the end of the trip
+    progress: float  # Fraction of the scheduled time to the next stop
+    shift: int  # Seconds the run of a frequency-based trip is shifted by
+    previous_day: bool  # Trip of the day before, running after midnight
+    on_shape: bool  # Placed on the trip's shape rather than between stops
+
+
+@dataclass
+class RealtimeStopTimeUpdate:
+    """StopTimeUpdate of a decoded GTFS-Realtime trip update"""
+
+    stop_id: str
+    stop: Optional[int]  # Timetable index
+    stop_sequence: Optional[int]
+    schedule_relationship: int
+    arrival_time: Optional[int]  # POSIX times
+    arrival_delay: Optional[int]
+    departure_time: Optional[int]
+    departure_delay: Optional[int]
+    scheduled_arrival: Optional[int]  # realcity extension
+    scheduled_departure: Optional[int]
+
+
+@dataclass
+class RealtimeTripUpdate:
+    """TripUpdate of a decoded GTFS-Realtime feed"""
+
+    entity_id: str
+    trip_id: str
+    route_id: str
+    vehicle_id: str
+    trip: Optional[int]  # Timetable indices
+    route: Optional[int]
+    start_date: Optional[date]
+    start_time: Optional[int]  # Seconds after midnight
+    direction_id: Optional[int]
+    schedule_relationship: int
+    delay: Optional[int]
+    timestamp: Optional[int]
+    deleted: bool
+    stop_time_updates: List[RealtimeStopTimeUpdate] = field(default_factory=list)
+
+
+@dataclass
+class RealtimeVehicle:
+    """VehiclePosition of a decoded GTFS-Realtime feed"""
+
+    entity_id: str
+    trip_id: str
+    route_id: str
+    stop_id: str
+    vehicle_id: str
+    label: str
+    license_plate: str
+    trip: Optional[int]  # Timetable indices
+    route: Optional[int]
+    stop: Optional[int]
+    start_date: Optional[date]
+    start_time: Optional[int]
+    direction_id: Optional[int]
+    current_stop_sequence: Optional[int]
+    current_status: Optional[int]
+    congestion_level: int
+    occupancy_status: int
+    timestamp: Optional[int]
+    lat: Optional[float]
+    lon: Optional[float]
+    bearing: Optional[float]
+    speed: Optional[float]  # Metres per second
+    odometer: Optional[float]
+    deleted: bool
+    vehicle_model: str  # realcity extension
+    vehicle_type: Optional[int]
+    door_open: bool
+    deviated: bool
+    stop_distance: Optional[int]  # Metres to the stop
+
+
+@dataclass
+class RealtimeFeed:
+    """Trip updates and vehicle positions of a GTFS-Realtime FeedMessage"""
+
+    timestamp: Optional[int]
+    n_entities: int
+    trip_updates: List[RealtimeTripUpdate]
+    vehicles: List[RealtimeVehicle]
+
+
+_lib = None
+_lib_lock = threading.Lock()
+
+
+def _library_path() -> Path:
+    script_dir = Path(__file__).parent.absolute()
+    if sys.platform == "win32":
+        return script_dir / "gtfs_timetable.dll"
+    if sys.platform == "darwin":
+        return script_dir / "libgtfs_timetable.dylib"
+    return script_dir / "libgtfs_timetable.so"
+
+
+def _load_library():
+    """Load and prototype the shared library once. Returns None if missing."""
+    global _lib
+    with _lib_lock:
+        if _lib is not None:
+            return _lib or None
+
+        path = _library_path()
+        if not path.exists():
+            logger.info(f"Native timetable library not found at {path}")
+            _lib = False
+            return None
+        try:
+            lib = ctypes.CDLL(str(path))
+        except OSError as e:
+            logger.warning(f"Failed to load native timetable library: {e}")
+            _lib = False
+            return None
+
+        u32 = ctypes.c_uint32
+        i32 = ctypes.c_int32
+        handle = ctypes.c_void_p
+
+        lib.gtt_build.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p]
+        lib.gtt_build.restype = ctypes.c_int
+        lib.gtt_open.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+        lib.gtt_open.restype = handle
+        lib.gtt_close.argtypes = [handle]
+        lib.gtt_close.restype = None
+        lib.gtt_header.argtypes = [handle]
+        lib.gtt_header.restype = ctypes.POINTER(_Header)
+        for name in ("gtt_find_stop", "gtt_find_trip", "gtt_find_route"):
+            getattr(lib, name).argtypes = [handle, ctypes.c_char_p]
+            getattr(lib, name).restype = i32
+        for name in (
+            "gtt_stop_id",
+            "gtt_stop_name",
+            "gtt_route_id",
+            "gtt_service_id",
+            "gtt_trip_id",
+            "gtt_trip_headsign",
+        ):
+            getattr(lib, name).argtypes = [handle, u32]
+            getattr(lib, name).restype = ctypes.c_char_p
+        lib.gtt_language.argtypes = [handle, u32]
+        lib.gtt_language.restype = ctypes.c_char_p
+        lib.gtt_stop_translation.argtypes = [handle, u32, u32]
+        lib.gtt_stop_translation.restype = ctypes.c_char_p
+        lib.gtt_trip_route.argtypes = [handle, u32]
+        lib.gtt_trip_route.restype = u32
+        lib.gtt_trip_direction.argtypes = [handle, u32]
+        lib.gtt_trip_direction.restype = i32
+        lib.gtt_trip_stop_times.argtypes = [
+            handle,
+            u32,
+            u32,
+            u32,
+            ctypes.POINTER(u32),
+            ctypes.POINTER(i32),
+            ctypes.POINTER(i32),
+            ctypes.POINTER(u32),
+        ]
+        lib.gtt_trip_stop_times.restype = u32
+        lib.gtt_service_active.argtypes = [handle, u32, i32]
+        lib.gtt_service_active.restype = ctypes.c_int
+        lib.gtt_trips_between.argtypes = [
+            handle,
+            ctypes.POINTER(u32),
+            ctypes.c_size_t,
+            ctypes.POINTER(u32),
+            ctypes.c_size_t,
+            i32,
+            ctypes.POINTER(_TripMatch),
+            ctypes.c_size_t,
+        ]
+        lib.gtt_trips_between.restype = ctypes.c_size_t
+        lib.gtt_stop_transfers.argtypes = [
+            handle,
+            u32,
+            ctypes.POINTER(u32),
+            ctypes.POINTER(i32),
+            u32,
+        ]
+        lib.gtt_stop_transfers.restype = u32
+        lib.gtt_stop_reachable.argtypes = [
+            handle,
+            u32,
+            ctypes.c_int,
+            ctypes.POINTER(u32),
+            u32,
+        ]
+        lib.gtt_stop_reachable.restype = u32
+        lib.gtt_plan_journeys.argtypes = [handle, ctypes.POINTER(_JourneyQuery)]
+        lib.gtt_plan_journeys.restype = ctypes.POINTER(_JourneyResult)
+        lib.gtt_free_journeys.argtypes = [ctypes.POINTER(_JourneyResult)]
+        lib.gtt_free_journeys.restype = None
+        lib.gtt_earliest_arrivals.argtypes = [
+            handle,
+            ctypes.POINTER(u32),
+            ctypes.c_size_t,
+            i32,
+            i32,
+            i32,
+            ctypes.POINTER(i32),
+        ]
+        lib.gtt_earliest_arrivals.restype = ctypes.c_int64
+        lib.gtt_profile.argtypes = [
+            handle,
+            ctypes.POINTER(u32),
+            ctypes.c_size_t,
+            i32,
+            i32,
+            i32,
+        ]
+        lib.gtt_profile.restype = ctypes.POINTER(_Profile)
+        lib.gtt_free_profile.argtypes = [ctypes.POINTER(_Profile)]
+        lib.gtt_free_profile.restype = None
+        lib.gtt_isochrone.argtypes = [
+            handle,
+            ctypes.POINTER(_IsochroneQuery),
+            ctypes.POINTER(_StopReach),
+        ]
+        lib.gtt_isochrone.restype = ctypes.c_int
+        lib.gtt_rasterize.argtypes = [
+            handle,
+            ctypes.POINTER(_StopReach),
+            i32,
+            ctypes.c_double,
+            ctypes.c_double,
+            ctypes.c_int,
+            ctypes.POINTER(_Cell),
+            ctypes.c_size_t,
+        ]
+        lib.gtt_rasterize.restype = ctypes.c_size_t
+        lib.gtt_route_calendars.argtypes = [handle, ctypes.POINTER(_CalendarQuery)]
+        lib.gtt_route_calendars.restype = ctypes.POINTER(_RouteCalendars)
+        lib.gtt_free_route_calendars.argtypes = [ctypes.POINTER(_RouteCalendars)]
+        lib.gtt_free_route_calendars.restype = None
+        lib.gtt_locate_vehicles.argtypes = [
+            handle,
+            ctypes.POINTER(_VehicleQuery),
+            ctypes.c_size_t,
+            ctypes.POINTER(_VehicleLocation),
+        ]
+        lib.gtt_locate_vehicles.restype = ctypes.c_size_t
+        lib.gtt_scheduled_vehicles.argtypes = [handle, ctypes.POINTER(_ScheduleQuery)]
+        lib.gtt_scheduled_vehicles.restype = ctypes.POINTER(_ScheduledVehicles)
+        lib.gtt_free_scheduled_vehicles.argtypes = [ctypes.POINTER(_ScheduledVehicles)]
+        lib.gtt_free_scheduled_vehicles.restype = None
+        lib.gtt_rt_decode.argtypes = [
+            handle,
+            ctypes.c_char_p,
+            ctypes.c_size_t,
+            ctypes.POINTER(_RtOptions),
+        ]
+        lib.gtt_rt_decode.restype = ctypes.POINTER(_RtFeed)
+        lib.gtt_rt_decode_file.argtypes = [handle, ctypes.c_char_p, ctypes.POINTER(_RtOptions)]
+        lib.gtt_rt_decode_file.restype = ctypes.POINTER(_RtFeed)
+        lib.gtt_free_rt_feed.argtypes = [ctypes.POINTER(_RtFeed)]
+        lib.gtt_free_rt_feed.restype = None
+
+        _lib = lib
+        return lib
+
+
+def format_gtfs_time(seconds: int) -> str:
+    """Format seconds after midnight as GTFS HH:MM:SS (hours may exceed 24)"""
+    return f"{seconds // 3600:02d}:{seconds % 3600 // 60:02d}:{seconds % 60:02d}"
+
+
+def days_since_epoch(day: date | datetime) -> int:
+    if isinstance(day, datetime):
+        day = day.date()
+    return (day - date(1970, 1, 1)).days
+
+
+def weekday_names(mask: int) -> List[str]:
+    return [name for bit, name in enumerate(WEEKDAY_NAMES) if mask & (1 << bit)]
+
+
+class NativeTimetable:
+    """Read-only handle on a compiled timetable file"""
+
+    def __init__(self, lib, handle: int, path: Path):
+        self._lib = lib
+        self._handle = ctypes.c_void_p(handle)
+        self.path = path
+        header = lib.gtt_header(self._handle).contents
+        self.n_stops = header.n_stops
+        self.n_routes = header.n_routes
+        self.n_trips = header.n_trips
+        self.n_patterns = header.n_patterns
+        self.n_stop_times = header.n_stop_times
+        self.n_services = header.n_services
+        self.n_languages = header.n_languages
+        self.n_shapes = header.n_shapes
+        self._service_index: Optional[Dict[str, int]] = None
+
+    def close(self) -> None:
+        if self._handle:
+            self._lib.gtt_close(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        try:
+            self.close()
+        except Exception:
+            pass
+
+    def _str(self, value: Optional[bytes]) -> str:
+        return value.decode("utf-8", errors="replace") if value else ""
+
+    def find_stop(self, stop_id: str) -> Optional[int]:
+        index = self._lib.gtt_find_stop(self._handle, stop_id.encode("utf-8"))
+        return index if index >= 0 else None
+
+    def stop_id(self, stop: int) -> str:
+        return self._str(self._lib.gtt_stop_id(self._handle, stop))
+
+    def languages(self) -> List[str]:
+        """Languages stop names are translated into"""
+        return [
+            self._str(self._lib.gtt_language(self._handle, l))
+            for l in range(self.n_languages)
+        ]
+
+    def stop_translations(self) -> Dict[str, Dict[str, str]]:
+        """Translated names of every stop that has any, by stop ID. Stops
+        with the same translations share one dictionary."""
+        languages = self.languages()
+        shared: Dict[Tuple, Dict[str, str]] = {}
+        result = {}
+        for stop in range(self.n_stops if languages else 0):
+            names = tuple(
+                self._lib.gtt_stop_translation(self._handle, stop, l)
+                for l in range(len(languages))
+            )
+            if not any(names):
+                continue
+            translations = shared.get(names)
+            if translations is None:
+                translations = {
+                    language: self._str(name)
+                    for language, name in zip(languages, names)
+                    if name
+                }
+                shared[names] = translations
+            result[self.stop_id(stop)] = translations
+        return result
+
+    def _stop_indices(self, stop_ids: Iterable[str]):
+        indices = [i for i in (self.find_stop(s) for s in stop_ids) if i is not None]
+        return (ctypes.c_uint32 * max(len(indices), 1))(*indices), len(indices)
+
+    def reachable_stops(self, stop_id: str, upstream: bool = False) -> List[str]:
+        """Stops served after stop_id by any trip calling there (or, when
+        upstream is set, before it)."""
+        stop = self.find_stop(stop_id)
+        if stop is None:
+            return []
+        capacity = 256
+        while True:
+            out = (ctypes.c_uint32 * capacity)()
+            total = self._lib.gtt_stop_reachable(
+                self._handle, stop, int(upstream), out, capacity
+            )
+            if total <= capacity:
+                break
+            capacity = total
+        return [self.stop_id(s) for s in out[:total]]
+
+    def trip_stop_times(
+        self, trip: int, from_pos: int, to_pos: int, shift: int = 0
+    ) -> List[Tuple[str, str, str]]:
+        """Stops and times of a trip between two pattern positions. shift
+        selects the run of a frequency-based trip."""
+        n = to_pos - from_pos + 1
+        if n <= 0:
+            return []
+        stops = (ctypes.c_uint32 * n)()
+        arrivals = (ctypes.c_int32 * n)()
+        departures = (ctypes.c_int32 * n)()
+        count = self._lib.gtt_trip_stop_times(
+            self._handle, trip, from_pos, to_pos, stops, arrivals, departures, None
+        )
+        return [
+            (
+                self.stop_id(stops[i]),
+                format_gtfs_time(arrivals[i] + shift),
+                format_gtfs_time(departures[i] + shift),
+            )
+            for i in range(count)
+        ]
+
+    def trip_stop_sequences(self, trip: int, from_pos: int, to_pos: int) -> List[int]:
+        """GTFS stop_sequence values of a trip between two pattern positions"""
+        n = to_pos - from_pos + 1
+        if n <= 0:
+            return []
+        sequences = (ctypes.c_uint32 * n)()
+        count = self._lib.gtt_trip_stop_times(
+            self._handle, trip, from_pos, to_pos, None, None, None, sequences
+        )
+        return list(sequences[:count])
+
+    def trips_between(
+        self,
+        from_stop_ids: Iterable[str],
+        to_stop_ids: Iterable[str],
+        day: Optional[date | datetime] = None,
+    ) -> List[TripMatch]:
+        """Trips calling at any from-stop and later at any to-stop.
+
+        When day is given only trips whose service runs on that weekday are
+        returned, matching the weekday semantics of the Python search.
+        """
+        from_stops, n_from = self._stop_indices(from_stop_ids)
+        to_stops, n_to = self._stop_indices(to_stop_ids)
+        if n_from == 0 or n_to == 0:
+            return []
+        day_value = days_since_epoch(day) if day is not None else INT32_MIN
+
+        capacity = 256
+        while True:
+            out = (_TripMatch * capacity)()
+            total = self._lib.gtt_trips_between(
+                self._handle, from_stops, n_from, to_stops, n_to, day_value, out, capacity
+            )
+            if total <= capacity:
+                break
+            capacity = total
+
+        matches = []
+        for m in out[:total]:
+            route = self._lib.gtt_trip_route(self._handle, m.trip)
+            direction = self._lib.gtt_trip_direction(self._handle, m.trip)
+            matches.append(
+                TripMatch(
+                    trip_id=self._str(self._lib.gtt_trip_id(self._handle, m.trip)),
+                    route_id=self._str(self._lib.gtt_route_id(self._handle, route)),
+                    service_id=self._str(
+                        self._lib.gtt_service_id(self._handle, m.service)
+                    ),
+                    direction_id=str(direction) if direction >= 0 else None,
+                    headsign=self._str(
+                        self._lib.gtt_trip_headsign(self._handle, m.trip)
+                    ),
+                    departure=m.departure,
+                    arrival=m.arrival,
+                    service_days=weekday_names(m.weekdays),
+                    stop_times=self.trip_stop_times(m.trip, m.from_pos, m.to_pos, m.shift),
+                    stop_sequences=self.trip_stop_sequences(m.trip, m.from_pos, m.to_pos),
+                )
+            )
+        return matches
+
+    def plan_journeys(
+        self,
+        from_stop_ids: Iterable[str],
+        to_stop_ids: Iterable[str],
+        day: date | datetime,
+        departure_min: int,
+        departure_max: int,
+        max_transfers: int = 3,
+    ) -> List[Journey]:
+        """Pareto-optimal journeys (departure, arrival, transfers) leaving
+        between departure_min and departure_max (seconds after midnight)."""
+        from_stops, n_from = self._stop_indices(from_stop_ids)
+        to_stops, n_to = self._stop_indices(to_stop_ids)
+        if n_from == 0 or n_to == 0:
+            return []
+
+        query = _JourneyQuery(
+            from_stops,
+            n_from,
+            to_stops,
+            n_to,
+            days_since_epoch(day),
+            departure_min,
+            departure_max,
+            max(0, min(max_transfers, MAX_TRANSFERS)),
+        )
+        result = self._lib.gtt_plan_journeys(self._handle, ctypes.byref(query))
+        if not result:
+            raise MemoryError("Native journey planner ran out of memory")
+        try:
+            res = result.contents
+            journeys = []
+            for j in range(res.n_journeys):
+                journey = res.journeys[j]
+                legs = []
+                for i in range(journey.first_leg, journey.first_leg + journey.n_legs):
+                    leg = res.legs[i]
+                    if leg.kind == LEG_TRANSIT:
+                        route = self._lib.gtt_trip_route(self._handle, leg.trip)
+                        legs.append(
+                            JourneyLeg(
+                                mode="transit",
+                                from_stop_id=self.stop_id(leg.from_stop),
+                                to_stop_id=self.stop_id(leg.to_stop),
+                                departure=leg.departure,
+                                arrival=leg.arrival,
+                                trip_id=self._str(self._lib.gtt_trip_id(self._handle, leg.trip)),
+                                route_id=self._str(self._lib.gtt_route_id(self._handle, route)),
+                                headsign=self._str(
+                                    self._lib.gtt_trip_headsign(self._handle, leg.trip)
+                                ),
+                                stop_times=self.trip_stop_times(
+                                    leg.trip, leg.from_pos, leg.to_pos, leg.shift
+                                ),
+                            )
+                        )
+                    else:
+                        legs.append(
+                            JourneyLeg(
+                                mode="walk",
+                                from_stop_id=self.stop_id(leg.from_stop),
+                                to_stop_id=self.stop_id(leg.to_stop),
+                                departure=leg.departure,
+                                arrival=leg.arrival,
+                            )
+                        )
+                journeys.append(
+                    Journey(
+                        departure=journey.departure,
+                        arrival=journey.arrival,
+                        transfers=journey.n_transfers,
+                        legs=legs,
+                    )
+                )
+            return journeys
+        finally:
+            self._lib.gtt_free_journeys(result)
+
+    def earliest_arrivals(
+        self,
+        from_stop_ids: Iterable[str],
+        day: date | datetime,
+        departure: int,
+        max_duration: Optional[int] = None,
+    ) -> Dict[str, int]:
+        """Earliest arrival (seconds after midnight) at every stop reachable
+        when leaving from_stop_ids at departure, optionally within
+        max_duration seconds."""
+        from_stops, n_from = self._stop_indices(from_stop_ids)
+        if n_from == 0:
+            return {}
+        arrivals = (ctypes.c_int32 * max(self.n_stops, 1))()
+        reached = self._lib.gtt_earliest_arrivals(
+            self._handle,
+            from_stops,
+            n_from,
+            days_since_epoch(day),
+            departure,
+            max_duration or 0,
+            arrivals,
+        )
+        if reached < 0:
+            raise MemoryError("Native connection scan ran out of memory")
+        limit = departure + max_duration if max_duration else INT32_MAX
+        return {
+            self.stop_id(stop): arrivals[stop]
+            for stop in range(self.n_stops)
+            if arrivals[stop] <= limit
+        }
+
+    def profile(
+        self,
+        to_stop_ids: Iterable[str],
+        day: date | datetime,
+        departure_min: int = 0,
+        departure_max: int = 24 * 3600,
+    ) -> Dict[str, List[Tuple[int, int]]]:
+        """For every stop, the (departure, arrival) pairs towards to_stop_ids
+        that no later departure beats, sorted by departure."""
+        to_stops, n_to = self._stop_indices(to_stop_ids)
+        if n_to == 0:
+            return {}
+        result = self._lib.gtt_profile(
+            self._handle, to_stops, n_to, days_since_epoch(day), departure_min, departure_max
+        )
+        if not result:
+            raise MemoryError("Native connection scan ran out of memory")
+        try:
+            res = result.contents
+            starts = res.stop_start[: self.n_stops + 1]
+            # Copy all entries out at once as a flat list of ints
+            flat = []
+            if res.n_entries:
+                array_type = ctypes.c_int32 * (2 * res.n_entries)
+                flat = ctypes.cast(res.entries, ctypes.POINTER(array_type)).contents[:]
+            pairs = list(zip(flat[0::2], flat[1::2]))
+            return {
+                self.stop_id(stop): pairs[starts[stop] : starts[stop + 1]]
+                for stop in range(self.n_stops)
+                if starts[stop] < starts[stop + 1]
+            }
+        finally:
+            self._lib.gtt_free_profile(result)
+
+    def isochrone(
+        self,
+        from_stop_ids: Iterable[str],
+        day: date | datetime,
+        departures: List[int],
+        max_duration: int,
+        cell_size: Optional[float] = None,
+        walk_radius: float = 500.0,
+        hexagonal: bool = True,
+        n_threads: Optional[int] = None,
+    ) -> Tuple[Dict[str, StopReach], List[IsochroneCell]]:
+        """Travel times to every stop reached within max_duration seconds,
+        over several departure times evaluated in parallel.
+
+        When cell_size (metres) is given, the median travel times are also
+        rasterized onto hexagonal (or square) cells, each cell taking the
+        best stop within walk_radius metres plus the walk.
+        """
+        from_stops, n_from = self._stop_indices(from_stop_ids)
+        if n_from == 0 or not departures:
+            return {}, []
+        departure_array = (ctypes.c_int32 * len(departures))(*departures)
+        query = _IsochroneQuery(
+            from_stops,
+            n_from,
+            days_since_epoch(day),
+            departure_array,
+            len(departures),
+            max_duration,
+            n_threads or min(len(departures), os.cpu_count() or 1),
+        )
+        reach = (_StopReach * max(self.n_stops, 1))()
+        if self._lib.gtt_isochrone(self._handle, ctypes.byref(query), reach) != 0:
+            raise MemoryError("Native isochrone ran out of memory")
+
+        stops = {
+            self.stop_id(stop): StopReach(
+                first_arrival=r.first_arrival if r.first_arrival != INT32_MAX else None,
+                min_travel=r.min_travel,
+                median_travel=r.median_travel,
+            )
+            for stop, r in enumerate(reach[: self.n_stops])
+            if r.min_travel != INT32_MAX
+        }
+
+        cells = []
+        if cell_size:
+            capacity = 65536
+            while True:
+                out = (_Cell * capacity)()
+                total = self._lib.gtt_rasterize(
+                    self._handle,
+                    reach,
+                    max_duration,
+                    cell_size,
+                    walk_radius,
+                    int(hexagonal),
+                    out,
+                    capacity,
+                )
+                if total <= capacity:
+                    break
+                capacity = total
+            cells = [IsochroneCell(c.lat, c.lon, c.travel_time) for c in out[:total]]
+        return stops, cells
+
+
+    def route_calendars(
+        self,
+        routes: List[Tuple[Iterable[str], Iterable[str]]],
+        n_threads: Optional[int] = None,
+    ) -> List[RouteCalendar]:
+        """Service calendars of many routes, computed in parallel.
+
+        Each route is given as (service IDs of its trips, service IDs whose
+        running days count as the route's). Unknown services are ignored.
+        """
+        if self._service_index is None:
+            self._service_index = {
+                self._str(self._lib.gtt_service_id(self._handle, s)): s
+                for s in range(self.n_services)
+            }
+
+        def csr(lists: List[List[int]]):
+            starts = [0]
+            flat = []
+            for values in lists:
+                flat.extend(values)
+                starts.append(len(flat))
+            return (
+                (ctypes.c_uint32 * len(starts))(*starts),
+                (ctypes.c_uint32 * max(len(flat), 1))(*flat),
+            )
+
+        index = self._service_index
+        services_start, services = csr(
+            [[index[s] for s in set(services) if s in index] for services, _ in routes]
+        )
+        active_start, active = csr(
+            [[index[s] for s in set(active) if s in index] for _, active in routes]
+        )
+        query = _CalendarQuery(
+            services_start,
+            services,
+            active_start,
+            active,
+            len(routes),
+            n_threads or os.cpu_count() or 1,
+        )
+        result = self._lib.gtt_route_calendars(self._handle, ctypes.byref(query))
+        if not result:
+            raise MemoryError("Native route calendars ran out of memory")
+        try:
+            res = result.contents
+            days = res.days[: res.n_days]
+            calendars = []
+            for r in range(res.n_routes):
+                rc = res.routes[r]
+                i = rc.first_day
+                valid = days[i : i + rc.n_valid]
+                i += rc.n_valid
+                additions = days[i : i + rc.n_additions]
+                i += rc.n_additions
+                removals = days[i : i + rc.n_removals]
+                i += rc.n_removals
+                ranges = days[i : i + 2 * rc.n_ranges]
+                calendars.append(
+                    RouteCalendar(
+                        calendar_weekdays=weekday_names(rc.calendar_weekdays),
+                        valid_days=valid,
+                        additions=additions,
+                        removals=removals,
+                        ranges=list(zip(ranges[0::2], ranges[1::2])),
+                        valid_weekdays=weekday_names(rc.valid_weekdays),
+                        addition_weekdays=weekday_names(rc.addition_weekdays),
+                    )
+                )
+            return calendars
+        finally:
+            self._lib.gtt_free_route_calendars(result)
+
+    def locate_vehicles(
+        self, vehicles: List[Tuple[str, str, float]]
+    ) -> List[Optional[VehicleLocation]]:
+        """Positions of vehicles given as (trip ID, ID of the stop they are
+        heading to, metres left to it), located in one native call on the
+        stop projections computed when the timetable was built. None for
+        vehicles with an unknown trip or stop, a trip without a shape, or
+        heading to the first stop of their trip."""
+        n = len(vehicles)
+        if n == 0:
+            return []
+        queries = (_VehicleQuery * n)()
+        for q, (trip_id, stop_id, distance) in zip(queries, vehicles):
+            trip = self._lib.gtt_find_trip(self._handle, trip_id.encode("utf-8"))
+            stop = self.find_stop(stop_id)
+            q.trip = trip if trip >= 0 else NONE
+            q.next_stop = stop if stop is not None else NONE
+            q.next_pos = NONE
+            q.distance_to_next = distance
+        out = (_VehicleLocation * n)()
+        self._lib.gtt_locate_vehicles(self._handle, queries, n, out)
+        return [
+            VehicleLocation(o.lat, o.lon, o.bearing, o.segment_length) if o.located else None
+            for o in out
+        ]
+
+    def scheduled_vehicles(
+        self,
+        day: date | datetime,
+        time: int,
+        bbox: Optional[Tuple[float, float, float, float]] = None,
+        n_threads: Optional[int] = None,
+    ) -> List[ScheduledVehicle]:
+        """Every trip running at time (seconds after midnight of day)
+        according to the timetable, placed between its last and next stop.
+        bbox is (min_lat, min_lon, max_lat, max_lon)."""
+        query = _ScheduleQuery(
+            days_since_epoch(day),
+            time,
+            int(bbox is not None),
+            n_threads or os.cpu_count() or 1,
+            *(bbox or (0.0, 0.0, 0.0, 0.0)),
+        )
+        result = self._lib.gtt_scheduled_vehicles(self._handle, ctypes.byref(query))
+        if not result:
+            raise MemoryError("Native scheduled vehicles ran out of memory")
+        try:
+            res = result.contents
+            vehicles = []
+            for v in res.vehicles[: res.n_vehicles]:
+                direction = self._lib.gtt_trip_direction(self._handle, v.trip)
+                vehicles.append(
+                    ScheduledVehicle(
+                        trip_id=self._str(self._lib.gtt_trip_id(self._handle, v.trip)),
+                        route_id=self._str(
+                            self._lib.gtt_route_id(
+                                self._handle, self._lib.gtt_trip_route(self._handle, v.trip)
+                            )
+                        ),
+                        headsign=self._str(self._lib.gtt_trip_headsign(self._handle, v.trip)),
+                        direction_id=str(direction) if direction >= 0 else None,
+                        lat=v.lat,
+                        lon=v.lon,
+                        bearing=v.bearing,
+                        from_stop_id=self.stop_id(v.from_stop),
+                        to_stop_id=self.stop_id(v.to_stop),
+                        progress=v.progress,
+                        shift=v.shift,
+                        previous_day=v.day != query.day,
+                        on_shape=bool(v.on_shape),
+                    )
+                )
+            return vehicles
+        finally:
+            self._lib.gtt_free_scheduled_vehicles(result)
+
+    def decode_realtime(
+        self,
+        data: bytes,
+        id_prefixes: Iterable[str] = (),
+        stop_separator: Optional[str] = None,
+    ) -> RealtimeFeed:
+        """Decode a GTFS-Realtime TripUpdates or VehiclePositions message
+        natively, resolving its ids to timetable indices. id_prefixes are
+        removed from trip, route and stop ids, and stop ids are cut at the
+        first stop_separator (platforms of a station); the ids returned are
+        those looked up. Raises ValueError for malformed messages."""
+        options = _rt_options(id_prefixes, stop_separator)
+        result = self._lib.gtt_rt_decode(self._handle, data, len(data), ctypes.byref(options))
+        if not result:
+            raise ValueError("Malformed GTFS-Realtime message")
+        try:
+            return self._realtime_feed(result.contents, data)
+        finally:
+            self._lib.gtt_free_rt_feed(result)
+
+    def decode_realtime_file(
+        self,
+        path: Path,
+        id_prefixes: Iterable[str] = (),
+        stop_separator: Optional[str] = None,
+    ) -> RealtimeFeed:
+        """decode_realtime() of a message saved to a file, such as a
+        recorded .pb feed"""
+        options = _rt_options(id_prefixes, stop_separator)
+        result = self._lib.gtt_rt_decode_file(
+            self._handle, str(path).encode("utf-8"), ctypes.byref(options)
+        )
+        if not result:
+            raise ValueError(f"Could not decode GTFS-Realtime message {path}")
+        try:
+            res = result.contents
+            return self._realtime_feed(res, ctypes.string_at(res.data, res.size))
+        finally:
+            self._lib.gtt_free_rt_feed(result)
+
+    def _realtime_feed(self, res: _RtFeed, data: bytes) -> RealtimeFeed:
+        # The records are unpacked from their raw bytes, which is much
+        # faster than reading the fields of the ctypes structures
+        def records(array, n: int, fmt: str):
+            return struct.iter_unpack(fmt, ctypes.string_at(array, n * struct.calcsize(fmt)))
+
+        def text(offset: int, length: int) -> str:
+            return data[offset : offset + length].decode("utf-8", errors="replace")
+
+        def index(value: int) -> Optional[int]:
+            return value if value != NONE else None
+
+        def start_date(day: int) -> Optional[date]:
+            return date(1970, 1, 1) + timedelta(days=day) if day != INT32_MIN else None
+
+        stop_time_updates = [
+            RealtimeStopTimeUpdate(
+                stop_id=text(id_offset, id_length),
+                stop=index(stop),
+                stop_sequence=index(sequence),
+                schedule_relationship=relationship,
+                arrival_time=arrival if flags & RT_HAS_ARRIVAL_TIME else None,
+                arrival_delay=arrival_delay if flags & RT_HAS_ARRIVAL_DELAY else None,
+                departure_time=departure if flags & RT_HAS_DEPARTURE_TIME else None,
+                departure_delay=departure_delay if flags & RT_HAS_DEPARTURE_DELAY else None,
+                scheduled_arrival=scheduled_arrival if flags & RT_HAS_SCHEDULED_ARRIVAL else None,
+                scheduled_departure=(
+                    scheduled_departure if flags & RT_HAS_SCHEDULED_DEPARTURE else None
+                ),
+            )
+            for (
+                stop,
+                sequence,
+                id_offset,
+                id_length,
+                arrival_delay,
+                departure_delay,
+                flags,
+                relationship,
+                arrival,
+                departure,
+                scheduled_arrival,
+                scheduled_departure,
+            ) in records(res.stop_time_updates, res.n_stop_time_updates, _RT_STOP_TIME_UPDATE)
+        ]
+
+        trip_updates = []
+        for t in records(res.trip_updates, res.n_trip_updates, _RT_TRIP_UPDATE):
+            trip, route, first, n_updates = t[:4]
+            start_day, start_time, delay, flags, relationship, direction, timestamp = t[12:]
+            trip_updates.append(
+                RealtimeTripUpdate(
+                    entity_id=text(t[4], t[5]),
+                    trip_id=text(t[6], t[7]),
+                    route_id=text(t[8], t[9]),
+                    vehicle_id=text(t[10], t[11]),
+                    trip=index(trip),
+                    route=index(route),
+                    start_date=start_date(start_day),
+                    start_time=start_time if start_time >= 0 else None,
+                    direction_id=index(direction),
+                    schedule_relationship=relationship,
+                    delay=delay if flags & RT_HAS_DELAY else None,
+                    timestamp=timestamp if flags & RT_HAS_TIMESTAMP else None,
+                    deleted=bool(flags & RT_DELETED),
+                    stop_time_updates=stop_time_updates[first : first + n_updates],
+                )
+            )
+
+        vehicles = []
+        for v in records(res.vehicles, res.n_vehicles, _RT_VEHICLE):
+            trip, route, stop, sequence = v[:4]
+            (
+                start_day,
+                start_time,
+                direction,
+                flags,
+                status,
+                congestion,
+                occupancy,
+                vehicle_type,
+                stop_distance,
+                _,
+                timestamp,
+                lat,
+                lon,
+                bearing,
+                speed,
+                odometer,
+            ) = v[20:]
+            has_position = bool(flags & RT_HAS_POSITION)
+            vehicles.append(
+                RealtimeVehicle(
+                    entity_id=text(v[4], v[5]),
+                    trip_id=text(v[6], v[7]),
+                    route_id=text(v[8], v[9]),
+                    stop_id=text(v[10], v[11]),
+                    vehicle_id=text(v[12], v[13]),
+                    label=text(v[14], v[15]),
+                    license_plate=text(v[16], v[17]),
+                    trip=index(trip),
+                    route=index(route),
+                    stop=index(stop),
+                    start_date=start_date(start_day),
+                    start_time=start_time if start_time >= 0 else None,
+                    direction_id=index(direction),
+                    current_stop_sequence=index(sequence),
+                    current_status=status if flags & RT_HAS_STATUS else None,
+                    congestion_level=congestion,
+                    occupancy_status=occupancy,
+                    timestamp=timestamp if flags & RT_HAS_TIMESTAMP else None,
+                    lat=lat if has_position else None,
+                    lon=lon if has_position else None,
+                    bearing=bearing if flags & RT_HAS_BEARING else None,
+                    speed=speed if flags & RT_HAS_SPEED else None,
+                    odometer=odometer if flags & RT_HAS_ODOMETER else None,
+                    deleted=bool(flags & RT_DELETED),
+                    vehicle_model=text(v[18], v[19]),
+                    vehicle_type=vehicle_type if flags & RT_HAS_VEHICLE_TYPE else None,
+                    door_open=bool(flags & RT_DOOR_OPEN),
+                    deviated=bool(flags & RT_DEVIATED),
+                    stop_distance=stop_distance if flags & RT_HAS_STOP_DISTANCE else None,
+                )
+            )
+        return RealtimeFeed(
+            timestamp=res.timestamp or None,
+            n_entities=res.n_entities,
+            trip_updates=trip_updates,
+            vehicles=vehicles,
+        )
+
+def _rt_options(id_prefixes: Iterable[str], stop_separator: Optional[str]) -> _RtOptions:
+    prefixes = b"".join(p.encode("utf-8") + b"\0" for p in id_prefixes if p)
+    return _RtOptions(
+        prefixes + b"\0" if prefixes else None,
+        stop_separator.encode("utf-8") if stop_separator else b"\0",
+    )
+
+
+def load_native_timetable(data_path: Path, cache_key: str) -> Optional[NativeTimetable]:
+    """Open the compiled timetable of a GTFS directory, building it if it is
+    missing or was built from different data. Returns None when the native
+    library is unavailable or the build fails."""
+    lib = _load_library()
+    if lib is None:
+        return None
+
+    path = Path(data_path) / TIMETABLE_FILE
+    key = cache_key.encode("utf-8")
+    handle = lib.gtt_open(str(path).encode("utf-8"), key) if path.exists() else None
+    if not handle:
+        logger.info(f"Building native timetable at {path}")
+        if lib.gtt_build(str(data_path).encode("utf-8"), str(path).encode("utf-8"), key) != 0:
+            logger.warning(f"Failed to build native timetable for {data_path}")
+            return None
+        handle = lib.gtt_open(str(path).encode("utf-8"), key)
+        if not handle:
+            logger.warning(f"Failed to open native timetable {path}")
+            return None
+
+    timetable = NativeTimetable(lib, handle, path)
+    logger.info(
+        f"Native timetable loaded: {timetable.n_stops} stops, {timetable.n_trips} trips, "
+        f"{timetable.n_patterns} patterns"
+    )
+    return timetable
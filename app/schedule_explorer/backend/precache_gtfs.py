@@ -14,7 +14,8 @@ import msgpack
 from dataclasses import asdict
 import re
 import os
-from .gtfs_loader import load_feed, bytes_to_mb, CACHE_VERSION, calculate_gtfs_hash
+from .gtfs_cache import pack_cache, write_cache_data
+from .gtfs_loader import load_feed, bytes_to_mb, cache_sections, CACHE_VERSION, calculate_gtfs_hash
 
 logger = logging.getLogger("schedule_explorer.precache_gtfs")
 
@@ -119,82 +120,20 @@ def precache_gtfs(data_dir: str | Path, max_cpu_percent: float = 85.0, check_int
     
     # Load the feed with CPU checks
     logger.info("Loading GTFS feed...")
-    feed = load_feed(data_path, cpu_check_fn=check_cpu_usage)
+    feed = load_feed(data_path, cpu_check_fn=check_cpu_usage, cpu_limit=int(max_cpu_percent))
     check_cpu_usage()
     
     # Serialize the feed
     logger.info("Serializing feed data...")
     t0 = time.time()
     
-    # Create a custom dictionary without _feed references
-    data = {
-        "stops": {stop_id: asdict(stop) for stop_id, stop in feed.stops.items()},
-        "routes": [],
-        "calendars": {cal_id: asdict(cal) for cal_id, cal in feed.calendars.items()},
-        "calendar_dates": [asdict(cal_date) for cal_date in feed.calendar_dates],
-        "trips": {trip_id: asdict(trip) for trip_id, trip in feed.trips.items()},
-        "stop_times_dict": feed.stop_times_dict,
-        "agencies": {agency_id: asdict(agency) for agency_id, agency in feed.agencies.items()},
-    }
+    data = cache_sections(feed)
     check_cpu_usage()
     
-    # Handle routes separately to avoid _feed recursion
-    for route in feed.routes:
-        route_dict = {
-            "route_id": route.route_id,
-            "route_name": route.route_name,
-            "trip_id": route.trip_id,
-            "service_days": route.service_days,
-            "stops": [
-                {
-                    "stop": asdict(rs.stop),
-                    "arrival_time": rs.arrival_time,
-                    "departure_time": rs.departure_time,
-                    "stop_sequence": rs.stop_sequence,
-                }
-                for rs in route.stops
-            ],
-            "shape": asdict(route.shape) if route.shape else None,
-            "short_name": route.short_name,
-            "long_name": route.long_name,
-            "route_type": route.route_type,
-            "color": route.color,
-            "text_color": route.text_color,
-            "agency_id": route.agency_id,
-            "headsigns": route.headsigns,
-            "service_ids": route.service_ids,
-            "direction_id": route.direction_id,
-            "route_desc": route.route_desc,
-            "route_url": route.route_url,
-            "route_sort_order": route.route_sort_order,
-            "continuous_pickup": route.continuous_pickup,
-            "continuous_drop_off": route.continuous_drop_off,
-            "trip_ids": [trip.id for trip in route.trips],
-            "service_days_explicit": route.service_days_explicit,
-            "calendar_dates_additions": [d.isoformat() for d in route.calendar_dates_additions],
-            "calendar_dates_removals": [d.isoformat() for d in route.calendar_dates_removals],
-            "valid_calendar_days": [d.isoformat() for d in route.valid_calendar_days],
-            "service_calendar": route.service_calendar,
-        }
-        data["routes"].append(route_dict)
-        check_cpu_usage()
-    
-    # Convert datetime objects to ISO format strings
-    if "calendars" in data:
-        for calendar in data["calendars"].values():
-            calendar["start_date"] = calendar["start_date"].isoformat()
-            calendar["end_date"] = calendar["end_date"].isoformat()
-    check_cpu_usage()
-    
-    if "calendar_dates" in data:
-        for cal_date in data["calendar_dates"]:
-            cal_date["date"] = cal_date["date"].isoformat()
-    check_cpu_usage()
-    
-    # Pack with msgpack
+    # Pack each section with msgpack and compress its blocks
     logger.info("Packing data with msgpack...")
     t0 = time.time()
-    packed_data = msgpack.packb(data, use_bin_type=True)
+    packed_data = pack_cache(data)
     logger.info(f"Packed data size: {bytes_to_mb(len(packed_data))} MB in {time.time() - t0:.2f}s")
     check_cpu_usage()
     
@@ -202,8 +141,7 @@ def precache_gtfs(data_dir: str | Path, max_cpu_percent: float = 85.0, check_int
     cache_file = data_path / ".gtfs_cache"
     hash_file = data_path / ".gtfs_cache_hash"
     logger.info(f"Saving to cache file: {cache_file} with hash: {current_hash}")
-    with open(cache_file, "wb") as f:
-        f.write(packed_data)
+    write_cache_data(cache_file, packed_data)
     hash_file.write_text(current_hash)
     
     total_time = time.time() - start_time
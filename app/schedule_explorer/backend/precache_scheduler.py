@@ -0,0 +1,245 @@
+"""
+Background stop times conversion for several providers at once.
+
+Runs one gtfs_precache --batch process (see the batch mode comment in
+gtfs_precache.c) and feeds it a job per GTFS directory whose converted stop
+times (gtfs_loader.STOP_TIMES_CACHE) are missing or older than
+stop_times.txt. The process converts several feeds at once within a memory
+budget and a CPU limit; the provider a user is waiting on is moved to the
+front of the queue. Loading a feed afterwards finds every trip already
+converted and only checks it.
+
+Jobs are identified by their GTFS directory. Their latest progress event is
+kept for status().
+"""
+
+import json
+import logging
+import os
+import subprocess
+import threading
+import time
+from pathlib import Path
+from typing import Callable, Dict, List, Optional
+
+from .gtfs_loader import STOP_TIMES_CACHE, find_previous_stop_times
+
+logger = logging.getLogger("schedule_explorer.precache_scheduler")
+
+
+def needs_precache(data_path: Path) -> bool:
+    """Whether the stop times of data_path have to be converted again."""
+    txt_path = data_path / "stop_times.txt"
+    output = data_path / STOP_TIMES_CACHE
+    index = output.with_name(STOP_TIMES_CACHE + ".index")
+    if not txt_path.exists():
+        return False
+    if not output.exists() or not index.exists():
+        return True
+    return output.stat().st_mtime < txt_path.stat().st_mtime
+
+
+class PrecacheScheduler:
+    def __init__(
+        self,
+        executable: Path,
+        jobs: Optional[int] = None,
+        max_memory_mb: Optional[int] = None,
+        max_cpu: Optional[int] = None,
+    ):
+        self.executable = Path(executable)
+        self.jobs = jobs
+        self.max_memory_mb = max_memory_mb
+        self.max_cpu = max_cpu
+        self._process: Optional[subprocess.Popen] = None
+        self._status: Dict[str, Dict] = {}
+        self._changed = threading.Condition()
+        self._write_lock = threading.Lock()
+
+    @classmethod
+    def from_env(cls) -> "PrecacheScheduler":
+        """Limits from PRECACHE_JOBS, PRECACHE_MAX_MEMORY_MB and
+        PRECACHE_MAX_CPU (percent of one core); gtfs_precache picks defaults
+        for the ones not set."""
+
+        def env_int(name: str) -> Optional[int]:
+            value = os.environ.get(name)
+            return int(value) if value else None
+
+        return cls(
+            Path(__file__).parent.absolute() / "gtfs_precache",
+            jobs=env_int("PRECACHE_JOBS"),
+            max_memory_mb=env_int("PRECACHE_MAX_MEMORY_MB"),
+            max_cpu=env_int("PRECACHE_MAX_CPU"),
+        )
+
+    @property
+    def running(self) -> bool:
+        return self._process is not None and self._process.poll() is None
+
+    def start(self) -> bool:
+        """Start the batch process. Returns False when gtfs_precache is not
+        available, in which case feeds are converted when they are loaded."""
+        if self.running:
+            return True
+        if not self.executable.exists():
+            logger.info("gtfs_precache not available, stop times are converted on load")
+            return False
+        cmd = [str(self.executable), "--batch", "--progress=json"]
+        if self.jobs:
+            cmd += ["--jobs", str(self.jobs)]
+        if self.max_memory_mb:
+            cmd += ["--max-memory", str(self.max_memory_mb)]
+        if self.max_cpu:
+            cmd += ["--max-cpu", str(self.max_cpu)]
+        try:
+            self._process = subprocess.Popen(
+                cmd,
+                stdin=subprocess.PIPE,
+                stdout=subprocess.PIPE,
+                stderr=subprocess.PIPE,
+                text=True,
+                bufsize=1,  # Line buffered
+            )
+        except OSError as e:
+            logger.warning(f"Could not start gtfs_precache --batch: {e}")
+            return False
+        threading.Thread(target=self._read_events, args=(self._process,), daemon=True).start()
+        threading.Thread(target=self._read_errors, args=(self._process,), daemon=True).start()
+        logger.info(f"Started precache scheduler: {' '.join(cmd)}")
+        return True
+
+    def close(self) -> None:
+        """Stop the batch process. Jobs in progress are abandoned; their
+        outputs are only renamed into place once complete."""
+        process, self._process = self._process, None
+        if process is None:
+            return
+        process.terminate()
+        try:
+            process.wait(timeout=5)
+        except subprocess.TimeoutExpired:
+            process.kill()
+
+    @staticmethod
+    def job_id(data_path: Path) -> str:
+        # Echoed unescaped in JSON events
+        return f"{data_path.parent.name}/{data_path.name}".replace('"', "'").replace("\\", "/")
+
+    def submit(self, data_path: Path, priority: int = 0) -> Optional[str]:
+        """Queue the conversion of a GTFS directory. Returns the job ID, or
+        None when the directory is up to date or the scheduler is not running."""
+        data_path = Path(data_path)
+        if not self.running or not needs_precache(data_path):
+            return None
+        job = self.job_id(data_path)
+        with self._changed:
+            if self._status.get(job, {}).get("state") in ("queued", "running"):
+                return job
+            self._status[job] = {"job": job, "state": "submitted", "path": str(data_path)}
+        previous = find_previous_stop_times(data_path)
+        fields = [
+            "job",
+            job,
+            str(priority),
+            str(data_path / "stop_times.txt"),
+            str(data_path / STOP_TIMES_CACHE),
+            f"incremental={previous}" if previous is not None else "incremental",
+        ]
+        if any("\t" in field or "\n" in field for field in fields):
+            logger.warning(f"Cannot queue {data_path}: tab or newline in path")
+            return None
+        self._send(fields)
+        return job
+
+    def prioritize(self, data_path: Path) -> bool:
+        """Move a queued job to the front. Returns whether it is still to
+        finish (queued or running)."""
+        job = self.job_id(Path(data_path))
+        with self._changed:
+            state = self._status.get(job, {}).get("state")
+        if state not in ("submitted", "queued", "running"):
+            return False
+        if state != "running":
+            self._send(["prioritize", job])
+        return True
+
+    def wait(
+        self,
+        data_path: Path,
+        timeout: Optional[float] = None,
+        progress_fn: Optional[Callable[[Dict], None]] = None,
+    ) -> bool:
+        """Block until the job of data_path is no longer queued or running,
+        passing its progress events to progress_fn. Returns True when it
+        succeeded or there was nothing to wait for."""
+        job = self.job_id(Path(data_path))
+        deadline = None if timeout is None else time.time() + timeout
+        with self._changed:
+            while self._status.get(job, {}).get("state") in ("submitted", "queued", "running"):
+                remaining = None if deadline is None else deadline - time.time()
+                if remaining is not None and remaining <= 0:
+                    return False
+                self._changed.wait(remaining if remaining is not None else 1.0)
+                event = self._status.get(job, {}).get("event")
+                if progress_fn and event:
+                    progress_fn(event)
+            return self._status.get(job, {}).get("state") != "failed"
+
+    def status(self) -> List[Dict]:
+        """Every job seen, with its state and latest progress event."""
+        with self._changed:
+            return [dict(status) for status in self._status.values()]
+
+    def _send(self, fields: List[str]) -> None:
+        process = self._process
+        if process is None:
+            return
+        with self._write_lock:
+            try:
+                process.stdin.write("\t".join(fields) + "\n")
+                process.stdin.flush()
+            except (BrokenPipeError, OSError) as e:
+                logger.warning(f"Precache scheduler is gone: {e}")
+
+    def _read_events(self, process: subprocess.Popen) -> None:
+        for line in iter(process.stdout.readline, ""):
+            line = line.strip()
+            if not line.startswith("{"):
+                if line:
+                    logger.debug(f"gtfs_precache batch: {line}")
+                continue
+            try:
+                event = json.loads(line)
+            except ValueError:
+                continue
+            job = event.get("job")
+            if not job:
+                continue
+            kind = event.get("event")
+            with self._changed:
+                status = self._status.setdefault(job, {"job": job})
+                status["event"] = event
+                if kind == "queued":
+                    status["state"] = "queued"
+                elif kind == "started":
+                    status["state"] = "running"
+                    status["mode"] = event.get("mode")
+                elif kind == "done":
+                    status["state"] = "done" if event.get("status") == 0 else "failed"
+                    logger.info(f"Precached {job}: {status['state']} in {event.get('elapsed_s')}s")
+                self._changed.notify_all()
+        process.stdout.close()
+
+        # The process is gone: nothing left will finish
+        with self._changed:
+            for status in self._status.values():
+                if status.get("state") in ("submitted", "queued", "running"):
+                    status["state"] = "failed"
+            self._changed.notify_all()
+
+    def _read_errors(self, process: subprocess.Popen) -> None:
+        for line in iter(process.stderr.readline, ""):
+            if line.strip():
+                logger.warning(f"gtfs_precache batch stderr: {line.strip()}")
+        process.stderr.close()
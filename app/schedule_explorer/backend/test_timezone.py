@@ -4,7 +4,7 @@ import pytest
 from datetime import datetime
 from zoneinfo import ZoneInfo
 from unittest.mock import MagicMock, patch
-from .main import get_waiting_times
+from .main import ProviderState, get_waiting_times
 from .gtfs_loader import Agency, Stop
 
 
@@ -36,7 +36,7 @@ async def test_timezone_handling_with_agency_timezone(mock_feed):
         "app.schedule_explorer.backend.main.ensure_provider_loaded"
     ) as mock_ensure_provider:
         # Mock the provider loading
-        mock_ensure_provider.return_value = (True, "OK", MagicMock())
+        mock_ensure_provider.return_value = (ProviderState.READY, "OK", MagicMock())
 
         # Test with UTC time
         response = await get_waiting_times(
@@ -68,7 +68,7 @@ async def test_timezone_handling_without_agency_timezone(mock_feed):
         "app.schedule_explorer.backend.main.ensure_provider_loaded"
     ) as mock_ensure_provider:
         # Mock the provider loading
-        mock_ensure_provider.return_value = (True, "OK", MagicMock())
+        mock_ensure_provider.return_value = (ProviderState.READY, "OK", MagicMock())
 
         # Test with UTC time
         response = await get_waiting_times(
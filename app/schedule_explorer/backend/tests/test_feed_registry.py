@@ -0,0 +1,47 @@
+import time
+
+from ..feed_registry import FeedRegistry
+from ..gtfs_loader import FlixbusFeed
+
+MB = 1024 * 1024
+
+
+def make_feed() -> FlixbusFeed:
+    return FlixbusFeed(stops={}, routes=[])
+
+
+def test_resident_feed_is_reused():
+    registry = FeedRegistry(budget_bytes=100 * MB)
+    stib, sncb = make_feed(), make_feed()
+    registry.put("stib", stib, load_seconds=5, heap_bytes=10 * MB)
+    registry.put("sncb", sncb, load_seconds=5, heap_bytes=10 * MB)
+    assert registry.get("stib") is stib
+    assert registry.get("sncb") is sncb
+    assert registry.get("delijn") is None
+
+
+def test_evicts_least_recently_used_over_budget():
+    registry = FeedRegistry(budget_bytes=25 * MB)
+    registry.put("a", make_feed(), load_seconds=5, heap_bytes=10 * MB)
+    registry.put("b", make_feed(), load_seconds=5, heap_bytes=10 * MB)
+    time.sleep(0.01)
+    registry.get("a")
+    registry.put("c", make_feed(), load_seconds=5, heap_bytes=10 * MB)
+    assert "a" in registry and "c" in registry and "b" not in registry
+
+
+def test_expensive_feed_outlives_cheap_one():
+    registry = FeedRegistry(budget_bytes=25 * MB)
+    registry.put("slow", make_feed(), load_seconds=60, heap_bytes=10 * MB)
+    time.sleep(0.01)
+    registry.put("fast", make_feed(), load_seconds=0.5, heap_bytes=10 * MB)
+    time.sleep(0.01)
+    registry.put("new", make_feed(), load_seconds=5, heap_bytes=10 * MB)
+    assert "slow" in registry and "fast" not in registry
+
+
+def test_keeps_requested_feed_even_over_budget():
+    registry = FeedRegistry(budget_bytes=1 * MB, max_feeds=4)
+    registry.put("a", make_feed(), load_seconds=5, heap_bytes=10 * MB)
+    registry.put("b", make_feed(), load_seconds=5, heap_bytes=10 * MB)
+    assert len(registry) == 1 and "b" in registry
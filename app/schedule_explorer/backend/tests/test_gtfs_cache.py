@@ -0,0 +1,86 @@
+import msgpack
+import pytest
+
+from ..gtfs_cache import CacheReader, get_codec, pack_cache, read_cache, write_cache
+
+SECTIONS = {
+    "stops": {
+        f"S{i}": {"id": f"S{i}", "name": f"Stop {i}", "lat": 50.0 + i / 1000, "lon": 4.0}
+        for i in range(500)
+    },
+    "routes": [{"route_id": f"R{i}", "trip_ids": [f"T{i}", f"T{i + 1}"]} for i in range(300)],
+    "calendar_dates": [],
+    "version": "x",
+}
+
+
+@pytest.mark.parametrize("codec", ["zstd", "lz4", "zlib", "none"])
+def test_round_trip(codec, tmp_path):
+    if get_codec(codec) is None:
+        pytest.skip(f"{codec} not available")
+    path = tmp_path / ".gtfs_cache"
+    write_cache(path, SECTIONS, codec=codec, block_size=2048, workers=2)
+    assert read_cache(path) == SECTIONS
+
+
+def test_lazy_blocks(tmp_path):
+    path = tmp_path / ".gtfs_cache"
+    path.write_bytes(pack_cache(SECTIONS, codec="zlib", block_size=2048))
+    with CacheReader(path) as reader:
+        assert reader.sections() == list(SECTIONS)
+        assert reader.block_count("stops") > 1
+        first = reader.block("stops", 0)
+        assert first and all(SECTIONS["stops"][k] == v for k, v in first.items())
+        last = reader.block("routes", reader.block_count("routes") - 1)
+        assert last[-1] == SECTIONS["routes"][-1]
+        assert reader.section("version") == "x"
+
+
+def test_legacy_plain_msgpack(tmp_path):
+    path = tmp_path / ".gtfs_cache"
+    path.write_bytes(msgpack.packb(SECTIONS, use_bin_type=True))
+    with CacheReader(path) as reader:
+        assert reader.legacy
+        assert reader.section("stops") == SECTIONS["stops"]
+
+
+def test_lazy_feed_sections(tmp_path):
+    from ..gtfs_loader import (
+        FlixbusFeed,
+        Route,
+        RouteStop,
+        Shape,
+        Stop,
+        Trip,
+        cache_sections,
+        deserialize_gtfs_data,
+    )
+
+    stops = {s: Stop(id=s, name=s, lat=50.0, lon=4.0) for s in ("A", "B", "C")}
+    stops["A"].translations = stops["C"].translations = {"fr": "Gare", "nl": "Station"}
+    trip = Trip(id="T1", route_id="R1", service_id="WK")
+    route = Route(
+        route_id="R1",
+        route_name="A - B",
+        trip_id="T1",
+        stops=[RouteStop(stops[s], "08:00:00", "08:00:00", i) for i, s in enumerate("AB")],
+        service_days=["monday"],
+        shape=Shape("SH1", [[50.0, 4.0], [50.1, 4.1]]),
+        trips=[trip],
+    )
+    feed = FlixbusFeed(stops=stops, routes=[route], trips={"T1": trip})
+    path = tmp_path / ".gtfs_cache"
+    write_cache(path, cache_sections(feed))
+
+    lazy = deserialize_gtfs_data(path)
+    assert lazy.loaded_sections() == ["stops"]
+    assert lazy.stops == stops
+    assert lazy.stops["A"].translations is lazy.stops["C"].translations
+    assert lazy.stops["B"].translations == {}
+
+    loaded = lazy.routes[0]
+    assert set(lazy.loaded_sections()) == {"stops", "trips", "routes"}
+    assert loaded.stops[1].stop is lazy.stops["B"]
+    assert loaded.trips[0] is lazy.trips["T1"]
+    assert loaded.shape == route.shape
+    assert loaded._feed is lazy
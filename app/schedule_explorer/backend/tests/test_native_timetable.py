@@ -0,0 +1,561 @@
+import struct
+import zipfile
+from datetime import date, datetime
+from pathlib import Path
+from typing import Dict, Optional
+
+import pytest
+
+from ..native_timetable import days_since_epoch, load_native_timetable, _load_library
+
+pytestmark = pytest.mark.skipif(
+    _load_library() is None, reason="native timetable library not built"
+)
+
+GTFS_FILES = {
+    "stops.txt": (
+        "stop_id,stop_name,stop_lat,stop_lon,location_type,parent_station\n"
+        'S1,"Station One",50.0,4.0,1,\n'
+        'A,"Station One, platform A",50.0,4.0,0,S1\n'
+        "B,Two,50.1,4.1,0,\n"
+        "C,Three,50.2,4.2,0,\n"
+        "D,Four,50.3,4.3,0,\n"
+        "E,Five,50.4,4.4,0,\n"
+        "F,Six,50.4005,4.4,0,\n"
+    ),
+    "routes.txt": (
+        "\ufeffroute_id,agency_id,route_short_name,route_long_name,route_type\r\n"
+        "R1,ag,1,One - Four,3\r\n"
+        "R2,ag,2,Four - One,3\r\n"
+        "R3,ag,3,Four - Five,3\r\n"
+    ),
+    "calendar.txt": (
+        "service_id,monday,tuesday,wednesday,thursday,friday,saturday,sunday,start_date,end_date\n"
+        "WK,1,1,1,1,1,0,0,20260101,20261231\n"
+        "SA,0,0,0,0,0,1,0,20260101,20261231\n"
+    ),
+    "calendar_dates.txt": (
+        "service_id,date,exception_type\n"
+        "SPECIAL,20260704,1\n"
+    ),
+    "trips.txt": (
+        "route_id,service_id,trip_id,trip_headsign,direction_id,shape_id\n"
+        "R1,WK,T1,Four,0,SH1\n"
+        "R1,WK,T2,Four,0,SH1\n"
+        "R1,SA,T3,Four,0,SH1\n"
+        "R2,WK,T4,One,1,SH2\n"
+        "R1,SPECIAL,T5,Four,0,SH1\n"
+        "R3,WK,T6,Five,0,SH3\n"
+    ),
+    "stop_times.txt": (
+        "trip_id,arrival_time,departure_time,stop_id,stop_sequence\n"
+        "T1,08:00:00,08:00:00,A,1\n"
+        "T1,,,B,2\n"
+        "T1,08:20:00,08:21:00,C,3\n"
+        "T1,08:30:00,08:30:00,D,4\n"
+        "T2,08:05:00,08:05:00,A,1\n"
+        "T2,08:10:00,08:10:00,B,2\n"
+        "T2,08:15:00,08:15:00,C,3\n"
+        "T2,08:20:00,08:20:00,D,4\n"
+        "T3,25:00:00,25:00:00,A,1\n"
+        "T3,25:10:00,25:10:00,B,2\n"
+        "T3,25:20:00,25:20:00,C,3\n"
+        "T3,25:30:00,25:30:00,D,4\n"
+        "T4,09:00:00,09:00:00,D,1\n"
+        "T4,09:10:00,09:10:00,C,2\n"
+        "T4,09:20:00,09:20:00,A,3\n"
+        "T5,10:00:00,10:00:00,A,1\n"
+        "T5,10:30:00,10:30:00,D,2\n"
+        "T6,08:35:00,08:35:00,D,1\n"
+        "T6,08:45:00,08:45:00,E,2\n"
+    ),
+}
+
+
+def write_feed(path: Path, overrides: Optional[Dict[str, str]] = None) -> Path:
+    """Write the test feed to path, with files replaced or added by overrides"""
+    for name, content in {**GTFS_FILES, **(overrides or {})}.items():
+        (path / name).write_text(content, encoding="utf-8")
+    return path
+
+
+@pytest.fixture
+def timetable(tmp_path: Path):
+    write_feed(tmp_path)
+    tt = load_native_timetable(tmp_path, "test-key")
+    assert tt is not None
+    yield tt
+    tt.close()
+
+
+def test_build_and_reopen(timetable, tmp_path):
+    assert timetable.n_stops == 7
+    assert timetable.n_trips == 6
+    # T2 overtakes T1, so the four-stop trips of R1 are split in two patterns
+    assert timetable.n_patterns == 5
+
+    reopened = load_native_timetable(tmp_path, "test-key")
+    assert reopened is not None and reopened.n_trips == 6
+    reopened.close()
+
+
+def test_trips_between_forward_only(timetable):
+    matches = timetable.trips_between(["A"], ["D"])
+    assert sorted(m.trip_id for m in matches) == ["T1", "T2", "T3", "T5"]
+
+    # T4 runs D -> A; searching A -> D must not return it reversed
+    assert [m.trip_id for m in timetable.trips_between(["D"], ["A"])] == ["T4"]
+
+
+def test_trips_between_multiple_stations(timetable):
+    matches = {m.trip_id: m for m in timetable.trips_between(["A", "B"], ["C", "D"])}
+    assert sorted(matches) == ["T1", "T2", "T3", "T5"]
+
+    # Board at the first from-stop, alight at the first to-stop after it
+    t1 = matches["T1"]
+    assert [s[0] for s in t1.stop_times] == ["A", "B", "C"]
+    assert t1.departure == 8 * 3600
+    assert t1.arrival == 8 * 3600 + 20 * 60
+    # Missing times are interpolated
+    assert t1.stop_times[1] == ("B", "08:10:00", "08:10:00")
+
+
+def test_trips_between_date_filter(timetable):
+    saturday = datetime(2026, 10, 17)
+    weekday = datetime(2026, 10, 16)
+    assert sorted(m.trip_id for m in timetable.trips_between(["A"], ["D"], saturday)) == [
+        "T3",
+        "T5",
+    ]
+    assert sorted(m.trip_id for m in timetable.trips_between(["A"], ["D"], weekday)) == [
+        "T1",
+        "T2",
+    ]
+    t3 = timetable.trips_between(["A"], ["D"], saturday)[0]
+    assert t3.service_days == ["saturday"]
+
+
+def test_find_trips_between_matches_python(tmp_path):
+    from ..gtfs_loader import load_feed
+
+    # Sparse stop_sequence values, as many feeds use
+    stop_times = "\n".join(
+        line if i == 0 else f"{line.rsplit(',', 1)[0]},{int(line.rsplit(',', 1)[1]) * 10}"
+        for i, line in enumerate(GTFS_FILES["stop_times.txt"].strip().split("\n"))
+    ) + "\n"
+    write_feed(tmp_path, {"stop_times.txt": stop_times})
+    feed = load_feed(tmp_path)
+    assert feed.native is not None
+
+    def summary(routes):
+        return sorted(
+            (r.trip_id, [(s.stop.id, s.stop_sequence) for s in r.stops]) for r in routes
+        )
+
+    for from_ids, to_ids in ((["A"], ["D"]), (["D"], ["A"]), (["A", "B"], ["C"])):
+        native = summary(feed.find_trips_between(from_ids, to_ids))
+        python_feed = load_feed(tmp_path)
+        python_feed.native = None
+        assert summary(python_feed.find_trips_between(from_ids, to_ids)) == native
+    assert ("T5", [("A", 10), ("D", 20)]) in summary(feed.find_trips_between(["A"], ["D"]))
+    # T4 runs D -> A and is not returned reversed by either path
+    assert [t for t, _ in summary(feed.find_trips_between(["A"], ["D"]))] == ["T1", "T2", "T3", "T5"]
+
+
+def test_unknown_stops(timetable):
+    assert timetable.trips_between(["nope"], ["D"]) == []
+
+
+def test_invalid_stop_sequence(tmp_path):
+    # Rows without a numeric stop_sequence are dropped, not placed first
+    write_feed(
+        tmp_path,
+        {
+            "stop_times.txt": GTFS_FILES["stop_times.txt"]
+            + "T5,10:10:00,10:10:00,B,\n"
+            + "T5,10:20:00,10:20:00,C,0x\n"
+        },
+    )
+    tt = load_native_timetable(tmp_path, "test-key")
+    (t5,) = [m for m in tt.trips_between(["A"], ["D"]) if m.trip_id == "T5"]
+    assert [s[0] for s in t5.stop_times] == ["A", "D"]
+    assert "T5" not in [m.trip_id for m in tt.trips_between(["B", "C"], ["A"])]
+    tt.close()
+
+
+def test_plan_journeys_with_transfer(timetable):
+    weekday = datetime(2026, 10, 16)
+    journeys = timetable.plan_journeys(["A"], ["F"], weekday, 7 * 3600 + 50 * 60, 8 * 3600 + 10 * 60)
+    # T1 reaches D at 08:30 too, but T2 leaves later for the same connection
+    assert len(journeys) == 1
+    journey = journeys[0]
+    assert journey.transfers == 1
+    assert [(leg.mode, leg.trip_id) for leg in journey.legs] == [
+        ("transit", "T2"),
+        ("transit", "T6"),
+        ("walk", None),
+    ]
+    assert journey.departure == 8 * 3600 + 5 * 60
+    # F is about 55 m from E, walked at 1.2 m/s after arriving at 08:45
+    assert 8 * 3600 + 45 * 60 < journey.arrival < 8 * 3600 + 47 * 60
+    assert journey.legs[0].stop_times[-1][0] == "D"
+
+
+def test_plan_journeys_after_midnight(timetable):
+    saturday = datetime(2026, 10, 17)
+    journeys = timetable.plan_journeys(["A"], ["D"], saturday, 24 * 3600, 26 * 3600)
+    assert [leg.trip_id for j in journeys for leg in j.legs] == ["T3"]
+    assert journeys[0].departure == 25 * 3600
+
+
+def test_earliest_arrivals(timetable):
+    weekday = datetime(2026, 10, 16)
+    arrivals = timetable.earliest_arrivals(["A"], weekday, 7 * 3600 + 55 * 60)
+    assert arrivals["A"] == arrivals["S1"] == 7 * 3600 + 55 * 60
+    assert arrivals["B"] == 8 * 3600 + 10 * 60
+    # T2 leaves A after T1 but reaches C and D first
+    assert arrivals["C"] == 8 * 3600 + 15 * 60
+    assert arrivals["D"] == 8 * 3600 + 20 * 60
+    assert arrivals["E"] == 8 * 3600 + 45 * 60
+    assert arrivals["F"] > arrivals["E"]
+
+    within = timetable.earliest_arrivals(["A"], weekday, 7 * 3600 + 55 * 60, 30 * 60)
+    assert sorted(within) == ["A", "B", "C", "D", "S1"]
+
+
+def test_profile(timetable):
+    weekday = datetime(2026, 10, 16)
+    profile = timetable.profile(["F"], weekday)
+    arrival_f = timetable.earliest_arrivals(["A"], weekday, 8 * 3600 + 5 * 60)["F"]
+    # T1 at 08:00 makes the same connection to T6 as T2 at 08:05
+    assert profile["A"] == [(8 * 3600 + 5 * 60, arrival_f)]
+    assert profile["D"] == [(8 * 3600 + 35 * 60, arrival_f)]
+    assert "F" not in profile
+
+    assert timetable.profile(["F"], datetime(2026, 10, 17)) == {}
+
+
+def test_isochrone(timetable):
+    weekday = datetime(2026, 10, 16)
+    departures = [7 * 3600 + 55 * 60, 8 * 3600]
+    reach, cells = timetable.isochrone(["A"], weekday, departures, 3600, n_threads=2)
+    d = reach["D"]
+    assert d.first_arrival == 8 * 3600 + 20 * 60
+    assert d.min_travel == 20 * 60
+    assert d.median_travel == 25 * 60
+    assert reach["E"].min_travel == 45 * 60
+    assert cells == []
+
+    _, cells = timetable.isochrone(["A"], weekday, departures, 3600, cell_size=200)
+    assert cells
+    assert all(cell.travel_time <= 3600 for cell in cells)
+    # Cells around D cannot be reached faster than D itself
+    near_d = [c for c in cells if abs(c.lat - 50.3) < 0.003 and abs(c.lon - 4.3) < 0.003]
+    assert near_d and min(c.travel_time for c in near_d) >= d.median_travel
+
+
+def test_isochrone_partial_reach(timetable):
+    weekday = datetime(2026, 10, 16)
+    # Only the first two departures catch a trip from A within the hour
+    departures = [7 * 3600 + 55 * 60, 8 * 3600, 9 * 3600, 9 * 3600 + 5 * 60, 9 * 3600 + 10 * 60]
+    reach, _ = timetable.isochrone(["A"], weekday, departures, 3600)
+    d = reach["D"]
+    assert d.min_travel == 20 * 60
+    # Median over the two departures that reach D, not over all five
+    assert d.median_travel == 25 * 60
+    assert all(r.median_travel <= 3600 for r in reach.values())
+
+
+def test_reachable_stops(timetable):
+    # Stop order follows the stop index, which is the order of stops.txt
+    assert timetable.reachable_stops("A") == ["B", "C", "D"]
+    assert timetable.reachable_stops("D") == ["A", "C", "E"]
+    assert timetable.reachable_stops("C", upstream=True) == ["A", "B", "D"]
+    assert timetable.reachable_stops("E", upstream=True) == ["D"]
+    assert timetable.reachable_stops("F") == []
+    assert timetable.reachable_stops("nope") == []
+
+
+def test_build_from_zip(timetable, tmp_path):
+    # Feeds are often zipped with a top-level folder
+    archive = tmp_path / "feed.zip"
+    with zipfile.ZipFile(archive, "w", zipfile.ZIP_DEFLATED) as zf:
+        for name, content in GTFS_FILES.items():
+            zf.writestr(f"gtfs/{name}", content)
+    output = tmp_path / "from_zip.bin"
+    lib = _load_library()
+    assert lib.gtt_build(str(archive).encode("utf-8"), str(output).encode("utf-8"), b"test-key") == 0
+    assert output.read_bytes() == timetable.path.read_bytes()
+
+
+def test_stop_translations(tmp_path):
+    # Legacy form keyed by stop name, then the table form where a record_id
+    # names a single stop
+    write_feed(
+        tmp_path,
+        {
+            "translations.txt": "trans_id,translation,lang\n"
+            "Two,Deux,fr\n"
+            "Two,Twee,nl\n"
+            "Three,Trois,fr\n"
+        },
+    )
+    tt = load_native_timetable(tmp_path, "test-key")
+    assert tt.languages() == ["fr", "nl"]
+    assert tt.stop_translations() == {
+        "B": {"fr": "Deux", "nl": "Twee"},
+        "C": {"fr": "Trois"},
+    }
+    tt.close()
+
+    write_feed(
+        tmp_path,
+        {
+            "translations.txt": "table_name,field_name,language,translation,record_id,record_sub_id,field_value\n"
+            "stops,stop_name,de,Vier,,,Four\n"
+            "stops,stop_name,de,Fünf,E,,\n"
+            "routes,route_long_name,de,Eins - Vier,R1,,\n"
+        },
+    )
+    tt = load_native_timetable(tmp_path, "other-key")
+    assert tt.stop_translations() == {"D": {"de": "Vier"}, "E": {"de": "Fünf"}}
+    tt.close()
+
+
+def test_stop_translations_match_python(tmp_path):
+    from ..gtfs_loader import load_translations
+
+    # G shares its name with B
+    stops = GTFS_FILES["stops.txt"] + "G,Two,50.5,4.5,0,\n"
+    forms = [
+        "trans_id,translation,lang\n"
+        "Two,Deux,fr\n"
+        "Two,Twee,nl\n"
+        "Three,Trois,fr\n"
+        "Nowhere,Nulle part,fr\n",
+        "table_name,field_name,language,translation,record_id,record_sub_id,field_value\n"
+        "stops,stop_name,fr,Deux,,,Two\n"
+        "stops,stop_name,fr,Deux bis,G,,\n"
+        "stops,stop_name,nl,Twee,,,Two\n"
+        "stops,stop_name,de,Fünf,E,,Five\n"
+        "stops,stop_name,de,Niemand,X,,\n"
+        "stops,stop_desc,de,Drei,C,,\n"
+        "stops,stop_name,,Drei,C,,\n"
+        "routes,route_long_name,de,Eins - Vier,R1,,\n",
+    ]
+    for i, form in enumerate(forms):
+        write_feed(tmp_path, {"stops.txt": stops, "translations.txt": form})
+        tt = load_native_timetable(tmp_path, f"key-{i}")
+        try:
+            assert load_translations(str(tmp_path)) == tt.stop_translations()
+        finally:
+            tt.close()
+    # The record_id of G overrides the translation of its name
+    assert load_translations(str(tmp_path)) == {
+        "B": {"fr": "Deux", "nl": "Twee"},
+        "G": {"fr": "Deux bis", "nl": "Twee"},
+        "E": {"de": "Fünf"},
+    }
+
+
+def test_route_calendars(timetable):
+    day = days_since_epoch(datetime(2026, 7, 4))
+    weekly, special, unknown = timetable.route_calendars(
+        [({"WK", "SPECIAL"}, {"WK", "SPECIAL"}), ({"SPECIAL"}, {"SPECIAL"}), ({"X"}, {"X"})]
+    )
+
+    assert weekly.calendar_weekdays == ["monday", "tuesday", "wednesday", "thursday", "friday"]
+    assert weekly.additions == [day] and weekly.removals == []
+    # Every weekday of 2026 plus the added Saturday
+    assert len(weekly.valid_days) == 261 + 1
+    assert day in weekly.valid_days
+    assert weekly.valid_weekdays == weekly.calendar_weekdays + ["saturday"]
+    # 2026-01-01 is a Thursday
+    assert weekly.ranges[0] == (
+        days_since_epoch(datetime(2026, 1, 1)),
+        days_since_epoch(datetime(2026, 1, 2)),
+    )
+    # The added Saturday extends the week from Monday 2026-06-29
+    assert (day - 5, day) in weekly.ranges
+
+    assert special.calendar_weekdays == []
+    assert special.valid_days == [day]
+    assert special.ranges == [(day, day)]
+    assert special.valid_weekdays == special.addition_weekdays == ["saturday"]
+
+    assert unknown.valid_days == [] and unknown.ranges == []
+
+
+def test_frequencies(tmp_path):
+    write_feed(
+        tmp_path,
+        {
+            "trips.txt": GTFS_FILES["trips.txt"] + "R2,WK,T7,Three,1,SH2\n",
+            # Template times: runs are shifted to each start of the window
+            "stop_times.txt": GTFS_FILES["stop_times.txt"]
+            + "T7,00:00:00,00:00:00,D,1\nT7,00:10:00,00:10:00,C,2\n",
+            "frequencies.txt": "trip_id,start_time,end_time,headway_secs,exact_times\n"
+            "T7,06:00:00,07:00:00,1200,1\n",
+        },
+    )
+    tt = load_native_timetable(tmp_path, "test-key")
+    weekday = datetime(2026, 10, 16)
+
+    runs = [m for m in tt.trips_between(["D"], ["C"], weekday) if m.trip_id == "T7"]
+    assert [m.departure for m in runs] == [6 * 3600, 6 * 3600 + 1200, 6 * 3600 + 2400]
+    assert runs[1].stop_times == [("D", "06:20:00", "06:20:00"), ("C", "06:30:00", "06:30:00")]
+
+    journeys = tt.plan_journeys(["D"], ["C"], weekday, 6 * 3600 + 5 * 60, 6 * 3600 + 25 * 60)
+    assert [(j.departure, j.arrival) for j in journeys] == [(6 * 3600 + 1200, 6 * 3600 + 1800)]
+    assert journeys[0].legs[0].trip_id == "T7"
+    assert journeys[0].legs[0].stop_times[0] == ("D", "06:20:00", "06:20:00")
+    tt.close()
+
+
+def test_locate_vehicles(tmp_path):
+    # Points out of order; SH2 runs straight from D back to A
+    shapes = (
+        "shape_id,shape_pt_lat,shape_pt_lon,shape_pt_sequence\n"
+        "SH1,50.1,4.1,3\n"
+        "SH1,50.0,4.0,1\n"
+        "SH1,50.05,4.05,2\n"
+        "SH1,50.15,4.15,4\n"
+        "SH1,50.2,4.2,5\n"
+        "SH1,50.3,4.3,6\n"
+        "SH2,50.3,4.3,1\n"
+        "SH2,50.0,4.0,2\n"
+    )
+    write_feed(tmp_path, {"shapes.txt": shapes})
+    tt = load_native_timetable(tmp_path, "test-key")
+    assert tt.n_shapes == 2
+
+    heading_c, at_b, at_c, first, no_shape, unknown = tt.locate_vehicles(
+        [
+            ("T1", "C", 1000.0),
+            ("T2", "B", 1e9),  # Capped at the stretch from A
+            ("T4", "C", 0.0),
+            ("T1", "A", 0.0),
+            ("T6", "E", 0.0),
+            ("T9", "C", 0.0),
+        ]
+    )
+    assert heading_c.lat == pytest.approx(50.1924, abs=1e-3)
+    assert heading_c.lon == pytest.approx(4.1924, abs=1e-3)
+    assert 0 < heading_c.bearing < 90
+    assert heading_c.segment_length == pytest.approx(13200, rel=0.01)
+    assert (at_b.lat, at_b.lon) == pytest.approx((50.0, 4.0))
+    assert (at_c.lat, at_c.lon) == pytest.approx((50.2, 4.2))
+    assert 180 < at_c.bearing < 270
+    assert first is None and no_shape is None and unknown is None
+    tt.close()
+
+
+def test_scheduled_vehicles(timetable):
+    friday = datetime(2026, 10, 16)
+    vehicles = timetable.scheduled_vehicles(friday, 8 * 3600 + 12 * 60)
+    assert [v.trip_id for v in vehicles] == ["T1", "T2"]
+    t1, t2 = vehicles
+    # T1 calls at B at the time interpolated between A and C
+    assert (t1.from_stop_id, t1.to_stop_id) == ("B", "C")
+    assert t1.progress == pytest.approx(0.2)
+    assert (t1.lat, t1.lon) == pytest.approx((50.12, 4.12))
+    assert 0 < t1.bearing < 90 and not t1.on_shape
+    assert (t2.from_stop_id, t2.progress) == ("B", pytest.approx(0.4))
+
+    in_view = timetable.scheduled_vehicles(
+        friday, 8 * 3600 + 12 * 60, bbox=(50.13, 4.0, 50.2, 4.2)
+    )
+    assert [v.trip_id for v in in_view] == ["T2"]
+
+    # Saturday's 25:10 trip is still running early on Sunday
+    (night,) = timetable.scheduled_vehicles(datetime(2026, 10, 18), 3600 + 15 * 60)
+    assert night.trip_id == "T3" and night.previous_day
+    assert (night.from_stop_id, night.to_stop_id) == ("B", "C")
+
+
+# Protocol buffer encoding, enough to write GTFS-Realtime messages by hand
+def _varint(value: int) -> bytes:
+    value &= (1 << 64) - 1
+    out = bytearray()
+    while value >= 0x80:
+        out.append(value & 0x7F | 0x80)
+        value >>= 7
+    return bytes(out) + bytes([value])
+
+
+def _pb(number: int, value) -> bytes:
+    if isinstance(value, float):
+        return _varint(number << 3 | 5) + struct.pack("<f", value)
+    if isinstance(value, int):
+        return _varint(number << 3) + _varint(value)
+    if isinstance(value, str):
+        value = value.encode("utf-8")
+    return _varint(number << 3 | 2) + _varint(len(value)) + value
+
+
+def test_decode_realtime(timetable, tmp_path):
+    trip_update = _pb(
+        3,
+        _pb(1, _pb(1, "nmbssncb:T1") + _pb(3, "20261016") + _pb(2, "08:00:00"))
+        + _pb(
+            2,
+            _pb(1, 2)
+            + _pb(4, "nmbssncb:B_3")
+            + _pb(2, _pb(1, -60) + _pb(2, 1_792_131_540))
+            # realcity scheduled arrival
+            + _pb(1006, _pb(1, _pb(2, 1_792_131_600))),
+        )
+        + _pb(2, _pb(1, 3) + _pb(4, "Z") + _pb(3, _pb(2, 1_792_132_860)))
+        + _pb(5, 120),
+    )
+    vehicle = _pb(
+        4,
+        _pb(1, _pb(1, "T2") + _pb(5, "R1"))
+        + _pb(2, _pb(1, 50.15) + _pb(2, 4.15) + _pb(3, 90.0))
+        + _pb(7, "C")
+        + _pb(5, 1_792_131_000)
+        + _pb(
+            8,
+            _pb(1, "V1")
+            + _pb(2, "Bus 1")
+            # realcity model, open doors and distance to the stop
+            + _pb(1006, _pb(1, "Ikarus") + _pb(4, 1) + _pb(5, 120)),
+        ),
+    )
+    message = (
+        _pb(1, _pb(1, "2.0") + _pb(3, 1_792_131_000))
+        + _pb(2, _pb(1, "e1") + trip_update)
+        # is_deleted after the vehicle it applies to
+        + _pb(2, vehicle + _pb(1, "e2") + _pb(2, 1))
+    )
+
+    feed = timetable.decode_realtime(message, id_prefixes=["nmbssncb:"], stop_separator="_")
+    assert feed.timestamp == 1_792_131_000 and feed.n_entities == 2
+    (update,) = feed.trip_updates
+    assert (update.entity_id, update.trip_id, update.route_id) == ("e1", "T1", "")
+    assert update.trip is not None and update.route is not None
+    assert update.start_date == date(2026, 10, 16) and update.start_time == 8 * 3600
+    assert update.delay == 120 and update.timestamp is None and not update.deleted
+    b, z = update.stop_time_updates
+    assert (b.stop_id, b.stop, b.stop_sequence) == ("B", timetable.find_stop("B"), 2)
+    assert (b.arrival_delay, b.arrival_time) == (-60, 1_792_131_540)
+    assert b.scheduled_arrival == 1_792_131_600 and b.departure_time is None
+    assert (z.stop, z.departure_time, z.arrival_time) == (None, 1_792_132_860, None)
+
+    (v,) = feed.vehicles
+    assert (v.entity_id, v.trip_id, v.deleted) == ("e2", "T2", True)
+    assert v.stop == timetable.find_stop("C")
+    assert (v.lat, v.lon, v.bearing) == pytest.approx((50.15, 4.15, 90.0))
+    assert v.speed is None and v.current_status is None
+    assert (v.vehicle_id, v.label, v.vehicle_model) == ("V1", "Bus 1", "Ikarus")
+    assert v.door_open and not v.deviated and v.stop_distance == 120
+
+    # Recorded feeds decode from disk; without options the ids stay whole
+    recorded = tmp_path / "trip_updates.pb"
+    recorded.write_bytes(message)
+    from_file = timetable.decode_realtime_file(recorded)
+    assert from_file.trip_updates[0].trip_id == "nmbssncb:T1"
+    assert from_file.trip_updates[0].trip is None
+
+    with pytest.raises(ValueError):
+        timetable.decode_realtime(message[:-3])
@@ -0,0 +1,180 @@
+import re
+import subprocess
+from pathlib import Path
+
+import pytest
+
+from ..gtfs_loader import STOP_TIMES_CACHE, find_previous_stop_times
+
+EXECUTABLE = Path(__file__).parents[1] / "gtfs_precache"
+requires_executable = pytest.mark.skipif(
+    not EXECUTABLE.exists(), reason="gtfs_precache not built"
+)
+
+HEADER = "trip_id,arrival_time,departure_time,stop_id,stop_sequence"
+
+
+def make_trips(count: int, stops: int = 20) -> dict:
+    trips = {}
+    for trip in range(count):
+        rows = []
+        for seq in range(stops):
+            time = f"{8 + trip % 12:02d}:{seq:02d}:00"
+            rows.append(f"T{trip},{time},{time},S{(trip + seq) % 50},{seq + 1}")
+        trips[f"T{trip}"] = rows
+    return trips
+
+
+def write_feed(path: Path, trips: dict) -> Path:
+    path.mkdir(parents=True, exist_ok=True)
+    lines = [HEADER] + [row for rows in trips.values() for row in rows]
+    (path / "stop_times.txt").write_text("\n".join(lines) + "\n")
+    return path
+
+
+def run(path: Path, *args: str) -> str:
+    result = subprocess.run(
+        [str(EXECUTABLE), str(path / "stop_times.txt"), str(path / STOP_TIMES_CACHE), *args],
+        capture_output=True,
+        text=True,
+        timeout=60,
+    )
+    assert result.returncode == 0, result.stderr
+    return result.stdout
+
+
+def full_conversion(tmp_path: Path, trips: dict) -> bytes:
+    # Rows of a trip are consecutive, so the plain conversion, in input
+    # order, is also grouped by trip
+    path = write_feed(tmp_path / "full", trips)
+    run(path)
+    return (path / STOP_TIMES_CACHE).read_bytes()
+
+
+def changed_trips(output: str) -> int:
+    return int(re.search(r"(\d+) of \d+ trips changed", output).group(1))
+
+
+def update(trips: dict) -> dict:
+    # One changed, one removed, one moved to the front and one added trip
+    updated = {"T10": trips["T10"]}
+    updated.update((trip, rows) for trip, rows in trips.items() if trip not in ("T5", "T10"))
+    updated["T3"] = [row.replace("S", "X", 1) if row.endswith(",4") else row for row in trips["T3"]]
+    updated["NEW"] = [row.replace("T0,", "NEW,") for row in trips["T0"]]
+    return updated
+
+
+@requires_executable
+def test_incremental_reuses_unchanged_trips(tmp_path):
+    trips = make_trips(200)
+    feed = write_feed(tmp_path / "feed", trips)
+    first = run(feed, "--incremental")
+    assert "No previous output to reuse" in first
+    assert (feed / STOP_TIMES_CACHE).read_bytes() == full_conversion(tmp_path, trips)
+
+    updated = update(trips)
+    write_feed(feed, updated)
+    second = run(feed, "--incremental")
+    assert "Reusing unchanged trips" in second
+    assert changed_trips(second) == 2
+    assert (feed / STOP_TIMES_CACHE).read_bytes() == full_conversion(tmp_path, updated)
+
+    # An unchanged feed repacks nothing
+    third = run(feed, "--incremental")
+    assert changed_trips(third) == 0
+    assert (feed / STOP_TIMES_CACHE).read_bytes() == full_conversion(tmp_path, updated)
+
+
+@requires_executable
+def test_incremental_missing_index(tmp_path):
+    trips = make_trips(50)
+    feed = write_feed(tmp_path / "feed", trips)
+    run(feed, "--incremental")
+    (feed / (STOP_TIMES_CACHE + ".index")).unlink()
+
+    updated = update(trips)
+    write_feed(feed, updated)
+    output = run(feed, "--incremental")
+    assert "No previous output to reuse" in output
+    assert (feed / STOP_TIMES_CACHE).read_bytes() == full_conversion(tmp_path, updated)
+    assert (feed / (STOP_TIMES_CACHE + ".index")).exists()
+
+
+@requires_executable
+def test_incremental_stale_index(tmp_path):
+    trips = make_trips(50)
+    feed = write_feed(tmp_path / "feed", trips)
+    run(feed, "--incremental")
+    index = (feed / (STOP_TIMES_CACHE + ".index")).read_bytes()
+
+    # A plain conversion drops the index; one left over from an earlier
+    # output no longer describes the file
+    updated = update(trips)
+    write_feed(feed, updated)
+    run(feed)
+    assert not (feed / (STOP_TIMES_CACHE + ".index")).exists()
+    (feed / (STOP_TIMES_CACHE + ".index")).write_bytes(index)
+    output = run(feed, "--incremental")
+    assert "Ignoring index" in output
+    assert (feed / STOP_TIMES_CACHE).read_bytes() == full_conversion(tmp_path, updated)
+
+    # A truncated index is ignored as well
+    (feed / (STOP_TIMES_CACHE + ".index")).write_bytes(index[:40])
+    output = run(feed, "--incremental")
+    assert "Ignoring index" in output
+    assert (feed / STOP_TIMES_CACHE).read_bytes() == full_conversion(tmp_path, updated)
+
+
+@requires_executable
+def test_incremental_bounded_memory(tmp_path):
+    # With a 1 MB budget the changed trips are repacked in several passes
+    trips = make_trips(1000)
+    feed = write_feed(tmp_path / "feed", trips)
+    first = run(feed, "--incremental", "--max-memory", "1")
+    passes = int(re.search(r"in (\d+) pass", first).group(1))
+    assert passes > 1
+    assert (feed / STOP_TIMES_CACHE).read_bytes() == full_conversion(tmp_path, trips)
+
+    updated = update(trips)
+    write_feed(feed, updated)
+    second = run(feed, "--incremental", "--max-memory", "1")
+    assert changed_trips(second) == 2
+    assert (feed / STOP_TIMES_CACHE).read_bytes() == full_conversion(tmp_path, updated)
+
+
+def test_find_previous_stop_times(tmp_path):
+    older = write_feed(tmp_path / "provider" / "2024-01-01", {})
+    newer = write_feed(tmp_path / "provider" / "2024-02-01", {})
+    current = write_feed(tmp_path / "provider" / "2024-03-01", {})
+    assert find_previous_stop_times(current) is None
+
+    # Outputs without an index are not reused
+    for path in (older, newer):
+        (path / STOP_TIMES_CACHE).write_bytes(b"")
+    assert find_previous_stop_times(current) is None
+
+    # The newest sibling wins, the dataset's own output before it
+    (older / (STOP_TIMES_CACHE + ".index")).write_bytes(b"")
+    assert find_previous_stop_times(current) == older / STOP_TIMES_CACHE
+    (newer / (STOP_TIMES_CACHE + ".index")).write_bytes(b"")
+    assert find_previous_stop_times(current) == newer / STOP_TIMES_CACHE
+    (current / STOP_TIMES_CACHE).write_bytes(b"")
+    (current / (STOP_TIMES_CACHE + ".index")).write_bytes(b"")
+    assert find_previous_stop_times(current) == current / STOP_TIMES_CACHE
+
+
+@requires_executable
+def test_incremental_from_sibling(tmp_path):
+    trips = make_trips(50)
+    older = write_feed(tmp_path / "provider" / "2024-01-01", trips)
+    run(older, "--incremental")
+
+    updated = update(trips)
+    current = write_feed(tmp_path / "provider" / "2024-02-01", updated)
+    previous = find_previous_stop_times(current)
+    assert previous == older / STOP_TIMES_CACHE
+    output = run(current, f"--incremental={previous}")
+    assert changed_trips(output) == 2
+    assert (current / STOP_TIMES_CACHE).read_bytes() == full_conversion(tmp_path, updated)
+    # The sibling's output is left as it was
+    assert (older / STOP_TIMES_CACHE).read_bytes() == full_conversion(tmp_path, trips)
@@ -0,0 +1,105 @@
+import os
+from pathlib import Path
+
+import pytest
+
+from ..gtfs_loader import STOP_TIMES_CACHE
+from ..precache_scheduler import PrecacheScheduler, needs_precache
+
+
+def test_needs_precache(tmp_path):
+    assert not needs_precache(tmp_path)
+    txt = tmp_path / "stop_times.txt"
+    txt.write_text("trip_id,arrival_time,departure_time,stop_id,stop_sequence\n")
+    assert needs_precache(tmp_path)
+
+    output = tmp_path / STOP_TIMES_CACHE
+    output.write_bytes(b"")
+    (tmp_path / (STOP_TIMES_CACHE + ".index")).write_bytes(b"")
+    assert not needs_precache(tmp_path)
+
+    # stop_times.txt replaced by a newer download
+    mtime = output.stat().st_mtime
+    os.utime(txt, (mtime + 10, mtime + 10))
+    assert needs_precache(tmp_path)
+
+
+def test_without_executable(tmp_path):
+    scheduler = PrecacheScheduler(tmp_path / "gtfs_precache")
+    assert not scheduler.start()
+    (tmp_path / "stop_times.txt").write_text("")
+    assert scheduler.submit(tmp_path) is None
+    assert not scheduler.prioritize(tmp_path)
+    assert scheduler.wait(tmp_path, timeout=0.1)
+    assert scheduler.status() == []
+
+
+EXECUTABLE = Path(__file__).parents[1] / "gtfs_precache"
+requires_executable = pytest.mark.skipif(
+    not EXECUTABLE.exists(), reason="gtfs_precache not built"
+)
+
+
+def write_feed(path: Path, rows: int) -> Path:
+    path.mkdir(parents=True)
+    lines = ["trip_id,arrival_time,departure_time,stop_id,stop_sequence"]
+    for i in range(rows):
+        trip, seq = divmod(i, 20)
+        time = f"{8 + seq // 60:02d}:{seq % 60:02d}:00"
+        lines.append(f"T{trip},{time},{time},S{seq},{seq + 1}")
+    (path / "stop_times.txt").write_text("\n".join(lines) + "\n")
+    return path
+
+
+@pytest.fixture
+def scheduler():
+    # One worker, so jobs run one after the other in queue order
+    scheduler = PrecacheScheduler(EXECUTABLE, jobs=1)
+    assert scheduler.start()
+    yield scheduler
+    scheduler.close()
+
+
+@requires_executable
+def test_batch_prioritize_and_wait(tmp_path, scheduler):
+    # The first job keeps the worker busy while the others are queued
+    busy = write_feed(tmp_path / "busy" / "gtfs", 200000)
+    later = write_feed(tmp_path / "later" / "gtfs", 100)
+    urgent = write_feed(tmp_path / "urgent" / "gtfs", 100)
+    for path in (busy, later, urgent):
+        assert scheduler.submit(path) == PrecacheScheduler.job_id(path)
+    assert scheduler.prioritize(urgent)
+
+    events = []
+    assert scheduler.wait(urgent, timeout=60, progress_fn=events.append)
+    assert events and all(event["job"] == "urgent/gtfs" for event in events)
+    assert not needs_precache(urgent)
+    assert scheduler.wait(later, timeout=60)
+    assert not needs_precache(later)
+
+    # The prioritized job overtook the one queued before it
+    urgent_output = (urgent / STOP_TIMES_CACHE).stat().st_mtime_ns
+    assert urgent_output <= (later / STOP_TIMES_CACHE).stat().st_mtime_ns
+    states = {status["job"]: status["state"] for status in scheduler.status()}
+    assert states["urgent/gtfs"] == states["later/gtfs"] == "done"
+
+    # Done jobs are neither waited for nor queued again
+    assert not scheduler.prioritize(urgent)
+    assert scheduler.submit(urgent) is None
+
+
+@requires_executable
+def test_batch_failed_job(tmp_path, scheduler):
+    broken = tmp_path / "broken" / "gtfs"
+    broken.mkdir(parents=True)
+    (broken / "stop_times.txt").write_text("trip_id,stop_id\nT1,S1\n")
+    good = write_feed(tmp_path / "good" / "gtfs", 100)
+
+    assert scheduler.submit(broken) is not None
+    assert scheduler.submit(good) is not None
+    assert not scheduler.wait(broken, timeout=60)
+    assert needs_precache(broken)
+    # A failed job does not hold up the rest of the queue
+    assert scheduler.wait(good, timeout=60)
+    states = {status["job"]: status["state"] for status in scheduler.status()}
+    assert states == {"broken/gtfs": "failed", "good/gtfs": "done"}
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Measure query latency on the native timetable.
+
+Usage: python benchmark_journeys.py <gtfs_dir> [date YYYY-MM-DD] [queries]
+
+Plans journeys between random stop pairs over a one hour departure window,
+then times earliest arrival scans and full-day profiles from/to random
+stops, and writes the latency percentiles to profiling_results/.
+"""
+import json
+import logging
+import random
+import sys
+import time
+from datetime import datetime
+from pathlib import Path
+
+from backend.gtfs_loader import CACHE_VERSION, calculate_gtfs_hash
+from backend.native_timetable import load_native_timetable
+
+logging.basicConfig(
+    level=logging.INFO,
+    format='%(asctime)s - %(name)s - %(levelname)s - %(message)s'
+)
+
+logger = logging.getLogger("schedule_explorer.benchmark_journeys")
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * fraction))]
+
+
+def summarize(latencies):
+    return {
+        "p50_ms": percentile(latencies, 0.50),
+        "p95_ms": percentile(latencies, 0.95),
+        "max_ms": max(latencies),
+    }
+
+
+def timed(function, *args):
+    start = time.perf_counter()
+    result = function(*args)
+    return result, (time.perf_counter() - start) * 1000
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+    data_dir = Path(sys.argv[1])
+    day = datetime.strptime(sys.argv[2], "%Y-%m-%d") if len(sys.argv) > 2 else datetime.now()
+    n_queries = int(sys.argv[3]) if len(sys.argv) > 3 else 200
+
+    output_dir = Path(__file__).parent.parent.parent / "profiling_results"
+    output_dir.mkdir(exist_ok=True)
+
+    cache_key = f"{CACHE_VERSION}_{calculate_gtfs_hash(data_dir)}"
+    timetable = load_native_timetable(data_dir, cache_key)
+    if timetable is None:
+        logger.error("Native timetable library is not available, build it with make")
+        sys.exit(1)
+
+    rng = random.Random(42)
+    stop_ids = [timetable.stop_id(i) for i in range(timetable.n_stops)]
+    latencies = []
+    found = 0
+    for _ in range(n_queries):
+        from_id, to_id = rng.sample(stop_ids, 2)
+        journeys, elapsed = timed(
+            timetable.plan_journeys, [from_id], [to_id], day, 8 * 3600, 9 * 3600
+        )
+        latencies.append(elapsed)
+        found += bool(journeys)
+
+    # Connection scans cover the whole network, so fewer runs are enough
+    n_scans = max(1, n_queries // 10)
+    arrival_latencies = []
+    profile_latencies = []
+    for _ in range(n_scans):
+        stop_id = rng.choice(stop_ids)
+        arrival_latencies.append(timed(timetable.earliest_arrivals, [stop_id], day, 8 * 3600)[1])
+        profile_latencies.append(timed(timetable.profile, [stop_id], day)[1])
+
+    metrics = {
+        "gtfs_dir": str(data_dir),
+        "date": day.strftime("%Y-%m-%d"),
+        "stops": timetable.n_stops,
+        "trips": timetable.n_trips,
+        "patterns": timetable.n_patterns,
+        "queries": n_queries,
+        "queries_with_journeys": found,
+        **summarize(latencies),
+        "earliest_arrivals": summarize(arrival_latencies),
+        "full_day_profile": summarize(profile_latencies),
+    }
+    logger.info(
+        f"{n_queries} journey queries: p50 {metrics['p50_ms']:.2f} ms, "
+        f"p95 {metrics['p95_ms']:.2f} ms, max {metrics['max_ms']:.2f} ms"
+    )
+    for name in ("earliest_arrivals", "full_day_profile"):
+        logger.info(
+            f"{n_scans} {name.replace('_', ' ')} scans: p50 {metrics[name]['p50_ms']:.2f} ms, "
+            f"max {metrics[name]['max_ms']:.2f} ms"
+        )
+
+    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+    output_file = output_dir / f"journey_benchmark_{timestamp}.json"
+    with open(output_file, 'w') as f:
+        json.dump(metrics, f, indent=2)
+    logger.info(f"Benchmark results saved to {output_file}")
+    timetable.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -8,6 +8,7 @@ let selectedStops = new Map(); // For stops that are selected
 let routeLines = [];
 let selectedLanguage = 'default';
 let providers = []; // Store providers data globally
+let isochroneLayer = null; // Cells of the isochrone currently shown
 
 // Use the API URL injected from the environment
 const API_BASE_URL = window.API_BASE_URL;
@@ -406,7 +407,10 @@ async function loadAllRoutes() {
                                     </div>
                                 </div>
                             </div>
-                            <button class="btn btn-sm btn-outline-danger" onclick="removeStop('${stopId}')">Remove</button>
+                            <div>
+                                <button class="btn btn-sm btn-outline-primary me-1" onclick="showIsochrone('${stopId}')" title="Where can I get from here?">Isochrone</button>
+                                <button class="btn btn-sm btn-outline-danger" onclick="removeStop('${stopId}')">Remove</button>
+                            </div>
                         </div>
                     </div>
                     <div class="stop-routes-content">
@@ -506,6 +510,9 @@ function setupEventListeners() {
     document.getElementById('showUnselectedStops').addEventListener('change', () => {
         loadStopsInView();
     });
+
+    // Isochrone controls
+    document.getElementById('clearIsochrone').addEventListener('click', clearIsochrone);
 }
 
 // Status indicator functions
@@ -836,6 +843,105 @@ function debounceLoadStops() {
     debounceTimer = setTimeout(() => loadStopsInView(false), 300);
 }
 
+// Colour for a travel time: green when close, red near the limit
+function isochroneColor(minutes, maxMinutes) {
+    const ratio = Math.min(minutes / maxMinutes, 1);
+    return `hsl(${Math.round(120 * (1 - ratio))}, 80%, 45%)`;
+}
+
+// Corners of a cell around its centre. Hexagon centres are cellSize metres
+// apart (pointy top), squares have sides of cellSize metres.
+function cellPolygon(lat, lon, cellSize, grid) {
+    const metersPerDegree = 111320;
+    const lonScale = Math.cos(lat * Math.PI / 180);
+    const toLatLng = (dx, dy) => [
+        lat + dy / metersPerDegree,
+        lon + dx / (metersPerDegree * lonScale)
+    ];
+    if (grid === 'square') {
+        const half = cellSize / 2;
+        return [toLatLng(-half, -half), toLatLng(half, -half), toLatLng(half, half), toLatLng(-half, half)];
+    }
+    const radius = cellSize / Math.sqrt(3);
+    const corners = [];
+    for (let i = 0; i < 6; i++) {
+        const angle = Math.PI / 6 + i * Math.PI / 3;
+        corners.push(toLatLng(radius * Math.cos(angle), radius * Math.sin(angle)));
+    }
+    return corners;
+}
+
+// Remove the isochrone from the map
+function clearIsochrone() {
+    if (isochroneLayer) {
+        map.removeLayer(isochroneLayer);
+        isochroneLayer = null;
+    }
+    document.getElementById('clearIsochrone').disabled = true;
+}
+
+// Show how far one can travel from a stop within the selected time
+async function showIsochrone(stopId) {
+    const providerId = providerSelect.value;
+    if (!providerId) return;
+
+    const maxMinutes = parseInt(document.getElementById('isochroneMinutes').value, 10);
+    const grid = document.getElementById('isochroneGrid').value;
+    const departureTime = document.getElementById('isochroneTime').value;
+    // Larger areas get coarser cells to keep the number of polygons reasonable
+    const cellSize = Math.max(250, maxMinutes * 8);
+
+    const params = new URLSearchParams({
+        stop_id: stopId,
+        max_minutes: maxMinutes,
+        window_minutes: 30,
+        step_minutes: 10,
+        grid: grid,
+        cell_size: cellSize,
+        language: selectedLanguage
+    });
+    if (departureTime) {
+        params.set('departure_time', departureTime);
+    }
+
+    try {
+        showLoading('Computing isochrone...');
+        const response = await fetch(`${API_BASE_URL}/api/${providerId}/isochrone?${params}`);
+        if (!response.ok) {
+            const error = await response.json().catch(() => ({}));
+            throw new Error(error.detail || 'Failed to compute isochrone');
+        }
+        const data = await response.json();
+
+        clearIsochrone();
+        const renderer = L.canvas();
+        isochroneLayer = L.layerGroup();
+        data.cells.forEach(cell => {
+            const color = isochroneColor(cell.travel_minutes, data.max_minutes);
+            L.polygon(cellPolygon(cell.lat, cell.lon, data.cell_size, data.grid), {
+                renderer,
+                stroke: false,
+                fillColor: color,
+                fillOpacity: 0.45
+            }).bindTooltip(`${cell.travel_minutes} min`).addTo(isochroneLayer);
+        });
+        isochroneLayer.addTo(map);
+        document.getElementById('clearIsochrone').disabled = false;
+
+        const departures = data.departure_times;
+        showSuccess(
+            `${data.stops.length} stops within ${data.max_minutes} min ` +
+            `(departures ${departures[0]}–${departures[departures.length - 1]})`
+        );
+    } catch (error) {
+        console.error('Error computing isochrone:', error);
+        showError(error.message);
+    }
+}
+
+// Make isochrone function available globally
+window.showIsochrone = showIsochrone;
+
 // Function to copy text to clipboard
 async function copyToClipboard(text) {
     try {
@@ -1,4 +1,6 @@
-from dataclasses import dataclass
+from bisect import bisect_right
+from dataclasses import dataclass, field
+from pathlib import Path
 from typing import Dict, List, Optional, Tuple
 import json
 import logging
@@ -30,6 +32,8 @@ class VehiclePosition:
     bearing: float = 0
     shape_segment: Optional[List[List[float]]] = None
     raw_data: Optional[Dict] = None
+    # Distance along the shape at each point of shape_segment, from its start
+    shape_distances: Optional[List[float]] = field(default=None, repr=False)
 
     def to_dict(self):
         """Convert the VehiclePosition object to a dictionary for JSON serialization"""
@@ -143,6 +147,70 @@ def find_stop_in_shape(
     return None
 
 
+class ShapeProjection:
+    """
+    Shape of a line direction with the distance travelled at each of its
+    points, and the shape index of every stop located on it so far. Built
+    once per shape file, so locating a vehicle on a refresh is a subtraction
+    and a binary search instead of distances over the whole shape.
+    """
+
+    def __init__(self, shape_coords: List[List[float]]):
+        self.coords = shape_coords
+        self.distances = [0.0]
+        for i in range(len(shape_coords) - 1):
+            self.distances.append(
+                self.distances[-1]
+                + haversine_distance(
+                    (shape_coords[i][1], shape_coords[i][0]),
+                    (shape_coords[i + 1][1], shape_coords[i + 1][0]),
+                )
+            )
+        self._stop_indices: Dict[Tuple[float, float], Optional[int]] = {}
+
+    def stop_index(self, stop_coords: Tuple[float, float]) -> Optional[int]:
+        if stop_coords not in self._stop_indices:
+            self._stop_indices[stop_coords] = find_stop_in_shape(
+                stop_coords, self.coords
+            )
+        return self._stop_indices[stop_coords]
+
+    def segment(
+        self, from_idx: int, to_idx: int
+    ) -> Tuple[List[List[float]], List[float]]:
+        """Points between two indices and their distances from the first"""
+        start = self.distances[from_idx]
+        return (
+            self.coords[from_idx : to_idx + 1],
+            [d - start for d in self.distances[from_idx : to_idx + 1]],
+        )
+
+
+# (line, direction) -> (shape file mtime, projection)
+_shape_projections: Dict[Tuple[str, str], Tuple[float, ShapeProjection]] = {}
+
+
+def get_shape_projection(line: str, direction: str) -> Optional[ShapeProjection]:
+    """Projection of the shape of a line direction, rebuilt when the shape
+    file changes"""
+    shape_file = Path(f"cache/shapes/line_{line}.json")
+    try:
+        mtime = shape_file.stat().st_mtime
+    except OSError:
+        mtime = None
+    cached = _shape_projections.get((line, direction))
+    if cached and mtime is not None and cached[0] == mtime:
+        return cached[1]
+
+    shape_coords = load_route_shape(line, direction)
+    if not shape_coords:
+        return None
+    projection = ShapeProjection(shape_coords)
+    if mtime is not None:
+        _shape_projections[(line, direction)] = (mtime, projection)
+    return projection
+
+
 def calculate_bearing(lat1: float, lon1: float, lat2: float, lon2: float) -> float:
     """Calculate the bearing between two points in degrees"""
     lat1, lon1, lat2, lon2 = map(radians, [lat1, lon1, lat2, lon2])
@@ -171,7 +239,8 @@ def validate_segment(
     """
     try:
         # Load shape coordinates for this specific direction
-        shape_coords = load_route_shape(line, direction)
+        projection = get_shape_projection(line, direction)
+        shape_coords = projection.coords if projection else []
         if not shape_coords:
             logger.error(
                 f"No shape coordinates found for line {line} direction {direction}"
@@ -207,8 +276,8 @@ def validate_segment(
         to_coords = (to_lat, to_lon)
 
         # Find stops in shape
-        from_idx = find_stop_in_shape(from_coords, shape_coords)
-        to_idx = find_stop_in_shape(to_coords, shape_coords)
+        from_idx = projection.stop_index(from_coords)
+        to_idx = projection.stop_index(to_coords)
 
         if from_idx is None or to_idx is None:
             logger.error(
@@ -220,11 +289,9 @@ def validate_segment(
         if from_idx > to_idx:
             from_idx, to_idx = to_idx, from_idx
 
-        # Calculate total segment distance
-        segment_length = calculate_segment_distance(shape_coords, from_idx, to_idx)
-
-        # Extract shape segment
-        shape_segment = shape_coords[from_idx : to_idx + 1]
+        # Extract shape segment and its length from the precomputed distances
+        shape_segment, shape_distances = projection.segment(from_idx, to_idx)
+        segment_length = shape_distances[-1]
 
         # Validate reported distance with 20% tolerance
         tolerance = 1.2  # Allow reported distance to be up to 20% longer
@@ -247,6 +314,7 @@ def validate_segment(
             is_valid=is_valid,
             shape_segment=shape_segment,
             raw_data=raw_data,
+            shape_distances=shape_distances,
         )
 
         # Calculate interpolated position and bearing
@@ -488,36 +556,40 @@ def interpolate_position(vehicle: VehiclePosition) -> Optional[Tuple[float, floa
     # Distance from start of segment
     distance_from_start = vehicle.segment_length - vehicle.distance_to_next
 
-    # Walk along shape until we find our position
-    current_distance = 0
-    for i in range(len(vehicle.shape_segment) - 1):
-        point1 = (vehicle.shape_segment[i][1], vehicle.shape_segment[i][0])  # lat, lon
-        point2 = (
-            vehicle.shape_segment[i + 1][1],
-            vehicle.shape_segment[i + 1][0],
-        )  # lat, lon
-
-        segment_distance = haversine_distance(point1, point2)
-        next_distance = current_distance + segment_distance
-
-        if next_distance >= distance_from_start:
-            # Our position is on this mini-segment
-            fraction = (distance_from_start - current_distance) / segment_distance
-
-            # Linear interpolation
-            lat = point1[0] + fraction * (point2[0] - point1[0])
-            lon = point1[1] + fraction * (point2[1] - point1[1])
-
-            # Calculate bearing
-            vehicle.bearing = calculate_bearing(lat, lon, point2[0], point2[1])
-
-            return (lat, lon)
-
-        current_distance = next_distance
-
-    # If we get here, we're at the end of the segment
-    last_point = vehicle.shape_segment[-1]
-    return (last_point[1], last_point[0])  # Return last point instead of None
+    # Distances along the segment, precomputed by validate_segment
+    distances = vehicle.shape_distances
+    if distances is None or len(distances) != len(vehicle.shape_segment):
+        distances = ShapeProjection(vehicle.shape_segment).distances
+
+    # Mini-segment the position is on: the last point at or before it
+    i = bisect_right(distances, distance_from_start) - 1
+    if i < 0:
+        i = 0
+    if i >= len(vehicle.shape_segment) - 1:
+        # At the end of the segment
+        last_point = vehicle.shape_segment[-1]
+        return (last_point[1], last_point[0])  # Return last point instead of None
+
+    point1 = (vehicle.shape_segment[i][1], vehicle.shape_segment[i][0])  # lat, lon
+    point2 = (
+        vehicle.shape_segment[i + 1][1],
+        vehicle.shape_segment[i + 1][0],
+    )  # lat, lon
+    segment_distance = distances[i + 1] - distances[i]
+    fraction = (
+        (distance_from_start - distances[i]) / segment_distance
+        if segment_distance > 0
+        else 0
+    )
+
+    # Linear interpolation
+    lat = point1[0] + fraction * (point2[0] - point1[0])
+    lon = point1[1] + fraction * (point2[1] - point1[1])
+
+    # Calculate bearing
+    vehicle.bearing = calculate_bearing(lat, lon, point2[0], point2[1])
+
+    return (lat, lon)
 
 
 if __name__ == "__main__":